@@ -28,25 +28,108 @@
 #include <openssl/sha.h>
 #include <openssl/ripemd.h>
 #include <openssl/ssl.h>
+#include <pthread.h>
+#include <string.h>
 
 #pragma GCC diagnostic ignored "-Wdeprecated-declarations" // For OSX Lion
 
+// Constants
+
+#define CB_OPENSSL_KEY_CACHE_SIZE 256 // Number of decoded public keys kept by each thread.
+#define CB_OPENSSL_MAX_KEY_LEN 65
+
+// Types
+
+typedef struct{
+	EC_KEY * key;
+	uint8_t keyLen;
+	uint8_t keyData[CB_OPENSSL_MAX_KEY_LEN];
+} CBOpenSSLCachedKey;
+
+/**
+ @brief Long lived state for each thread, so that the curve and BN_CTX are not created for every operation and public keys used repeatedly are only decoded once.
+ */
+typedef struct{
+	EC_GROUP * group;
+	BN_CTX * bnCtx;
+	CBOpenSSLCachedKey keys[CB_OPENSSL_KEY_CACHE_SIZE];
+} CBOpenSSLContext;
+
+static pthread_key_t CBOpenSSLContextKey;
+static pthread_once_t CBOpenSSLContextOnce = PTHREAD_ONCE_INIT;
+
 // Implementation
 
+static void CBOpenSSLFreeContext(void * vctx){
+	CBOpenSSLContext * ctx = vctx;
+	for (uint16_t x = 0; x < CB_OPENSSL_KEY_CACHE_SIZE; x++)
+		if (ctx->keys[x].key)
+			EC_KEY_free(ctx->keys[x].key);
+	EC_GROUP_free(ctx->group);
+	BN_CTX_free(ctx->bnCtx);
+	free(ctx);
+}
+static void CBOpenSSLCreateContextKey(void){
+	pthread_key_create(&CBOpenSSLContextKey, CBOpenSSLFreeContext);
+}
+static CBOpenSSLContext * CBOpenSSLGetContext(void){
+	pthread_once(&CBOpenSSLContextOnce, CBOpenSSLCreateContextKey);
+	CBOpenSSLContext * ctx = pthread_getspecific(CBOpenSSLContextKey);
+	if (ctx)
+		return ctx;
+	ctx = calloc(1, sizeof(*ctx));
+	if (NOT ctx)
+		return NULL;
+	ctx->group = EC_GROUP_new_by_curve_name(NID_secp256k1);
+	ctx->bnCtx = BN_CTX_new();
+	if (NOT ctx->group || NOT ctx->bnCtx || pthread_setspecific(CBOpenSSLContextKey, ctx)) {
+		CBOpenSSLFreeContext(ctx);
+		return NULL;
+	}
+	return ctx;
+}
+// Hashes the whole public key to its place in the cache with FNV-1a.
+static uint16_t CBOpenSSLKeyCacheIndex(const uint8_t * pubKey, uint8_t keyLen){
+	uint32_t hash = 2166136261u;
+	for (uint8_t x = 0; x < keyLen; x++)
+		hash = (hash ^ pubKey[x]) * 16777619u;
+	return (hash ^ (hash >> 16)) % CB_OPENSSL_KEY_CACHE_SIZE;
+}
+// Gets a decoded public key from the thread's cache, decoding it if it is not cached. Returns NULL if the key is invalid.
+static EC_KEY * CBOpenSSLGetPublicKey(CBOpenSSLContext * ctx, const uint8_t * pubKey, uint8_t keyLen){
+	// Public keys are at least 33 bytes, as compressed keys.
+	if (keyLen < 33 || keyLen > CB_OPENSSL_MAX_KEY_LEN)
+		return NULL;
+	CBOpenSSLCachedKey * cached = &ctx->keys[CBOpenSSLKeyCacheIndex(pubKey, keyLen)];
+	if (cached->key && cached->keyLen == keyLen && NOT memcmp(cached->keyData, pubKey, keyLen))
+		return cached->key;
+	EC_KEY * key = EC_KEY_new();
+	if (NOT key)
+		return NULL;
+	const uint8_t * keyCursor = pubKey; // o2i_ECPublicKey moves the pointer past the key.
+	if (NOT EC_KEY_set_group(key, ctx->group)
+		|| NOT o2i_ECPublicKey(&key, &keyCursor, keyLen)) {
+		EC_KEY_free(key);
+		return NULL;
+	}
+	// Replace the previous key in the cache.
+	if (cached->key)
+		EC_KEY_free(cached->key);
+	cached->key = key;
+	cached->keyLen = keyLen;
+	memcpy(cached->keyData, pubKey, keyLen);
+	return key;
+}
 // Generate a private key from just the secret parameter
-int EC_KEY_regenerate_key(EC_KEY *eckey, BIGNUM *priv_key)
+int EC_KEY_regenerate_key(EC_KEY *eckey, BIGNUM *priv_key, BN_CTX *ctx)
 {
     int ok = 0;
-    BN_CTX *ctx = NULL;
     EC_POINT *pub_key = NULL;
 
     if (!eckey) return 0;
 
     const EC_GROUP *group = EC_KEY_get0_group(eckey);
 
-    if ((ctx = BN_CTX_new()) == NULL)
-        goto err;
-
     pub_key = EC_POINT_new(group);
 
     if (pub_key == NULL)
@@ -64,8 +147,6 @@ err:
 
     if (pub_key)
         EC_POINT_free(pub_key);
-    if (ctx != NULL)
-        BN_CTX_free(ctx);
 
     return(ok);
 }
@@ -81,16 +162,41 @@ void CBRipemd160(uint8_t * data, uint16_t len, uint8_t * output){
 	RIPEMD160(data, len, output);
 }
 bool CBEcdsaVerify(uint8_t * signature, uint8_t sigLen, uint8_t * hash, const uint8_t * pubKey, uint8_t keyLen){
-	EC_KEY * key = EC_KEY_new_by_curve_name(NID_secp256k1);
-	o2i_ECPublicKey(&key, &pubKey, keyLen);
-	int res = ECDSA_verify(0, hash, 32, signature, sigLen, key);
-	EC_KEY_free(key);
-	return res == 1;
+	CBOpenSSLContext * ctx = CBOpenSSLGetContext();
+	if (NOT ctx)
+		return false;
+	EC_KEY * key = CBOpenSSLGetPublicKey(ctx, pubKey, keyLen);
+	if (NOT key)
+		return false;
+	return ECDSA_verify(0, hash, 32, signature, sigLen, key) == 1;
+}
+bool CBEcdsaVerifyBatch(CBEcdsaVerifyInput * inputs, uint32_t num, bool * results){
+	// OpenSSL cannot verify ECDSA signatures together, so share the context and decoded keys between the signatures.
+	CBOpenSSLContext * ctx = CBOpenSSLGetContext();
+	bool allValid = true;
+	for (uint32_t x = 0; x < num; x++) {
+		bool res = false;
+		if (ctx) {
+			EC_KEY * key = CBOpenSSLGetPublicKey(ctx, inputs[x].pubKey, inputs[x].keyLen);
+			res = key && ECDSA_verify(0, inputs[x].hash, 32, inputs[x].signature, inputs[x].sigLen, key) == 1;
+		}
+		if (results)
+			results[x] = res;
+		allValid &= res;
+	}
+	return allValid;
 }
 bool CBEcdsaSign(uint8_t * hash, uint8_t * privkey, unsigned int *nSig, uint8_t **sig) {
-    EC_KEY *pkey = EC_KEY_new_by_curve_name(NID_secp256k1);
+    CBOpenSSLContext * ctx = CBOpenSSLGetContext();
+    if (!ctx)
+        return 0;
+    EC_KEY *pkey = EC_KEY_new();
+    if (!pkey || !EC_KEY_set_group(pkey, ctx->group)) {
+        EC_KEY_free(pkey);
+        return 0;
+    }
     BIGNUM *bn = BN_bin2bn(privkey,32,BN_new());
-    if (!EC_KEY_regenerate_key(pkey,bn)) {
+    if (!EC_KEY_regenerate_key(pkey,bn,ctx->bnCtx)) {
         printf("creating failed\n");
 	EC_KEY_free(pkey);
         BN_clear_free(bn);
@@ -0,0 +1,1155 @@
+//
+//  CBSecp256k1Crypto.c
+//  cbitcoin
+//
+//  Copyright (c) 2012 Matthew Mitchell
+//
+//  This file is part of cbitcoin.
+//
+//  cbitcoin is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  cbitcoin is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with cbitcoin.  If not, see <http://www.gnu.org/licenses/>.
+
+// Implementation of the cryptographic dependencies without OpenSSL, specialised for secp256k1. Link with this library instead of the OpenSSL crypto library to use it.
+// Field elements and scalars are eight 32-bit limbs, least significant first, and are always fully reduced.
+// Verification splits both scalars with the secp256k1 endomorphism and uses wNAF with a precomputed table for the generator.
+// Signing uses deterministic nonces (RFC 6979) and a constant-time comb with complete addition formulas so that no branch or memory access depends on secret data.
+
+// Includes
+
+#include "CBDependencies.h" // cbitcoin dependencies to implement
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+// Types
+
+typedef struct{
+	uint32_t d[8];
+} CBSecpField;
+
+typedef struct{
+	uint32_t d[8];
+} CBSecpScalar;
+
+typedef struct{
+	CBSecpField x;
+	CBSecpField y;
+	bool infinity;
+} CBSecpAffine;
+
+/**
+ @brief Jacobian coordinates where x = X/Z^2 and y = Y/Z^3, used for verification.
+ */
+typedef struct{
+	CBSecpField x;
+	CBSecpField y;
+	CBSecpField z;
+	bool infinity;
+} CBSecpJacobian;
+
+/**
+ @brief Homogeneous projective coordinates where x = X/Z and y = Y/Z, used with the complete addition formulas for signing. The point at infinity is (0, 1, 0).
+ */
+typedef struct{
+	CBSecpField x;
+	CBSecpField y;
+	CBSecpField z;
+} CBSecpProjective;
+
+// Constants
+
+#define CB_SECP_G_WINDOW 8 // wNAF window for the generator, using the precomputed table.
+#define CB_SECP_Q_WINDOW 5 // wNAF window for public keys.
+#define CB_SECP_G_TABLE_SIZE (1 << (CB_SECP_G_WINDOW - 2))
+#define CB_SECP_Q_TABLE_SIZE (1 << (CB_SECP_Q_WINDOW - 2))
+#define CB_SECP_WNAF_MAX 264
+
+static const uint32_t CB_SECP_P[8] = {0xFFFFFC2F, 0xFFFFFFFE, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF};
+static const uint32_t CB_SECP_N[8] = {0xD0364141, 0xBFD25E8C, 0xAF48A03B, 0xBAAEDCE6, 0xFFFFFFFE, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF};
+static const uint32_t CB_SECP_N_HALF[8] = {0x681B20A0, 0xDFE92F46, 0x57A4501D, 0x5D576E73, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF, 0x7FFFFFFF};
+static const uint32_t CB_SECP_N_COMPLEMENT[5] = {0x2FC9BEBF, 0x402DA173, 0x50B75FC4, 0x45512319, 0x00000001}; // 2^256 - n
+static const uint32_t CB_SECP_P_MINUS_N[8] = {0x2FC9BAEE, 0x402DA172, 0x50B75FC4, 0x45512319, 0x00000001, 0, 0, 0};
+static const uint32_t CB_SECP_GX[8] = {0x16F81798, 0x59F2815B, 0x2DCE28D9, 0x029BFCDB, 0xCE870B07, 0x55A06295, 0xF9DCBBAC, 0x79BE667E};
+static const uint32_t CB_SECP_GY[8] = {0xFB10D4B8, 0x9C47D08F, 0xA6855419, 0xFD17B448, 0x0E1108A8, 0x5DA4FBFC, 0x26A3C465, 0x483ADA77};
+// Endomorphism constants. lambda * (x, y) = (beta * x, y)
+static const CBSecpField CB_SECP_BETA = {{0x719501EE, 0xC1396C28, 0x12F58995, 0x9CF04975, 0xAC3434E9, 0x6E64479E, 0x657C0710, 0x7AE96A2B}};
+static const CBSecpScalar CB_SECP_LAMBDA = {{0x1B23BD72, 0xDF02967C, 0x20816678, 0x122E22EA, 0x8812645A, 0xA5261C02, 0xC05C30E0, 0x5363AD4C}};
+// Constants for splitting scalars. g1 = round(2^384 * b2 / n), g2 = round(2^384 * -b1 / n)
+static const CBSecpScalar CB_SECP_MINUS_B1 = {{0x0ABFE4C3, 0x6F547FA9, 0x010E8828, 0xE4437ED6, 0, 0, 0, 0}};
+static const CBSecpScalar CB_SECP_MINUS_B2 = {{0x3DB1562C, 0xD765CDA8, 0x0774346D, 0x8A280AC5, 0xFFFFFFFE, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF}};
+static const uint32_t CB_SECP_G1[8] = {0x45DBB031, 0xE893209A, 0x71E8CA7F, 0x3DAA8A14, 0x9284EB15, 0xE86C90E4, 0xA7D46BCD, 0x3086D221};
+static const uint32_t CB_SECP_G2[8] = {0x8AC47F71, 0x1571B4AE, 0x9DF506C6, 0x221208AC, 0x0ABFE4C4, 0x6F547FA9, 0x010E8828, 0xE4437ED6};
+
+static const uint32_t CB_SHA256_K[64] = {0x428A2F98, 0x71374491, 0xB5C0FBCF, 0xE9B5DBA5, 0x3956C25B, 0x59F111F1, 0x923F82A4, 0xAB1C5ED5, 0xD807AA98, 0x12835B01, 0x243185BE, 0x550C7DC3, 0x72BE5D74, 0x80DEB1FE, 0x9BDC06A7, 0xC19BF174, 0xE49B69C1, 0xEFBE4786, 0x0FC19DC6, 0x240CA1CC, 0x2DE92C6F, 0x4A7484AA, 0x5CB0A9DC, 0x76F988DA, 0x983E5152, 0xA831C66D, 0xB00327C8, 0xBF597FC7, 0xC6E00BF3, 0xD5A79147, 0x06CA6351, 0x14292967, 0x27B70A85, 0x2E1B2138, 0x4D2C6DFC, 0x53380D13, 0x650A7354, 0x766A0ABB, 0x81C2C92E, 0x92722C85, 0xA2BFE8A1, 0xA81A664B, 0xC24B8B70, 0xC76C51A3, 0xD192E819, 0xD6990624, 0xF40E3585, 0x106AA070, 0x19A4C116, 0x1E376C08, 0x2748774C, 0x34B0BCB5, 0x391C0CB3, 0x4ED8AA4A, 0x5B9CCA4F, 0x682E6FF3, 0x748F82EE, 0x78A5636F, 0x84C87814, 0x8CC70208, 0x90BEFFFA, 0xA4506CEB, 0xBEF9A3F7, 0xC67178F2};
+static const uint8_t CB_RIPEMD160_R[160] = {
+	0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+	7, 4, 13, 1, 10, 6, 15, 3, 12, 0, 9, 5, 2, 14, 11, 8,
+	3, 10, 14, 4, 9, 15, 8, 1, 2, 7, 0, 6, 13, 11, 5, 12,
+	1, 9, 11, 10, 0, 8, 12, 4, 13, 3, 7, 15, 14, 5, 6, 2,
+	4, 0, 5, 9, 7, 12, 2, 10, 14, 1, 3, 8, 11, 6, 15, 13,
+	5, 14, 7, 0, 9, 2, 11, 4, 13, 6, 15, 8, 1, 10, 3, 12,
+	6, 11, 3, 7, 0, 13, 5, 10, 14, 15, 8, 12, 4, 9, 1, 2,
+	15, 5, 1, 3, 7, 14, 6, 9, 11, 8, 12, 2, 10, 0, 4, 13,
+	8, 6, 4, 1, 3, 11, 15, 0, 5, 12, 2, 13, 9, 7, 10, 14,
+	12, 15, 10, 4, 1, 5, 8, 7, 6, 2, 13, 14, 0, 3, 9, 11};
+static const uint8_t CB_RIPEMD160_S[160] = {
+	11, 14, 15, 12, 5, 8, 7, 9, 11, 13, 14, 15, 6, 7, 9, 8,
+	7, 6, 8, 13, 11, 9, 7, 15, 7, 12, 15, 9, 11, 7, 13, 12,
+	11, 13, 6, 7, 14, 9, 13, 15, 14, 8, 13, 6, 5, 12, 7, 5,
+	11, 12, 14, 15, 14, 15, 9, 8, 9, 14, 5, 6, 8, 6, 5, 12,
+	9, 15, 5, 11, 6, 8, 13, 12, 5, 12, 13, 14, 11, 8, 5, 6,
+	8, 9, 9, 11, 13, 15, 15, 5, 7, 7, 8, 11, 14, 14, 12, 6,
+	9, 13, 15, 7, 12, 8, 9, 11, 7, 7, 12, 7, 6, 15, 13, 11,
+	9, 7, 15, 11, 8, 6, 6, 14, 12, 13, 5, 14, 13, 13, 7, 5,
+	15, 5, 8, 11, 14, 14, 6, 14, 6, 9, 12, 9, 12, 5, 15, 8,
+	8, 5, 12, 9, 12, 5, 14, 6, 8, 13, 6, 5, 15, 13, 11, 11};
+static const uint32_t CB_RIPEMD160_K[5] = {0x00000000, 0x5A827999, 0x6ED9EBA1, 0x8F1BBCDC, 0xA953FD4E};
+static const uint32_t CB_RIPEMD160_KR[5] = {0x50A28BE6, 0x5C4DD124, 0x6D703EF3, 0x7A6D76E9, 0x00000000};
+
+// Tables created once when first needed.
+
+static CBSecpAffine CBSecpGTable[CB_SECP_G_TABLE_SIZE]; // Odd multiples of G
+static CBSecpAffine CBSecpGLambdaTable[CB_SECP_G_TABLE_SIZE]; // Odd multiples of lambda * G
+static CBSecpProjective CBSecpCombTable[64][16]; // j * 16^i * G
+static pthread_once_t CBSecpTablesOnce = PTHREAD_ONCE_INIT;
+static bool CBSecpTablesReady = false; // False if the tables could not be created, as pthread_once will not try again.
+
+// Hash implementation
+
+static uint32_t CBRotateLeft(uint32_t x, uint8_t n){
+	return (x << n) | (x >> (32 - n));
+}
+static uint32_t CBRotateRight(uint32_t x, uint8_t n){
+	return (x >> n) | (x << (32 - n));
+}
+// Pads the message into the final one or two blocks. The length is big-endian unless littleEndian is true.
+static uint8_t CBHashPadding(uint8_t * blocks, uint8_t * data, uint32_t len, bool littleEndian){
+	uint8_t rem = len % 64;
+	memset(blocks, 0, 128);
+	memcpy(blocks, data + len - rem, rem);
+	blocks[rem] = 0x80;
+	uint8_t num = rem < 56 ? 1 : 2;
+	uint64_t bits = (uint64_t)len * 8;
+	for (uint8_t x = 0; x < 8; x++)
+		blocks[num * 64 - (littleEndian ? 8 - x : x + 1)] = bits >> (x * 8);
+	return num;
+}
+static void CBSha256Block(uint32_t * h, uint8_t * block){
+	uint32_t w[64];
+	for (uint8_t x = 0; x < 16; x++)
+		w[x] = (uint32_t)block[x*4] << 24 | (uint32_t)block[x*4 + 1] << 16 | (uint32_t)block[x*4 + 2] << 8 | block[x*4 + 3];
+	for (uint8_t x = 16; x < 64; x++){
+		uint32_t s0 = CBRotateRight(w[x-15], 7) ^ CBRotateRight(w[x-15], 18) ^ (w[x-15] >> 3);
+		uint32_t s1 = CBRotateRight(w[x-2], 17) ^ CBRotateRight(w[x-2], 19) ^ (w[x-2] >> 10);
+		w[x] = w[x-16] + s0 + w[x-7] + s1;
+	}
+	uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4], f = h[5], g = h[6], k = h[7];
+	for (uint8_t x = 0; x < 64; x++) {
+		uint32_t t1 = k + (CBRotateRight(e, 6) ^ CBRotateRight(e, 11) ^ CBRotateRight(e, 25)) + ((e & f) ^ (~e & g)) + CB_SHA256_K[x] + w[x];
+		uint32_t t2 = (CBRotateRight(a, 2) ^ CBRotateRight(a, 13) ^ CBRotateRight(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+		k = g; g = f; f = e; e = d + t1;
+		d = c; c = b; b = a; a = t1 + t2;
+	}
+	h[0] += a; h[1] += b; h[2] += c; h[3] += d; h[4] += e; h[5] += f; h[6] += g; h[7] += k;
+}
+static void CBSecpSha256(uint8_t * data, uint32_t len, uint8_t * output){
+	uint32_t h[8] = {0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A, 0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19};
+	for (uint32_t x = 0; x + 64 <= len; x += 64)
+		CBSha256Block(h, data + x);
+	uint8_t blocks[128];
+	uint8_t num = CBHashPadding(blocks, data, len, false);
+	for (uint8_t x = 0; x < num; x++)
+		CBSha256Block(h, blocks + x * 64);
+	for (uint8_t x = 0; x < 32; x++)
+		output[x] = h[x/4] >> (24 - (x % 4) * 8);
+}
+static void CBSha1Block(uint32_t * h, uint8_t * block){
+	uint32_t w[80];
+	for (uint8_t x = 0; x < 16; x++)
+		w[x] = (uint32_t)block[x*4] << 24 | (uint32_t)block[x*4 + 1] << 16 | (uint32_t)block[x*4 + 2] << 8 | block[x*4 + 3];
+	for (uint8_t x = 16; x < 80; x++)
+		w[x] = CBRotateLeft(w[x-3] ^ w[x-8] ^ w[x-14] ^ w[x-16], 1);
+	uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+	for (uint8_t x = 0; x < 80; x++) {
+		uint32_t f, k;
+		if (x < 20) {
+			f = (b & c) | (~b & d);
+			k = 0x5A827999;
+		}else if (x < 40) {
+			f = b ^ c ^ d;
+			k = 0x6ED9EBA1;
+		}else if (x < 60) {
+			f = (b & c) | (b & d) | (c & d);
+			k = 0x8F1BBCDC;
+		}else{
+			f = b ^ c ^ d;
+			k = 0xCA62C1D6;
+		}
+		uint32_t t = CBRotateLeft(a, 5) + f + e + k + w[x];
+		e = d; d = c; c = CBRotateLeft(b, 30); b = a; a = t;
+	}
+	h[0] += a; h[1] += b; h[2] += c; h[3] += d; h[4] += e;
+}
+static uint32_t CBRipemd160F(uint8_t j, uint32_t x, uint32_t y, uint32_t z){
+	switch (j / 16) {
+		case 0: return x ^ y ^ z;
+		case 1: return (x & y) | (~x & z);
+		case 2: return (x | ~y) ^ z;
+		case 3: return (x & z) | (y & ~z);
+		default: return x ^ (y | ~z);
+	}
+}
+static void CBRipemd160Block(uint32_t * h, uint8_t * block){
+	uint32_t w[16];
+	for (uint8_t x = 0; x < 16; x++)
+		w[x] = (uint32_t)block[x*4 + 3] << 24 | (uint32_t)block[x*4 + 2] << 16 | (uint32_t)block[x*4 + 1] << 8 | block[x*4];
+	uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+	uint32_t ar = h[0], br = h[1], cr = h[2], dr = h[3], er = h[4];
+	for (uint8_t j = 0; j < 80; j++) {
+		uint32_t t = CBRotateLeft(a + CBRipemd160F(j, b, c, d) + w[CB_RIPEMD160_R[j]] + CB_RIPEMD160_K[j/16], CB_RIPEMD160_S[j]) + e;
+		a = e; e = d; d = CBRotateLeft(c, 10); c = b; b = t;
+		t = CBRotateLeft(ar + CBRipemd160F(79 - j, br, cr, dr) + w[CB_RIPEMD160_R[80 + j]] + CB_RIPEMD160_KR[j/16], CB_RIPEMD160_S[80 + j]) + er;
+		ar = er; er = dr; dr = CBRotateLeft(cr, 10); cr = br; br = t;
+	}
+	uint32_t t = h[1] + c + dr;
+	h[1] = h[2] + d + er;
+	h[2] = h[3] + e + ar;
+	h[3] = h[4] + a + br;
+	h[4] = h[0] + b + cr;
+	h[0] = t;
+}
+static void CBSecpHmacSha256(uint8_t * key, uint8_t * data, uint8_t len, uint8_t * output){
+	// Key is 32 bytes.
+	uint8_t buf[64 + 255];
+	for (uint8_t x = 0; x < 64; x++)
+		buf[x] = (x < 32 ? key[x] : 0) ^ 0x36;
+	memcpy(buf + 64, data, len);
+	uint8_t inner[32];
+	CBSecpSha256(buf, 64 + len, inner);
+	for (uint8_t x = 0; x < 64; x++)
+		buf[x] = (x < 32 ? key[x] : 0) ^ 0x5C;
+	memcpy(buf + 64, inner, 32);
+	CBSecpSha256(buf, 96, output);
+}
+
+// Field implementation. All functions give fully reduced results.
+
+// Subtracts p if the value with the carry is p or more. The value must be below 2p.
+static void CBSecpFieldReduceOnce(CBSecpField * r, const uint32_t * a, uint32_t carry){
+	uint32_t t[8];
+	int64_t borrow = 0;
+	for (uint8_t x = 0; x < 8; x++) {
+		borrow += (int64_t)a[x] - CB_SECP_P[x];
+		t[x] = (uint32_t)borrow;
+		borrow >>= 32;
+	}
+	// Use the subtraction when there is a carry or no borrow.
+	uint32_t mask = -(uint32_t)(carry | (uint32_t)(borrow + 1));
+	for (uint8_t x = 0; x < 8; x++)
+		r->d[x] = (t[x] & mask) | (a[x] & ~mask);
+}
+static void CBSecpFieldAdd(CBSecpField * r, const CBSecpField * a, const CBSecpField * b){
+	uint32_t t[8];
+	uint64_t carry = 0;
+	for (uint8_t x = 0; x < 8; x++) {
+		carry += (uint64_t)a->d[x] + b->d[x];
+		t[x] = (uint32_t)carry;
+		carry >>= 32;
+	}
+	CBSecpFieldReduceOnce(r, t, (uint32_t)carry);
+}
+static void CBSecpFieldSub(CBSecpField * r, const CBSecpField * a, const CBSecpField * b){
+	uint32_t t[8];
+	int64_t borrow = 0;
+	for (uint8_t x = 0; x < 8; x++) {
+		borrow += (int64_t)a->d[x] - b->d[x];
+		t[x] = (uint32_t)borrow;
+		borrow >>= 32;
+	}
+	// Add p back if it went below zero.
+	uint32_t mask = (uint32_t)borrow;
+	uint64_t carry = 0;
+	for (uint8_t x = 0; x < 8; x++) {
+		carry += (uint64_t)t[x] + (CB_SECP_P[x] & mask);
+		r->d[x] = (uint32_t)carry;
+		carry >>= 32;
+	}
+}
+static void CBSecpFieldNeg(CBSecpField * r, const CBSecpField * a){
+	CBSecpField zero = {{0}};
+	CBSecpFieldSub(r, &zero, a);
+}
+// Reduces a 512-bit value using 2^256 = 2^32 + 977 (mod p)
+static void CBSecpFieldReduceWide(CBSecpField * r, const uint32_t * t){
+	uint32_t s[8];
+	uint64_t acc = 0;
+	for (uint8_t x = 0; x < 8; x++) {
+		acc += (uint64_t)t[x] + (uint64_t)t[8 + x] * 977 + (x ? t[7 + x] : 0);
+		s[x] = (uint32_t)acc;
+		acc >>= 32;
+	}
+	acc += t[15];
+	// Fold the overflow in again
+	uint64_t high = acc;
+	acc = (uint64_t)s[0] + high * 977;
+	s[0] = (uint32_t)acc;
+	acc = (acc >> 32) + s[1] + high;
+	s[1] = (uint32_t)acc;
+	acc >>= 32;
+	for (uint8_t x = 2; x < 8; x++) {
+		acc += s[x];
+		s[x] = (uint32_t)acc;
+		acc >>= 32;
+	}
+	// A carry can only remain if the value is now small, so this cannot overflow.
+	high = acc;
+	acc = (uint64_t)s[0] + high * 977;
+	s[0] = (uint32_t)acc;
+	acc = (acc >> 32) + s[1] + high;
+	s[1] = (uint32_t)acc;
+	acc >>= 32;
+	for (uint8_t x = 2; x < 8; x++) {
+		acc += s[x];
+		s[x] = (uint32_t)acc;
+		acc >>= 32;
+	}
+	CBSecpFieldReduceOnce(r, s, 0);
+}
+static void CBSecpMul256(uint32_t * t, const uint32_t * a, const uint32_t * b){
+	memset(t, 0, 64);
+	for (uint8_t x = 0; x < 8; x++) {
+		uint64_t carry = 0;
+		for (uint8_t y = 0; y < 8; y++) {
+			carry += (uint64_t)a[x] * b[y] + t[x + y];
+			t[x + y] = (uint32_t)carry;
+			carry >>= 32;
+		}
+		t[x + 8] = (uint32_t)carry;
+	}
+}
+static void CBSecpSqr256(uint32_t * t, const uint32_t * a){
+	// Cross products once, doubled, then the squares.
+	memset(t, 0, 64);
+	for (uint8_t x = 0; x < 7; x++) {
+		uint64_t carry = 0;
+		for (uint8_t y = x + 1; y < 8; y++) {
+			carry += (uint64_t)a[x] * a[y] + t[x + y];
+			t[x + y] = (uint32_t)carry;
+			carry >>= 32;
+		}
+		t[x + 8] = (uint32_t)carry;
+	}
+	for (uint8_t x = 15; x > 0; x--)
+		t[x] = t[x] << 1 | t[x-1] >> 31;
+	t[0] <<= 1;
+	uint64_t carry = 0;
+	for (uint8_t x = 0; x < 8; x++) {
+		carry += (uint64_t)a[x] * a[x] + t[2*x];
+		t[2*x] = (uint32_t)carry;
+		carry >>= 32;
+		carry += t[2*x + 1];
+		t[2*x + 1] = (uint32_t)carry;
+		carry >>= 32;
+	}
+}
+static void CBSecpFieldMul(CBSecpField * r, const CBSecpField * a, const CBSecpField * b){
+	uint32_t t[16];
+	CBSecpMul256(t, a->d, b->d);
+	CBSecpFieldReduceWide(r, t);
+}
+static void CBSecpFieldSqr(CBSecpField * r, const CBSecpField * a){
+	uint32_t t[16];
+	CBSecpSqr256(t, a->d);
+	CBSecpFieldReduceWide(r, t);
+}
+static void CBSecpFieldMulInt(CBSecpField * r, const CBSecpField * a, uint32_t n){
+	uint32_t t[16] = {0};
+	uint64_t carry = 0;
+	for (uint8_t x = 0; x < 8; x++) {
+		carry += (uint64_t)a->d[x] * n;
+		t[x] = (uint32_t)carry;
+		carry >>= 32;
+	}
+	t[8] = (uint32_t)carry;
+	CBSecpFieldReduceWide(r, t);
+}
+// Raises to a fixed public exponent with 4-bit windows, so the time does not depend on the value.
+static void CBSecpFieldPow(CBSecpField * r, const CBSecpField * a, const uint32_t * exponent){
+	CBSecpField table[16], res;
+	memset(&table[0], 0, sizeof(CBSecpField));
+	table[0].d[0] = 1;
+	table[1] = *a;
+	for (uint8_t x = 2; x < 16; x++)
+		CBSecpFieldMul(&table[x], &table[x-1], a);
+	res = table[exponent[7] >> 28];
+	for (int8_t x = 62; x >= 0; x--) {
+		for (uint8_t y = 0; y < 4; y++)
+			CBSecpFieldSqr(&res, &res);
+		CBSecpFieldMul(&res, &res, &table[(exponent[x / 8] >> ((x % 8) * 4)) & 0xF]);
+	}
+	*r = res;
+}
+static void CBSecpFieldInv(CBSecpField * r, const CBSecpField * a){
+	static const uint32_t exponent[8] = {0xFFFFFC2D, 0xFFFFFFFE, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF}; // p - 2
+	CBSecpFieldPow(r, a, exponent);
+}
+static bool CBSecpFieldIsZero(const CBSecpField * a){
+	uint32_t z = 0;
+	for (uint8_t x = 0; x < 8; x++)
+		z |= a->d[x];
+	return z == 0;
+}
+static bool CBSecpFieldEqual(const CBSecpField * a, const CBSecpField * b){
+	uint32_t z = 0;
+	for (uint8_t x = 0; x < 8; x++)
+		z |= a->d[x] ^ b->d[x];
+	return z == 0;
+}
+static bool CBSecpFieldSqrt(CBSecpField * r, const CBSecpField * a){
+	static const uint32_t exponent[8] = {0xBFFFFF0C, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF, 0x3FFFFFFF}; // (p + 1) / 4
+	CBSecpField check;
+	CBSecpFieldPow(r, a, exponent);
+	CBSecpFieldSqr(&check, r);
+	return CBSecpFieldEqual(&check, a);
+}
+static bool CBSecpFieldSetBytes(CBSecpField * r, const uint8_t * bytes){
+	for (uint8_t x = 0; x < 8; x++)
+		r->d[x] = (uint32_t)bytes[31 - x*4] | (uint32_t)bytes[30 - x*4] << 8 | (uint32_t)bytes[29 - x*4] << 16 | (uint32_t)bytes[28 - x*4] << 24;
+	for (int8_t x = 7; x >= 0; x--)
+		if (r->d[x] != CB_SECP_P[x])
+			return r->d[x] < CB_SECP_P[x];
+	return false;
+}
+static void CBSecpFieldCmov(CBSecpField * r, const CBSecpField * a, uint32_t mask){
+	for (uint8_t x = 0; x < 8; x++)
+		r->d[x] = (a->d[x] & mask) | (r->d[x] & ~mask);
+}
+
+// Scalar implementation, modulo the group order.
+
+static void CBSecpScalarReduceOnce(CBSecpScalar * r, const uint32_t * a, uint32_t carry){
+	uint32_t t[8];
+	int64_t borrow = 0;
+	for (uint8_t x = 0; x < 8; x++) {
+		borrow += (int64_t)a[x] - CB_SECP_N[x];
+		t[x] = (uint32_t)borrow;
+		borrow >>= 32;
+	}
+	uint32_t mask = -(uint32_t)(carry | (uint32_t)(borrow + 1));
+	for (uint8_t x = 0; x < 8; x++)
+		r->d[x] = (t[x] & mask) | (a[x] & ~mask);
+}
+// Sets the scalar from big-endian bytes. Returns true if the value was n or more, in which case it is reduced.
+static bool CBSecpScalarSetBytes(CBSecpScalar * r, const uint8_t * bytes){
+	uint32_t t[8];
+	for (uint8_t x = 0; x < 8; x++)
+		t[x] = (uint32_t)bytes[31 - x*4] | (uint32_t)bytes[30 - x*4] << 8 | (uint32_t)bytes[29 - x*4] << 16 | (uint32_t)bytes[28 - x*4] << 24;
+	CBSecpScalarReduceOnce(r, t, 0);
+	return memcmp(r->d, t, 32) != 0;
+}
+static void CBSecpScalarGetBytes(uint8_t * bytes, const CBSecpScalar * a){
+	for (uint8_t x = 0; x < 32; x++)
+		bytes[x] = a->d[7 - x/4] >> (24 - (x % 4) * 8);
+}
+static bool CBSecpScalarIsZero(const CBSecpScalar * a){
+	uint32_t z = 0;
+	for (uint8_t x = 0; x < 8; x++)
+		z |= a->d[x];
+	return z == 0;
+}
+static bool CBSecpScalarIsHigh(const CBSecpScalar * a){
+	for (int8_t x = 7; x >= 0; x--)
+		if (a->d[x] != CB_SECP_N_HALF[x])
+			return a->d[x] > CB_SECP_N_HALF[x];
+	return false;
+}
+static void CBSecpScalarAdd(CBSecpScalar * r, const CBSecpScalar * a, const CBSecpScalar * b){
+	uint32_t t[8];
+	uint64_t carry = 0;
+	for (uint8_t x = 0; x < 8; x++) {
+		carry += (uint64_t)a->d[x] + b->d[x];
+		t[x] = (uint32_t)carry;
+		carry >>= 32;
+	}
+	CBSecpScalarReduceOnce(r, t, (uint32_t)carry);
+}
+static void CBSecpScalarNeg(CBSecpScalar * r, const CBSecpScalar * a){
+	uint32_t mask = -(uint32_t)NOT CBSecpScalarIsZero(a);
+	int64_t borrow = 0;
+	for (uint8_t x = 0; x < 8; x++) {
+		borrow += (int64_t)CB_SECP_N[x] - a->d[x];
+		r->d[x] = (uint32_t)borrow & mask;
+		borrow >>= 32;
+	}
+}
+// Replaces t with the low 256 bits plus the high limbs multiplied by 2^256 - n.
+static void CBSecpScalarFold(uint32_t * t, uint8_t highLen){
+	uint32_t p[13] = {0};
+	for (uint8_t x = 0; x < highLen; x++) {
+		uint64_t carry = 0;
+		for (uint8_t y = 0; y < 5; y++) {
+			carry += (uint64_t)t[8 + x] * CB_SECP_N_COMPLEMENT[y] + p[x + y];
+			p[x + y] = (uint32_t)carry;
+			carry >>= 32;
+		}
+		p[x + 5] = (uint32_t)carry;
+	}
+	uint64_t carry = 0;
+	for (uint8_t x = 0; x < 13; x++) {
+		carry += (uint64_t)(x < 8 ? t[x] : 0) + p[x];
+		t[x] = (uint32_t)carry;
+		carry >>= 32;
+	}
+	t[13] = t[14] = t[15] = 0;
+}
+// Reduces a 512-bit value using 2^256 = 2^256 - n (mod n). The value is below 2^386 after the first fold, 2^260 after the second, 2^256 + 2^133 after the third and 2^256 after the fourth.
+static void CBSecpScalarReduceWide(CBSecpScalar * r, const uint32_t * wide){
+	uint32_t t[16];
+	memcpy(t, wide, 64);
+	CBSecpScalarFold(t, 8);
+	CBSecpScalarFold(t, 5);
+	CBSecpScalarFold(t, 1);
+	CBSecpScalarFold(t, 1);
+	CBSecpScalarReduceOnce(r, t, 0);
+}
+static void CBSecpScalarMul(CBSecpScalar * r, const CBSecpScalar * a, const CBSecpScalar * b){
+	uint32_t t[16];
+	CBSecpMul256(t, a->d, b->d);
+	CBSecpScalarReduceWide(r, t);
+}
+static void CBSecpScalarInv(CBSecpScalar * r, const CBSecpScalar * a){
+	// Use a^(n-2) with 4-bit windows, with a fixed exponent so the time does not depend on the value.
+	static const uint32_t exponent[8] = {0xD036413F, 0xBFD25E8C, 0xAF48A03B, 0xBAAEDCE6, 0xFFFFFFFE, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF};
+	CBSecpScalar table[16], res;
+	memset(&table[0], 0, sizeof(CBSecpScalar));
+	table[0].d[0] = 1;
+	table[1] = *a;
+	for (uint8_t x = 2; x < 16; x++)
+		CBSecpScalarMul(&table[x], &table[x-1], a);
+	res = table[exponent[7] >> 28];
+	for (int8_t x = 62; x >= 0; x--) {
+		for (uint8_t y = 0; y < 4; y++)
+			CBSecpScalarMul(&res, &res, &res);
+		CBSecpScalarMul(&res, &res, &table[(exponent[x / 8] >> ((x % 8) * 4)) & 0xF]);
+	}
+	*r = res;
+}
+static bool CBSecpLimbsIsOne(const uint32_t * a){
+	uint32_t z = a[0] ^ 1;
+	for (uint8_t x = 1; x < 8; x++)
+		z |= a[x];
+	return z == 0;
+}
+static void CBSecpLimbsShiftRight(uint32_t * a, uint32_t top){
+	for (uint8_t x = 0; x < 7; x++)
+		a[x] = a[x] >> 1 | a[x + 1] << 31;
+	a[7] = a[7] >> 1 | top << 31;
+}
+// Halves modulo n.
+static void CBSecpScalarHalve(CBSecpScalar * a){
+	uint64_t carry = 0;
+	if (a->d[0] & 1)
+		for (uint8_t x = 0; x < 8; x++) {
+			carry += (uint64_t)a->d[x] + CB_SECP_N[x];
+			a->d[x] = (uint32_t)carry;
+			carry >>= 32;
+		}
+	CBSecpLimbsShiftRight(a->d, (uint32_t)carry);
+}
+// Inverse with the binary extended Euclidean algorithm. This is faster but the time depends on the value so it is only for public values. a must not be zero.
+static void CBSecpScalarInvVar(CBSecpScalar * r, const CBSecpScalar * a){
+	uint32_t u[8], v[8];
+	CBSecpScalar x1 = {{1}}, x2 = {{0}}, t;
+	memcpy(u, a->d, 32);
+	memcpy(v, CB_SECP_N, 32);
+	while (NOT CBSecpLimbsIsOne(u) && NOT CBSecpLimbsIsOne(v)) {
+		while (NOT (u[0] & 1)) {
+			CBSecpLimbsShiftRight(u, 0);
+			CBSecpScalarHalve(&x1);
+		}
+		while (NOT (v[0] & 1)) {
+			CBSecpLimbsShiftRight(v, 0);
+			CBSecpScalarHalve(&x2);
+		}
+		// Subtract the smaller from the larger.
+		int8_t x = 7;
+		while (x > 0 && u[x] == v[x])
+			x--;
+		uint32_t * big = u, * small = v;
+		CBSecpScalar * bigX = &x1, * smallX = &x2;
+		if (u[x] < v[x]) {
+			big = v;
+			small = u;
+			bigX = &x2;
+			smallX = &x1;
+		}
+		int64_t borrow = 0;
+		for (uint8_t y = 0; y < 8; y++) {
+			borrow += (int64_t)big[y] - small[y];
+			big[y] = (uint32_t)borrow;
+			borrow >>= 32;
+		}
+		CBSecpScalarNeg(&t, smallX);
+		CBSecpScalarAdd(bigX, bigX, &t);
+	}
+	*r = CBSecpLimbsIsOne(u) ? x1 : x2;
+}
+// Gives round(a * g / 2^384)
+static void CBSecpScalarMulShift384(CBSecpScalar * r, const CBSecpScalar * a, const uint32_t * g){
+	uint32_t t[16];
+	CBSecpMul256(t, a->d, g);
+	uint64_t carry = t[11] >> 31;
+	for (uint8_t x = 0; x < 8; x++) {
+		carry += x < 4 ? t[12 + x] : 0;
+		r->d[x] = (uint32_t)carry;
+		carry >>= 32;
+	}
+}
+// Splits k into k1 + k2 * lambda where k1 and k2 have at most 128 bits once negated when high.
+static void CBSecpScalarSplitLambda(CBSecpScalar * k1, CBSecpScalar * k2, const CBSecpScalar * k){
+	CBSecpScalar c1, c2, t;
+	CBSecpScalarMulShift384(&c1, k, CB_SECP_G1);
+	CBSecpScalarMulShift384(&c2, k, CB_SECP_G2);
+	CBSecpScalarMul(&c1, &c1, &CB_SECP_MINUS_B1);
+	CBSecpScalarMul(&c2, &c2, &CB_SECP_MINUS_B2);
+	CBSecpScalarAdd(k2, &c1, &c2);
+	CBSecpScalarMul(&t, k2, &CB_SECP_LAMBDA);
+	CBSecpScalarNeg(&t, &t);
+	CBSecpScalarAdd(k1, k, &t);
+}
+// Gives the window-w non-adjacent form of the scalar. Returns the number of digits.
+static uint16_t CBSecpScalarWnaf(int16_t * wnaf, const CBSecpScalar * a, uint8_t w){
+	memset(wnaf, 0, CB_SECP_WNAF_MAX * sizeof(*wnaf));
+	uint16_t bit = 0, len = 0;
+	int16_t carry = 0;
+	while (bit < 256) {
+		if ((int16_t)((a->d[bit / 32] >> (bit % 32)) & 1) == carry) {
+			bit++;
+			continue;
+		}
+		uint8_t now = w;
+		if (now > 256 - bit)
+			now = 256 - bit;
+		// Get "now" bits from the bit position.
+		uint32_t word = a->d[bit / 32] >> (bit % 32);
+		if (bit % 32 + now > 32 && bit / 32 < 7)
+			word |= a->d[bit / 32 + 1] << (32 - bit % 32);
+		int16_t digit = (int16_t)(word & ((1 << now) - 1)) + carry;
+		carry = (digit >> (w - 1)) & 1;
+		digit -= carry << w;
+		wnaf[bit] = digit;
+		bit += now;
+		len = bit;
+	}
+	if (carry) {
+		wnaf[bit] = carry;
+		len = bit + 1;
+	}
+	return len;
+}
+
+// Group implementation for verification. This is not constant-time.
+
+static void CBSecpJacobianDouble(CBSecpJacobian * r, const CBSecpJacobian * a){
+	if (a->infinity || CBSecpFieldIsZero(&a->y)) {
+		r->infinity = true;
+		return;
+	}
+	CBSecpField t1, t2, t3, t4, t5;
+	CBSecpFieldSqr(&t1, &a->x); // A = X^2
+	CBSecpFieldSqr(&t2, &a->y); // B = Y^2
+	CBSecpFieldSqr(&t3, &t2); // C = B^2
+	CBSecpFieldAdd(&t4, &a->x, &t2);
+	CBSecpFieldSqr(&t4, &t4);
+	CBSecpFieldSub(&t4, &t4, &t1);
+	CBSecpFieldSub(&t4, &t4, &t3);
+	CBSecpFieldAdd(&t4, &t4, &t4); // D = 2 * ((X + B)^2 - A - C)
+	CBSecpFieldMulInt(&t5, &t1, 3); // E = 3 * A
+	CBSecpFieldMul(&r->z, &a->y, &a->z);
+	CBSecpFieldAdd(&r->z, &r->z, &r->z); // Z3 = 2 * Y * Z
+	CBSecpFieldSqr(&t1, &t5); // F = E^2
+	CBSecpFieldAdd(&t2, &t4, &t4);
+	CBSecpFieldSub(&r->x, &t1, &t2); // X3 = F - 2 * D
+	CBSecpFieldSub(&t4, &t4, &r->x);
+	CBSecpFieldMul(&t4, &t5, &t4);
+	CBSecpFieldMulInt(&t3, &t3, 8);
+	CBSecpFieldSub(&r->y, &t4, &t3); // Y3 = E * (D - X3) - 8 * C
+	r->infinity = false;
+}
+// Adds b to a, with b given as Jacobian coordinates with Z as bz, or one if bz is NULL.
+static void CBSecpJacobianAddCoordinates(CBSecpJacobian * r, const CBSecpJacobian * a, const CBSecpField * bx, const CBSecpField * by, const CBSecpField * bz){
+	CBSecpField z1z1, z2z2, u1, u2, s1, s2, h, i, j, rr, v, t;
+	CBSecpFieldSqr(&z1z1, &a->z);
+	if (bz) {
+		CBSecpFieldSqr(&z2z2, bz);
+		CBSecpFieldMul(&u1, &a->x, &z2z2);
+		CBSecpFieldMul(&s1, &a->y, bz);
+		CBSecpFieldMul(&s1, &s1, &z2z2);
+	}else{
+		u1 = a->x;
+		s1 = a->y;
+	}
+	CBSecpFieldMul(&u2, bx, &z1z1);
+	CBSecpFieldMul(&s2, by, &a->z);
+	CBSecpFieldMul(&s2, &s2, &z1z1);
+	CBSecpFieldSub(&h, &u2, &u1);
+	CBSecpFieldSub(&rr, &s2, &s1);
+	if (CBSecpFieldIsZero(&h)) {
+		if (CBSecpFieldIsZero(&rr)) {
+			// Same point so double
+			CBSecpJacobian b = {*bx, *by, {{1}}, false};
+			if (bz)
+				b.z = *bz;
+			CBSecpJacobianDouble(r, &b);
+		}else
+			r->infinity = true;
+		return;
+	}
+	CBSecpFieldAdd(&i, &h, &h);
+	CBSecpFieldSqr(&i, &i); // I = (2 * H)^2
+	CBSecpFieldMul(&j, &h, &i); // J = H * I
+	CBSecpFieldAdd(&rr, &rr, &rr); // r = 2 * (S2 - S1)
+	CBSecpFieldMul(&v, &u1, &i); // V = U1 * I
+	// Z3 = ((Z1 + Z2)^2 - Z1Z1 - Z2Z2) * H, which is 2 * Z1 * Z2 * H
+	if (bz)
+		CBSecpFieldMul(&t, &a->z, bz);
+	else
+		t = a->z;
+	CBSecpFieldAdd(&t, &t, &t);
+	CBSecpFieldMul(&r->z, &t, &h);
+	CBSecpFieldSqr(&t, &rr);
+	CBSecpFieldSub(&t, &t, &j);
+	CBSecpFieldSub(&t, &t, &v);
+	CBSecpFieldSub(&r->x, &t, &v); // X3 = r^2 - J - 2 * V
+	CBSecpFieldSub(&t, &v, &r->x);
+	CBSecpFieldMul(&t, &rr, &t);
+	CBSecpFieldMul(&s1, &s1, &j);
+	CBSecpFieldAdd(&s1, &s1, &s1);
+	CBSecpFieldSub(&r->y, &t, &s1); // Y3 = r * (V - X3) - 2 * S1 * J
+	r->infinity = false;
+}
+static void CBSecpJacobianAdd(CBSecpJacobian * r, const CBSecpJacobian * a, const CBSecpJacobian * b){
+	if (b->infinity)
+		*r = *a;
+	else if (a->infinity)
+		*r = *b;
+	else
+		CBSecpJacobianAddCoordinates(r, a, &b->x, &b->y, &b->z);
+}
+static void CBSecpJacobianAddAffine(CBSecpJacobian * r, const CBSecpJacobian * a, const CBSecpAffine * b){
+	if (b->infinity)
+		*r = *a;
+	else if (a->infinity)
+		*r = (CBSecpJacobian){b->x, b->y, {{1}}, false};
+	else
+		CBSecpJacobianAddCoordinates(r, a, &b->x, &b->y, NULL);
+}
+// Converts points to affine coordinates with a single inversion. Returns false if memory could not be allocated.
+static bool CBSecpJacobianToAffineAll(CBSecpAffine * r, const CBSecpJacobian * a, uint16_t num){
+	CBSecpField * acc = malloc(sizeof(*acc) * num);
+	if (NOT acc)
+		return false;
+	CBSecpField inv, t;
+	acc[0] = a[0].z;
+	for (uint16_t x = 1; x < num; x++)
+		CBSecpFieldMul(&acc[x], &acc[x-1], &a[x].z);
+	CBSecpFieldInv(&inv, &acc[num-1]);
+	for (uint16_t x = num; x-- > 0;) {
+		CBSecpField zinv, zinv2;
+		if (x) {
+			CBSecpFieldMul(&zinv, &inv, &acc[x-1]);
+			CBSecpFieldMul(&inv, &inv, &a[x].z);
+		}else
+			zinv = inv;
+		CBSecpFieldSqr(&zinv2, &zinv);
+		CBSecpFieldMul(&r[x].x, &a[x].x, &zinv2);
+		CBSecpFieldMul(&t, &zinv2, &zinv);
+		CBSecpFieldMul(&r[x].y, &a[x].y, &t);
+		r[x].infinity = false;
+	}
+	free(acc);
+	return true;
+}
+static void CBSecpCreateTables(void){
+	CBSecpJacobian g = {{{0}}, {{0}}, {{1}}, false}, g2;
+	memcpy(g.x.d, CB_SECP_GX, 32);
+	memcpy(g.y.d, CB_SECP_GY, 32);
+	// Odd multiples for verification
+	CBSecpJacobian odd[CB_SECP_G_TABLE_SIZE];
+	odd[0] = g;
+	CBSecpJacobianDouble(&g2, &g);
+	for (uint16_t x = 1; x < CB_SECP_G_TABLE_SIZE; x++)
+		CBSecpJacobianAdd(&odd[x], &odd[x-1], &g2);
+	if (NOT CBSecpJacobianToAffineAll(CBSecpGTable, odd, CB_SECP_G_TABLE_SIZE))
+		return;
+	for (uint16_t x = 0; x < CB_SECP_G_TABLE_SIZE; x++) {
+		CBSecpFieldMul(&CBSecpGLambdaTable[x].x, &CBSecpGTable[x].x, &CB_SECP_BETA);
+		CBSecpGLambdaTable[x].y = CBSecpGTable[x].y;
+		CBSecpGLambdaTable[x].infinity = false;
+	}
+	// Comb table for signing. The first entry of each window is the point at infinity.
+	CBSecpJacobian * comb = malloc(sizeof(*comb) * 64 * 15);
+	CBSecpAffine * combAffine = malloc(sizeof(*combAffine) * 64 * 15);
+	if (NOT comb || NOT combAffine) {
+		free(comb);
+		free(combAffine);
+		return;
+	}
+	CBSecpJacobian base = g;
+	for (uint8_t x = 0; x < 64; x++) {
+		comb[x * 15] = base;
+		for (uint8_t y = 1; y < 15; y++)
+			CBSecpJacobianAdd(&comb[x * 15 + y], &comb[x * 15 + y - 1], &base);
+		// Next base is 16 times this base
+		CBSecpJacobianAdd(&base, &comb[x * 15 + 14], &base);
+	}
+	if (NOT CBSecpJacobianToAffineAll(combAffine, comb, 64 * 15)) {
+		free(comb);
+		free(combAffine);
+		return;
+	}
+	for (uint8_t x = 0; x < 64; x++) {
+		memset(&CBSecpCombTable[x][0], 0, sizeof(CBSecpProjective));
+		CBSecpCombTable[x][0].y.d[0] = 1;
+		for (uint8_t y = 1; y < 16; y++) {
+			CBSecpCombTable[x][y].x = combAffine[x * 15 + y - 1].x;
+			CBSecpCombTable[x][y].y = combAffine[x * 15 + y - 1].y;
+			memset(&CBSecpCombTable[x][y].z, 0, sizeof(CBSecpField));
+			CBSecpCombTable[x][y].z.d[0] = 1;
+		}
+	}
+	free(comb);
+	free(combAffine);
+	CBSecpTablesReady = true;
+}
+static bool CBSecpParsePublicKey(CBSecpAffine * r, const uint8_t * key, uint8_t len){
+	CBSecpField rhs, t;
+	if (len == 33 && (key[0] == 0x02 || key[0] == 0x03)) {
+		if (NOT CBSecpFieldSetBytes(&r->x, key + 1))
+			return false;
+		// y^2 = x^3 + 7
+		CBSecpFieldSqr(&rhs, &r->x);
+		CBSecpFieldMul(&rhs, &rhs, &r->x);
+		CBSecpFieldAdd(&rhs, &rhs, &(CBSecpField){{7}});
+		if (NOT CBSecpFieldSqrt(&r->y, &rhs))
+			return false;
+		if ((r->y.d[0] & 1) != (key[0] & 1))
+			CBSecpFieldNeg(&r->y, &r->y);
+	}else if (len == 65 && (key[0] == 0x04 || key[0] == 0x06 || key[0] == 0x07)) {
+		if (NOT CBSecpFieldSetBytes(&r->x, key + 1)
+			|| NOT CBSecpFieldSetBytes(&r->y, key + 33))
+			return false;
+		// Hybrid keys give the parity in the first byte.
+		if (key[0] != 0x04 && (r->y.d[0] & 1) != (key[0] & 1))
+			return false;
+		CBSecpFieldSqr(&rhs, &r->x);
+		CBSecpFieldMul(&rhs, &rhs, &r->x);
+		CBSecpFieldAdd(&rhs, &rhs, &(CBSecpField){{7}});
+		CBSecpFieldSqr(&t, &r->y);
+		if (NOT CBSecpFieldEqual(&t, &rhs))
+			return false;
+	}else
+		return false;
+	r->infinity = false;
+	return true;
+}
+// Parses a DER integer into a scalar which must be between 1 and n-1. Returns the number of bytes read or zero on failure.
+static uint8_t CBSecpParseDERInteger(CBSecpScalar * r, const uint8_t * data, uint8_t len){
+	if (len < 3 || data[0] != 0x02 || data[1] == 0 || data[1] > len - 2)
+		return 0;
+	uint8_t intLen = data[1];
+	const uint8_t * num = data + 2;
+	if (num[0] & 0x80)
+		return 0; // Negative
+	if (intLen > 1 && num[0] == 0 && NOT (num[1] & 0x80))
+		return 0; // Not minimal
+	while (intLen && num[0] == 0) {
+		num++;
+		intLen--;
+	}
+	if (intLen > 32)
+		return 0;
+	uint8_t bytes[32] = {0};
+	memcpy(bytes + 32 - intLen, num, intLen);
+	if (CBSecpScalarSetBytes(r, bytes) || CBSecpScalarIsZero(r))
+		return 0;
+	return data[1] + 2;
+}
+static bool CBSecpParseSignature(CBSecpScalar * r, CBSecpScalar * s, const uint8_t * sig, uint8_t len){
+	if (len < 8 || sig[0] != 0x30 || sig[1] != len - 2)
+		return false;
+	uint8_t rLen = CBSecpParseDERInteger(r, sig + 2, len - 2);
+	if (NOT rLen)
+		return false;
+	uint8_t sLen = CBSecpParseDERInteger(s, sig + 2 + rLen, len - 2 - rLen);
+	return sLen && 2 + rLen + sLen == len;
+}
+static bool CBSecpVerify(const CBSecpScalar * r, const CBSecpScalar * s, const CBSecpScalar * z, const CBSecpAffine * q){
+	CBSecpScalar w, u1, u2, g1, g2, q1, q2;
+	CBSecpScalarInvVar(&w, s);
+	CBSecpScalarMul(&u1, z, &w);
+	CBSecpScalarMul(&u2, r, &w);
+	// Split both scalars with lambda and make the parts small by negating them when high.
+	CBSecpScalarSplitLambda(&g1, &g2, &u1);
+	CBSecpScalarSplitLambda(&q1, &q2, &u2);
+	CBSecpScalar * parts[4] = {&g1, &g2, &q1, &q2};
+	bool negate[4];
+	int16_t wnaf[4][CB_SECP_WNAF_MAX];
+	uint16_t bits = 0;
+	for (uint8_t x = 0; x < 4; x++) {
+		negate[x] = CBSecpScalarIsHigh(parts[x]);
+		if (negate[x])
+			CBSecpScalarNeg(parts[x], parts[x]);
+		uint16_t len = CBSecpScalarWnaf(wnaf[x], parts[x], x < 2 ? CB_SECP_G_WINDOW : CB_SECP_Q_WINDOW);
+		if (len > bits)
+			bits = len;
+	}
+	// Odd multiples of the public key and of lambda times the public key.
+	CBSecpJacobian qTable[CB_SECP_Q_TABLE_SIZE], qLambdaTable[CB_SECP_Q_TABLE_SIZE], q2x;
+	qTable[0] = (CBSecpJacobian){q->x, q->y, {{1}}, false};
+	CBSecpJacobianDouble(&q2x, &qTable[0]);
+	for (uint8_t x = 1; x < CB_SECP_Q_TABLE_SIZE; x++)
+		CBSecpJacobianAdd(&qTable[x], &qTable[x-1], &q2x);
+	for (uint8_t x = 0; x < CB_SECP_Q_TABLE_SIZE; x++) {
+		qLambdaTable[x] = qTable[x];
+		CBSecpFieldMul(&qLambdaTable[x].x, &qTable[x].x, &CB_SECP_BETA);
+	}
+	CBSecpJacobian res = {{{0}}, {{0}}, {{0}}, true};
+	for (uint16_t x = bits; x-- > 0;) {
+		CBSecpJacobianDouble(&res, &res);
+		for (uint8_t y = 0; y < 4; y++) {
+			int16_t digit = wnaf[y][x];
+			if (NOT digit)
+				continue;
+			bool neg = (digit < 0) != negate[y];
+			uint8_t index = (digit < 0 ? -digit : digit) / 2;
+			if (y < 2) {
+				CBSecpAffine point = y ? CBSecpGLambdaTable[index] : CBSecpGTable[index];
+				if (neg)
+					CBSecpFieldNeg(&point.y, &point.y);
+				CBSecpJacobianAddAffine(&res, &res, &point);
+			}else{
+				CBSecpJacobian point = y == 3 ? qLambdaTable[index] : qTable[index];
+				if (neg)
+					CBSecpFieldNeg(&point.y, &point.y);
+				CBSecpJacobianAdd(&res, &res, &point);
+			}
+		}
+	}
+	if (res.infinity)
+		return false;
+	// Check x = r without inverting Z, using r * Z^2 = X. x is also allowed to be r + n when that is below p.
+	CBSecpField rField, z2, t;
+	memcpy(rField.d, r->d, 32);
+	CBSecpFieldSqr(&z2, &res.z);
+	CBSecpFieldMul(&t, &rField, &z2);
+	if (CBSecpFieldEqual(&t, &res.x))
+		return true;
+	int8_t x = 7;
+	while (x >= 0 && r->d[x] == CB_SECP_P_MINUS_N[x])
+		x--;
+	if (x < 0 || r->d[x] > CB_SECP_P_MINUS_N[x])
+		return false;
+	CBSecpField nField;
+	memcpy(nField.d, CB_SECP_N, 32);
+	CBSecpFieldAdd(&rField, &rField, &nField);
+	CBSecpFieldMul(&t, &rField, &z2);
+	return CBSecpFieldEqual(&t, &res.x);
+}
+
+// Group implementation for signing. This is constant-time.
+
+// Complete addition for a = 0 from Renes, Costello and Batina 2015, algorithm 7. Works for all inputs including doubling and infinity.
+static void CBSecpProjectiveAdd(CBSecpProjective * r, const CBSecpProjective * a, const CBSecpProjective * b){
+	CBSecpField t0, t1, t2, t3, t4, x3, y3, z3;
+	CBSecpFieldMul(&t0, &a->x, &b->x);
+	CBSecpFieldMul(&t1, &a->y, &b->y);
+	CBSecpFieldMul(&t2, &a->z, &b->z);
+	CBSecpFieldAdd(&t3, &a->x, &a->y);
+	CBSecpFieldAdd(&t4, &b->x, &b->y);
+	CBSecpFieldMul(&t3, &t3, &t4);
+	CBSecpFieldAdd(&t4, &t0, &t1);
+	CBSecpFieldSub(&t3, &t3, &t4);
+	CBSecpFieldAdd(&t4, &a->y, &a->z);
+	CBSecpFieldAdd(&x3, &b->y, &b->z);
+	CBSecpFieldMul(&t4, &t4, &x3);
+	CBSecpFieldAdd(&x3, &t1, &t2);
+	CBSecpFieldSub(&t4, &t4, &x3);
+	CBSecpFieldAdd(&x3, &a->x, &a->z);
+	CBSecpFieldAdd(&y3, &b->x, &b->z);
+	CBSecpFieldMul(&x3, &x3, &y3);
+	CBSecpFieldAdd(&y3, &t0, &t2);
+	CBSecpFieldSub(&y3, &x3, &y3);
+	CBSecpFieldAdd(&x3, &t0, &t0);
+	CBSecpFieldAdd(&t0, &x3, &t0);
+	CBSecpFieldMulInt(&t2, &t2, 21); // 3 * b
+	CBSecpFieldAdd(&z3, &t1, &t2);
+	CBSecpFieldSub(&t1, &t1, &t2);
+	CBSecpFieldMulInt(&y3, &y3, 21);
+	CBSecpFieldMul(&x3, &t4, &y3);
+	CBSecpFieldMul(&t2, &t3, &t1);
+	CBSecpFieldSub(&x3, &t2, &x3);
+	CBSecpFieldMul(&y3, &y3, &t0);
+	CBSecpFieldMul(&t1, &t1, &z3);
+	CBSecpFieldAdd(&y3, &t1, &y3);
+	CBSecpFieldMul(&t0, &t0, &t3);
+	CBSecpFieldMul(&z3, &z3, &t4);
+	CBSecpFieldAdd(&z3, &z3, &t0);
+	r->x = x3;
+	r->y = y3;
+	r->z = z3;
+}
+// Gives k * G as affine x, looking at every table entry for every window so memory access does not depend on k.
+static void CBSecpMultiplyGenerator(CBSecpField * x, const CBSecpScalar * k){
+	CBSecpProjective res, entry;
+	memset(&res, 0, sizeof(res));
+	res.y.d[0] = 1;
+	for (uint8_t w = 0; w < 64; w++) {
+		uint32_t bits = (k->d[w / 8] >> ((w % 8) * 4)) & 0xF;
+		memset(&entry, 0, sizeof(entry));
+		for (uint8_t y = 0; y < 16; y++) {
+			uint32_t mask = -(uint32_t)((((y ^ bits) - 1) >> 31) & 1); // All ones when y == bits
+			CBSecpFieldCmov(&entry.x, &CBSecpCombTable[w][y].x, mask);
+			CBSecpFieldCmov(&entry.y, &CBSecpCombTable[w][y].y, mask);
+			CBSecpFieldCmov(&entry.z, &CBSecpCombTable[w][y].z, mask);
+		}
+		CBSecpProjectiveAdd(&res, &res, &entry);
+	}
+	CBSecpField zinv;
+	CBSecpFieldInv(&zinv, &res.z);
+	CBSecpFieldMul(x, &res.x, &zinv);
+}
+static uint8_t CBSecpEncodeDERInteger(uint8_t * out, const CBSecpScalar * a){
+	uint8_t bytes[33];
+	bytes[0] = 0;
+	CBSecpScalarGetBytes(bytes + 1, a);
+	uint8_t start = 0;
+	while (start < 32 && bytes[start] == 0 && NOT (bytes[start + 1] & 0x80))
+		start++;
+	out[0] = 0x02;
+	out[1] = 33 - start;
+	memcpy(out + 2, bytes + start, 33 - start);
+	return 35 - start;
+}
+
+// Implementation of the dependencies
+
+void CBSha160(uint8_t * data, uint16_t len, uint8_t * output){
+	uint32_t h[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+	for (uint32_t x = 0; x + 64 <= len; x += 64)
+		CBSha1Block(h, data + x);
+	uint8_t blocks[128];
+	uint8_t num = CBHashPadding(blocks, data, len, false);
+	for (uint8_t x = 0; x < num; x++)
+		CBSha1Block(h, blocks + x * 64);
+	for (uint8_t x = 0; x < 20; x++)
+		output[x] = h[x/4] >> (24 - (x % 4) * 8);
+}
+void CBSha256(uint8_t * data, uint16_t len, uint8_t * output){
+	CBSecpSha256(data, len, output);
+}
+void CBRipemd160(uint8_t * data, uint16_t len, uint8_t * output){
+	uint32_t h[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+	for (uint32_t x = 0; x + 64 <= len; x += 64)
+		CBRipemd160Block(h, data + x);
+	uint8_t blocks[128];
+	uint8_t num = CBHashPadding(blocks, data, len, true);
+	for (uint8_t x = 0; x < num; x++)
+		CBRipemd160Block(h, blocks + x * 64);
+	for (uint8_t x = 0; x < 20; x++)
+		output[x] = h[x/4] >> ((x % 4) * 8);
+}
+bool CBEcdsaVerify(uint8_t * signature, uint8_t sigLen, uint8_t * hash, const uint8_t * pubKey, uint8_t keyLen){
+	CBSecpScalar r, s, z;
+	CBSecpAffine q;
+	if (NOT CBSecpParseSignature(&r, &s, signature, sigLen)
+		|| NOT CBSecpParsePublicKey(&q, pubKey, keyLen))
+		return false;
+	CBSecpScalarSetBytes(&z, hash);
+	pthread_once(&CBSecpTablesOnce, CBSecpCreateTables);
+	if (NOT CBSecpTablesReady)
+		return false;
+	return CBSecpVerify(&r, &s, &z, &q);
+}
+bool CBEcdsaVerifyBatch(CBEcdsaVerifyInput * inputs, uint32_t num, bool * results){
+	// ECDSA signatures cannot be combined, so verify each with the shared tables.
+	bool allValid = true;
+	for (uint32_t x = 0; x < num; x++) {
+		bool res = CBEcdsaVerify(inputs[x].signature, inputs[x].sigLen, inputs[x].hash, inputs[x].pubKey, inputs[x].keyLen);
+		if (results)
+			results[x] = res;
+		allValid &= res;
+	}
+	return allValid;
+}
+bool CBEcdsaSign(uint8_t * hash, uint8_t * privKey, unsigned int * nSig, uint8_t ** sig){
+	pthread_once(&CBSecpTablesOnce, CBSecpCreateTables);
+	if (NOT CBSecpTablesReady)
+		return false;
+	CBSecpScalar d, z, k, r, s;
+	if (CBSecpScalarSetBytes(&d, privKey) || CBSecpScalarIsZero(&d))
+		return false;
+	CBSecpScalarSetBytes(&z, hash);
+	// Deterministic nonce from RFC 6979 with HMAC-SHA256
+	uint8_t v[32], key[32], data[32 + 1 + 32 + 32];
+	memset(v, 0x01, 32);
+	memset(key, 0x00, 32);
+	memcpy(data, v, 32);
+	data[32] = 0x00;
+	memcpy(data + 33, privKey, 32);
+	CBSecpScalarGetBytes(data + 65, &z);
+	CBSecpHmacSha256(key, data, 97, key);
+	CBSecpHmacSha256(key, v, 32, v);
+	memcpy(data, v, 32);
+	data[32] = 0x01;
+	CBSecpHmacSha256(key, data, 97, key);
+	CBSecpHmacSha256(key, v, 32, v);
+	for (;;) {
+		CBSecpHmacSha256(key, v, 32, v);
+		if (NOT CBSecpScalarSetBytes(&k, v) && NOT CBSecpScalarIsZero(&k)) {
+			// r = x(k * G) mod n, s = (z + r * d) / k
+			CBSecpField x;
+			uint8_t xBytes[32];
+			CBSecpMultiplyGenerator(&x, &k);
+			for (uint8_t y = 0; y < 32; y++)
+				xBytes[y] = x.d[7 - y/4] >> (24 - (y % 4) * 8);
+			CBSecpScalarSetBytes(&r, xBytes);
+			CBSecpScalarMul(&s, &r, &d);
+			CBSecpScalarAdd(&s, &s, &z);
+			CBSecpScalarInv(&k, &k);
+			CBSecpScalarMul(&s, &s, &k);
+			if (NOT CBSecpScalarIsZero(&r) && NOT CBSecpScalarIsZero(&s))
+				break;
+		}
+		memcpy(data, v, 32);
+		data[32] = 0x00;
+		CBSecpHmacSha256(key, data, 33, key);
+		CBSecpHmacSha256(key, v, 32, v);
+	}
+	memset(key, 0, 32);
+	memset(data, 0, sizeof(data));
+	memset(&d, 0, sizeof(d));
+	memset(&k, 0, sizeof(k));
+	// Use the low s value
+	if (CBSecpScalarIsHigh(&s))
+		CBSecpScalarNeg(&s, &s);
+	*sig = malloc(73);
+	if (NOT *sig)
+		return false;
+	uint8_t len = CBSecpEncodeDERInteger(*sig + 2, &r);
+	len += CBSecpEncodeDERInteger(*sig + 2 + len, &s);
+	(*sig)[0] = 0x30;
+	(*sig)[1] = len;
+	*nSig = len + 2;
+	return true;
+}
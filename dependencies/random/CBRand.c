@@ -26,27 +26,221 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#if defined(__linux__) && defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 25))
+#include <sys/random.h>
+#define CB_RAND_HAVE_GETRANDOM
+#endif
+
+// Constants
+
+#define CB_RAND_BUFFER_BLOCKS 8 // The number of ChaCha20 blocks generated at a time.
+#define CB_RAND_BUFFER_SIZE (CB_RAND_BUFFER_BLOCKS * 64)
+
+// Types
+
+/*
+ The generator runs ChaCha20 with a 256-bit key and a 64-bit block counter. Output is generated CB_RAND_BUFFER_BLOCKS at a time and the first 32 bytes of each refill replace the key, so that past output cannot be recovered from the state. Output bytes are erased from the buffer as they are used.
+ */
+typedef struct{
+	uint32_t key[8];
+	uint64_t counter;
+	uint8_t buffer[CB_RAND_BUFFER_SIZE];
+	uint16_t available; // Unused bytes at the end of the buffer.
+	uint32_t forkGeneration; // Only used by the per-thread generators.
+} CBSecureRandomState;
+
+// Per-thread generators used by CBSecureRandomBytes.
+
+static pthread_key_t CBRandThreadKey;
+static pthread_once_t CBRandThreadOnce = PTHREAD_ONCE_INIT;
+static volatile uint32_t CBRandForkGeneration = 0; // Incremented in the child after fork, so that the copied states are reseeded.
 
 // Implementation
 
+static void CBRandErase(void * data, size_t len){
+	volatile uint8_t * bytes = data;
+	while (len--)
+		*bytes++ = 0;
+}
+static bool CBRandGetEntropy(uint8_t * buf, uint32_t len){
+#ifdef CB_RAND_HAVE_GETRANDOM
+	while (len) {
+		ssize_t got = getrandom(buf, len, 0);
+		if (got < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno == ENOSYS)
+				break; // Old kernel, fall back to /dev/urandom.
+			return false;
+		}
+		buf += got;
+		len -= got;
+	}
+	if (NOT len)
+		return true;
+#endif
+	int fd = open("/dev/urandom", O_RDONLY | O_CLOEXEC); // Using urandom for speed.
+	if (fd < 0)
+		return false;
+	while (len) {
+		ssize_t got = read(fd, buf, len);
+		if (got <= 0) {
+			if (got < 0 && errno == EINTR)
+				continue;
+			close(fd);
+			return false;
+		}
+		buf += got;
+		len -= got;
+	}
+	close(fd);
+	return true;
+}
+#define CB_CHACHA_ROTATE(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+#define CB_CHACHA_QUARTER_ROUND(a, b, c, d) \
+	a += b; d = CB_CHACHA_ROTATE(d ^ a, 16); \
+	c += d; b = CB_CHACHA_ROTATE(b ^ c, 12); \
+	a += b; d = CB_CHACHA_ROTATE(d ^ a, 8); \
+	c += d; b = CB_CHACHA_ROTATE(b ^ c, 7);
+static void CBChaCha20Block(uint32_t * key, uint64_t counter, uint8_t * out){
+	uint32_t input[16] = {0x61707865, 0x3320646e, 0x79622d32, 0x6b206574,
+		key[0], key[1], key[2], key[3], key[4], key[5], key[6], key[7],
+		(uint32_t)counter, (uint32_t)(counter >> 32), 0, 0};
+	uint32_t x[16];
+	memcpy(x, input, sizeof(x));
+	for (uint8_t i = 0; i < 10; i++) {
+		CB_CHACHA_QUARTER_ROUND(x[0], x[4], x[8], x[12])
+		CB_CHACHA_QUARTER_ROUND(x[1], x[5], x[9], x[13])
+		CB_CHACHA_QUARTER_ROUND(x[2], x[6], x[10], x[14])
+		CB_CHACHA_QUARTER_ROUND(x[3], x[7], x[11], x[15])
+		CB_CHACHA_QUARTER_ROUND(x[0], x[5], x[10], x[15])
+		CB_CHACHA_QUARTER_ROUND(x[1], x[6], x[11], x[12])
+		CB_CHACHA_QUARTER_ROUND(x[2], x[7], x[8], x[13])
+		CB_CHACHA_QUARTER_ROUND(x[3], x[4], x[9], x[14])
+	}
+	for (uint8_t i = 0; i < 16; i++) {
+		uint32_t word = x[i] + input[i];
+		out[i*4] = word;
+		out[i*4 + 1] = word >> 8;
+		out[i*4 + 2] = word >> 16;
+		out[i*4 + 3] = word >> 24;
+	}
+}
+static void CBRandRefill(CBSecureRandomState * state){
+	for (uint8_t x = 0; x < CB_RAND_BUFFER_BLOCKS; x++)
+		CBChaCha20Block(state->key, state->counter++, state->buffer + x*64);
+	// Replace the key with the first 32 bytes of output.
+	for (uint8_t x = 0; x < 8; x++)
+		state->key[x] = state->buffer[x*4] | state->buffer[x*4 + 1] << 8 | state->buffer[x*4 + 2] << 16 | (uint32_t)state->buffer[x*4 + 3] << 24;
+	CBRandErase(state->buffer, 32);
+	state->available = CB_RAND_BUFFER_SIZE - 32;
+}
+static void CBRandSetKey(CBSecureRandomState * state, uint8_t * key){
+	for (uint8_t x = 0; x < 8; x++)
+		state->key[x] = key[x*4] | key[x*4 + 1] << 8 | key[x*4 + 2] << 16 | (uint32_t)key[x*4 + 3] << 24;
+	state->counter = 0;
+	CBRandErase(state->buffer, CB_RAND_BUFFER_SIZE);
+	state->available = 0;
+}
+static void CBRandFill(CBSecureRandomState * state, uint8_t * buf, uint32_t len){
+	bool rekey = false;
+	while (len) {
+		if (NOT state->available) {
+			if (len >= 64) {
+				// Write whole blocks straight to the output and change the key afterwards.
+				CBChaCha20Block(state->key, state->counter++, buf);
+				buf += 64;
+				len -= 64;
+				rekey = true;
+				continue;
+			}
+			CBRandRefill(state);
+			rekey = false;
+		}
+		uint16_t take = len < state->available ? len : state->available;
+		uint8_t * from = state->buffer + CB_RAND_BUFFER_SIZE - state->available;
+		memcpy(buf, from, take);
+		CBRandErase(from, take);
+		state->available -= take;
+		buf += take;
+		len -= take;
+	}
+	if (rekey)
+		CBRandRefill(state);
+}
+static bool CBRandSeedFromEntropy(CBSecureRandomState * state){
+	uint8_t key[32];
+	if (NOT CBRandGetEntropy(key, 32))
+		return false;
+	CBRandSetKey(state, key);
+	CBRandErase(key, 32);
+	return true;
+}
+static void CBRandFreeState(void * state){
+	CBRandErase(state, sizeof(CBSecureRandomState));
+	free(state);
+}
+static void CBRandForkChild(void){
+	CBRandForkGeneration++;
+}
+static void CBRandThreadInit(void){
+	pthread_key_create(&CBRandThreadKey, CBRandFreeState);
+	pthread_atfork(NULL, NULL, CBRandForkChild);
+}
 bool CBNewSecureRandomGenerator(uint64_t * gen){
-	*gen = (uint64_t)malloc(32);
-	return *gen;
+	CBSecureRandomState * state = malloc(sizeof(*state));
+	if (NOT state)
+		return false;
+	memset(state, 0, sizeof(*state));
+	*gen = (uint64_t)state;
+	return true;
 }
 bool CBSecureRandomSeed(uint64_t gen){
-	FILE * f = fopen("/dev/urandom", "r"); // Using urandom for speed.
-	return fread((void *)gen, 1, 32, f) == 32;
+	return CBRandSeedFromEntropy((CBSecureRandomState *)gen);
 }
 void CBRandomSeed(uint64_t gen, uint64_t seed){
-	memcpy((void *)gen, &seed, 8);
-	memset(((uint8_t *)gen) + 8, 0, 24); // Blank out the rest of the data
+	uint8_t key[32] = {0};
+	for (uint8_t x = 0; x < 8; x++)
+		key[x] = seed >> (x*8);
+	CBRandSetKey((CBSecureRandomState *)gen, key);
 }
 uint64_t CBSecureRandomInteger(uint64_t gen){
-	CBSha256((uint8_t *)gen, 32, (void *)gen);
-	uint64_t i;
-	memcpy(&i, (void *)gen, 8);
+	uint8_t bytes[8];
+	CBRandFill((CBSecureRandomState *)gen, bytes, 8);
+	uint64_t i = 0;
+	for (uint8_t x = 0; x < 8; x++)
+		i |= (uint64_t)bytes[x] << (x*8);
 	return i;
 }
+void CBSecureRandomFill(uint64_t gen, uint8_t * buf, uint32_t len){
+	CBRandFill((CBSecureRandomState *)gen, buf, len);
+}
+bool CBSecureRandomBytes(uint8_t * buf, uint32_t len){
+	pthread_once(&CBRandThreadOnce, CBRandThreadInit);
+	CBSecureRandomState * state = pthread_getspecific(CBRandThreadKey);
+	if (NOT state) {
+		state = malloc(sizeof(*state));
+		if (NOT state)
+			return false;
+		if (NOT CBRandSeedFromEntropy(state)) {
+			free(state);
+			return false;
+		}
+		state->forkGeneration = CBRandForkGeneration;
+		pthread_setspecific(CBRandThreadKey, state);
+	}else if (state->forkGeneration != CBRandForkGeneration) {
+		// This process is a fork child, so do not repeat the parent's output.
+		if (NOT CBRandSeedFromEntropy(state))
+			return false;
+		state->forkGeneration = CBRandForkGeneration;
+	}
+	CBRandFill(state, buf, len);
+	return true;
+}
 void CBFreeSecureRandomGenerator(uint64_t gen){
-	free((void *)gen);
+	CBRandFreeState((void *)gen);
 }
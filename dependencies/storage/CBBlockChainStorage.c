@@ -27,68 +27,634 @@
 // KEYS
 
 uint8_t CB_VALIDATOR_INFO_KEY[2] = {1, CB_STORAGE_VALIDATOR_INFO};
-uint8_t CB_ORPHAN_KEY[3] = {2, CB_STORAGE_ORPHAN, 0};
-uint8_t CB_BRANCH_KEY[3] = {2, CB_STORAGE_BRANCH_INFO, 0};
-uint8_t CB_WORK_KEY[3] = {2, CB_STORAGE_WORK, 0};
-uint8_t CB_BLOCK_KEY[7] = {6, CB_STORAGE_BLOCK, 0, 0, 0, 0, 0};
-uint8_t CB_NEW_BLOCK_KEY[7] = {6, CB_STORAGE_BLOCK, 0, 0, 0, 0, 0};
-uint8_t CB_BLOCK_HASH_INDEX_KEY[22] = {21, CB_STORAGE_BLOCK_HASH_INDEX, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+uint8_t CB_BLOCK_KEY[6] = {5, CB_STORAGE_BLOCK, 0, 0, 0, 0};
 uint8_t CB_UNSPENT_OUTPUT_KEY[38] = {37, CB_STORAGE_UNSPENT_OUTPUT, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
 uint8_t CB_TRANSACTION_INDEX_KEY[34] = {33, CB_STORAGE_TRANSACTION_INDEX, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
-uint8_t CB_DATA_ARRAY[22];
+uint8_t CB_UNDO_KEY[6] = {5, CB_STORAGE_UNDO, 0, 0, 0, 0};
+uint8_t CB_BLOCK_FILE_KEY[4] = {3, CB_STORAGE_BLOCK_FILE, 0, 0};
+uint8_t CB_COMPACT_TRANSACTION_INDEX_KEY[CB_TRANSACTION_INDEX_KEY_HASH + 2] = {CB_TRANSACTION_INDEX_KEY_HASH + 1, CB_STORAGE_COMPACT_TRANSACTION_INDEX};
+uint8_t CB_DATA_ARRAY[CB_TRANSACTION_REF_SIZE];
+
+// Unspent output records
+
+// Writes a variable integer where the high bit of each byte marks a following byte, returning the length. Each following byte also adds one to the value before shifting, so that every value has one encoding.
+static uint8_t CBBlockChainStorageWriteVarInt(uint8_t * data, uint64_t value){
+	uint8_t reversed[10];
+	uint8_t len = 0;
+	for (;; len++) {
+		reversed[len] = (value & 0x7F) | (len ? 0x80 : 0x00);
+		if (value <= 0x7F)
+			break;
+		value = (value >> 7) - 1;
+	}
+	for (uint8_t x = 0; x <= len; x++)
+		data[x] = reversed[len - x];
+	return len + 1;
+}
+static bool CBBlockChainStorageReadVarInt(uint8_t * data, uint32_t length, uint32_t * cursor, uint64_t * value){
+	*value = 0;
+	for (uint8_t x = 0; x < 10 && *cursor < length; x++) {
+		uint8_t byte = data[(*cursor)++];
+		*value = (*value << 7) | (byte & 0x7F);
+		if (NOT (byte & 0x80))
+			return true;
+		(*value)++;
+	}
+	return false;
+}
+// Writes the start of an unspent output record to header and gives the script data which follows, returning the length of the header.
+static uint8_t CBBlockChainStorageCompressUnspentOutput(uint8_t * header, CBTransactionOutput * output, uint32_t height, bool coinbase, uint8_t ** script, uint32_t * scriptLen){
+	uint8_t len = CBBlockChainStorageWriteVarInt(header, (uint64_t)height * 2 + coinbase);
+	len += CBBlockChainStorageWriteVarInt(header + len, CBBlockChainStorageCompressAmount(output->value));
+	uint32_t outputScriptLen = output->scriptObject ? output->scriptObject->length : 0;
+	uint8_t * data = outputScriptLen ? CBByteArrayGetData(output->scriptObject) : NULL;
+	if (outputScriptLen == 25
+		&& data[0] == CB_SCRIPT_OP_DUP
+		&& data[1] == CB_SCRIPT_OP_HASH160
+		&& data[2] == 20
+		&& data[23] == CB_SCRIPT_OP_EQUALVERIFY
+		&& data[24] == CB_SCRIPT_OP_CHECKSIG) {
+		header[len++] = CB_UNSPENT_OUTPUT_P2PKH;
+		*script = data + 3;
+		*scriptLen = 20;
+	}else if (outputScriptLen == 23
+			  && data[0] == CB_SCRIPT_OP_HASH160
+			  && data[1] == 20
+			  && data[22] == CB_SCRIPT_OP_EQUAL) {
+		header[len++] = CB_UNSPENT_OUTPUT_P2SH;
+		*script = data + 2;
+		*scriptLen = 20;
+	}else{
+		len += CBBlockChainStorageWriteVarInt(header + len, CB_UNSPENT_OUTPUT_SCRIPT + (uint64_t)outputScriptLen);
+		*script = data;
+		*scriptLen = outputScriptLen;
+	}
+	return len;
+}
+// Writes an unspent output record under CB_UNSPENT_OUTPUT_KEY.
+static bool CBBlockChainStorageWriteUnspentOutput(CBDatabase * database, CBTransactionOutput * output, uint32_t height, bool coinbase){
+	uint8_t header[30];
+	uint8_t * parts[2] = {header, NULL};
+	uint32_t sizes[2];
+	sizes[0] = CBBlockChainStorageCompressUnspentOutput(header, output, height, coinbase, &parts[1], &sizes[1]);
+	return CBDatabaseWriteConcatenatedValue(database, CB_UNSPENT_OUTPUT_KEY, sizes[1] ? 2 : 1, parts, sizes);
+}
+// Appends an entry to the undo data of a block, returning where the unspent output record should be placed or NULL on failure.
+static uint8_t * CBBlockChainStorageAddUndoEntry(uint8_t ** undo, uint32_t * undoLength, uint32_t * undoAllocSize, uint8_t * txHash, uint32_t outputIndex, uint32_t recordLength){
+	// Reallocate the undo data if needed, allowing for the header, the transaction hash, two variable integers and the record.
+	uint32_t maxLength = (*undoLength ? *undoLength : CB_UNDO_HEADER_SIZE) + 32 + 5 + 5 + recordLength;
+	if (maxLength > *undoAllocSize) {
+		// Keep the old undo data if it cannot be grown, so that the caller can still free it.
+		uint8_t * newUndo = realloc(*undo, maxLength * 2);
+		if (NOT newUndo) {
+			CBLogError("Could not allocate memory for undo data.");
+			return NULL;
+		}
+		*undo = newUndo;
+		*undoAllocSize = maxLength * 2;
+	}
+	if (NOT *undoLength) {
+		CBInt32ToArray(*undo, 0, 0);
+		*undoLength = CB_UNDO_HEADER_SIZE;
+	}
+	uint8_t * entry = *undo + *undoLength;
+	memcpy(entry, txHash, 32);
+	uint32_t len = 32;
+	len += CBBlockChainStorageWriteVarInt(entry + len, outputIndex);
+	len += CBBlockChainStorageWriteVarInt(entry + len, recordLength);
+	*undoLength += len + recordLength;
+	CBInt32ToArray(*undo, 0, CBArrayToInt32(*undo, 0) + 1);
+	return entry + len;
+}
+// Removes the prefetched unspent outputs, for when the unspent outputs change.
+static void CBBlockChainStorageClearPrefetched(CBBlockChainStorage * self){
+	if (self->prefetched.root->numElements)
+		CBAssociativeArrayClear(&self->prefetched);
+}
+// Finds the prefetched unspent output for CB_UNSPENT_OUTPUT_KEY, returning the length followed by the record or NULL if it was not prefetched.
+static uint8_t * CBBlockChainStorageFindPrefetched(CBBlockChainStorage * self){
+	if (NOT self->prefetched.root->numElements)
+		return NULL;
+	CBFindResult res = CBAssociativeArrayFind(&self->prefetched, CB_UNSPENT_OUTPUT_KEY);
+	if (NOT res.found)
+		return NULL;
+	return (uint8_t *)res.position.node->elements[res.position.index] + 38;
+}
+// Converts an unspent output from a reference into a block to a record.
+static bool CBBlockChainStorageMigrateUnspentOutput(CBDatabase * database, uint8_t * key){
+	memcpy(CB_UNSPENT_OUTPUT_KEY, key, 38);
+	uint8_t ref[8];
+	if (NOT CBDatabaseReadValue(database, CB_UNSPENT_OUTPUT_KEY, ref, 8, 0)) {
+		CBLogError("Could not read an unspent output reference for migration.");
+		return false;
+	}
+	memcpy(CB_TRANSACTION_INDEX_KEY + 2, key + 2, 32);
+	if (NOT CBDatabaseReadValue(database, CB_TRANSACTION_INDEX_KEY, CB_DATA_ARRAY, CB_TRANSACTION_REF_IS_COINBASE + 1, 0)) {
+		CBLogError("Could not read a transaction reference for migration.");
+		return false;
+	}
+	memcpy(CB_BLOCK_KEY + 2, CB_DATA_ARRAY + CB_TRANSACTION_REF_BLOCK_ID, 4);
+	CBByteArray * outputBytes = CBNewByteArrayOfSize(CBArrayToInt32(ref, CB_UNSPENT_OUTPUT_REF_LENGTH));
+	if (NOT outputBytes) {
+		CBLogError("Could not create a CBByteArray for migrating an unspent output.");
+		return false;
+	}
+	if (NOT CBDatabaseReadValue(database, CB_BLOCK_KEY, CBByteArrayGetData(outputBytes), outputBytes->length, CBArrayToInt32(ref, CB_UNSPENT_OUTPUT_REF_POSITION))) {
+		CBLogError("Could not read an unspent output from a block for migration.");
+		CBReleaseObject(outputBytes);
+		return false;
+	}
+	CBTransactionOutput * output = CBNewTransactionOutputFromData(outputBytes);
+	CBReleaseObject(outputBytes);
+	if (NOT output || NOT CBTransactionOutputDeserialise(output)) {
+		CBLogError("Could not deserialise an unspent output for migration.");
+		if (output)
+			CBReleaseObject(output);
+		return false;
+	}
+	bool ok = CBBlockChainStorageWriteUnspentOutput(database, output, CBArrayToInt32(CB_DATA_ARRAY, CB_TRANSACTION_REF_HEIGHT), CB_DATA_ARRAY[CB_TRANSACTION_REF_IS_COINBASE]);
+	CBReleaseObject(output);
+	if (NOT ok)
+		CBLogError("Could not write a migrated unspent output.");
+	return ok;
+}
+
+// Block files
+
+// Makes the path for a block file. The filename needs space for the data directory and 13 more characters.
+static void CBBlockChainStorageGetBlockFileName(CBBlockChainStorage * self, uint16_t fileID, char * filename){
+	sprintf(filename, "%sblk%05u.dat", self->base.dataDir, fileID);
+}
+// Queues a write of the information for a block file.
+static bool CBBlockChainStorageWriteBlockFile(CBBlockChainStorage * self, uint16_t fileID){
+	uint8_t data[CB_BLOCK_FILE_INFO_SIZE];
+	CBInt16ToArray(CB_BLOCK_FILE_KEY, 2, fileID);
+	CBInt32ToArray(data, CB_BLOCK_FILE_NUM_BLOCKS, self->blockFiles[fileID].numBlocks);
+	CBInt32ToArray(data, CB_BLOCK_FILE_LENGTH, self->blockFiles[fileID].length);
+	if (NOT CBDatabaseWriteValue(&self->base, CB_BLOCK_FILE_KEY, data, CB_BLOCK_FILE_INFO_SIZE)) {
+		CBLogError("Could not write the information for a block file.");
+		return false;
+	}
+	return true;
+}
+// Closes the block files which are open.
+static void CBBlockChainStorageCloseBlockFiles(CBBlockChainStorage * self){
+	if (self->blockFile)
+		CBFileClose(self->blockFile);
+	if (self->readFile)
+		CBFileClose(self->readFile);
+	self->blockFile = 0;
+	self->readFile = 0;
+}
+// Loads the committed information for the block files and opens the last block file. Any data appended to the last block file after the last commit is removed.
+static bool CBBlockChainStorageLoadBlockFiles(CBBlockChainStorage * self){
+	free(self->blockFiles);
+	self->blockFiles = NULL;
+	self->numBlockFiles = 0;
+	self->blockFileChanged = false;
+	self->newBlockFile = false;
+	for (;;) {
+		CBInt16ToArray(CB_BLOCK_FILE_KEY, 2, self->numBlockFiles);
+		if (NOT CBDatabaseGetLength(&self->base, CB_BLOCK_FILE_KEY))
+			break;
+		CBBlockFile * blockFiles = realloc(self->blockFiles, (self->numBlockFiles + 1) * sizeof(*blockFiles));
+		if (NOT blockFiles) {
+			CBLogError("Could not allocate memory for the block file information.");
+			return false;
+		}
+		self->blockFiles = blockFiles;
+		uint8_t data[CB_BLOCK_FILE_INFO_SIZE];
+		if (NOT CBDatabaseReadValue(&self->base, CB_BLOCK_FILE_KEY, data, CB_BLOCK_FILE_INFO_SIZE, 0)) {
+			CBLogError("Could not read the information for a block file.");
+			return false;
+		}
+		blockFiles[self->numBlockFiles].numBlocks = CBArrayToInt32(data, CB_BLOCK_FILE_NUM_BLOCKS);
+		blockFiles[self->numBlockFiles].length = CBArrayToInt32(data, CB_BLOCK_FILE_LENGTH);
+		// Empty files are removed again after the next commit, in case they were not removed before.
+		blockFiles[self->numBlockFiles].removed = false;
+		self->numBlockFiles++;
+	}
+	if (NOT self->numBlockFiles)
+		return true;
+	char filename[strlen(self->base.dataDir) + 13];
+	CBBlockChainStorageGetBlockFileName(self, self->numBlockFiles - 1, filename);
+	self->blockFile = CBFileOpen(filename, false);
+	uint32_t length;
+	if (NOT self->blockFile
+		|| NOT CBFileGetLength(self->blockFile, &length)) {
+		CBLogError("Could not open the last block file.");
+		self->blockFile = 0;
+		return false;
+	}
+	if (length > self->blockFiles[self->numBlockFiles - 1].length) {
+		// Remove the blocks which were not committed.
+		CBFileClose(self->blockFile);
+		self->blockFile = 0;
+		if (NOT CBFileTruncate(filename, self->blockFiles[self->numBlockFiles - 1].length)) {
+			CBLogError("Could not remove uncommitted blocks from the last block file.");
+			return false;
+		}
+		self->blockFile = CBFileOpen(filename, false);
+		if (NOT self->blockFile) {
+			CBLogError("Could not open the last block file.");
+			return false;
+		}
+	}
+	return true;
+}
+// Appends a block to the last block file, starting a new block file when the block does not fit, and queues the index value for the block at CB_BLOCK_KEY.
+static bool CBBlockChainStorageAppendBlock(CBBlockChainStorage * self, uint8_t * data, uint32_t length){
+	if (NOT self->numBlockFiles
+		|| (self->blockFiles[self->numBlockFiles - 1].length
+			&& (uint64_t)self->blockFiles[self->numBlockFiles - 1].length + length > self->blockFileMaxSize)) {
+		if (self->numBlockFiles == UINT16_MAX) {
+			CBLogError("There are too many block files.");
+			return false;
+		}
+		CBBlockFile * blockFiles = realloc(self->blockFiles, (self->numBlockFiles + 1) * sizeof(*blockFiles));
+		if (NOT blockFiles) {
+			CBLogError("Could not allocate memory for the block file information.");
+			return false;
+		}
+		self->blockFiles = blockFiles;
+		char filename[strlen(self->base.dataDir) + 13];
+		CBBlockChainStorageGetBlockFileName(self, self->numBlockFiles, filename);
+		uint64_t file = CBFileOpen(filename, true);
+		if (NOT file) {
+			CBLogError("Could not create a new block file.");
+			return false;
+		}
+		if (self->blockFile)
+			CBFileClose(self->blockFile);
+		self->blockFile = file;
+		blockFiles[self->numBlockFiles].numBlocks = 0;
+		blockFiles[self->numBlockFiles].length = 0;
+		blockFiles[self->numBlockFiles].removed = false;
+		self->numBlockFiles++;
+		self->newBlockFile = true;
+	}
+	uint16_t fileID = self->numBlockFiles - 1;
+	CBBlockFile * blockFile = self->blockFiles + fileID;
+	if (NOT CBFileAppend(self->blockFile, data, length)) {
+		CBLogError("Could not append a block to a block file.");
+		return false;
+	}
+	self->blockFileChanged = true;
+	uint8_t index[CB_BLOCK_INDEX_SIZE];
+	memcpy(index + CB_BLOCK_INDEX_HEADER, data, 80);
+	CBInt16ToArray(index, CB_BLOCK_INDEX_FILE, fileID);
+	CBInt32ToArray(index, CB_BLOCK_INDEX_POSITION, blockFile->length);
+	CBInt32ToArray(index, CB_BLOCK_INDEX_LENGTH, length);
+	blockFile->length += length;
+	blockFile->numBlocks++;
+	if (NOT CBDatabaseWriteValue(&self->base, CB_BLOCK_KEY, index, CB_BLOCK_INDEX_SIZE)) {
+		CBLogError("Could not write the index value for a block.");
+		return false;
+	}
+	return CBBlockChainStorageWriteBlockFile(self, fileID);
+}
+// Reads part of a block from its block file.
+static bool CBBlockChainStorageReadBlock(CBBlockChainStorage * self, uint32_t blockID, uint8_t * data, uint32_t length, uint32_t offset){
+	uint8_t index[CB_BLOCK_INDEX_SIZE];
+	CBInt32ToArray(CB_BLOCK_KEY, 2, blockID);
+	if (CBDatabaseGetLength(&self->base, CB_BLOCK_KEY) != CB_BLOCK_INDEX_SIZE
+		|| NOT CBDatabaseReadValue(&self->base, CB_BLOCK_KEY, index, CB_BLOCK_INDEX_SIZE, 0)) {
+		CBLogError("Could not read the index value for block %u.", blockID);
+		return false;
+	}
+	uint16_t fileID = CBArrayToInt16(index, CB_BLOCK_INDEX_FILE);
+	if (fileID >= self->numBlockFiles
+		|| offset > CBArrayToInt32(index, CB_BLOCK_INDEX_LENGTH)
+		|| length > CBArrayToInt32(index, CB_BLOCK_INDEX_LENGTH) - offset) {
+		CBLogError("The index value for block %u is corrupt.", blockID);
+		return false;
+	}
+	uint64_t file = self->blockFile;
+	if (fileID != self->numBlockFiles - 1) {
+		// Keep the file open for reading more blocks from it.
+		if (NOT self->readFile || self->readFileID != fileID) {
+			if (self->readFile)
+				CBFileClose(self->readFile);
+			char filename[strlen(self->base.dataDir) + 13];
+			CBBlockChainStorageGetBlockFileName(self, fileID, filename);
+			self->readFile = CBFileOpen(filename, false);
+			if (NOT self->readFile) {
+				CBLogError("Could not open block file %u.", fileID);
+				return false;
+			}
+			self->readFileID = fileID;
+		}
+		file = self->readFile;
+	}
+	if (NOT CBFileSeek(file, CBArrayToInt32(index, CB_BLOCK_INDEX_POSITION) + offset)
+		|| NOT CBFileRead(file, data, length)) {
+		CBLogError("Could not read block %u from block file %u.", blockID, fileID);
+		return false;
+	}
+	return true;
+}
+// Reads the index value at CB_BLOCK_KEY into the index data and takes the block from the number of blocks in its block file, for pruning or deleting the block. Returns the length of the index value or 0 on failure.
+static uint32_t CBBlockChainStorageReleaseBlock(CBBlockChainStorage * self, uint8_t * index){
+	uint32_t length = CBDatabaseGetLength(&self->base, CB_BLOCK_KEY);
+	if ((length != CB_BLOCK_INDEX_SIZE && length != 80)
+		|| NOT CBDatabaseReadValue(&self->base, CB_BLOCK_KEY, index, length, 0)) {
+		CBLogError("Could not read the index value for a block.");
+		return 0;
+	}
+	if (length == 80)
+		// Already pruned
+		return length;
+	uint16_t fileID = CBArrayToInt16(index, CB_BLOCK_INDEX_FILE);
+	if (fileID >= self->numBlockFiles || NOT self->blockFiles[fileID].numBlocks) {
+		CBLogError("The index value for a block has an invalid block file.");
+		return 0;
+	}
+	self->blockFiles[fileID].numBlocks--;
+	return CBBlockChainStorageWriteBlockFile(self, fileID) ? length : 0;
+}
+
+// Compact transaction index
+
+// Reads an entry of a compact transaction index value at the cursor, moving the cursor past it. The fields are set to the height, the position of the outputs and the length of the outputs.
+static bool CBBlockChainStorageReadTransactionEntry(uint8_t * value, uint32_t length, uint32_t * cursor, uint64_t * fields){
+	if (length - *cursor < CB_TRANSACTION_INDEX_CHECK_HASH + 4)
+		return false;
+	*cursor += CB_TRANSACTION_INDEX_CHECK_HASH + 4;
+	for (uint8_t x = 0; x < 3; x++)
+		if (NOT CBBlockChainStorageReadVarInt(value, length, cursor, fields + x))
+			return false;
+	if (*cursor == length)
+		return false;
+	// Move past the coinbase byte
+	(*cursor)++;
+	return true;
+}
+// Reads the compact transaction index value for a transaction into newly allocated memory, setting the length. The key is left in CB_COMPACT_TRANSACTION_INDEX_KEY.
+static uint8_t * CBBlockChainStorageReadTransactionIndex(CBDatabase * database, uint8_t * txHash, uint32_t * length){
+	memcpy(CB_COMPACT_TRANSACTION_INDEX_KEY + 2, txHash, CB_TRANSACTION_INDEX_KEY_HASH);
+	*length = CBDatabaseGetLength(database, CB_COMPACT_TRANSACTION_INDEX_KEY);
+	if (NOT *length) {
+		CBLogError("A transaction is not in the transaction index.");
+		return NULL;
+	}
+	uint8_t * value = malloc(*length);
+	if (NOT value) {
+		CBLogError("Could not allocate memory for a transaction index value.");
+		return NULL;
+	}
+	if (NOT CBDatabaseReadValue(database, CB_COMPACT_TRANSACTION_INDEX_KEY, value, *length, 0)) {
+		CBLogError("Could not read a transaction index value.");
+		free(value);
+		return NULL;
+	}
+	return value;
+}
+// Adds an entry to the compact transaction index.
+static bool CBBlockChainStorageAddTransactionEntry(CBDatabase * database, uint8_t * txHash, uint32_t blockID, uint32_t height, uint32_t outputPos, uint32_t outputsLen, bool coinbase){
+	uint8_t entry[CB_TRANSACTION_INDEX_CHECK_HASH + 4 + 3*5 + 1];
+	memcpy(entry, txHash + CB_TRANSACTION_INDEX_KEY_HASH, CB_TRANSACTION_INDEX_CHECK_HASH);
+	CBInt32ToArray(entry, CB_TRANSACTION_INDEX_CHECK_HASH, blockID);
+	uint8_t entryLen = CB_TRANSACTION_INDEX_CHECK_HASH + 4;
+	entryLen += CBBlockChainStorageWriteVarInt(entry + entryLen, height);
+	entryLen += CBBlockChainStorageWriteVarInt(entry + entryLen, outputPos);
+	entryLen += CBBlockChainStorageWriteVarInt(entry + entryLen, outputsLen);
+	entry[entryLen++] = coinbase;
+	memcpy(CB_COMPACT_TRANSACTION_INDEX_KEY + 2, txHash, CB_TRANSACTION_INDEX_KEY_HASH);
+	uint32_t length = CBDatabaseGetLength(database, CB_COMPACT_TRANSACTION_INDEX_KEY);
+	if (NOT length) {
+		// Nearly every transaction has a key to itself, which is written without reading anything.
+		if (NOT CBDatabaseWriteValue(database, CB_COMPACT_TRANSACTION_INDEX_KEY, entry, entryLen)) {
+			CBLogError("Could not write a transaction index value.");
+			return false;
+		}
+		return true;
+	}
+	// Add the entry after the entries of the other transactions with this key, or the other instances of this transaction.
+	uint8_t * value = malloc(length + entryLen);
+	if (NOT value) {
+		CBLogError("Could not allocate memory for a transaction index value.");
+		return false;
+	}
+	if (NOT CBDatabaseReadValue(database, CB_COMPACT_TRANSACTION_INDEX_KEY, value, length, 0)) {
+		CBLogError("Could not read a transaction index value to add an entry.");
+		free(value);
+		return false;
+	}
+	memcpy(value + length, entry, entryLen);
+	bool ok = CBDatabaseWriteValue(database, CB_COMPACT_TRANSACTION_INDEX_KEY, value, length + entryLen);
+	free(value);
+	if (NOT ok)
+		CBLogError("Could not write a transaction index value with an added entry.");
+	return ok;
+}
+
+// Unspent output snapshots
+
+// Starts the commitment to the unspent outputs of a snapshot.
+static void CBBlockChainStorageStartCommitment(uint8_t * commitment, uint8_t * tipHash, uint32_t height){
+	uint8_t data[36];
+	memcpy(data, tipHash, 32);
+	CBInt32ToArray(data, 32, height);
+	CBSha256(data, 36, commitment);
+}
+// Adds an unspent output to the commitment. The data has 32 bytes of space for the commitment before the unspent output.
+static bool CBBlockChainStorageAddToCommitment(uint8_t * commitment, uint8_t * data, uint32_t length){
+	if (length + 32 > UINT16_MAX) {
+		CBLogError("An unspent output is too large for a snapshot.");
+		return false;
+	}
+	memcpy(data, commitment, 32);
+	CBSha256(data, length + 32, commitment);
+	return true;
+}
+// Reads a variable integer from a snapshot.
+static bool CBBlockChainStorageReadSnapshotVarInt(FILE * file, uint64_t * value){
+	uint8_t data[10];
+	uint32_t length = 0, cursor = 0;
+	do {
+		int byte = fgetc(file);
+		if (byte == EOF)
+			return false;
+		data[length++] = byte;
+	} while (data[length - 1] & 0x80 && length < 10);
+	return CBBlockChainStorageReadVarInt(data, length, &cursor, value);
+}
+// Finishes writing a snapshot, removing it on failure.
+static bool CBBlockChainStorageCloseSnapshot(FILE * file, char * filename, bool ok){
+	if (fclose(file))
+		ok = false;
+	if (NOT ok)
+		remove(filename);
+	return ok;
+}
+
+//  Functions
 
 uint64_t CBNewBlockChainStorage(char * dataDir){
-	return (uint64_t)CBNewDatabase(dataDir, "blk");
+	CBBlockChainStorage * self = malloc(sizeof(*self));
+	if (NOT self) {
+		CBLogError("Could not create a block-chain storage object.");
+		return 0;
+	}
+	if (NOT CBInitDatabase(&self->base, dataDir, "blk")) {
+		free(self);
+		CBLogError("Could not initialise the block-chain database.");
+		return 0;
+	}
+	self->blockFiles = NULL;
+	self->blockFile = 0;
+	self->readFile = 0;
+	self->blockFileMaxSize = CB_BLOCK_FILE_MAX_SIZE;
+	if (NOT CBInitAssociativeArray(&self->prefetched, CBKeyCompare, free)) {
+		CBLogError("Could not initialise the prefetched unspent outputs.");
+		CBFreeDatabase(&self->base);
+		return 0;
+	}
+	if (NOT CBBlockChainStorageLoadBlockFiles(self)) {
+		CBLogError("Could not load the block files.");
+		CBFreeBlockChainStorage((uint64_t)self);
+		return 0;
+	}
+	return (uint64_t)self;
 }
 void CBFreeBlockChainStorage(uint64_t iself){
-	CBFreeDatabase((CBDatabase *)iself);
+	CBBlockChainStorage * self = (CBBlockChainStorage *)iself;
+	CBBlockChainStorageCloseBlockFiles(self);
+	free(self->blockFiles);
+	CBFreeAssociativeArray(&self->prefetched);
+	// The database is the start of the storage object so this frees the storage object.
+	CBFreeDatabase(&self->base);
 }
-bool CBBlockChainStorageBlockExists(void * validator, uint8_t * blockHash){
+bool CBBlockChainStorageApplyUnspentOutputChanges(void * validator, void * changes, uint32_t numChanges, uint32_t height, uint8_t ** undo, uint32_t * undoLength, uint32_t * undoAllocSize){
 	CBFullValidator * validatorObj = validator;
-	memcpy(CB_BLOCK_HASH_INDEX_KEY + 2, blockHash, 20);
-	return CBDatabaseGetLength((CBDatabase *)validatorObj->storage, CB_BLOCK_HASH_INDEX_KEY);
+	CBDatabase * database = (CBDatabase *)validatorObj->storage;
+	CBUnspentOutputChange * changesObj = changes;
+	CBBlockChainStorageClearPrefetched((CBBlockChainStorage *)database);
+	for (uint32_t x = 0; x < numChanges; x++) {
+		CBUnspentOutputChange * change = changesObj + x;
+		uint32_t outputIndex = CBArrayToInt32(change->key, 32);
+		if (NOT change->output) {
+			// The spends of cancelled outputs have nothing to remove.
+			if (NOT change->cancelled
+				&& NOT CBBlockChainStorageSpendUnspentOutput(validator, change->key, outputIndex, undo, undoLength, undoAllocSize))
+				return false;
+			continue;
+		}
+		if (change->cancelled) {
+			// Place the record straight into the undo data.
+			uint8_t header[30];
+			uint8_t * script;
+			uint32_t scriptLen;
+			uint8_t headerLen = CBBlockChainStorageCompressUnspentOutput(header, change->output, height, change->coinbase, &script, &scriptLen);
+			uint8_t * record = CBBlockChainStorageAddUndoEntry(undo, undoLength, undoAllocSize, change->key, outputIndex, headerLen + scriptLen);
+			if (NOT record)
+				return false;
+			memcpy(record, header, headerLen);
+			if (scriptLen)
+				memcpy(record + headerLen, script, scriptLen);
+			continue;
+		}
+		memcpy(CB_UNSPENT_OUTPUT_KEY + 2, change->key, 36);
+		if (NOT CBBlockChainStorageWriteUnspentOutput(database, change->output, height, change->coinbase)) {
+			CBLogError("Could not write a new unspent output record into the database.");
+			return false;
+		}
+	}
+	return true;
 }
-bool CBBlockChainStorageChangeUnspentOutputsNum(CBDatabase * database, uint8_t * txHash, int8_t change){
-	// Place transaction hash into the key
-	memcpy(CB_TRANSACTION_INDEX_KEY + 2, txHash, 32);
-	// Read the number of unspent outputs to be decremented
-	if (NOT CBDatabaseReadValue(database, CB_TRANSACTION_INDEX_KEY, CB_DATA_ARRAY, 18, 0))
-		return false;
-	CBInt32ToArray(CB_DATA_ARRAY, CB_TRANSACTION_REF_NUM_UNSPENT_OUTPUTS, 
-				   CBArrayToInt32(CB_DATA_ARRAY, CB_TRANSACTION_REF_NUM_UNSPENT_OUTPUTS) + change);
-	// Now write the new value
-	return CBDatabaseWriteValue(database, CB_TRANSACTION_INDEX_KEY, CB_DATA_ARRAY, 18);
+bool CBBlockChainStorageBlockExists(void * validator, uint32_t blockID){
+	CBFullValidator * validatorObj = validator;
+	CBInt32ToArray(CB_BLOCK_KEY, 2, blockID);
+	return CBDatabaseGetLength((CBDatabase *)validatorObj->storage, CB_BLOCK_KEY);
+}
+uint32_t CBBlockChainStorageBlockSize(void * validator, uint32_t blockID){
+	CBFullValidator * validatorObj = validator;
+	CBInt32ToArray(CB_BLOCK_KEY, 2, blockID);
+	uint8_t length[4];
+	// Pruned blocks only have the header
+	if (CBDatabaseGetLength((CBDatabase *)validatorObj->storage, CB_BLOCK_KEY) != CB_BLOCK_INDEX_SIZE
+		|| NOT CBDatabaseReadValue((CBDatabase *)validatorObj->storage, CB_BLOCK_KEY, length, 4, CB_BLOCK_INDEX_LENGTH))
+		return 0;
+	return CBArrayToInt32(length, 0);
 }
 bool CBBlockChainStorageCommitData(uint64_t iself){
-	return CBDatabaseCommit((CBDatabase *)iself);
+	CBBlockChainStorage * self = (CBBlockChainStorage *)iself;
+	// The blocks must be on disk before the index values which refer to them.
+	if (self->blockFileChanged) {
+		if (NOT CBFileSync(self->blockFile)
+			|| (self->newBlockFile && NOT CBFileSyncDir(self->base.dataDir))) {
+			CBLogError("Could not synchronise the block files.");
+			return false;
+		}
+		self->blockFileChanged = false;
+		self->newBlockFile = false;
+	}
+	if (NOT CBDatabaseCommit(&self->base))
+		return false;
+	// Now nothing refers to the block files without blocks, they can be removed.
+	for (uint16_t x = 0; x + 1 < self->numBlockFiles; x++)
+		if (NOT self->blockFiles[x].numBlocks && NOT self->blockFiles[x].removed) {
+			if (self->readFile && self->readFileID == x) {
+				CBFileClose(self->readFile);
+				self->readFile = 0;
+			}
+			char filename[strlen(self->base.dataDir) + 13];
+			CBBlockChainStorageGetBlockFileName(self, x, filename);
+			remove(filename);
+			self->blockFiles[x].removed = true;
+		}
+	return true;
 }
-bool CBBlockChainStorageDeleteBlock(void * validator, uint8_t branch, uint32_t blockIndex){
+uint64_t CBBlockChainStorageCompressAmount(uint64_t amount){
+	if (NOT amount)
+		return 0;
+	uint8_t exponent = 0;
+	while (NOT (amount % 10) && exponent < 9) {
+		amount /= 10;
+		exponent++;
+	}
+	if (exponent < 9) {
+		uint8_t lastDigit = amount % 10;
+		amount /= 10;
+		return 1 + (amount * 9 + lastDigit - 1) * 10 + exponent;
+	}
+	return 1 + (amount - 1) * 10 + 9;
+}
+uint64_t CBBlockChainStorageDecompressAmount(uint64_t compressed){
+	if (NOT compressed)
+		return 0;
+	compressed--;
+	uint8_t exponent = compressed % 10;
+	compressed /= 10;
+	uint64_t amount;
+	if (exponent < 9) {
+		uint8_t lastDigit = compressed % 9 + 1;
+		compressed /= 9;
+		amount = compressed * 10 + lastDigit;
+	}else
+		amount = compressed + 1;
+	while (exponent--)
+		amount *= 10;
+	return amount;
+}
+bool CBBlockChainStorageDeleteBlock(void * validator, uint32_t blockID){
 	CBFullValidator * validatorObj = validator;
-	CBDatabase * database = (CBDatabase *)validatorObj->storage;
-	// Delete from storage
-	CB_BLOCK_KEY[2] = branch;
-	CBInt32ToArray(CB_BLOCK_KEY, 3, blockIndex);
-	// Get hash
-	if (NOT CBDatabaseReadValue(database, CB_BLOCK_KEY, CB_DATA_ARRAY, 20, CB_BLOCK_HASH)) {
-		CBLogError("Could not obtain a block hash from the block chain database.");
+	uint8_t index[CB_BLOCK_INDEX_SIZE];
+	CBInt32ToArray(CB_BLOCK_KEY, 2, blockID);
+	if (NOT CBBlockChainStorageReleaseBlock((CBBlockChainStorage *)validatorObj->storage, index)) {
+		CBLogError("Could not release a block being deleted from its block file.");
 		return false;
 	}
-	// Remove data
-	if (NOT CBDatabaseRemoveValue(database, CB_BLOCK_KEY)){
+	if (NOT CBDatabaseRemoveValue((CBDatabase *)validatorObj->storage, CB_BLOCK_KEY)){
 		CBLogError("Could not remove block value from database.");
 		return false;
 	}
-	// Remove hash index reference
-	memcpy(CB_BLOCK_HASH_INDEX_KEY + 2, CB_DATA_ARRAY, 20);
-	if (NOT CBDatabaseRemoveValue(database, CB_BLOCK_HASH_INDEX_KEY)){
-		CBLogError("Could not remove block hash index reference from database.");
-		return false;
-	}
 	return true;
 }
-bool CBBlockChainStorageDeleteUnspentOutput(void * validator, uint8_t * txHash, uint32_t outputIndex, bool decrement){
+bool CBBlockChainStorageDeleteUnspentOutput(void * validator, uint8_t * txHash, uint32_t outputIndex){
 	CBFullValidator * validatorObj = validator;
 	CBDatabase * database = (CBDatabase *)validatorObj->storage;
+	CBBlockChainStorageClearPrefetched((CBBlockChainStorage *)database);
 	// Place transaction hash into the key
 	memcpy(CB_UNSPENT_OUTPUT_KEY + 2, txHash, 32);
 	// Place output index into the key
@@ -98,128 +664,352 @@ bool CBBlockChainStorageDeleteUnspentOutput(void * validator, uint8_t * txHash,
 		CBLogError("Could not remove an unspent output reference from storage.");
 		return false;
 	}
-	if (decrement
-		// For the transaction, decrement the number of unspent outputs
-		&& NOT CBBlockChainStorageChangeUnspentOutputsNum(database, txHash, -1)) {
-		CBLogError("Could not decrement the number of unspent outputs for a transaction.");
-		return false;
-	}
 	return true;
 }
-bool CBBlockChainStorageDeleteTransactionRef(void * validator, uint8_t * txHash){
+bool CBBlockChainStorageDeleteTransactionRef(void * validator, uint8_t * txHash, uint32_t blockID){
 	CBFullValidator * validatorObj = validator;
 	CBDatabase * database = (CBDatabase *)validatorObj->storage;
-	// Place transaction hash into the key
-	memcpy(CB_TRANSACTION_INDEX_KEY + 2, txHash, 32);
-	// Read the instance count
-	if (NOT CBDatabaseReadValue(database, CB_TRANSACTION_INDEX_KEY, CB_DATA_ARRAY, 22, 0)) {
-		CBLogError("Could not read a transaction reference from storage.");
-		return false;
-	}
-	uint32_t txInstanceNum = CB_DATA_ARRAY[CB_TRANSACTION_REF_INSTANCE_COUNT] - 1;
-	if (txInstanceNum) {
-		// There are still more instances of this transaction. Do not remove the transaction, only make the unspent output number equal to zero and decrement the instance count.
-		CB_DATA_ARRAY[CB_TRANSACTION_REF_NUM_UNSPENT_OUTPUTS] = 0;
-		CB_DATA_ARRAY[CB_TRANSACTION_REF_INSTANCE_COUNT] = txInstanceNum;
-		// Write to storage.
-		if (NOT CBDatabaseWriteValue(database, CB_TRANSACTION_INDEX_KEY, CB_DATA_ARRAY, 22)) {
-			CBLogError("Could not update a transaction reference for deleting an instance.");
-			return false;
+	uint32_t length;
+	uint8_t * value = CBBlockChainStorageReadTransactionIndex(database, txHash, &length);
+	if (NOT value)
+		return false;
+	// Find the entry for the transaction in the block
+	uint64_t fields[3];
+	for (uint32_t cursor = 0; cursor < length;) {
+		uint32_t start = cursor;
+		if (NOT CBBlockChainStorageReadTransactionEntry(value, length, &cursor, fields)) {
+			CBLogError("A transaction index value is corrupt.");
+			break;
 		}
-	}else{
-		// This was the last instance.
-		// Remove from storage
-		if (NOT CBDatabaseRemoveValue(database, CB_TRANSACTION_INDEX_KEY)) {
-			CBLogError("Could not remove a transaction reference from storage.");
-			return false;
+		if (memcmp(value + start, txHash + CB_TRANSACTION_INDEX_KEY_HASH, CB_TRANSACTION_INDEX_CHECK_HASH)
+			|| CBArrayToInt32(value, start + CB_TRANSACTION_INDEX_CHECK_HASH) != blockID)
+			continue;
+		bool ok;
+		if (cursor - start == length)
+			// This was the only entry
+			ok = CBDatabaseRemoveValue(database, CB_COMPACT_TRANSACTION_INDEX_KEY);
+		else{
+			memmove(value + start, value + cursor, length - cursor);
+			ok = CBDatabaseWriteValue(database, CB_COMPACT_TRANSACTION_INDEX_KEY, value, length - (cursor - start));
 		}
+		free(value);
+		if (NOT ok)
+			CBLogError("Could not remove an entry from the transaction index.");
+		return ok;
 	}
-	return true;
+	free(value);
+	CBLogError("Could not find the transaction index entry for a transaction in a block.");
+	return false;
 }
 bool CBBlockChainStorageExists(uint64_t iself){
 	return CBDatabaseGetLength((CBDatabase *)iself, CB_VALIDATOR_INFO_KEY);
 }
-bool CBBlockChainStorageGetBlockLocation(void * validator, uint8_t * blockHash, uint8_t * branch, uint32_t * index){
+bool CBBlockChainStorageExportUnspentOutputs(void * validator, char * filename, uint8_t * commitment){
 	CBFullValidator * validatorObj = validator;
 	CBDatabase * database = (CBDatabase *)validatorObj->storage;
-	memcpy(CB_BLOCK_HASH_INDEX_KEY + 2, blockHash, 20);
-	if (NOT CBDatabaseReadValue(database, CB_BLOCK_HASH_INDEX_KEY, CB_DATA_ARRAY, 5, 0)) {
-		CBLogError("Could not read a block hash reference from the block chain database.");
+	FILE * file = fopen(filename, "wb");
+	if (NOT file) {
+		CBLogError("Could not open %s to write a snapshot.", filename);
 		return false;
 	}
-	*branch = CB_DATA_ARRAY[CB_BLOCK_HASH_REF_BRANCH];
-	*index = CBArrayToInt32(CB_DATA_ARRAY, CB_BLOCK_HASH_REF_INDEX);
-	return true;
-}
-uint32_t CBBlockChainStorageGetBlockTime(void * validator, uint8_t branch, uint32_t blockIndex){
-	CBFullValidator * validatorObj = validator;
-	CBDatabase * database = (CBDatabase *)validatorObj->storage;
-	CB_BLOCK_KEY[2] = branch;
-	CBInt32ToArray(CB_BLOCK_KEY, 3, blockIndex);
-	if (NOT CBDatabaseReadValue(database, CB_BLOCK_KEY, CB_DATA_ARRAY, 4, CB_BLOCK_TIME)) {
-		CBLogError("Could not read the time for a block.");
-		return 0;
+	// Count the unspent outputs for the start of the snapshot
+	uint64_t numOutputs = 0;
+	CBPosition it;
+	if (CBAssociativeArrayGetFirst(&database->index, &it)) for (;;) {
+		uint8_t * key = it.node->elements[it.index];
+		if (key[0] == 37 && key[1] == CB_STORAGE_UNSPENT_OUTPUT && ((CBIndexValue *)(key + 38))->length)
+			numOutputs++;
+		if (CBAssociativeArrayIterate(&database->index, &it))
+			break;
 	}
-	return CBArrayToInt32(CB_DATA_ARRAY, 0);
-}
-uint32_t CBBlockChainStorageGetBlockTarget(void * validator, uint8_t branch, uint32_t blockIndex){
-	CBFullValidator * validatorObj = validator;
-	CBDatabase * database = (CBDatabase *)validatorObj->storage;
-	CB_BLOCK_KEY[2] = branch;
-	CBInt32ToArray(CB_BLOCK_KEY, 3, blockIndex);
-	if (NOT CBDatabaseReadValue(database, CB_BLOCK_KEY, CB_DATA_ARRAY, 4, CB_BLOCK_TARGET)) {
-		CBLogError("Could not read the target for a block.");
-		return 0;
+	uint32_t height = validatorObj->mainTip->height;
+	uint8_t header[CB_SNAPSHOT_HEADER_SIZE];
+	CBInt32ToArray(header, 0, CB_SNAPSHOT_MAGIC);
+	CBInt32ToArray(header, 4, CB_SNAPSHOT_VERSION);
+	CBInt32ToArray(header, 8, height);
+	CBInt64ToArray(header, 12, numOutputs);
+	if (fwrite(header, CB_SNAPSHOT_HEADER_SIZE, 1, file) != 1) {
+		CBLogError("Could not write the start of a snapshot.");
+		return CBBlockChainStorageCloseSnapshot(file, filename, false);
+	}
+	for (uint32_t x = 0; x <= height; x++) {
+		uint8_t blockHeader[80];
+		if (NOT CBBlockChainStorageLoadBlockHeader(validator, validatorObj->mainChain[x]->blockID, blockHeader)
+			|| fwrite(blockHeader, 80, 1, file) != 1) {
+			CBLogError("Could not write the header at height %u to a snapshot.", x);
+			return CBBlockChainStorageCloseSnapshot(file, filename, false);
+		}
 	}
-	return CBArrayToInt32(CB_DATA_ARRAY, 0);
+	CBBlockChainStorageStartCommitment(commitment, validatorObj->mainTip->hash, height);
+	// The index is sorted, so the unspent outputs are written in order.
+	uint8_t * data = NULL;
+	uint32_t dataAllocSize = 0;
+	bool ok = true;
+	if (CBAssociativeArrayGetFirst(&database->index, &it)) for (;;) {
+		uint8_t * key = it.node->elements[it.index];
+		uint32_t length = key[0] == 37 && key[1] == CB_STORAGE_UNSPENT_OUTPUT ? ((CBIndexValue *)(key + 38))->length : 0;
+		if (length) {
+			if (length + 78 > dataAllocSize) {
+				dataAllocSize = length + 78;
+				uint8_t * newData = realloc(data, dataAllocSize);
+				if (NOT newData) {
+					CBLogError("Could not allocate memory for writing an unspent output to a snapshot.");
+					ok = false;
+					break;
+				}
+				data = newData;
+			}
+			// After space for the commitment, the hash and output index from the key and then the record.
+			memcpy(data + 32, key + 2, 36);
+			uint8_t entryLen = 36 + CBBlockChainStorageWriteVarInt(data + 68, length);
+			if (NOT CBDatabaseReadValue(database, key, data + 32 + entryLen, length, 0)) {
+				CBLogError("Could not read an unspent output for a snapshot.");
+				ok = false;
+				break;
+			}
+			if (fwrite(data + 32, entryLen + length, 1, file) != 1) {
+				CBLogError("Could not write an unspent output to a snapshot.");
+				ok = false;
+				break;
+			}
+			if (NOT CBBlockChainStorageAddToCommitment(commitment, data, entryLen + length)) {
+				ok = false;
+				break;
+			}
+		}
+		if (CBAssociativeArrayIterate(&database->index, &it))
+			break;
+	}
+	free(data);
+	if (ok && fwrite(commitment, 32, 1, file) != 1) {
+		CBLogError("Could not write the commitment to a snapshot.");
+		ok = false;
+	}
+	return CBBlockChainStorageCloseSnapshot(file, filename, ok);
 }
-bool CBBlockChainStorageIsTransactionWithUnspentOutputs(void * validator, uint8_t * txHash, bool * exists){
-	CBFullValidator * validatorObj = validator;
-	CBDatabase * database = (CBDatabase *)validatorObj->storage;
-	// Place transaction hash into the key
-	memcpy(CB_TRANSACTION_INDEX_KEY + 2, txHash, 32);
-	// See if the transaction exists
-	if (NOT CBDatabaseGetLength(database, CB_TRANSACTION_INDEX_KEY)){
-		*exists = false;
-		return true;
+bool CBBlockChainStorageImportUnspentOutputs(uint64_t iself, char * filename, uint8_t * commitment, CBFullValidatorFlags flags){
+	CBDatabase * database = (CBDatabase *)iself;
+	if (NOT commitment) {
+		CBLogError("A snapshot can only be imported with a trusted commitment.");
+		return false;
+	}
+	if (CBBlockChainStorageExists(iself)) {
+		CBLogError("A snapshot can only be imported into new storage.");
+		return false;
+	}
+	FILE * file = fopen(filename, "rb");
+	if (NOT file) {
+		CBLogError("Could not open the snapshot %s.", filename);
+		return false;
+	}
+	uint8_t header[CB_SNAPSHOT_HEADER_SIZE];
+	if (fread(header, CB_SNAPSHOT_HEADER_SIZE, 1, file) != 1
+		|| CBArrayToInt32(header, 0) != CB_SNAPSHOT_MAGIC
+		|| CBArrayToInt32(header, 4) != CB_SNAPSHOT_VERSION) {
+		CBLogError("%s is not a snapshot of the unspent outputs.", filename);
+		fclose(file);
+		return false;
+	}
+	uint32_t height = CBArrayToInt32(header, 8);
+	uint64_t numOutputs = CBArrayToInt64(header, 12);
+	// The headers are stored as pruned blocks, and must start with the genesis block, link together and have the work the validator would require.
+	CBBlock * genesis = CBNewBlockGenesis();
+	if (NOT genesis) {
+		fclose(file);
+		return false;
 	}
-	// Now see if the transaction has unspent outputs
-	if (NOT CBDatabaseReadValue(database, CB_TRANSACTION_INDEX_KEY, CB_DATA_ARRAY, 4, CB_TRANSACTION_REF_NUM_UNSPENT_OUTPUTS)) {
-		CBLogError("Could not read the number of unspent outputs for a transaction.");
+	uint8_t hash[32], hash2[32];
+	uint32_t batch = 0, prevTarget = 0, prevTime = 0, retargetTime = 0;
+	bool ok = true;
+	for (uint32_t x = 0; x <= height; x++) {
+		uint8_t blockHeader[80];
+		if (fread(blockHeader, 80, 1, file) != 1) {
+			CBLogError("The snapshot ends before the header at height %u.", x);
+			ok = false;
+			break;
+		}
+		if (x && memcmp(blockHeader + 4, hash, 32)) {
+			CBLogError("The header at height %u in the snapshot does not follow the previous header.", x);
+			ok = false;
+			break;
+		}
+		CBSha256(blockHeader, 80, hash2);
+		CBSha256(hash2, 32, hash);
+		if (NOT x && memcmp(hash, CBBlockGetHash(genesis), 32)) {
+			CBLogError("The snapshot is for a different block-chain.");
+			ok = false;
+			break;
+		}
+		uint32_t target = CBArrayToInt32(blockHeader, 72), time = CBArrayToInt32(blockHeader, 68);
+		if (x) {
+			// The target changes every 2016 blocks as in CBFullValidatorGetNextTarget.
+			if (target != (x % 2016 ? prevTarget : CBCalculateTarget(prevTarget, prevTime - retargetTime))) {
+				CBLogError("The header at height %u in the snapshot has the wrong target.", x);
+				ok = false;
+				break;
+			}
+			if (NOT (flags & CB_FULL_VALIDATOR_DISABLE_POW_CHECK) && NOT CBValidateProofOfWork(hash, target)) {
+				CBLogError("The header at height %u in the snapshot does not meet its target.", x);
+				ok = false;
+				break;
+			}
+		}
+		if (NOT (x % 2016))
+			retargetTime = time;
+		prevTarget = target;
+		prevTime = time;
+		CBInt32ToArray(CB_BLOCK_KEY, 2, x);
+		if (NOT CBDatabaseWriteValue(database, CB_BLOCK_KEY, blockHeader, 80)) {
+			CBLogError("Could not write a header from a snapshot.");
+			ok = false;
+			break;
+		}
+		if (++batch == CB_MIGRATION_BATCH) {
+			if (NOT CBDatabaseCommit(database)) {
+				CBLogError("Could not commit headers from a snapshot.");
+				fclose(file);
+				CBReleaseObject(genesis);
+				return false;
+			}
+			batch = 0;
+		}
+	}
+	CBReleaseObject(genesis);
+	if (NOT ok) {
+		CBDatabaseClearPending(database);
+		fclose(file);
+		return false;
+	}
+	uint8_t expected[32];
+	CBBlockChainStorageStartCommitment(expected, hash, height);
+	// Write the unspent outputs as they are read, committing in batches.
+	uint8_t * data = NULL;
+	uint32_t dataAllocSize = 0;
+	uint8_t lastKey[36];
+	batch = 0;
+	for (uint64_t x = 0; x < numOutputs; x++) {
+		uint64_t length;
+		if (fread(CB_UNSPENT_OUTPUT_KEY + 2, 36, 1, file) != 1
+			|| NOT CBBlockChainStorageReadSnapshotVarInt(file, &length)
+			|| length > UINT16_MAX) {
+			CBLogError("The snapshot ends or is corrupt at unspent output %llu.", (unsigned long long)x);
+			ok = false;
+			break;
+		}
+		// Being in order ensures there are no duplicates.
+		if (x && memcmp(CB_UNSPENT_OUTPUT_KEY + 2, lastKey, 36) <= 0) {
+			CBLogError("The unspent outputs in the snapshot are not in order.");
+			ok = false;
+			break;
+		}
+		memcpy(lastKey, CB_UNSPENT_OUTPUT_KEY + 2, 36);
+		if (length + 78 > dataAllocSize) {
+			dataAllocSize = (uint32_t)length + 78;
+			uint8_t * newData = realloc(data, dataAllocSize);
+			if (NOT newData) {
+				CBLogError("Could not allocate memory for reading an unspent output from a snapshot.");
+				ok = false;
+				break;
+			}
+			data = newData;
+		}
+		memcpy(data + 32, lastKey, 36);
+		uint8_t entryLen = 36 + CBBlockChainStorageWriteVarInt(data + 68, length);
+		if (fread(data + 32 + entryLen, length, 1, file) != 1) {
+			CBLogError("The snapshot ends at unspent output %llu.", (unsigned long long)x);
+			ok = false;
+			break;
+		}
+		if (NOT CBDatabaseWriteValue(database, CB_UNSPENT_OUTPUT_KEY, data + 32 + entryLen, (uint32_t)length)) {
+			CBLogError("Could not write an unspent output from a snapshot.");
+			ok = false;
+			break;
+		}
+		if (NOT CBBlockChainStorageAddToCommitment(expected, data, entryLen + (uint32_t)length)) {
+			ok = false;
+			break;
+		}
+		if (++batch == CB_MIGRATION_BATCH) {
+			if (NOT CBDatabaseCommit(database)) {
+				CBLogError("Could not commit unspent outputs from a snapshot.");
+				free(data);
+				fclose(file);
+				return false;
+			}
+			batch = 0;
+		}
+	}
+	free(data);
+	uint8_t fileCommitment[32];
+	if (ok && (fread(fileCommitment, 32, 1, file) != 1 || fgetc(file) != EOF)) {
+		CBLogError("The snapshot does not end with the commitment.");
+		ok = false;
+	}
+	fclose(file);
+	if (ok && (memcmp(fileCommitment, expected, 32) || memcmp(commitment, expected, 32))) {
+		CBLogError("The unspent outputs in the snapshot do not match the commitment.");
+		ok = false;
+	}
+	if (NOT ok) {
+		CBDatabaseClearPending(database);
+		return false;
+	}
+	// The validator information goes last, so that the storage is only used once everything is imported.
+	CBInt32ToArray(CB_DATA_ARRAY, CB_VALIDATION_MAIN_TIP, height);
+	CBInt32ToArray(CB_DATA_ARRAY, CB_VALIDATION_NEXT_BLOCK_ID, height + 1);
+	CBInt32ToArray(CB_DATA_ARRAY, CB_VALIDATION_VERSION, CB_BLOCK_CHAIN_STORAGE_VERSION);
+	if (NOT CBDatabaseWriteValue(database, CB_VALIDATOR_INFO_KEY, CB_DATA_ARRAY, CB_VALIDATION_SIZE)
+		|| NOT CBDatabaseCommit(database)) {
+		CBLogError("Could not commit the validator information for a snapshot.");
 		return false;
 	}
-	*exists = CBArrayToInt32(CB_DATA_ARRAY, 0);
 	return true;
 }
-bool CBBlockChainStorageLoadBasicValidator(void * validator){
+bool CBBlockChainStorageLoadBasicValidator(void * validator, uint32_t * mainTip){
 	CBFullValidator * validatorObj = validator;
 	CBDatabase * database = (CBDatabase *)validatorObj->storage;
-	if (NOT CBDatabaseReadValue(database, CB_VALIDATOR_INFO_KEY, CB_DATA_ARRAY, 4, 0)){
+	if (CBDatabaseGetLength(database, CB_VALIDATOR_INFO_KEY) < CB_VALIDATION_SIZE) {
+		CBLogError("The unspent outputs are stored as references into the blocks. The database needs migrating with CBBlockChainStorageMigrateUnspentOutputs.");
+		return false;
+	}
+	if (NOT CBDatabaseReadValue(database, CB_VALIDATOR_INFO_KEY, CB_DATA_ARRAY, CB_VALIDATION_SIZE, 0)){
 		CBLogError("There was an error when reading the validator information from storage.");
 		return false;
 	}
-	validatorObj->firstOrphan = CB_DATA_ARRAY[CB_VALIDATION_FIRST_ORPHAN];
-	validatorObj->numOrphans = CB_DATA_ARRAY[CB_VALIDATION_NUM_ORPHANS];
-	validatorObj->mainBranch = CB_DATA_ARRAY[CB_VALIDATION_MAIN_BRANCH];
-	validatorObj->numBranches = CB_DATA_ARRAY[CB_VALIDATION_NUM_BRANCHES];
+	if (CBArrayToInt32(CB_DATA_ARRAY, CB_VALIDATION_VERSION) == 1) {
+		CBLogError("The blocks are stored in the database. The database needs migrating with CBBlockChainStorageMigrateBlocks.");
+		return false;
+	}
+	if (CBArrayToInt32(CB_DATA_ARRAY, CB_VALIDATION_VERSION) == 2) {
+		CBLogError("The transaction index has the old format. The database needs migrating with CBBlockChainStorageMigrateTransactionIndex.");
+		return false;
+	}
+	if (CBArrayToInt32(CB_DATA_ARRAY, CB_VALIDATION_VERSION) != CB_BLOCK_CHAIN_STORAGE_VERSION) {
+		CBLogError("The block-chain database has an unknown version.");
+		return false;
+	}
+	*mainTip = CBArrayToInt32(CB_DATA_ARRAY, CB_VALIDATION_MAIN_TIP);
+	validatorObj->nextBlockID = CBArrayToInt32(CB_DATA_ARRAY, CB_VALIDATION_NEXT_BLOCK_ID);
 	return true;
 }
-void * CBBlockChainStorageLoadBlock(void * validator, uint32_t blockID, uint32_t branch){
+void * CBBlockChainStorageLoadBlock(void * validator, uint32_t blockID){
 	CBFullValidator * validatorObj = validator;
 	CBDatabase * database = (CBDatabase *)validatorObj->storage;
-	CB_BLOCK_KEY[2] = branch;
-	CBInt32ToArray(CB_BLOCK_KEY, 3, blockID);
-	uint32_t blockDataLen = CBDatabaseGetLength(database, CB_BLOCK_KEY);
-	if (NOT blockDataLen)
+	CBInt32ToArray(CB_BLOCK_KEY, 2, blockID);
+	uint32_t indexLen = CBDatabaseGetLength(database, CB_BLOCK_KEY);
+	if (NOT indexLen)
 		return NULL;
-	blockDataLen -= CB_BLOCK_START;
+	if (indexLen == 80) {
+		CBLogError("Block %u has been pruned.", blockID);
+		return NULL;
+	}
 	// Get block data
-	CBByteArray * data = CBNewByteArrayOfSize(blockDataLen);
+	CBByteArray * data = CBNewByteArrayOfSize(CBBlockChainStorageBlockSize(validator, blockID));
 	if (NOT data) {
 		CBLogError("Could not initialise a byte array for loading a block.");
 		return NULL;
 	}
-	if (NOT CBDatabaseReadValue(database, CB_BLOCK_KEY, CBByteArrayGetData(data), blockDataLen, CB_BLOCK_START)){
+	if (NOT CBBlockChainStorageReadBlock((CBBlockChainStorage *)database, blockID, CBByteArrayGetData(data), data->length, 0)){
 		CBLogError("Could not read a block from the database.");
 		CBReleaseObject(data);
 		return NULL;
@@ -233,91 +1023,59 @@ void * CBBlockChainStorageLoadBlock(void * validator, uint32_t blockID, uint32_t
 	}
 	return block;
 }
-bool CBBlockChainStorageLoadBranch(void * validator, uint8_t branchNum){
+bool CBBlockChainStorageLoadBlockHeader(void * validator, uint32_t blockID, uint8_t * header){
 	CBFullValidator * validatorObj = validator;
 	CBDatabase * database = (CBDatabase *)validatorObj->storage;
-	// Get simple information
-	CB_BRANCH_KEY[2] = branchNum;
-	if (NOT CBDatabaseReadValue(database, CB_BRANCH_KEY, CB_DATA_ARRAY, 21, 0)) {
-		CBLogError("There was an error when reading the data for a branch's information.");
-		return false;
-	}
-	validatorObj->branches[branchNum].lastRetargetTime = CBArrayToInt32(CB_DATA_ARRAY, CB_BRANCH_LAST_RETARGET);
-	validatorObj->branches[branchNum].lastValidation = CBArrayToInt32(CB_DATA_ARRAY, CB_BRANCH_LAST_VALIDATION);
-	validatorObj->branches[branchNum].numBlocks = CBArrayToInt32(CB_DATA_ARRAY, CB_BRANCH_NUM_BLOCKS);
-	validatorObj->branches[branchNum].parentBlockIndex = CBArrayToInt32(CB_DATA_ARRAY, CB_BRANCH_PARENT_BLOCK_INDEX);
-	validatorObj->branches[branchNum].parentBranch = CB_DATA_ARRAY[CB_BRANCH_PARENT_BRANCH];
-	validatorObj->branches[branchNum].startHeight = CBArrayToInt32(CB_DATA_ARRAY, CB_BRANCH_START_HEIGHT);
-	validatorObj->branches[branchNum].working = false; // Start off not working on any branch.
-	return true;
-}
-bool CBBlockChainStorageLoadBranchWork(void * validator, uint8_t branchNum){
-	CBFullValidator * validatorObj = validator;
-	CBDatabase * database = (CBDatabase *)validatorObj->storage;
-	// Get work
-	CB_WORK_KEY[2] = branchNum;
-	uint8_t workLen = CBDatabaseGetLength(database, CB_WORK_KEY);
-	if (NOT CBBigIntAlloc(&validatorObj->branches[branchNum].work, workLen)){
-		CBLogError("There was an error when allocating memory for a branch's work.");
-		return false;
-	}
-	validatorObj->branches[branchNum].work.length = workLen;
-	if (NOT CBDatabaseReadValue(database, CB_WORK_KEY, validatorObj->branches[branchNum].work.data, workLen, 0)) {
-		CBLogError("There was an error when reading the work for a branch.");
-		free(validatorObj->branches[branchNum].work.data);
+	CBInt32ToArray(CB_BLOCK_KEY, 2, blockID);
+	if (NOT CBDatabaseReadValue(database, CB_BLOCK_KEY, header, 80, 0)) {
+		CBLogError("Could not read the header for a block.");
 		return false;
 	}
 	return true;
 }
-bool CBBlockChainStorageLoadOrphan(void * validator, uint8_t orphanNum){
+bool CBBlockChainStorageLoadOutputs(void * validator, uint8_t * txHash, uint8_t ** data, uint32_t * dataAllocSize, uint32_t * position, uint32_t * height, bool * coinbase){
 	CBFullValidator * validatorObj = validator;
 	CBDatabase * database = (CBDatabase *)validatorObj->storage;
-	CB_ORPHAN_KEY[2] = orphanNum;
-	uint32_t len = CBDatabaseGetLength(database, CB_ORPHAN_KEY);
-	CBByteArray * orphanData = CBNewByteArrayOfSize(len);
-	if (NOT orphanData) {
-		CBLogError("There was an error when initialising a byte array for an orphan.");
-		return false;
-	}
-	if (NOT CBDatabaseReadValue(database, CB_ORPHAN_KEY, CBByteArrayGetData(orphanData), len, 0)) {
-		CBLogError("There was an error when reading the data for an orphan.");
-		CBReleaseObject(orphanData);
-		return false;
-	}
-	validatorObj->orphans[orphanNum] = CBNewBlockFromData(orphanData);
-        CBBlockDeserialise(validatorObj->orphans[orphanNum], true);
-	if (NOT validatorObj->orphans[orphanNum]) {
-		CBLogError("There was an error when creating a block object for an orphan.");
-		CBReleaseObject(orphanData);
+	uint32_t length;
+	uint8_t * value = CBBlockChainStorageReadTransactionIndex(database, txHash, &length);
+	if (NOT value)
 		return false;
+	// Use the last entry for the transaction, which is the latest instance of it.
+	uint64_t fields[3], found[3];
+	uint32_t blockID;
+	bool exists = false;
+	for (uint32_t cursor = 0; cursor < length;) {
+		uint32_t start = cursor;
+		if (NOT CBBlockChainStorageReadTransactionEntry(value, length, &cursor, fields)) {
+			CBLogError("A transaction index value is corrupt.");
+			free(value);
+			return false;
+		}
+		if (memcmp(value + start, txHash + CB_TRANSACTION_INDEX_KEY_HASH, CB_TRANSACTION_INDEX_CHECK_HASH))
+			continue;
+		exists = true;
+		memcpy(found, fields, sizeof(fields));
+		blockID = CBArrayToInt32(value, start + CB_TRANSACTION_INDEX_CHECK_HASH);
+		*coinbase = value[cursor - 1];
 	}
-	CBReleaseObject(orphanData);
-	return true;
-}
-bool CBBlockChainStorageLoadOutputs(void * validator, uint8_t * txHash, uint8_t ** data, uint32_t * dataAllocSize, uint32_t * position){
-	CBFullValidator * validatorObj = validator;
-	CBDatabase * database = (CBDatabase *)validatorObj->storage;
-	memcpy(CB_TRANSACTION_INDEX_KEY + 2, txHash, 32);
-	if (NOT CBDatabaseReadValue(database, CB_TRANSACTION_INDEX_KEY, CB_DATA_ARRAY, 14, 0)) {
-		CBLogError("Could not read a transaction reference from the transaction index.");
+	free(value);
+	if (NOT exists) {
+		CBLogError("A transaction is not in the transaction index.");
 		return false;
 	}
-	// Set position of outputs
-	*position = CBArrayToInt32(CB_DATA_ARRAY, CB_TRANSACTION_REF_POSITION_OUPTUTS);
-	// Get transaction to find position for output in the block
+	*height = (uint32_t)found[0];
+	*position = (uint32_t)found[1];
 	// Reallocate transaction data memory if needed.
-	if (CBArrayToInt32(CB_DATA_ARRAY, CB_TRANSACTION_REF_LENGTH_OUTPUTS) > *dataAllocSize) {
-		*dataAllocSize = CBArrayToInt32(CB_DATA_ARRAY, CB_TRANSACTION_REF_LENGTH_OUTPUTS);
+	if (found[2] > *dataAllocSize) {
+		*dataAllocSize = (uint32_t)found[2];
 		*data = realloc(*data, *dataAllocSize);
 		if (NOT *data) {
 			CBLogError("Could not allocate memory for reading a transaction.");
 			return false;
 		}
 	}
-	// Read transaction from the block
-	CB_BLOCK_KEY[2] = CB_DATA_ARRAY[CB_TRANSACTION_REF_BRANCH];
-	memcpy(CB_BLOCK_KEY + 3, CB_DATA_ARRAY + CB_TRANSACTION_REF_BLOCK_INDEX, 4);
-	if (NOT CBDatabaseReadValue(database, CB_BLOCK_KEY, *data, CBArrayToInt32(CB_DATA_ARRAY, CB_TRANSACTION_REF_LENGTH_OUTPUTS), CB_BLOCK_START + *position)) {
+	// Read the outputs from the block
+	if (NOT CBBlockChainStorageReadBlock((CBBlockChainStorage *)database, blockID, *data, (uint32_t)found[2], *position)) {
 		CBLogError("Could not read a transaction from the block-chain database.");
 		return false;
 	}
@@ -326,197 +1084,478 @@ bool CBBlockChainStorageLoadOutputs(void * validator, uint8_t * txHash, uint8_t
 void * CBBlockChainStorageLoadUnspentOutput(void * validator, uint8_t * txHash, uint32_t outputIndex, bool * coinbase, uint32_t * outputHeight){
 	CBFullValidator * validatorObj = validator;
 	CBDatabase * database = (CBDatabase *)validatorObj->storage;
-	// First read data for the unspent output key.
 	memcpy(CB_UNSPENT_OUTPUT_KEY + 2, txHash, 32);
 	CBInt32ToArray(CB_UNSPENT_OUTPUT_KEY, 34, outputIndex);
-	if (NOT CBDatabaseReadValue(database, CB_UNSPENT_OUTPUT_KEY, CB_DATA_ARRAY, 8, 0)) {
-		CBLogError("Cannot read unspent output information from the block chain database");
-		return NULL;
-	}
-	uint32_t outputPosition = CBArrayToInt32(CB_DATA_ARRAY, CB_UNSPENT_OUTPUT_REF_POSITION);
-	uint32_t outputLength = CBArrayToInt32(CB_DATA_ARRAY, CB_UNSPENT_OUTPUT_REF_LENGTH);
-	// Now read data for the transaction
-	memcpy(CB_TRANSACTION_INDEX_KEY + 2, txHash, 32);
-	if (NOT CBDatabaseReadValue(database, CB_TRANSACTION_INDEX_KEY, CB_DATA_ARRAY, 14, 0)) {
-		CBLogError("Cannot read a transaction reference from the transaction index.");
-		return NULL;
+	// Most records are for templated scripts and fit on the stack.
+	uint8_t stackData[64];
+	uint8_t * data;
+	uint32_t length;
+	uint8_t * prefetched = CBBlockChainStorageFindPrefetched((CBBlockChainStorage *)database);
+	if (prefetched) {
+		length = CBArrayToInt32(prefetched, 0);
+		data = prefetched + 4;
+		if (NOT length) {
+			CBLogError("Cannot load an unspent output which was prefetched as not existing.");
+			return NULL;
+		}
+	}else{
+		length = CBDatabaseGetLength(database, CB_UNSPENT_OUTPUT_KEY);
+		data = length <= sizeof(stackData) ? stackData : malloc(length);
+		if (NOT data) {
+			CBLogError("Could not allocate %u bytes of memory for an unspent output record.", length);
+			return NULL;
+		}
+		if (NOT length || NOT CBDatabaseReadValue(database, CB_UNSPENT_OUTPUT_KEY, data, length, 0)) {
+			CBLogError("Cannot read an unspent output record from the block chain database.");
+			if (data != stackData)
+				free(data);
+			return NULL;
+		}
 	}
-	uint8_t outputBranch = CB_DATA_ARRAY[CB_TRANSACTION_REF_BRANCH];
-	uint32_t outputBlockIndex = CBArrayToInt32(CB_DATA_ARRAY, CB_TRANSACTION_REF_BLOCK_INDEX);
-	// Set coinbase
-	*coinbase = CB_DATA_ARRAY[CB_TRANSACTION_REF_IS_COINBASE];
-	// Set output height
-	*outputHeight = validatorObj->branches[outputBranch].startHeight + outputBlockIndex;
-	// Get the output from storage
-	CB_BLOCK_KEY[2] = outputBranch;
-	CBInt32ToArray(CB_BLOCK_KEY, 3, outputBlockIndex);
-	// Get output data
-	CBByteArray * outputBytes = CBNewByteArrayOfSize(outputLength);
-	if (NOT outputBytes) {
-		CBLogError("Could not create  CBByteArray for an unspent output.");
-		return NULL;
+	uint32_t cursor = 0;
+	uint64_t code, amount, type;
+	CBScript * script = NULL;
+	if (CBBlockChainStorageReadVarInt(data, length, &cursor, &code)
+		&& CBBlockChainStorageReadVarInt(data, length, &cursor, &amount)
+		&& CBBlockChainStorageReadVarInt(data, length, &cursor, &type)) {
+		if (type == CB_UNSPENT_OUTPUT_P2PKH && length - cursor == 20) {
+			script = CBNewScriptOfSize(25);
+			if (script) {
+				uint8_t * scriptData = CBByteArrayGetData(script);
+				scriptData[0] = CB_SCRIPT_OP_DUP;
+				scriptData[1] = CB_SCRIPT_OP_HASH160;
+				scriptData[2] = 20;
+				memcpy(scriptData + 3, data + cursor, 20);
+				scriptData[23] = CB_SCRIPT_OP_EQUALVERIFY;
+				scriptData[24] = CB_SCRIPT_OP_CHECKSIG;
+			}
+		}else if (type == CB_UNSPENT_OUTPUT_P2SH && length - cursor == 20) {
+			script = CBNewScriptOfSize(23);
+			if (script) {
+				uint8_t * scriptData = CBByteArrayGetData(script);
+				scriptData[0] = CB_SCRIPT_OP_HASH160;
+				scriptData[1] = 20;
+				memcpy(scriptData + 2, data + cursor, 20);
+				scriptData[22] = CB_SCRIPT_OP_EQUAL;
+			}
+		}else if (type >= CB_UNSPENT_OUTPUT_SCRIPT && type - CB_UNSPENT_OUTPUT_SCRIPT == length - cursor) {
+			script = CBNewScriptOfSize(length - cursor);
+			if (script && length - cursor)
+				memcpy(CBByteArrayGetData(script), data + cursor, length - cursor);
+		}
 	}
-	if (NOT CBDatabaseReadValue(database, CB_BLOCK_KEY, CBByteArrayGetData(outputBytes), outputLength, CB_BLOCK_START + outputPosition)) {
-		CBLogError("Could not read an unspent output");
-		CBReleaseObject(outputBytes);
+	if (NOT prefetched && data != stackData)
+		free(data);
+	if (NOT script) {
+		CBLogError("Could not read the script of an unspent output record.");
 		return NULL;
 	}
-	// Create output object
-	CBTransactionOutput * output = CBNewTransactionOutputFromData(outputBytes);
-	CBReleaseObject(outputBytes);
-	if (NOT output) {
+	*outputHeight = (uint32_t)(code >> 1);
+	*coinbase = code & 1;
+	CBTransactionOutput * output = CBNewTransactionOutput(CBBlockChainStorageDecompressAmount(amount), script);
+	CBReleaseObject(script);
+	if (NOT output)
 		CBLogError("Could not create an object for an unspent output");
-		return NULL;
+	return output;
+}
+bool CBBlockChainStorageMigrateBlocks(uint64_t iself){
+	CBBlockChainStorage * self = (CBBlockChainStorage *)iself;
+	CBDatabase * database = &self->base;
+	if (CBDatabaseGetLength(database, CB_VALIDATOR_INFO_KEY) != CB_VALIDATION_SIZE
+		|| NOT CBDatabaseReadValue(database, CB_VALIDATOR_INFO_KEY, CB_DATA_ARRAY, CB_VALIDATION_SIZE, 0)) {
+		CBLogError("The unspent outputs need migrating with CBBlockChainStorageMigrateUnspentOutputs before the blocks.");
+		return false;
 	}
-	if (NOT CBTransactionOutputDeserialise(output)) {
-		CBLogError("Could not deserialise an unspent output");
-		return NULL;
+	if (CBArrayToInt32(CB_DATA_ARRAY, CB_VALIDATION_VERSION) >= 2)
+		// Already migrated
+		return true;
+	if (CBArrayToInt32(CB_DATA_ARRAY, CB_VALIDATION_VERSION) != 1) {
+		CBLogError("The block-chain database is not recognised for migration.");
+		return false;
 	}
-	return output;
+	uint32_t nextBlockID = CBArrayToInt32(CB_DATA_ARRAY, CB_VALIDATION_NEXT_BLOCK_ID);
+	uint8_t * data = NULL;
+	uint32_t dataAllocSize = 0;
+	uint32_t batch = 0;
+	for (uint32_t x = 0; x < nextBlockID; x++) {
+		CBInt32ToArray(CB_BLOCK_KEY, 2, x);
+		uint32_t length = CBDatabaseGetLength(database, CB_BLOCK_KEY);
+		// Every block is longer than an index value, so this skips missing and pruned blocks, and blocks moved before an interrupted migration.
+		if (length <= CB_BLOCK_INDEX_SIZE)
+			continue;
+		if (length > dataAllocSize) {
+			uint8_t * newData = realloc(data, length);
+			if (NOT newData) {
+				CBLogError("Could not allocate %u bytes of memory for migrating a block.", length);
+				free(data);
+				CBBlockChainStorageReset(iself);
+				return false;
+			}
+			data = newData;
+			dataAllocSize = length;
+		}
+		if (NOT CBDatabaseReadValue(database, CB_BLOCK_KEY, data, length, 0)
+			|| NOT CBBlockChainStorageAppendBlock(self, data, length)) {
+			CBLogError("Could not move block %u to the block files.", x);
+			free(data);
+			CBBlockChainStorageReset(iself);
+			return false;
+		}
+		if (++batch == CB_BLOCK_MIGRATION_BATCH) {
+			if (NOT CBBlockChainStorageCommitData(iself)) {
+				CBLogError("Could not commit migrated blocks.");
+				free(data);
+				return false;
+			}
+			batch = 0;
+		}
+	}
+	free(data);
+	// Record the version with the last of the blocks.
+	if (NOT CBDatabaseReadValue(database, CB_VALIDATOR_INFO_KEY, CB_DATA_ARRAY, CB_VALIDATION_SIZE, 0)) {
+		CBLogError("Could not read the validator information for migration.");
+		CBBlockChainStorageReset(iself);
+		return false;
+	}
+	// The transaction references have the old format at version 2.
+	CBInt32ToArray(CB_DATA_ARRAY, CB_VALIDATION_VERSION, 2);
+	if (NOT CBDatabaseWriteValue(database, CB_VALIDATOR_INFO_KEY, CB_DATA_ARRAY, CB_VALIDATION_SIZE)
+		|| NOT CBBlockChainStorageCommitData(iself)) {
+		CBLogError("Could not write the storage version after migrating the blocks.");
+		return false;
+	}
+	return true;
 }
-bool CBBlockChainStorageMoveBlock(void * validator, uint8_t branch, uint32_t blockIndex, uint8_t newBranch, uint32_t newIndex){
-	CBFullValidator * validatorObj = validator;
-	CBDatabase * database = (CBDatabase *)validatorObj->storage;
-	CB_BLOCK_KEY[2] = branch;
-	CBInt32ToArray(CB_BLOCK_KEY, 3, blockIndex);
-	CB_NEW_BLOCK_KEY[2] = newBranch;
-	if (NOT CBDatabaseChangeKey(database, CB_BLOCK_KEY, CB_NEW_BLOCK_KEY)) {
-		CBLogError("Could not move a block location in the block-chain database.");
+bool CBBlockChainStorageMigrateTransactionIndex(uint64_t iself, bool keep){
+	CBDatabase * database = (CBDatabase *)iself;
+	if (CBDatabaseGetLength(database, CB_VALIDATOR_INFO_KEY) != CB_VALIDATION_SIZE
+		|| NOT CBDatabaseReadValue(database, CB_VALIDATOR_INFO_KEY, CB_DATA_ARRAY, CB_VALIDATION_SIZE, 0)
+		|| CBArrayToInt32(CB_DATA_ARRAY, CB_VALIDATION_VERSION) < 2) {
+		CBLogError("The blocks need migrating with CBBlockChainStorageMigrateBlocks before the transaction index.");
+		return false;
+	}
+	if (CBArrayToInt32(CB_DATA_ARRAY, CB_VALIDATION_VERSION) == CB_BLOCK_CHAIN_STORAGE_VERSION)
+		// Already migrated
+		return true;
+	if (CBArrayToInt32(CB_DATA_ARRAY, CB_VALIDATION_VERSION) != 2) {
+		CBLogError("The block-chain database is not recognised for migration.");
+		return false;
+	}
+	// The references are removed on each commit, so the iteration continues from the key after the last one migrated.
+	uint8_t nextKey[256];
+	uint32_t batch = 0;
+	CBPosition it;
+	bool end = NOT CBAssociativeArrayGetFirst(&database->index, &it);
+	while (NOT end) {
+		uint8_t * key = it.node->elements[it.index];
+		CBIndexValue * val = (CBIndexValue *)(key + *key + 1);
+		if (key[0] == 33 && key[1] == CB_STORAGE_TRANSACTION_INDEX && val->length) {
+			memcpy(CB_TRANSACTION_INDEX_KEY, key, 34);
+			if (NOT CBDatabaseReadValue(database, CB_TRANSACTION_INDEX_KEY, CB_DATA_ARRAY, CB_TRANSACTION_REF_SIZE, 0)
+				|| (keep && NOT CBBlockChainStorageAddTransactionEntry(database, key + 2, CBArrayToInt32(CB_DATA_ARRAY, CB_TRANSACTION_REF_BLOCK_ID), CBArrayToInt32(CB_DATA_ARRAY, CB_TRANSACTION_REF_HEIGHT), CBArrayToInt32(CB_DATA_ARRAY, CB_TRANSACTION_REF_POSITION_OUPTUTS), CBArrayToInt32(CB_DATA_ARRAY, CB_TRANSACTION_REF_LENGTH_OUTPUTS), CB_DATA_ARRAY[CB_TRANSACTION_REF_IS_COINBASE]))
+				|| NOT CBDatabaseRemoveValue(database, CB_TRANSACTION_INDEX_KEY)) {
+				CBLogError("Could not migrate a transaction reference.");
+				CBDatabaseClearPending(database);
+				return false;
+			}
+			batch++;
+		}
+		end = CBAssociativeArrayIterate(&database->index, &it);
+		if (batch == CB_MIGRATION_BATCH && NOT end) {
+			key = it.node->elements[it.index];
+			memcpy(nextKey, key, *key + 1);
+			if (NOT CBDatabaseCommit(database)) {
+				CBLogError("Could not commit migrated transaction references.");
+				return false;
+			}
+			batch = 0;
+			it = CBAssociativeArrayFind(&database->index, nextKey).position;
+		}
+	}
+	// Record the version with the last of the transaction references.
+	CBInt32ToArray(CB_DATA_ARRAY, CB_VALIDATION_VERSION, CB_BLOCK_CHAIN_STORAGE_VERSION);
+	if (NOT CBDatabaseReadValue(database, CB_VALIDATOR_INFO_KEY, CB_DATA_ARRAY, CB_VALIDATION_VERSION, 0)
+		|| NOT CBDatabaseWriteValue(database, CB_VALIDATOR_INFO_KEY, CB_DATA_ARRAY, CB_VALIDATION_SIZE)
+		|| NOT CBDatabaseCommit(database)) {
+		CBLogError("Could not write the storage version after migrating the transaction index.");
+		CBDatabaseClearPending(database);
+		return false;
+	}
+	return true;
+}
+bool CBBlockChainStorageMigrateUnspentOutputs(uint64_t iself){
+	CBDatabase * database = (CBDatabase *)iself;
+	uint32_t infoLength = CBDatabaseGetLength(database, CB_VALIDATOR_INFO_KEY);
+	if (infoLength == CB_VALIDATION_SIZE)
+		// Already migrated
+		return true;
+	if (infoLength != CB_VALIDATION_VERSION) {
+		CBLogError("The block-chain database is not recognised for migration.");
+		return false;
+	}
+	// The writes are only queued so the index can be iterated while migrating. After each commit the iteration continues from the last migrated key.
+	uint8_t lastKey[38];
+	uint32_t batch = 0;
+	CBPosition it;
+	if (CBAssociativeArrayGetFirst(&database->index, &it)) for (;;) {
+		uint8_t * key = it.node->elements[it.index];
+		CBIndexValue * val = (CBIndexValue *)(key + *key + 1);
+		if (key[0] == 37 && key[1] == CB_STORAGE_UNSPENT_OUTPUT && val->length) {
+			if (NOT CBBlockChainStorageMigrateUnspentOutput(database, key)) {
+				CBDatabaseClearPending(database);
+				return false;
+			}
+			if (++batch == CB_MIGRATION_BATCH) {
+				memcpy(lastKey, key, 38);
+				if (NOT CBDatabaseCommit(database)) {
+					CBLogError("Could not commit migrated unspent outputs.");
+					return false;
+				}
+				batch = 0;
+				it = CBAssociativeArrayFind(&database->index, lastKey).position;
+			}
+		}
+		if (CBAssociativeArrayIterate(&database->index, &it))
+			break;
+	}
+	// Record the version with the last of the unspent outputs.
+	if (NOT CBDatabaseReadValue(database, CB_VALIDATOR_INFO_KEY, CB_DATA_ARRAY, CB_VALIDATION_VERSION, 0)) {
+		CBLogError("Could not read the validator information for migration.");
+		CBDatabaseClearPending(database);
+		return false;
+	}
+	// The blocks are still in the database at version 1.
+	CBInt32ToArray(CB_DATA_ARRAY, CB_VALIDATION_VERSION, 1);
+	if (NOT CBDatabaseWriteValue(database, CB_VALIDATOR_INFO_KEY, CB_DATA_ARRAY, CB_VALIDATION_SIZE)
+		|| NOT CBDatabaseCommit(database)) {
+		CBLogError("Could not write the storage version after migration.");
 		return false;
 	}
 	return true;
 }
 void CBBlockChainStorageReset(uint64_t iself){
-	CBDatabaseClearPending((CBDatabase *)iself);
+	CBBlockChainStorage * self = (CBBlockChainStorage *)iself;
+	CBDatabaseClearPending(&self->base);
+	CBBlockChainStorageClearPrefetched(self);
+	// Go back to the committed block files, removing any started since the last commit.
+	uint16_t numBlockFiles = self->numBlockFiles;
+	CBBlockChainStorageCloseBlockFiles(self);
+	if (NOT CBBlockChainStorageLoadBlockFiles(self))
+		CBLogError("Could not reload the block files.");
+	for (uint16_t x = self->numBlockFiles; x < numBlockFiles; x++) {
+		char filename[strlen(self->base.dataDir) + 13];
+		CBBlockChainStorageGetBlockFileName(self, x, filename);
+		remove(filename);
+	}
 }
-bool CBBlockChainStorageSaveBasicValidator(void * validator){
+bool CBBlockChainStoragePrefetchUnspentOutputs(void * validator, uint8_t * outpoints, uint32_t numOutpoints){
+	CBFullValidator * validatorObj = validator;
+	CBBlockChainStorage * self = (CBBlockChainStorage *)validatorObj->storage;
+	CBBlockChainStorageClearPrefetched(self);
+	if (NOT numOutpoints)
+		return true;
+	// Make the keys and read the records in the order they are stored.
+	uint8_t * keyData = malloc(numOutpoints * 38);
+	uint8_t ** keys = malloc(numOutpoints * sizeof(*keys));
+	uint8_t ** data = malloc(numOutpoints * sizeof(*data));
+	uint32_t * lengths = malloc(numOutpoints * sizeof(*lengths));
+	bool ok = keyData && keys && data && lengths;
+	if (NOT ok)
+		CBLogError("Could not allocate memory for prefetching %u unspent outputs.", numOutpoints);
+	else{
+		for (uint32_t x = 0; x < numOutpoints; x++) {
+			keys[x] = keyData + x*38;
+			keys[x][0] = 37;
+			keys[x][1] = CB_STORAGE_UNSPENT_OUTPUT;
+			memcpy(keys[x] + 2, outpoints + x*36, 36);
+		}
+		ok = CBDatabaseReadValues(&self->base, keys, numOutpoints, data, lengths);
+	}
+	if (ok) {
+		for (uint32_t x = 0; x < numOutpoints; x++) {
+			// Keep the record after the key and length, with a zero length for outputs which do not exist.
+			CBFindResult res = CBAssociativeArrayFind(&self->prefetched, keys[x]);
+			if (res.found) {
+				free(data[x]);
+				continue;
+			}
+			uint8_t * element = ok ? malloc(42 + lengths[x]) : NULL;
+			if (element) {
+				memcpy(element, keys[x], 38);
+				CBInt32ToArray(element, 38, lengths[x]);
+				if (lengths[x])
+					memcpy(element + 42, data[x], lengths[x]);
+				if (NOT CBAssociativeArrayInsert(&self->prefetched, element, res.position, NULL)) {
+					free(element);
+					ok = false;
+				}
+			}else
+				ok = false;
+			free(data[x]);
+		}
+		if (NOT ok) {
+			CBLogError("Could not keep the prefetched unspent outputs.");
+			CBBlockChainStorageClearPrefetched(self);
+		}
+	}
+	free(keyData);
+	free(keys);
+	free(data);
+	free(lengths);
+	return ok;
+}
+bool CBBlockChainStoragePruneBlock(void * validator, uint32_t blockID){
 	CBFullValidator * validatorObj = validator;
 	CBDatabase * database = (CBDatabase *)validatorObj->storage;
-	CB_DATA_ARRAY[CB_VALIDATION_FIRST_ORPHAN] = validatorObj->firstOrphan;
-	CB_DATA_ARRAY[CB_VALIDATION_NUM_ORPHANS] = validatorObj->numOrphans;
-	CB_DATA_ARRAY[CB_VALIDATION_MAIN_BRANCH] = validatorObj->mainBranch;
-	CB_DATA_ARRAY[CB_VALIDATION_NUM_BRANCHES] = validatorObj->numBranches;
-	if (NOT CBDatabaseWriteValue(database, CB_VALIDATOR_INFO_KEY, CB_DATA_ARRAY, 4)) {
-		CBLogError("Could not write the initial basic validation data.");
+	uint8_t index[CB_BLOCK_INDEX_SIZE];
+	CBInt32ToArray(CB_BLOCK_KEY, 2, blockID);
+	if (NOT CBBlockChainStorageReleaseBlock((CBBlockChainStorage *)database, index)) {
+		CBLogError("Could not release a block to prune from its block file.");
+		return false;
+	}
+	// The block file is removed once all of its blocks are pruned or deleted.
+	if (NOT CBDatabaseWriteValue(database, CB_BLOCK_KEY, index, 80)) {
+		CBLogError("Could not replace a block with its header.");
+		return false;
+	}
+	CBInt32ToArray(CB_UNDO_KEY, 2, blockID);
+	if (CBDatabaseGetLength(database, CB_UNDO_KEY)
+		&& NOT CBDatabaseRemoveValue(database, CB_UNDO_KEY)) {
+		CBLogError("Could not remove the undo data of a pruned block.");
 		return false;
 	}
 	return true;
 }
-bool CBBlockChainStorageSaveBlock(void * validator, void * block, uint8_t branch, uint32_t blockIndex){
+bool CBBlockChainStorageRestoreUndo(void * validator, uint32_t blockID){
 	CBFullValidator * validatorObj = validator;
-	CBBlock * blockObj = block;
-	// Write the block data
-	CB_BLOCK_KEY[2] = branch;
-	CBInt32ToArray(CB_BLOCK_KEY, 3, blockIndex);
-	uint8_t * dataParts[2] = {CBBlockGetHash(blockObj), CBByteArrayGetData(CBGetMessage(blockObj)->bytes)};
-	uint32_t dataSizes[2] = {20, CBGetMessage(blockObj)->bytes->length};
-	if (NOT CBDatabaseWriteConcatenatedValue((CBDatabase *)validatorObj->storage, CB_BLOCK_KEY, 2, dataParts, dataSizes)) {
-		CBLogError("Could not write a block to the block-chain database.");
+	CBDatabase * database = (CBDatabase *)validatorObj->storage;
+	CBBlockChainStorageClearPrefetched((CBBlockChainStorage *)database);
+	CBInt32ToArray(CB_UNDO_KEY, 2, blockID);
+	uint32_t length = CBDatabaseGetLength(database, CB_UNDO_KEY);
+	if (length < CB_UNDO_HEADER_SIZE) {
+		CBLogError("There is no undo data for a block being removed from the main chain.");
 		return false;
 	}
-	// Write to the block hash index
-	memcpy(CB_BLOCK_HASH_INDEX_KEY + 2, CBBlockGetHash(blockObj), 20);
-	CB_DATA_ARRAY[CB_BLOCK_HASH_REF_BRANCH] = branch;
-	CBInt32ToArray(CB_DATA_ARRAY, CB_BLOCK_HASH_REF_INDEX, blockIndex);
-	if (NOT CBDatabaseWriteValue((CBDatabase *)validatorObj->storage, CB_BLOCK_HASH_INDEX_KEY, CB_DATA_ARRAY, 5)) {
-		CBLogError("Could not write a block hash to the block-chain database block hash index.");
+	// Read all of the undo data at once.
+	uint8_t * undo = malloc(length);
+	if (NOT undo) {
+		CBLogError("Could not allocate %u bytes of memory for undo data.", length);
+		return false;
+	}
+	if (NOT CBDatabaseReadValue(database, CB_UNDO_KEY, undo, length, 0)) {
+		CBLogError("Could not read the undo data for a block.");
+		free(undo);
+		return false;
+	}
+	uint32_t cursor = CB_UNDO_HEADER_SIZE;
+	for (uint32_t x = CBArrayToInt32(undo, 0); x--;) {
+		uint64_t outputIndex, recordLength;
+		uint8_t * txHash = undo + cursor;
+		cursor += 32;
+		if (cursor > length
+			|| NOT CBBlockChainStorageReadVarInt(undo, length, &cursor, &outputIndex)
+			|| NOT CBBlockChainStorageReadVarInt(undo, length, &cursor, &recordLength)
+			|| recordLength > length - cursor) {
+			CBLogError("The undo data for a block is corrupt.");
+			free(undo);
+			return false;
+		}
+		memcpy(CB_UNSPENT_OUTPUT_KEY + 2, txHash, 32);
+		CBInt32ToArray(CB_UNSPENT_OUTPUT_KEY, 34, (uint32_t)outputIndex);
+		if (NOT CBDatabaseWriteValue(database, CB_UNSPENT_OUTPUT_KEY, undo + cursor, (uint32_t)recordLength)) {
+			CBLogError("Could not restore an unspent output from undo data.");
+			free(undo);
+			return false;
+		}
+		cursor += recordLength;
+	}
+	free(undo);
+	if (NOT CBDatabaseRemoveValue(database, CB_UNDO_KEY)) {
+		CBLogError("Could not remove the undo data for a block.");
 		return false;
 	}
 	return true;
 }
-bool CBBlockChainStorageSaveBranch(void * validator, uint8_t branch){
+bool CBBlockChainStorageSaveBasicValidator(void * validator){
 	CBFullValidator * validatorObj = validator;
 	CBDatabase * database = (CBDatabase *)validatorObj->storage;
-	CB_BRANCH_KEY[2] = branch;
-	// Make data
-	CBInt32ToArray(CB_DATA_ARRAY, CB_BRANCH_LAST_RETARGET, validatorObj->branches[branch].lastRetargetTime);
-	CBInt32ToArray(CB_DATA_ARRAY, CB_BRANCH_LAST_VALIDATION, validatorObj->branches[branch].lastValidation);
-	CBInt32ToArray(CB_DATA_ARRAY, CB_BRANCH_NUM_BLOCKS, validatorObj->branches[branch].numBlocks);
-	CBInt32ToArray(CB_DATA_ARRAY, CB_BRANCH_PARENT_BLOCK_INDEX, validatorObj->branches[branch].parentBlockIndex);
-	CB_DATA_ARRAY[CB_BRANCH_PARENT_BRANCH] = validatorObj->branches[branch].parentBranch;
-	CBInt32ToArray(CB_DATA_ARRAY, CB_BRANCH_START_HEIGHT, validatorObj->branches[branch].startHeight);
-	// Write data
-	if (NOT CBDatabaseWriteValue(database, CB_BRANCH_KEY, CB_DATA_ARRAY, 21)) {
-		CBLogError("Could not write branch information.");
+	CBInt32ToArray(CB_DATA_ARRAY, CB_VALIDATION_MAIN_TIP, validatorObj->mainTip->blockID);
+	CBInt32ToArray(CB_DATA_ARRAY, CB_VALIDATION_NEXT_BLOCK_ID, validatorObj->nextBlockID);
+	CBInt32ToArray(CB_DATA_ARRAY, CB_VALIDATION_VERSION, CB_BLOCK_CHAIN_STORAGE_VERSION);
+	if (NOT CBDatabaseWriteValue(database, CB_VALIDATOR_INFO_KEY, CB_DATA_ARRAY, CB_VALIDATION_SIZE)) {
+		CBLogError("Could not write the basic validation data.");
 		return false;
 	}
 	return true;
 }
-bool CBBlockChainStorageSaveBranchWork(void * validator, uint8_t branch){
+bool CBBlockChainStorageSaveBlock(void * validator, void * block, uint32_t blockID){
 	CBFullValidator * validatorObj = validator;
-	CBDatabase * database = (CBDatabase *)validatorObj->storage;
-	CB_WORK_KEY[2] = branch;
-	if (NOT CBDatabaseWriteValue(database, CB_WORK_KEY, validatorObj->branches[branch].work.data, validatorObj->branches[branch].work.length)) {
-		CBLogError("Could not write branch work.");
+	CBBlock * blockObj = block;
+	CBInt32ToArray(CB_BLOCK_KEY, 2, blockID);
+	if (NOT CBBlockChainStorageAppendBlock((CBBlockChainStorage *)validatorObj->storage, CBByteArrayGetData(CBGetMessage(blockObj)->bytes), CBGetMessage(blockObj)->bytes->length)) {
+		CBLogError("Could not write a block to the block-chain database.");
 		return false;
 	}
 	return true;
 }
-bool CBBlockChainStorageSaveOrphan(void * validator, void * block, uint8_t orphanNum){
+bool CBBlockChainStorageSaveUndo(void * validator, uint32_t blockID, uint8_t * undo, uint32_t undoLength){
 	CBFullValidator * validatorObj = validator;
-	CBDatabase * database = (CBDatabase *)validatorObj->storage;
-	CBBlock * blockObj = block;
-	CB_ORPHAN_KEY[2] = orphanNum;
-	if (NOT CBDatabaseWriteValue(database, CB_ORPHAN_KEY, CBByteArrayGetData(CBGetMessage(blockObj)->bytes), CBGetMessage(blockObj)->bytes->length)) {
-		CBLogError("Could not write an orphan.");
+	CBInt32ToArray(CB_UNDO_KEY, 2, blockID);
+	// A block which spends nothing has only the header.
+	uint8_t empty[CB_UNDO_HEADER_SIZE] = {0};
+	if (NOT CBDatabaseWriteValue((CBDatabase *)validatorObj->storage, CB_UNDO_KEY, undoLength ? undo : empty, undoLength ? undoLength : CB_UNDO_HEADER_SIZE)) {
+		CBLogError("Could not write the undo data for a block.");
 		return false;
 	}
 	return true;
 }
-bool CBBlockChainStorageSaveTransactionRef(void * validator, uint8_t * txHash, uint8_t branch, uint32_t blockIndex, uint32_t outputPos, uint32_t outputsLen, bool coinbase, uint32_t numOutputs){
+bool CBBlockChainStorageSaveTransactionRef(void * validator, uint8_t * txHash, uint32_t blockID, uint32_t height, uint32_t outputPos, uint32_t outputsLen, bool coinbase){
+	CBFullValidator * validatorObj = validator;
+	return CBBlockChainStorageAddTransactionEntry((CBDatabase *)validatorObj->storage, txHash, blockID, height, outputPos, outputsLen, coinbase);
+}
+bool CBBlockChainStorageSaveUnspentOutput(void * validator, uint8_t * txHash, uint32_t outputIndex, void * output, uint32_t height, bool coinbase){
 	CBFullValidator * validatorObj = validator;
 	CBDatabase * database = (CBDatabase *)validatorObj->storage;
-	memcpy(CB_TRANSACTION_INDEX_KEY + 2, txHash, 32);
-	if (CBDatabaseGetLength(database, CB_TRANSACTION_INDEX_KEY)) {
-		// We have the transaction already. Thus obtain the data already in the index.
-		if (NOT CBDatabaseReadValue(database, CB_TRANSACTION_INDEX_KEY, CB_DATA_ARRAY, 22, 0)) {
-			CBLogError("Could not read a transaction reference from the transaction index.");
-			return false;
-		}
-		// Increase the instance count. We change nothing else as we will use the first instance for all other instances.
-		CBInt32ToArray(CB_DATA_ARRAY, CB_TRANSACTION_REF_INSTANCE_COUNT, CBArrayToInt32(CB_DATA_ARRAY, CB_TRANSACTION_REF_INSTANCE_COUNT) + 1);
-	}else{
-		// This transaction has not yet been seen in the block chain.
-		CBInt32ToArray(CB_DATA_ARRAY, CB_TRANSACTION_REF_BLOCK_INDEX, blockIndex);
-		CB_DATA_ARRAY[CB_TRANSACTION_REF_BRANCH] = branch;
-		CBInt32ToArray(CB_DATA_ARRAY, CB_TRANSACTION_REF_POSITION_OUPTUTS, outputPos);
-		CBInt32ToArray(CB_DATA_ARRAY, CB_TRANSACTION_REF_LENGTH_OUTPUTS, outputsLen);
-		CB_DATA_ARRAY[CB_TRANSACTION_REF_IS_COINBASE] = coinbase;
-		// We start with an instance count of one
-		CBInt32ToArray(CB_DATA_ARRAY, CB_TRANSACTION_REF_INSTANCE_COUNT, 1);
-	}
-	// Always set the number of unspent outputs back to the number of outputs in the transaction
-	CBInt32ToArray(CB_DATA_ARRAY, CB_TRANSACTION_REF_NUM_UNSPENT_OUTPUTS, numOutputs);
-	// Write to the transaction index.
-	if (NOT CBDatabaseWriteValue(database, CB_TRANSACTION_INDEX_KEY, CB_DATA_ARRAY, 22)) {
-		CBLogError("Could not write transaction reference to transaction index.");
+	CBBlockChainStorageClearPrefetched((CBBlockChainStorage *)database);
+	memcpy(CB_UNSPENT_OUTPUT_KEY + 2, txHash, 32);
+	CBInt32ToArray(CB_UNSPENT_OUTPUT_KEY, 34, outputIndex);
+	// Add to storage
+	if (NOT CBBlockChainStorageWriteUnspentOutput(database, output, height, coinbase)) {
+		CBLogError("Could not write a new unspent output record into the database.");
 		return false;
 	}
 	return true;
 }
-bool CBBlockChainStorageSaveUnspentOutput(void * validator, uint8_t * txHash, uint32_t outputIndex, uint32_t position, uint32_t length, bool increment){
+bool CBBlockChainStorageSpendUnspentOutput(void * validator, uint8_t * txHash, uint32_t outputIndex, uint8_t ** undo, uint32_t * undoLength, uint32_t * undoAllocSize){
 	CBFullValidator * validatorObj = validator;
 	CBDatabase * database = (CBDatabase *)validatorObj->storage;
 	memcpy(CB_UNSPENT_OUTPUT_KEY + 2, txHash, 32);
 	CBInt32ToArray(CB_UNSPENT_OUTPUT_KEY, 34, outputIndex);
-	CBInt32ToArray(CB_DATA_ARRAY, CB_UNSPENT_OUTPUT_REF_POSITION, position);
-	CBInt32ToArray(CB_DATA_ARRAY, CB_UNSPENT_OUTPUT_REF_LENGTH, length);
-	// Add to storage
-	if (NOT CBDatabaseWriteValue(database, CB_UNSPENT_OUTPUT_KEY, CB_DATA_ARRAY, 8)) {
-		CBLogError("Could not write new unspent output reference into the database.");
+	uint32_t recordLength = CBDatabaseGetLength(database, CB_UNSPENT_OUTPUT_KEY);
+	if (NOT recordLength) {
+		CBLogError("Could not find an unspent output to spend.");
 		return false;
 	}
-	if (increment
-		// For the transaction, increment the number of unspent outputs
-		&& NOT CBBlockChainStorageChangeUnspentOutputsNum(database, txHash, +1)) {
-		CBLogError("Could not increment the number of unspent outputs for a transaction.");
+	uint8_t * record = CBBlockChainStorageAddUndoEntry(undo, undoLength, undoAllocSize, txHash, outputIndex, recordLength);
+	if (NOT record)
+		return false;
+	if (NOT CBDatabaseReadValue(database, CB_UNSPENT_OUTPUT_KEY, record, recordLength, 0)) {
+		CBLogError("Could not read an unspent output record for undo data.");
 		return false;
 	}
-	return true;
+	return CBBlockChainStorageDeleteUnspentOutput(validator, txHash, outputIndex);
+}
+bool CBBlockChainStorageUndoExists(void * validator, uint32_t blockID){
+	CBFullValidator * validatorObj = validator;
+	CBInt32ToArray(CB_UNDO_KEY, 2, blockID);
+	return CBDatabaseGetLength((CBDatabase *)validatorObj->storage, CB_UNDO_KEY);
 }
 bool CBBlockChainStorageUnspentOutputExists(void * validator, uint8_t * txHash, uint32_t outputIndex){
 	CBFullValidator * validatorObj = validator;
 	memcpy(CB_UNSPENT_OUTPUT_KEY + 2, txHash, 32);
 	CBInt32ToArray(CB_UNSPENT_OUTPUT_KEY, 34, outputIndex);
+	uint8_t * prefetched = CBBlockChainStorageFindPrefetched((CBBlockChainStorage *)validatorObj->storage);
+	if (prefetched)
+		return CBArrayToInt32(prefetched, 0);
 	return CBDatabaseGetLength((CBDatabase *)validatorObj->storage, CB_UNSPENT_OUTPUT_KEY);
 }
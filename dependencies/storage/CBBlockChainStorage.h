@@ -35,63 +35,65 @@
  @brief The data storage components.
  */
 typedef enum{
-	CB_STORAGE_ORPHAN, /**< key = [CB_STORAGE_ORPHANS, orphanID] */
+	CB_STORAGE_ORPHAN, /**< No longer used, as orphans are only kept in memory. */
 	CB_STORAGE_VALIDATOR_INFO, /**< key = [CB_STORAGE_VALIDATOR_INFO] */
-	CB_STORAGE_BRANCH_INFO, /**< key = [CB_STORAGE_BRANCH_INFO, branchID] */
-	CB_STORAGE_BLOCK, /**< key = [CB_STORAGE_BLOCK, branchID, blockID * 4] */
-	CB_STORAGE_BLOCK_HASH_INDEX, /**< [CB_STORAGE_BLOCK_HASH_INDEX, hash * 20] Links to the block branch id and position. */
-	CB_STORAGE_WORK, /**< key = [CB_STORAGE_WORK, branchID] */
-	CB_STORAGE_UNSPENT_OUTPUT, /**< key = [CB_STORAGE_NUM_SPENT_OUTPUTS, hash * 32, outputID * 4] */
-	CB_STORAGE_TRANSACTION_INDEX, /**< key = [CB_STORAGE_TRANSACTION_INDEX, hash * 32] */
+	CB_STORAGE_BRANCH_INFO, /**< No longer used, as the block tree is built from the blocks. */
+	CB_STORAGE_BLOCK, /**< key = [CB_STORAGE_BLOCK, blockID * 4] @see CBBlockIndexOffsets */
+	CB_STORAGE_BLOCK_HASH_INDEX, /**< No longer used, as the block tree is kept in memory. */
+	CB_STORAGE_WORK, /**< No longer used, as the work is calculated from the blocks. */
+	CB_STORAGE_UNSPENT_OUTPUT, /**< key = [CB_STORAGE_UNSPENT_OUTPUT, hash * 32, outputID * 4] @see CBUnspentOutputScriptTypes */
+	CB_STORAGE_TRANSACTION_INDEX, /**< key = [CB_STORAGE_TRANSACTION_INDEX, hash * 32] Used before CB_BLOCK_CHAIN_STORAGE_VERSION 3. @see CBTransactionReferenceOffsets */
+	CB_STORAGE_UNDO, /**< key = [CB_STORAGE_UNDO, blockID * 4] @see CB_UNDO_HEADER_SIZE */
+	CB_STORAGE_BLOCK_FILE, /**< key = [CB_STORAGE_BLOCK_FILE, fileID * 2] @see CBBlockFileOffsets */
+	CB_STORAGE_COMPACT_TRANSACTION_INDEX, /**< key = [CB_STORAGE_COMPACT_TRANSACTION_INDEX, hash * CB_TRANSACTION_INDEX_KEY_HASH] @see CB_TRANSACTION_INDEX_KEY_HASH */
 } CBStorageParts;
 
 /**
  @brief The offsets to parts of the main validation data
  */
 typedef enum{
-	CB_VALIDATION_FIRST_ORPHAN = 0, 
-	CB_VALIDATION_NUM_ORPHANS = 1, 
-	CB_VALIDATION_MAIN_BRANCH = 2, 
-	CB_VALIDATION_NUM_BRANCHES = 3, 
+	CB_VALIDATION_MAIN_TIP = 0, /**< The ID of the last block in the main chain. */
+	CB_VALIDATION_NEXT_BLOCK_ID = 4, /**< The ID for the next block. */
+	CB_VALIDATION_VERSION = 8, /**< The storage version. Databases without it have unspent output references into the blocks. */
+	CB_VALIDATION_SIZE = 12, /**< The size of the validation data. */
 } CBValidationOffsets;
 
 /**
- @brief The offsets to parts of the branch data.
+ @brief The offsets to parts of the block index values. The blocks are appended to the block files and the index value gives their location. Pruned blocks only have the 80 byte header.
  */
 typedef enum{
-	CB_BRANCH_LAST_RETARGET = 0, 
-	CB_BRANCH_LAST_VALIDATION = 4, 
-	CB_BRANCH_NUM_BLOCKS = 8, 
-	CB_BRANCH_PARENT_BLOCK_INDEX = 12, 
-	CB_BRANCH_PARENT_BRANCH = 16, 
-	CB_BRANCH_START_HEIGHT = 17, 
-} CBBranchOffsets;
+	CB_BLOCK_INDEX_HEADER = 0, /**< The 80 byte block header, so that the block tree can be loaded without reading the block files. */
+	CB_BLOCK_INDEX_FILE = 80, /**< The ID of the block file. */
+	CB_BLOCK_INDEX_POSITION = 82, /**< The byte position of the block in the block file. */
+	CB_BLOCK_INDEX_LENGTH = 86, /**< The length of the block in bytes. */
+	CB_BLOCK_INDEX_SIZE = 90, /**< The size of a block index value. */
+} CBBlockIndexOffsets;
 
 /**
- @brief The offsets to parts of the block data
+ @brief The offsets to parts of the block file information.
  */
 typedef enum{
-	CB_BLOCK_HASH = 0, /**< The hash is written before the block data */
-	CB_BLOCK_START = 20, /**< The start of the serialised block data */
-	CB_BLOCK_TIME = 88, 
-	CB_BLOCK_TARGET = 92, 
-} CBBlockOffsets;
+	CB_BLOCK_FILE_NUM_BLOCKS = 0, /**< The number of blocks in the file which have not been pruned or deleted. */
+	CB_BLOCK_FILE_LENGTH = 4, /**< The length of the committed block data in the file. */
+	CB_BLOCK_FILE_INFO_SIZE = 8, /**< The size of the block file information. */
+} CBBlockFileOffsets;
 
 /**
- @brief The offsets to parts of the unspent output reference data
+ @brief The offsets to parts of the transaction references used before CB_BLOCK_CHAIN_STORAGE_VERSION 3.
  */
 typedef enum{
-	CB_TRANSACTION_REF_BLOCK_INDEX = 0, /**< The block index in the branch where the transaction exists. */
-	CB_TRANSACTION_REF_BRANCH = 4, /**< The branch where the transaction exists. */
-	CB_TRANSACTION_REF_POSITION_OUPTUTS = 5, /**< The byte position in the block where the first transaction output exists. */
-	CB_TRANSACTION_REF_LENGTH_OUTPUTS = 9, /**< The length in bytes of the transaction outputs. */
-	CB_TRANSACTION_REF_IS_COINBASE = 13, /**< 1 if the transaction is a coinbase, else 0 */
-	CB_TRANSACTION_REF_NUM_UNSPENT_OUTPUTS = 14, /**< The number of unspent outputs for a transaction. */
-	CB_TRANSACTION_REF_INSTANCE_COUNT = 18, /**< The number of times this transaction has appeared on the block-chain. */
+	CB_TRANSACTION_REF_BLOCK_ID = 0, /**< The ID of the block where the transaction exists. */
+	CB_TRANSACTION_REF_HEIGHT = 4, /**< The height of the block where the transaction exists. */
+	CB_TRANSACTION_REF_POSITION_OUPTUTS = 8, /**< The byte position in the block where the first transaction output exists. */
+	CB_TRANSACTION_REF_LENGTH_OUTPUTS = 12, /**< The length in bytes of the transaction outputs. */
+	CB_TRANSACTION_REF_IS_COINBASE = 16, /**< 1 if the transaction is a coinbase, else 0 */
+	CB_TRANSACTION_REF_NUM_UNSPENT_OUTPUTS = 17, /**< The number of unspent outputs for a transaction. */
+	CB_TRANSACTION_REF_INSTANCE_COUNT = 21, /**< The number of times this transaction has appeared on the block-chain. */
+	CB_TRANSACTION_REF_SIZE = 25, /**< The size of a transaction reference. */
 } CBTransactionReferenceOffsets;
 
 /**
- @brief The offsets to parts of the unspent output reference data
+ @brief The offsets to parts of the unspent output references used before CB_BLOCK_CHAIN_STORAGE_VERSION 1.
  */
 typedef enum{
 	CB_UNSPENT_OUTPUT_REF_POSITION = 0, /**< Byte position in the block where this output exists. */
@@ -99,22 +101,109 @@ typedef enum{
 } CBUnspentOutputReferenceOffsets;
 
 /**
- @brief The offsets to parts of the block reference data
+ @brief The script types of unspent output records. A record holds the height times two plus one for a coinbase, and then the compressed amount, both as variable integers which use the high bit of each byte to mark following bytes. The script type follows as a variable integer. Templated scripts are followed by their 20 byte hash and other scripts by their data.
  */
 typedef enum{
-	CB_BLOCK_HASH_REF_BRANCH = 0, 
-	CB_BLOCK_HASH_REF_INDEX = 1, 
-} CBBlockHashRefOffsets;
+	CB_UNSPENT_OUTPUT_P2PKH = 0, /**< OP_DUP OP_HASH160 <hash> OP_EQUALVERIFY OP_CHECKSIG */
+	CB_UNSPENT_OUTPUT_P2SH = 1, /**< OP_HASH160 <hash> OP_EQUAL */
+	CB_UNSPENT_OUTPUT_SCRIPT = 2, /**< Other scripts, where the type is this plus the script length. */
+} CBUnspentOutputScriptTypes;
+
+/**
+ @brief Undo data begins with the number of spent outputs as four bytes. For each spent output it then has the transaction hash, the output index and the record length as a variable integer, followed by the unspent output record.
+ */
+#define CB_UNDO_HEADER_SIZE 4
+/**
+ @brief The compact transaction index is keyed by the first bytes of the transaction hash. The value has an entry for each block containing a transaction with a hash beginning with those bytes. Each entry has the next CB_TRANSACTION_INDEX_CHECK_HASH bytes of the hash, to tell apart transactions with the same key, and the block ID as four bytes. Then it has the height, the position of the outputs in the block and the length of the outputs as variable integers, like unspent output records, and a byte which is 1 for a coinbase.
+ */
+#define CB_TRANSACTION_INDEX_KEY_HASH 8
+#define CB_TRANSACTION_INDEX_CHECK_HASH 8
+#define CB_BLOCK_CHAIN_STORAGE_VERSION 3
+#define CB_MIGRATION_BATCH 50000 // Number of unspent outputs migrated between commits.
+#define CB_BLOCK_MIGRATION_BATCH 500 // Number of blocks moved to the block files between commits.
+#define CB_BLOCK_FILE_MAX_SIZE 134217728 // A new block file is started rather than exceeding this size, unless the file is empty.
+
+/**
+ @brief Unspent output snapshots hold the unspent outputs at the main chain tip, so that a new node can start from them rather than processing every block. A snapshot begins with CB_SNAPSHOT_MAGIC, CB_SNAPSHOT_VERSION, the height of the tip and the number of unspent outputs as eight bytes. The 80 byte headers of the main chain follow, from the genesis block to the tip. Then each unspent output has the transaction hash, the output index as four bytes and the record length as a variable integer, followed by the unspent output record, sorted by the transaction hash and output index. The snapshot ends with the commitment to the unspent outputs, which begins as the SHA-256 of the tip hash and height. Each unspent output is added by taking the SHA-256 of the commitment followed by the unspent output.
+ */
+#define CB_SNAPSHOT_MAGIC 0x4F545855
+#define CB_SNAPSHOT_VERSION 1
+#define CB_SNAPSHOT_HEADER_SIZE 20
+
+/**
+ @brief Information on a block file, which is named "blkNNNNN.dat" in the data directory.
+ */
+typedef struct{
+	uint32_t numBlocks; /**< The number of blocks in the file which have not been pruned or deleted. The file is removed when this is zero, unless it is the last file. */
+	uint32_t length; /**< The length of the block data in the file. */
+	bool removed; /**< True if the file has been removed. */
+} CBBlockFile;
+
+/**
+ @brief Structure for the block-chain storage objects. The blocks are appended to block files which are written outside of the database, so that they do not go through the database log. The database holds an index of the blocks and the other validation data.
+ */
+typedef struct{
+	CBDatabase base; /**< The database, so that the storage object can be used as a CBDatabase. */
+	CBBlockFile * blockFiles; /**< Information on every block file, including removed files. */
+	uint16_t numBlockFiles; /**< The number of block files. Blocks are appended to the last. */
+	uint64_t blockFile; /**< The file object for the last block file, or 0 if there are no block files. */
+	bool blockFileChanged; /**< True if blocks have been appended since the last commit. */
+	bool newBlockFile; /**< True if a block file has been started since the last commit. */
+	uint64_t readFile; /**< A file object kept for reading from a block file other than the last one, or 0. */
+	uint16_t readFileID; /**< The ID of the block file for readFile. */
+	uint32_t blockFileMaxSize; /**< CB_BLOCK_FILE_MAX_SIZE by default. */
+	CBAssociativeArray prefetched; /**< Unspent output records read by CBBlockChainStoragePrefetchUnspentOutputs. Each element is the unspent output key, the record length as four bytes, which is zero if there is no unspent output, and then the record. Cleared when the unspent outputs change. */
+} CBBlockChainStorage;
 
 // Other functions
 
 /**
- @brief Changes the number of unspent outputs for a transaction.
- @param database The database object.
- @param txHash The hash of the transaction
- @param change This number will be added to the number of unspent outputs.
+ @brief Compresses an amount, removing trailing zeros in the decimal representation.
+ @param amount The amount in satoshis.
+ @returns The compressed amount.
+ */
+uint64_t CBBlockChainStorageCompressAmount(uint64_t amount);
+/**
+ @brief Reverses CBBlockChainStorageCompressAmount.
+ @param compressed The compressed amount.
+ @returns The amount in satoshis.
+ */
+uint64_t CBBlockChainStorageDecompressAmount(uint64_t compressed);
+/**
+ @brief Converts the unspent outputs of a database written before CB_BLOCK_CHAIN_STORAGE_VERSION 1 from references into the blocks to unspent output records. This is done once before the database is used by a CBFullValidator.
+ @param iself The storage object.
+ @returns true on success and false on failure.
+ */
+bool CBBlockChainStorageMigrateUnspentOutputs(uint64_t iself);
+/**
+ @brief Moves the blocks of a database written before CB_BLOCK_CHAIN_STORAGE_VERSION 2 out of the database and into the block files. This is done after CBBlockChainStorageMigrateUnspentOutputs and before the database is used by a CBFullValidator.
+ @param iself The storage object.
+ @returns true on success and false on failure.
+ */
+bool CBBlockChainStorageMigrateBlocks(uint64_t iself);
+/**
+ @brief Replaces the transaction references of a database written before CB_BLOCK_CHAIN_STORAGE_VERSION 3 with the compact transaction index, or removes them. This is done after CBBlockChainStorageMigrateBlocks and before the database is used by a CBFullValidator.
+ @param iself The storage object.
+ @param keep If true the references are moved to the compact transaction index, for a validator using CB_FULL_VALIDATOR_TRANSACTION_INDEX. If false they are removed.
+ @returns true on success and false on failure.
+ */
+bool CBBlockChainStorageMigrateTransactionIndex(uint64_t iself, bool keep);
+/**
+ @brief Writes a snapshot of the unspent outputs at the main chain tip. @see CB_SNAPSHOT_MAGIC
+ @param validator The validator using the storage, with everything committed.
+ @param filename The file to write the snapshot to.
+ @param commitment Set to the 32 byte commitment to the unspent outputs, which can be given to CBBlockChainStorageImportUnspentOutputs to check the snapshot.
+ @returns true on success and false on failure.
+ */
+bool CBBlockChainStorageExportUnspentOutputs(void * validator, char * filename, uint8_t * commitment);
+/**
+ @brief Builds new storage from a snapshot of the unspent outputs. The headers of the main chain are stored as pruned blocks, so a CBFullValidator using the storage starts at the tip of the snapshot and cannot reorganise below it. The headers must start with the genesis block, link together, meet their targets and follow the retargeting rules of the validator. The unspent outputs are committed in batches as they are read. On failure the data directory should be removed.
+ @param iself The storage object, which must not have been used by a CBFullValidator.
+ @param filename The snapshot file.
+ @param commitment The commitment the snapshot must have, from a trusted source. The commitment at the end of the snapshot must also match it, but is not trusted alone, as a forged snapshot can commit to itself.
+ @param flags The flags the validator will use. With CB_FULL_VALIDATOR_DISABLE_POW_CHECK the proof of work of the headers is not checked.
  @returns true on success and false on failure.
  */
-bool CBBlockChainStorageChangeUnspentOutputsNum(CBDatabase * database, uint8_t * txHash, int8_t change);
+bool CBBlockChainStorageImportUnspentOutputs(uint64_t iself, char * filename, uint8_t * commitment, CBFullValidatorFlags flags);
 
 #endif
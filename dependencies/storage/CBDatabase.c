@@ -24,6 +24,30 @@
 
 #include "CBDatabase.h"
 
+// A value to read with CBDatabaseReadValues.
+typedef struct{
+	CBIndexValue * indexValue;
+	uint32_t keyIndex;
+} CBDatabaseRead;
+
+// Orders reads by file and then by position in the file.
+static int CBDatabaseCompareReads(const void * vread1, const void * vread2){
+	const CBIndexValue * val1 = ((const CBDatabaseRead *)vread1)->indexValue, * val2 = ((const CBDatabaseRead *)vread2)->indexValue;
+	if (val1->fileID != val2->fileID)
+		return val1->fileID < val2->fileID ? -1 : 1;
+	if (val1->pos != val2->pos)
+		return val1->pos < val2->pos ? -1 : 1;
+	return 0;
+}
+// Frees the values read by CBDatabaseReadValues on failure.
+static void CBDatabaseFreeValues(CBDatabaseRead * reads, uint8_t ** data, uint32_t numKeys){
+	free(reads);
+	for (uint32_t x = 0; x < numKeys; x++) {
+		free(data[x]);
+		data[x] = NULL;
+	}
+}
+
 CBDatabase * CBNewDatabase(char * dataDir, char * prefix){
 	// Try to create the object
 	CBDatabase * self = malloc(sizeof(*self));
@@ -1031,6 +1055,67 @@ bool CBDatabaseReadValue(CBDatabase * self, uint8_t * key, uint8_t * data, uint3
 	}
 	return true;
 }
+bool CBDatabaseReadValues(CBDatabase * self, uint8_t ** keys, uint32_t numKeys, uint8_t ** data, uint32_t * lengths){
+	CBDatabaseRead * reads = malloc(sizeof(*reads) * (numKeys ? numKeys : 1));
+	if (NOT reads) {
+		CBLogError("Could not allocate memory for reading %u values.", numKeys);
+		return false;
+	}
+	for (uint32_t x = 0; x < numKeys; x++) {
+		data[x] = NULL;
+		lengths[x] = 0;
+	}
+	// Find the values, taking values yet to be written straight away and leaving the rest to be read in order.
+	uint32_t numReads = 0;
+	for (uint32_t x = 0; x < numKeys; x++) {
+		CBFindResult res = CBAssociativeArrayFind(&self->index, keys[x]);
+		if (res.found) {
+			CBIndexValue * val = (CBIndexValue *)((uint8_t *)res.position.node->elements[res.position.index] + *keys[x] + 1);
+			if (val->length) {
+				reads[numReads].indexValue = val;
+				reads[numReads++].keyIndex = x;
+			}
+			continue;
+		}
+		res = CBAssociativeArrayFind(&self->valueWrites, keys[x]);
+		if (NOT res.found)
+			continue;
+		uint8_t * writeValue = res.position.node->elements[res.position.index];
+		uint32_t length = CBArrayToInt32(writeValue, *writeValue + 1);
+		if (NOT length)
+			continue;
+		data[x] = malloc(length);
+		if (NOT data[x]) {
+			CBLogError("Could not allocate %u bytes of memory for a value.", length);
+			CBDatabaseFreeValues(reads, data, numKeys);
+			return false;
+		}
+		memcpy(data[x], writeValue + *writeValue + 5, length);
+		lengths[x] = length;
+	}
+	qsort(reads, numReads, sizeof(*reads), CBDatabaseCompareReads);
+	for (uint32_t x = 0; x < numReads; x++) {
+		CBIndexValue * val = reads[x].indexValue;
+		uint32_t keyIndex = reads[x].keyIndex;
+		data[keyIndex] = malloc(val->length);
+		if (NOT data[keyIndex]) {
+			CBLogError("Could not allocate %u bytes of memory for a value.", val->length);
+			CBDatabaseFreeValues(reads, data, numKeys);
+			return false;
+		}
+		uint64_t file = CBDatabaseGetFile(self, val->fileID);
+		if (NOT file
+			|| NOT CBFileSeek(file, val->pos)
+			|| NOT CBFileRead(file, data[keyIndex], val->length)) {
+			CBLogError("Could not read a value from file %u.", val->fileID);
+			CBDatabaseFreeValues(reads, data, numKeys);
+			return false;
+		}
+		lengths[keyIndex] = val->length;
+	}
+	free(reads);
+	return true;
+}
 bool CBDatabaseRemoveValue(CBDatabase * self, uint8_t * key){
 	uint8_t * keyPtr = malloc(*key + 1);
 	if (NOT keyPtr) {
@@ -247,6 +247,16 @@ uint32_t CBDatabaseGetLength(CBDatabase * self, uint8_t * key);
  @returns true on success and false on failure.
  */
 bool CBDatabaseReadValue(CBDatabase * self, uint8_t * key, uint8_t * data, uint32_t dataSize, uint32_t offset);
+/**
+ @brief Reads several whole values, going through the data files in order of position rather than in the order of the keys, so that each file is only opened once.
+ @param self The database object.
+ @param keys The keys for the values. The first byte of each is the length.
+ @param numKeys The number of keys.
+ @param data Set to newly allocated memory holding each value, or NULL where there is no value.
+ @param lengths Set to the length of each value, or 0 where there is no value.
+ @returns true on success and false on failure, in which case nothing is left allocated.
+ */
+bool CBDatabaseReadValues(CBDatabase * self, uint8_t ** keys, uint32_t numKeys, uint8_t ** data, uint32_t * lengths);
 /**
  @brief Queues a key-value delete operation.
  @param self The database object.
@@ -0,0 +1,60 @@
+//
+//  migrateUnspentOutputs.c
+//  cbitcoin
+//
+//  Copyright (c) 2012 Matthew Mitchell
+//
+//  This file is part of cbitcoin.
+//
+//  cbitcoin is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  cbitcoin is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with cbitcoin.  If not, see <http://www.gnu.org/licenses/>.
+
+//  Converts the unspent outputs of a block-chain database from references into the stored blocks to self-contained records, and moves the blocks into the block files and the transaction index to compact keys, so that the database can be opened by the current validator.
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include "CBBlockChainStorage.h"
+
+void CBLogError(char * format, ...);
+void CBLogError(char * format, ...){
+	va_list argptr;
+	va_start(argptr, format);
+	vfprintf(stderr, format, argptr);
+	va_end(argptr);
+	fprintf(stderr, "\n");
+}
+
+int main(int argc, char * argv[]){
+	// The transaction index is only kept when asked for, as the validator only keeps it with CB_FULL_VALIDATOR_TRANSACTION_INDEX.
+	bool txIndex = argc == 3 && NOT strcmp(argv[2], "--txindex");
+	if (argc != 2 && NOT txIndex) {
+		printf("Usage: %s <data directory> [--txindex]\n", argv[0]);
+		return 1;
+	}
+	uint64_t storage = CBNewBlockChainStorage(argv[1]);
+	if (NOT storage) {
+		printf("Could not open the block-chain database in %s\n", argv[1]);
+		return 1;
+	}
+	bool ok = CBBlockChainStorageMigrateUnspentOutputs(storage)
+		&& CBBlockChainStorageMigrateBlocks(storage)
+		&& CBBlockChainStorageMigrateTransactionIndex(storage, txIndex);
+	CBFreeBlockChainStorage(storage);
+	if (NOT ok) {
+		printf("Migration failed.\n");
+		return 1;
+	}
+	printf("The unspent outputs, blocks and transaction index are up to date.\n");
+	return 0;
+}
@@ -0,0 +1,89 @@
+//
+//  utxoSnapshot.c
+//  cbitcoin
+//
+//  Copyright (c) 2012 Matthew Mitchell
+//
+//  This file is part of cbitcoin.
+//
+//  cbitcoin is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  cbitcoin is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with cbitcoin.  If not, see <http://www.gnu.org/licenses/>.
+
+//  Exports the unspent outputs at the main chain tip of a block-chain database to a snapshot, printing the commitment to the unspent outputs, or creates a new block-chain database from a snapshot with a commitment obtained from a trusted source.
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include "CBBlockChainStorage.h"
+
+void CBLogError(char * format, ...);
+void CBLogError(char * format, ...){
+	va_list argptr;
+	va_start(argptr, format);
+	vfprintf(stderr, format, argptr);
+	va_end(argptr);
+	fprintf(stderr, "\n");
+}
+
+int main(int argc, char * argv[]){
+	bool export = argc == 4 && NOT strcmp(argv[1], "export");
+	bool import = argc == 5 && NOT strcmp(argv[1], "import");
+	uint8_t commitment[32];
+	if (import) {
+		// The commitment is given as printed, in hex.
+		if (strlen(argv[4]) != 64)
+			import = false;
+		else for (uint8_t x = 0; x < 32; x++) {
+			unsigned int byte;
+			if (sscanf(argv[4] + x*2, "%2x", &byte) != 1) {
+				import = false;
+				break;
+			}
+			commitment[x] = byte;
+		}
+	}
+	if (NOT export && NOT import) {
+		printf("Usage: %s export <data directory> <snapshot>\n", argv[0]);
+		printf("       %s import <new data directory> <snapshot> <commitment>\n", argv[0]);
+		return 1;
+	}
+	uint64_t storage = CBNewBlockChainStorage(argv[2]);
+	if (NOT storage) {
+		printf("Could not open the block-chain database in %s\n", argv[2]);
+		return 1;
+	}
+	bool ok;
+	if (export) {
+		if (NOT CBBlockChainStorageExists(storage)) {
+			printf("There is no block-chain database in %s\n", argv[2]);
+			CBFreeBlockChainStorage(storage);
+			return 1;
+		}
+		bool bad;
+		CBFullValidator * validator = CBNewFullValidator(storage, &bad, 0);
+		ok = validator && CBBlockChainStorageExportUnspentOutputs(validator, argv[3], commitment);
+		if (validator)
+			CBReleaseObject(validator);
+	}else
+		ok = CBBlockChainStorageImportUnspentOutputs(storage, argv[3], commitment, 0);
+	CBFreeBlockChainStorage(storage);
+	if (NOT ok) {
+		printf("The snapshot could not be %s.\n", export ? "exported" : "imported");
+		return 1;
+	}
+	printf(export ? "Commitment: " : "Imported with the commitment: ");
+	for (uint8_t x = 0; x < 32; x++)
+		printf("%02x", commitment[x]);
+	printf("\n");
+	return 0;
+}
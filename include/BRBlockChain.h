@@ -6,12 +6,15 @@
 #include "CBChainDescriptor.h"
 #include "CBInventoryBroadcast.h"
 
+#include "BRHeaderChain.h"
+
 typedef struct {
     uint64_t storage;
     CBFullValidator *validator;
+    BRHeaderChain *headers; /* NULL unless synchronising headers first */
 } BRBlockChain;
 
-BRBlockChain *BRNewBlockChain(char *);
+BRBlockChain *BRNewBlockChain(char *, int);
 CBChainDescriptor *BRKnownBlocks(BRBlockChain *);
 CBInventoryBroadcast *BRUnknownBlocksFromInv(BRBlockChain *, CBInventoryBroadcast *);
 
@@ -4,6 +4,8 @@
 #include "CBByteArray.h"
 #include "CBNetworkAddress.h"
 
+#include "BRHeaderChain.h"
+
 typedef struct {
     int sock;
     CBNetworkAddress *address, *my_address;
@@ -13,6 +15,18 @@ typedef struct {
     void *connector; /* BRConnector pointer */
     char ver_acked, ver_received; /* both need to be true for version exchange */
     char addr_sent, getblocks_sent;
+    char getheaders_sent; /* headers-first only */
+    /* bodies requested from this peer and how many it may have at once */
+    int blocks_in_flight, window;
+    /* measured as downloadTime, downloadAmount, latencyTime and responses
+     * of CBPeer, in milliseconds and bytes */
+    uint64_t download_time, download_amount, latency_time;
+    uint32_t responses;
+    uint64_t last_receive; /* when the last body arrived */
+    uint64_t stalled_at; /* when a body from this peer last timed out */
+    /* messages are serialised into out after 24 bytes of header space.
+     * out_payload references the space after the header */
+    CBByteArray *out, *out_payload;
 } BRConnection;
 
 BRConnection *BRNewConnection(char *, uint16_t, CBNetworkAddress *,
@@ -25,10 +39,13 @@ void BRSendPing(BRConnection *);
 void BRSendPong(BRConnection *, CBByteArray *, uint32_t);
 void BRSendGetAddr(BRConnection *);
 void BRSendGetBlocks(BRConnection *);
+void BRSendGetHeaders(BRConnection *);
+void BRSendGetData(BRConnection *, BRHeader **, int);
 void BRSendAddr(BRConnection *);
 void BRHandleAddr(BRConnection *, CBByteArray *);
 void BRHandleInv(BRConnection *, CBByteArray *);
 void BRHandleBlock(BRConnection *, CBByteArray *);
+void BRHandleHeaders(BRConnection *, CBByteArray *);
 bool BRVersionExchanged(BRConnection *); /* if ver_sent and ver_received */
 
 #endif
@@ -6,6 +6,14 @@
 #include "BRSelector.h"
 #include "BRConnection.h"
 #include "BRBlockChain.h"
+#include "BRHeaderChain.h"
+
+/* body downloads in headers-first mode: each peer has a window of requests
+ * which grows by one per body received and halves when a body times out */
+#define BR_INITIAL_WINDOW 4
+#define BR_MAX_WINDOW 64
+#define BR_BLOCK_TIMEOUT 20000 /* milliseconds before asking another peer */
+#define BR_DOWNLOAD_INTERVAL 2 /* seconds between checks for stalled bodies */
 
 typedef struct {
     int num_conns, num_ho; /* number of open connections and half-open connections */
@@ -17,6 +25,7 @@ typedef struct {
     CBNetworkAddress *my_address;
     BRSelector *selector;
     BRBlockChain *block_chain;
+    uint64_t blocks_downloaded, blocks_stalled;
 } BRConnector;
 
 BRConnector *BRNewConnector(char *, int, BRSelector *, BRBlockChain *);
@@ -25,5 +34,9 @@ void BRRemoveConnection(BRConnector *, BRConnection *);
 void BRListenerCallback(void *);
 void BRPingCallback(void *);
 void BRConnectedCallback(void *);
+void BRScheduleDownloads(BRConnector *);
+void BRBlockDownloaded(BRConnector *, BRConnection *, BRHeader *, uint32_t);
+void BRDownloadCallback(void *);
+uint64_t BRThroughput(BRConnection *); /* bytes per second */
 
 #endif
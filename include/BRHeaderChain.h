@@ -0,0 +1,62 @@
+#ifndef BRHEADERCHAIN_H_
+#define BRHEADERCHAIN_H_
+
+#include <stdint.h>
+#include "CBBlock.h"
+#include "CBChainDescriptor.h"
+#include "CBAssociativeArray.h"
+#include "CBFullValidator.h"
+
+#define BR_HEADER_CHUNK 4096 /* headers allocated together */
+#define BR_MEDIAN_TIME_SPAN 11 /* blocks used for the median time */
+#define BR_DOWNLOAD_WINDOW 1024 /* bodies requested beyond the connected height */
+#define BR_REJECTED_HEADERS 16 /* hashes of rejected blocks remembered */
+
+/* headers-first synchronisation: the header chain is downloaded and
+ * validated ahead of the block bodies, which can then be fetched from
+ * several peers at once and connected to the validator in height order */
+
+typedef struct {
+    uint8_t hash[32]; /* first so the index can compare entries by hash */
+    uint32_t height;
+    uint32_t time, target;
+    uint32_t retarget_time; /* time of the first block of this retarget period */
+    CBBlock *block; /* downloaded body waiting to be connected, or NULL */
+    void *requested_from; /* BRConnection asked for the body, or NULL */
+    uint64_t requested_at; /* milliseconds */
+} BRHeader;
+
+typedef enum {
+    BR_HEADER_ADDED,
+    BR_HEADER_KNOWN, /* already in the chain */
+    BR_HEADER_UNCONNECTED, /* previous header unknown or not the tip */
+    BR_HEADER_BAD, /* failed proof of work, target or time checks, or a
+                    * rejected block or one of its descendants */
+} BRHeaderStatus;
+
+typedef struct {
+    BRHeader **chunks;
+    uint32_t num_chunks;
+    uint32_t base_height; /* height of the first header */
+    uint32_t num_headers;
+    uint32_t connected; /* height of the last block given to the validator */
+    CBAssociativeArray index; /* headers by hash */
+    uint8_t genesis[32]; /* ends every locator */
+    int check_pow; /* as the validator, which may disable it for testing */
+    uint8_t rejected[BR_REJECTED_HEADERS][32]; /* blocks whose bodies failed */
+    uint32_t num_rejected; /* total ever rejected, the oldest are overwritten */
+} BRHeaderChain;
+
+BRHeaderChain *BRNewHeaderChain(CBFullValidator *);
+void BRFreeHeaderChain(BRHeaderChain *);
+BRHeader *BRHeaderChainGet(BRHeaderChain *, uint32_t); /* by height */
+BRHeader *BRHeaderChainFind(BRHeaderChain *, uint8_t *); /* by hash */
+BRHeader *BRHeaderChainTip(BRHeaderChain *);
+BRHeaderStatus BRHeaderChainAdd(BRHeaderChain *, CBBlock *, uint64_t);
+CBChainDescriptor *BRHeaderChainLocator(BRHeaderChain *);
+void BRHeaderChainForgetRequests(BRHeaderChain *, void *);
+void *BRHeaderReleaseRequest(BRHeader *);
+int BRHeaderChainConnect(BRHeaderChain *, CBFullValidator *);
+void BRHeaderChainGiveAssumeValid(BRHeaderChain *, CBFullValidator *);
+
+#endif
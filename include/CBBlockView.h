@@ -0,0 +1,177 @@
+//
+//  CBBlockView.h
+//  cbitcoin
+//
+//  Copyright (c) 2012 Matthew Mitchell
+//
+//  This file is part of cbitcoin.
+//
+//  cbitcoin is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  cbitcoin is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with cbitcoin.  If not, see <http://www.gnu.org/licenses/>.
+
+/**
+ @file
+ @brief A read-only view of a serialised block which avoids creating objects. Where CBBlockDeserialise creates CBTransaction, CBTransactionInput, CBTransactionOutput, CBScript and CBByteArray objects for every part of the block, CBBlockViewParse reads the block in one pass into tables of offsets and decoded integers held in a single arena, which is kept between blocks so that parsing does not allocate once the arena is large enough. The view references the block data, which must outlive it. Scripts can be used through CBScript structures on the C stack which reference the block data.
+ */
+
+#ifndef CBBLOCKVIEWH
+#define CBBLOCKVIEWH
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "CBConstants.h"
+#include "CBDependencies.h"
+#include "CBScript.h"
+#include <stddef.h>
+
+// Constants
+
+#define CB_BLOCK_VIEW_MAX_ARENA_SIZE 0x40000000 // 1 GB. The tables of a block allowed by the protocol take a few MB.
+
+// Types
+
+/**
+ @brief A transaction in a CBBlockView.
+ */
+typedef struct{
+	uint32_t offset; /**< Offset of the transaction in the block data. */
+	uint32_t length; /**< Length of the serialised transaction. */
+	uint32_t version;
+	uint32_t lockTime;
+	uint32_t firstInput; /**< Index of the first input of the transaction in the inputs of the view. */
+	uint32_t inputNum;
+	uint32_t firstOutput; /**< Index of the first output of the transaction in the outputs of the view. */
+	uint32_t outputNum;
+} CBBlockViewTransaction;
+
+/**
+ @brief A transaction input in a CBBlockView.
+ */
+typedef struct{
+	uint32_t offset; /**< Offset of the input in the block data, which is where the previous output hash begins. */
+	uint32_t prevOutIndex;
+	uint32_t scriptOffset; /**< Offset of the input script in the block data. */
+	uint32_t scriptLength;
+	uint32_t sequence;
+} CBBlockViewInput;
+
+/**
+ @brief A transaction output in a CBBlockView.
+ */
+typedef struct{
+	uint64_t value;
+	uint32_t scriptOffset; /**< Offset of the output script in the block data. */
+	uint32_t scriptLength;
+} CBBlockViewOutput;
+
+/**
+ @brief Structure for a parsed block. @see CBBlockView.h
+ */
+typedef struct{
+	uint8_t * data; /**< The serialised block data, which is referenced and not owned. */
+	uint32_t length; /**< The length of the block data which was parsed. */
+	uint32_t version;
+	uint32_t time;
+	uint32_t target;
+	uint32_t nonce;
+	uint32_t transactionNum;
+	uint32_t inputNum; /**< Total number of inputs in the block. */
+	uint32_t outputNum; /**< Total number of outputs in the block. */
+	CBBlockViewTransaction * transactions; /**< In the arena. */
+	CBBlockViewInput * inputs; /**< In the arena, in block order. */
+	CBBlockViewOutput * outputs; /**< In the arena, in block order. */
+	uint8_t * hashes; /**< Space in the arena for 32 bytes per transaction, used to calculate the merkle root. */
+	uint8_t * arena; /**< Memory for the tables. */
+	size_t arenaSize;
+} CBBlockView;
+
+// Initialisation
+
+/**
+ @brief Initialises a CBBlockView with an empty arena.
+ @param self The CBBlockView.
+ */
+void CBInitBlockView(CBBlockView * self);
+/**
+ @brief Frees the arena of a CBBlockView.
+ @param self The CBBlockView.
+ */
+void CBFreeBlockView(CBBlockView * self);
+
+//  Functions
+
+/**
+ @brief Calculates the hash of a transaction in the view.
+ @param self The CBBlockView.
+ @param tx The index of the transaction.
+ @param hash 32 bytes for the double SHA-256 hash.
+ */
+void CBBlockViewCalculateTransactionHash(CBBlockView * self, uint32_t tx, uint8_t * hash);
+/**
+ @brief Calculates the merkle root of the transactions in the view using the arena.
+ @param self The CBBlockView.
+ @param root 32 bytes for the merkle root.
+ */
+void CBBlockViewCalculateMerkleRoot(CBBlockView * self, uint8_t * root);
+/**
+ @brief Gets the merkle root in the block header.
+ @param self The CBBlockView.
+ @returns A pointer to the 32 byte merkle root in the block data.
+ */
+uint8_t * CBBlockViewGetMerkleRoot(CBBlockView * self);
+/**
+ @brief Gets the previous block hash in the block header.
+ @param self The CBBlockView.
+ @returns A pointer to the 32 byte previous block hash in the block data.
+ */
+uint8_t * CBBlockViewGetPrevBlockHash(CBBlockView * self);
+/**
+ @brief Gets the previous output hash of an input.
+ @param self The CBBlockView.
+ @param input The index of the input in the block.
+ @returns A pointer to the 32 byte hash in the block data.
+ */
+uint8_t * CBBlockViewGetPrevOutHash(CBBlockView * self, uint32_t input);
+/**
+ @brief Initialises a CBScript for the script of an input, referencing the block data. @see CBInitScriptWithDataReference
+ @param self The CBBlockView.
+ @param input The index of the input in the block.
+ @param script The CBScript to initialise, which can be on the C stack.
+ @param sharedData The shared data structure for the script, which can be on the C stack.
+ */
+void CBBlockViewGetInputScript(CBBlockView * self, uint32_t input, CBScript * script, CBSharedData * sharedData);
+/**
+ @brief Initialises a CBScript for the script of an output, referencing the block data. @see CBInitScriptWithDataReference
+ @param self The CBBlockView.
+ @param output The index of the output in the block.
+ @param script The CBScript to initialise, which can be on the C stack.
+ @param sharedData The shared data structure for the script, which can be on the C stack.
+ */
+void CBBlockViewGetOutputScript(CBBlockView * self, uint32_t output, CBScript * script, CBSharedData * sharedData);
+/**
+ @brief Determines if a transaction is a coinbase transaction, which has one input with a null previous output.
+ @param self The CBBlockView.
+ @param tx The index of the transaction.
+ @returns true if the transaction is a coinbase, false otherwise.
+ */
+bool CBBlockViewTransactionIsCoinBase(CBBlockView * self, uint32_t tx);
+/**
+ @brief Parses a serialised block with transactions into the view. The checks on the data are the same as those of CBBlockDeserialise. The arena grows if it is not large enough and is otherwise reused.
+ @param self The CBBlockView.
+ @param data The serialised block, which must outlive the view or the next parse.
+ @param length The length of the data.
+ @returns The length read on success, 0 on failure.
+ */
+uint32_t CBBlockViewParse(CBBlockView * self, uint8_t * data, uint32_t length);
+
+#endif
@@ -40,7 +40,7 @@
  */
 typedef struct{
 	uint8_t * data; /**< Pointer to byte data */
-	uint32_t references; /**< References to this data */
+	CBReferenceCount references; /**< References to this data */
 }CBSharedData;
 
 /**
@@ -305,5 +305,23 @@ CBByteArray * CBByteArraySubCopy(CBByteArray * self, uint32_t offset, uint32_t l
  @returns The new CBByteArray.
  */
 CBByteArray * CBByteArraySubReference(CBByteArray * self, uint32_t offset, uint32_t length);
+/**
+ @brief Compares two 32 byte hashes like memcmp, using SSE2 where available. CBByteArrayCompare uses this for 32 byte arrays.
+ @param hash1 The first hash.
+ @param hash2 The second hash.
+ @returns CB_COMPARE_EQUAL if the hashes are equal, otherwise CB_COMPARE_MORE_THAN if the first different byte is higher in hash1, or CB_COMPARE_LESS_THAN.
+ */
+CBCompare CBHashCompare(uint8_t * hash1, uint8_t * hash2);
+/**
+ @brief Determines if a 32 byte hash is all zero, using SSE2 where available. CBByteArrayIsNull uses this for 32 byte arrays.
+ @param hash The hash.
+ @returns true if all bytes are zero, false otherwise.
+ */
+bool CBHashIsNull(uint8_t * hash);
+/**
+ @brief Reverses the bytes of a 32 byte hash, using SSE2 where available. CBByteArrayReverseBytes uses this for 32 byte arrays.
+ @param hash The hash.
+ */
+void CBHashReverse(uint8_t * hash);
 
 #endif
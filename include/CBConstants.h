@@ -23,6 +23,9 @@
 #ifndef CBCONSTANTSH
 #define CBCONSTANTSH
 
+#include <stdint.h>
+#include <string.h>
+
 //  Macros
 
 #define CB_LIBRARY_VERSION 5 // Goes up in increments
@@ -35,35 +38,68 @@
 #define CB_ONE_BITCOIN 100000000LL // Each bitcoin has 100 million satoshis (individual units).
 #define CB_24_HOURS 86400
 #define NOT ! // Better readability than !
-#define CBInt16ToArray(arr, offset, i) arr[offset] = i; \
-									 arr[offset + 1] = (i) >> 8;
-#define CBInt32ToArray(arr, offset, i) CBInt16ToArray(arr, offset, i) \
-									 arr[offset + 2] = (i) >> 16; \
-							         arr[offset + 3] = (i) >> 24;
-#define CBInt64ToArray(arr, offset, i) CBInt32ToArray(arr, offset, i) \
-									 arr[offset + 4] = (i) >> 32; \
-									 arr[offset + 5] = (i) >> 40; \
-									 arr[offset + 6] = (i) >> 48; \
-									 arr[offset + 7] = (i) >> 56;
-#define CBArrayToInt16(arr, offset) (arr[offset] \
-                                     | (uint16_t)arr[offset + 1] << 8)
-#define CBArrayToInt32(arr, offset) (CBArrayToInt16(arr, offset) \
-                                     | (uint32_t)arr[offset + 2] << 16 \
-									 | (uint32_t)arr[offset + 3] << 24)
-#define CBArrayToInt48(arr, offset) (CBArrayToInt32(arr, offset) \
-                                     | (uint64_t)arr[offset + 4] << 32 \
-                                     | (uint64_t)arr[offset + 5] << 40) 
-#define CBArrayToInt64(arr, offset) (CBArrayToInt48(arr, offset) \
-                                     | (uint64_t)arr[offset + 6] << 48 \
-                                     | (uint64_t)arr[offset + 7] << 56)
-#define CBInt32ToArrayBigEndian(arr, offset, i) arr[offset] = (i) >> 24; \
-										      arr[offset + 1] = (i) >> 16;\
-                                              arr[offset + 2] = (i) >> 8; \
-                                              arr[offset + 3] = (i);
-#define CBArrayToInt32BigEndian(arr, offset) (arr[offset] << 24 \
-                                              | (uint16_t)arr[offset + 1] << 16 \
-                                              | (uint32_t)arr[offset + 2] << 8 \
-                                              | (uint32_t)arr[offset + 3])
+#define CBInt16ToArray(arr, offset, i) CBStoreInt16((arr) + (offset), i);
+#define CBInt32ToArray(arr, offset, i) CBStoreInt32((arr) + (offset), i);
+#define CBInt64ToArray(arr, offset, i) CBStoreInt64((arr) + (offset), i);
+#define CBArrayToInt16(arr, offset) CBLoadInt16((arr) + (offset))
+#define CBArrayToInt32(arr, offset) CBLoadInt32((arr) + (offset))
+#define CBArrayToInt48(arr, offset) (CBLoadInt32((arr) + (offset)) | (uint64_t)CBLoadInt16((arr) + (offset) + 4) << 32)
+#define CBArrayToInt64(arr, offset) CBLoadInt64((arr) + (offset))
+#define CBInt32ToArrayBigEndian(arr, offset, i) CBStoreInt32BigEndian((arr) + (offset), i);
+#define CBArrayToInt32BigEndian(arr, offset) CBLoadInt32BigEndian((arr) + (offset))
+
+//  Endian helpers
+
+// Integers are loaded and stored with memcpy, which compiles to single unaligned loads and stores, and byte swapped when the host byte order differs.
+
+#if defined(__GNUC__) && defined(__BYTE_ORDER__)
+#define CB_LITTLE_ENDIAN_HOST (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+#define CBSwap16(x) __builtin_bswap16(x)
+#define CBSwap32(x) __builtin_bswap32(x)
+#define CBSwap64(x) __builtin_bswap64(x)
+#else
+#define CB_LITTLE_ENDIAN_HOST (*(uint16_t *)"\1" == 1)
+#define CBSwap16(x) ((uint16_t)((x) << 8 | (x) >> 8))
+#define CBSwap32(x) ((uint32_t)CBSwap16((uint16_t)(x)) << 16 | CBSwap16((uint16_t)((x) >> 16)))
+#define CBSwap64(x) ((uint64_t)CBSwap32((uint32_t)(x)) << 32 | CBSwap32((uint32_t)((x) >> 32)))
+#endif
+
+static inline uint16_t CBLoadInt16(const void * data){
+	uint16_t i;
+	memcpy(&i, data, 2);
+	return CB_LITTLE_ENDIAN_HOST ? i : CBSwap16(i);
+}
+static inline uint32_t CBLoadInt32(const void * data){
+	uint32_t i;
+	memcpy(&i, data, 4);
+	return CB_LITTLE_ENDIAN_HOST ? i : CBSwap32(i);
+}
+static inline uint64_t CBLoadInt64(const void * data){
+	uint64_t i;
+	memcpy(&i, data, 8);
+	return CB_LITTLE_ENDIAN_HOST ? i : CBSwap64(i);
+}
+static inline uint32_t CBLoadInt32BigEndian(const void * data){
+	uint32_t i;
+	memcpy(&i, data, 4);
+	return CB_LITTLE_ENDIAN_HOST ? CBSwap32(i) : i;
+}
+static inline void CBStoreInt16(void * data, uint16_t i){
+	i = CB_LITTLE_ENDIAN_HOST ? i : CBSwap16(i);
+	memcpy(data, &i, 2);
+}
+static inline void CBStoreInt32(void * data, uint32_t i){
+	i = CB_LITTLE_ENDIAN_HOST ? i : CBSwap32(i);
+	memcpy(data, &i, 4);
+}
+static inline void CBStoreInt64(void * data, uint64_t i){
+	i = CB_LITTLE_ENDIAN_HOST ? i : CBSwap64(i);
+	memcpy(data, &i, 8);
+}
+static inline void CBStoreInt32BigEndian(void * data, uint32_t i){
+	i = CB_LITTLE_ENDIAN_HOST ? CBSwap32(i) : i;
+	memcpy(data, &i, 4);
+}
 
 //  Enums
 
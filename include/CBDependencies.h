@@ -40,6 +40,7 @@
 #pragma weak CBRipemd160
 #pragma weak CBSha160
 #pragma weak CBEcdsaVerify
+#pragma weak CBEcdsaVerifyBatch
 #pragma weak CBEcdsaSign
 
 // Weak linking for networking functions.
@@ -70,37 +71,38 @@
 #pragma weak CBSecureRandomSeed
 #pragma weak CBRandomSeed
 #pragma weak CBSecureRandomInteger
+#pragma weak CBSecureRandomFill
+#pragma weak CBSecureRandomBytes
 #pragma weak CBFreeSecureRandomGenerator
 
 // Weak linking for block storage functions
 
 #pragma weak CBNewBlockChainStorage
 #pragma weak CBFreeBlockChainStorage
+#pragma weak CBBlockChainStorageApplyUnspentOutputChanges
 #pragma weak CBBlockChainStorageBlockExists
+#pragma weak CBBlockChainStorageBlockSize
 #pragma weak CBBlockChainStorageCommitData
 #pragma weak CBBlockChainStorageDeleteBlock
 #pragma weak CBBlockChainStorageDeleteUnspentOutput
 #pragma weak CBBlockChainStorageDeleteTransactionRef
 #pragma weak CBBlockChainStorageExists
-#pragma weak CBBlockChainStorageGetBlockLocation
-#pragma weak CBBlockChainStorageGetBlockTime
-#pragma weak CBBlockChainStorageGetBlockTarget
 #pragma weak CBBlockChainStorageLoadBasicValidator
 #pragma weak CBBlockChainStorageLoadBlock
-#pragma weak CBBlockChainStorageLoadBranch
-#pragma weak CBBlockChainStorageLoadBranchWork
-#pragma weak CBBlockChainStorageLoadOrphan
+#pragma weak CBBlockChainStorageLoadBlockHeader
 #pragma weak CBBlockChainStorageLoadOutputs
 #pragma weak CBBlockChainStorageLoadUnspentOutput
-#pragma weak CBBlockChainStorageMoveBlock
+#pragma weak CBBlockChainStoragePrefetchUnspentOutputs
+#pragma weak CBBlockChainStoragePruneBlock
 #pragma weak CBBlockChainStorageReset
+#pragma weak CBBlockChainStorageRestoreUndo
 #pragma weak CBBlockChainStorageSaveBasicValidator
 #pragma weak CBBlockChainStorageSaveBlock
-#pragma weak CBBlockChainStorageSaveBranch
-#pragma weak CBBlockChainStorageSaveBranchWork
-#pragma weak CBBlockChainStorageSaveOrphan
 #pragma weak CBBlockChainStorageSaveTransactionRef
+#pragma weak CBBlockChainStorageSaveUndo
 #pragma weak CBBlockChainStorageSaveUnspentOutput
+#pragma weak CBBlockChainStorageSpendUnspentOutput
+#pragma weak CBBlockChainStorageUndoExists
 #pragma weak CBBlockChainStorageUnspentOutputExists
 
 // Weak linking for address storage functions
@@ -151,6 +153,24 @@ void CBSha160(uint8_t * data, uint16_t length, uint8_t * output);
  @returns true if the signature is valid and false if invalid.
  */
 bool CBEcdsaVerify(uint8_t * signature, uint8_t sigLen, uint8_t * hash, const uint8_t * pubKey, uint8_t keyLen);
+/**
+ @brief A signature to verify with CBEcdsaVerifyBatch. The fields are the arguments for CBEcdsaVerify.
+ */
+typedef struct{
+	uint8_t * signature; /**< BER encoded signature bytes. */
+	uint8_t sigLen; /**< The length of the signature bytes. */
+	uint8_t * hash; /**< A 32 byte hash for checking the signature against. */
+	const uint8_t * pubKey; /**< Public key bytes to check this signature with. */
+	uint8_t keyLen; /**< The length of the public key bytes. */
+} CBEcdsaVerifyInput;
+/**
+ @brief Verifies a number of ECDSA signatures together, with the same requirements as CBEcdsaVerify. Implementations can share work between the signatures.
+ @param inputs The signatures to verify.
+ @param num The number of signatures.
+ @param results An array of num booleans set to the result for each signature. May be NULL.
+ @returns true if all of the signatures are valid and false if any are invalid.
+ */
+bool CBEcdsaVerifyBatch(CBEcdsaVerifyInput * inputs, uint32_t num, bool * results);
 
 bool CBEcdsaSign(uint8_t * hash, uint8_t * privKey, unsigned int *nSig, uint8_t **sig);
 
@@ -344,6 +364,20 @@ void CBRandomSeed(uint64_t gen, uint64_t seed);
  @returns The random 64-bit integer integer.
  */
 uint64_t CBSecureRandomInteger(uint64_t gen);
+/**
+ @brief Fills a buffer with random bytes from a generator.
+ @param gen The generator.
+ @param buf The buffer to fill.
+ @param len The number of bytes to generate.
+ */
+void CBSecureRandomFill(uint64_t gen, uint8_t * buf, uint32_t len);
+/**
+ @brief Fills a buffer with random bytes from a generator belonging to the calling thread, which is seeded securely on first use and reseeded in the child after a fork. No generator needs to be created and it is safe to call from any thread.
+ @param buf The buffer to fill.
+ @param len The number of bytes to generate.
+ @returns true on success, false if the generator could not be seeded.
+ */
+bool CBSecureRandomBytes(uint8_t * buf, uint32_t len);
 /**
  @brief Frees the random number generator.
  @param gen The generator.
@@ -364,12 +398,31 @@ uint64_t CBNewBlockChainStorage(char * dataDir);
  */
 void CBFreeBlockChainStorage(uint64_t iself);
 /**
- @brief Determines if the block is already in the storage.
+ @brief Applies the changes a block makes to the unspent outputs, given as CBUnspentOutputChange structures sorted by key. Spent outputs are removed and appended to the undo data as with CBBlockChainStorageSpendUnspentOutput. Cancelled outputs are not stored but are appended to the undo data, so that removing the block deletes them along with its other outputs.
  @param validator A CBFullValidator object. The storage object can be found within this.
- @param blockHash The 20 bytes of the hash of the block
+ @param changes The sorted CBUnspentOutputChange structures.
+ @param numChanges The number of changes.
+ @param height The height of the block.
+ @param undo A pointer to a memory block holding the undo data for the block, which may be reallocated.
+ @param undoLength The length of the undo data, which will be increased.
+ @param undoAllocSize The size of the memory block for the undo data, which may be increased.
+ @returns true on sucess or false on failure.
+ */
+bool CBBlockChainStorageApplyUnspentOutputChanges(void * validator, void * changes, uint32_t numChanges, uint32_t height, uint8_t ** undo, uint32_t * undoLength, uint32_t * undoAllocSize);
+/**
+ @brief Determines if there is a block stored with an ID. Deleted blocks leave gaps in the IDs.
+ @param validator A CBFullValidator object. The storage object can be found within this.
+ @param blockID The ID of the block.
  @returns true if the block is in the storage or false otherwise.
  */
-bool CBBlockChainStorageBlockExists(void * validator, uint8_t * blockHash);
+bool CBBlockChainStorageBlockExists(void * validator, uint32_t blockID);
+/**
+ @brief Gets the size of a stored block.
+ @param validator A CBFullValidator object. The storage object can be found within this.
+ @param blockID The ID of the block.
+ @returns The size of the block in bytes, or zero if the block has been pruned or does not exist.
+ */
+uint32_t CBBlockChainStorageBlockSize(void * validator, uint32_t blockID);
 /**
  @brief The data should be written to the disk atomically.
  @param iself The block-chain storage object.
@@ -379,27 +432,26 @@ bool CBBlockChainStorageCommitData(uint64_t iself);
 /**
  @brief Deletes a block.
  @param validator A CBFullValidator object. The storage object can be found within this.
- @param branch The branch where the block exists.
- @param blockIndex The index of the block.
+ @param blockID The ID of the block.
  @returns true on sucess or false on failure.
  */
-bool CBBlockChainStorageDeleteBlock(void * validator, uint8_t branch, uint32_t blockIndex);
+bool CBBlockChainStorageDeleteBlock(void * validator, uint32_t blockID);
 /**
- @brief Deletes an unspent output reference. The ouput should still be in the block. The number of unspent outputs for the transaction should be decremented.
+ @brief Deletes an unspent output.
  @param validator A CBFullValidator object. The storage object can be found within this.
  @param txHash The transaction hash of this output.
  @param outputIndex The index of the output in the transaction.
- @param decrement If true decrement the number of unspent outputs for the transaction.
  @returns true on sucess or false on failure.
  */
-bool CBBlockChainStorageDeleteUnspentOutput(void * validator, uint8_t * txHash, uint32_t outputIndex, bool decrement);
+bool CBBlockChainStorageDeleteUnspentOutput(void * validator, uint8_t * txHash, uint32_t outputIndex);
 /**
- @brief Deletes a transaction reference once all instances have been removed. Decrement the instance count and remove if zero. The transaction should still be in the block. Reset the unspent output count to 0.
+ @brief Deletes the transaction index entry for a transaction in a block. Other instances of the transaction in other blocks are kept.
  @param validator A CBFullValidator object. The storage object can be found within this.
  @param txHash The transaction's hash.
+ @param blockID The ID of the block which contains the transaction.
  @returns true on sucess or false on failure.
  */
-bool CBBlockChainStorageDeleteTransactionRef(void * validator, uint8_t * txHash);
+bool CBBlockChainStorageDeleteTransactionRef(void * validator, uint8_t * txHash, uint32_t blockID);
 /**
  @brief Determines if there is previous data or if initial data needs to be created.
  @param iself The block-chain storage object.
@@ -407,85 +459,41 @@ bool CBBlockChainStorageDeleteTransactionRef(void * validator, uint8_t * txHash)
  */
 bool CBBlockChainStorageExists(uint64_t iself);
 /**
- @brief Gets the location of a block.
- @param validator A CBFullValidator object. The storage object can be found within this.
- @param blockHash The 20 bytes of the hash of the block
- @param branch Will be set to the branch of the block.
- @param index Will be set to the index of the block.
- @returns true on success or false otherwise.
- */
-bool CBBlockChainStorageGetBlockLocation(void * validator, uint8_t * blockHash, uint8_t * branch, uint32_t * index);
-/**
- @brief Obtains the timestamp for a block.
- @param validator A CBFullValidator object. The storage object can be found within this.
- @param branch The branch where the block exists.
- @param blockIndex The index of the block.
- @returns The time on sucess or 0 on failure.
- */
-uint32_t CBBlockChainStorageGetBlockTime(void * validator, uint8_t branch, uint32_t blockIndex);
-/**
- @brief Obtains the target for a block.
- @param validator A CBFullValidator object. The storage object can be found within this.
- @param branch The branch where the block exists.
- @param blockIndex The index of the block.
- @returns The target on sucess or 0 on failure.
- */
-uint32_t CBBlockChainStorageGetBlockTarget(void * validator, uint8_t branch, uint32_t blockIndex);
-/**
- @brief Determines if a transaction exists in the index, which has more than zero unspent outputs.
- @param validator A CBFullValidator object. The storage object can be found within this.
- @param txHash The hash of the transaction to search for.
- @param exists To be set to true if the transaction exists and has unspent outputs, else set to false.
- @param true on success or false on failure.
- */
-bool CBBlockChainStorageIsTransactionWithUnspentOutputs(void * validator, uint8_t * txHash, bool * exists);
-/**
- @brief Loads the basic validator information, not any branches or orphans.
+ @brief Loads the basic validator information, setting nextBlockID.
  @param validator A CBFullValidator object. The storage object can be found within this.
+ @param mainTip Will be set to the ID of the last block in the main chain.
  @returns true on sucess or false on failure.
  */
-bool CBBlockChainStorageLoadBasicValidator(void * validator);
+bool CBBlockChainStorageLoadBasicValidator(void * validator, uint32_t * mainTip);
 /**
  @brief Loads a block from storage.
  @param validator The CBFullValidator object.
- @param blockID The index of the block int he branch.
- @param branch The branch the block belongs to.
- @returns A new CBBlock object with serailised block data which has not been deserialised or NULL on failure.
- */
-void * CBBlockChainStorageLoadBlock(void * validator, uint32_t blockID, uint32_t branch);
-/**
- @brief Loads a branch
- @param validator A CBFullValidator object. The storage object can be found within this.
- @param branchNum The number of the branch to load.
- @returns true on sucess or false on failure.
- */
-bool CBBlockChainStorageLoadBranch(void * validator, uint8_t branchNum);
-/**
- @brief Loads a branch's work
- @param validator A CBFullValidator object. The storage object can be found within this.
- @param branchNum The number of the branch to load the work for.
- @returns true on sucess or false on failure.
+ @param blockID The ID of the block.
+ @returns A new CBBlock object with serailised block data which has not been deserialised or NULL on failure, including when the block has been pruned. Pruned blocks cannot be given to peers.
  */
-bool CBBlockChainStorageLoadBranchWork(void * validator, uint8_t branchNum);
+void * CBBlockChainStorageLoadBlock(void * validator, uint32_t blockID);
 /**
- @brief Loads an orphan.
+ @brief Reads the 80 byte serialised header of a block without the rest of the block.
  @param validator A CBFullValidator object. The storage object can be found within this.
- @param orphanNum The number of the orphan to load.
+ @param blockID The ID of the block.
+ @param header 80 bytes to be set to the block header.
  @returns true on sucess or false on failure.
  */
-bool CBBlockChainStorageLoadOrphan(void * validator, uint8_t orphanNum);
+bool CBBlockChainStorageLoadBlockHeader(void * validator, uint32_t blockID, uint8_t * header);
 /**
- @brief Obtains the outputs for a transaction
+ @brief Obtains the outputs for a transaction from the transaction index. This is only available when the validator keeps the transaction index. @see CB_FULL_VALIDATOR_TRANSACTION_INDEX
  @param validator A CBFullValidator object. The storage object can be found within this.
  @param txHash The transaction hash to load the output data for.
  @param data A pointer to the buffer to set to the data.
  @param dataAllocSize If the size of the outputs is beyond this number, data will be reallocated to the size of the outputs and the number will be increased to the size of the outputs.
  @param position The position of the outputs in the block to be set.
+ @param height Will be set to the height of the block the transaction exists in.
+ @param coinbase Will be set to true if the transaction is a coinbase or false otherwise.
  @returns true on sucess or false on failure.
  */
-bool CBBlockChainStorageLoadOutputs(void * validator, uint8_t * txHash, uint8_t ** data, uint32_t * dataAllocSize, uint32_t * position);
+bool CBBlockChainStorageLoadOutputs(void * validator, uint8_t * txHash, uint8_t ** data, uint32_t * dataAllocSize, uint32_t * position, uint32_t * height, bool * coinbase);
 /**
- @brief Obtains an unspent output.
+ @brief Obtains an unspent output. This should not need to read the block the output exists in.
  @param validator A CBFullValidator object. The storage object can be found within this.
  @param txHash The transaction hash of this output.
  @param outputIndex The index of the output in the transaction.
@@ -495,81 +503,96 @@ bool CBBlockChainStorageLoadOutputs(void * validator, uint8_t * txHash, uint8_t
  */
 void * CBBlockChainStorageLoadUnspentOutput(void * validator, uint8_t * txHash, uint32_t outputIndex, bool * coinbase, uint32_t * outputHeight);
 /**
- @brief Moves a block to a new location.
+ @brief Reads the unspent outputs for a block ahead of validation, in the order they are stored, so that CBBlockChainStorageUnspentOutputExists and CBBlockChainStorageLoadUnspentOutput do not need to read the storage for them. The outputs are kept until the unspent outputs change.
  @param validator A CBFullValidator object. The storage object can be found within this.
- @param branch The branch where the block exists.
- @param blockIndex The index of the block.
- @param newBranch The branch where the block will be moved into.
- @param newIndex The index the block will take in the new branch.
+ @param outpoints The outputs to read, each being the transaction hash followed by the output index as four little-endian bytes.
+ @param numOutpoints The number of outputs.
  @returns true on sucess or false on failure.
  */
-bool CBBlockChainStorageMoveBlock(void * validator, uint8_t branch, uint32_t blockIndex, uint8_t newBranch, uint32_t newIndex);
+bool CBBlockChainStoragePrefetchUnspentOutputs(void * validator, uint8_t * outpoints, uint32_t numOutpoints);
+/**
+ @brief Removes the transactions of a block, keeping the header so that the block tree can still be loaded. The undo data for the block is also removed. The space is reused for later values.
+ @param validator A CBFullValidator object. The storage object can be found within this.
+ @param blockID The ID of the block.
+ @returns true on sucess or false on failure.
+ */
+bool CBBlockChainStoragePruneBlock(void * validator, uint32_t blockID);
 /**
  @brief Removes all of the pending operations.
  @param iself The storage object.
  */
 void CBBlockChainStorageReset(uint64_t iself);
 /**
- @brief Saves the basic validator information, not any branches or orphans.
- @param validator A CBFullValidator object. The storage object can be found within this.
- @returns true on sucess or false on failure.
- */
-bool CBBlockChainStorageSaveBasicValidator(void * validator);
-/**
- @brief Saves a block.
+ @brief Restores the unspent outputs spent by a block from the undo data for the block. The undo data is then removed.
  @param validator A CBFullValidator object. The storage object can be found within this.
- @param block The block to save.
- @param branch The branch of this block
- @param blockIndex The index of this block.
+ @param blockID The ID of the block being removed from the main chain.
  @returns true on sucess or false on failure.
  */
-bool CBBlockChainStorageSaveBlock(void * validator, void * block, uint8_t branch, uint32_t blockIndex);
+bool CBBlockChainStorageRestoreUndo(void * validator, uint32_t blockID);
 /**
- @brief Saves the branch information without commiting to disk.
+ @brief Saves the basic validator information, which is the main chain tip and nextBlockID.
  @param validator A CBFullValidator object. The storage object can be found within this.
- @param branch The branch number to save.
  @returns true on sucess or false on failure.
  */
-bool CBBlockChainStorageSaveBranch(void * validator, uint8_t branch);
+bool CBBlockChainStorageSaveBasicValidator(void * validator);
 /**
- @brief Saves the work for a branch without commiting to disk.
+ @brief Saves a block.
  @param validator A CBFullValidator object. The storage object can be found within this.
- @param branch The branch number with the work to save.
+ @param block The block to save.
+ @param blockID The ID to store the block with.
  @returns true on sucess or false on failure.
  */
-bool CBBlockChainStorageSaveBranchWork(void * validator, uint8_t branch);
+bool CBBlockChainStorageSaveBlock(void * validator, void * block, uint32_t blockID);
 /**
- @brief Saves a block as an orphan
+ @brief Saves the undo data for a block, made by CBBlockChainStorageSpendUnspentOutput.
  @param validator A CBFullValidator object. The storage object can be found within this.
- @param block The block to save.
- @param orphanNum The number of the orphan.
+ @param blockID The ID of the block which spent the outputs.
+ @param undo The undo data.
+ @param undoLength The length of the undo data.
  @returns true on sucess or false on failure.
  */
-bool CBBlockChainStorageSaveOrphan(void * validator, void * block, uint8_t orphanNum);
+bool CBBlockChainStorageSaveUndo(void * validator, uint32_t blockID, uint8_t * undo, uint32_t undoLength);
 /**
- @brief Saves a transaction reference. If the transaction exists in the block chain already, increment a counter. Else add a new reference.
+ @brief Adds an entry for a transaction in a block to the transaction index. A transaction which exists in the block chain already has an entry for each block.
  @param validator A CBFullValidator object. The storage object can be found within this.
  @param txHash The transaction's hash.
- @param branch The branch where the transaction exists.
- @param blockIndex The index of the block which contains the transaction.
+ @param blockID The ID of the block which contains the transaction.
+ @param height The height of the block which contains the transaction.
  @param outputPos The position of the outputs in the block for this transaction.
  @param outputsLen The length of the outputs in this transaction.
  @param coinbase If true the transaction is a coinbase, else it is not.
- @param numOutputs The number of outputs for this transaction.
  @returns true if successful or false otherwise.
  */
-bool CBBlockChainStorageSaveTransactionRef(void * validator, uint8_t * txHash, uint8_t branch, uint32_t blockIndex, uint32_t outputPos, uint32_t outputsLen, bool coinbase, uint32_t numOutputs);
+bool CBBlockChainStorageSaveTransactionRef(void * validator, uint8_t * txHash, uint32_t blockID, uint32_t height, uint32_t outputPos, uint32_t outputsLen, bool coinbase);
 /**
  @brief Saves an output as unspent.
  @param validator A CBFullValidator object. The storage object can be found within this.
  @param txHash The transaction hash of this output.
  @param outputIndex The index of the output in the transaction.
- @param position The position of the unspent output in the block.
- @param length The length of the unspent output in the block.
- @param increment If true, increment the number of unspent outputs for the transaction.
+ @param output The CBTransactionOutput to save.
+ @param height The height of the block the output exists in.
+ @param coinbase true if the output exists in a coinbase transaction or false otherwise.
  @returns true if successful or false otherwise.
  */
-bool CBBlockChainStorageSaveUnspentOutput(void * validator, uint8_t * txHash, uint32_t outputIndex, uint32_t position, uint32_t length, bool increment);
+bool CBBlockChainStorageSaveUnspentOutput(void * validator, uint8_t * txHash, uint32_t outputIndex, void * output, uint32_t height, bool coinbase);
+/**
+ @brief Deletes an unspent output as it is spent by a block. The output is first appended to the undo data for the block so that it can be restored with CBBlockChainStorageRestoreUndo. The undo data should be empty before the first output spent by a block.
+ @param validator A CBFullValidator object. The storage object can be found within this.
+ @param txHash The transaction hash of this output.
+ @param outputIndex The index of the output in the transaction.
+ @param undo A pointer to a memory block holding the undo data for the block, which may be reallocated.
+ @param undoLength The length of the undo data, which will be increased.
+ @param undoAllocSize The size of the memory block for the undo data, which may be increased.
+ @returns true on sucess or false on failure.
+ */
+bool CBBlockChainStorageSpendUnspentOutput(void * validator, uint8_t * txHash, uint32_t outputIndex, uint8_t ** undo, uint32_t * undoLength, uint32_t * undoAllocSize);
+/**
+ @brief Determines if there is undo data for a block. Blocks connected before undo data was stored do not have it.
+ @param validator A CBFullValidator object. The storage object can be found within this.
+ @param blockID The ID of the block.
+ @returns true if there is undo data for the block or false otherwise.
+ */
+bool CBBlockChainStorageUndoExists(void * validator, uint32_t blockID);
 /**
  @brief Determines if an unspent output exists.
  @param validator A CBFullValidator object. The storage object can be found within this.
@@ -39,21 +39,21 @@
 
 typedef enum{
 	CB_FULL_VALIDATOR_DISABLE_POW_CHECK = 1, /**< Does not verify the proof of work during validation. Used for testing. */
+	CB_FULL_VALIDATOR_TRANSACTION_INDEX = 2, /**< Keeps an index of the transactions in the main chain. Without it, blocks connected before undo data was stored cannot be removed from the main chain. The flag should be the same whenever the storage is used, or the index will be incomplete. */
 }CBFullValidatorFlags;
 
 /**
  @brief The return type for CBFullValidatorProcessBlock
  */
 typedef enum{
-	CB_BLOCK_STATUS_MAIN, /**< The block has extended the main branch. */
-	CB_BLOCK_STATUS_SIDE, /**< The block has extended a branch which is not the main branch. */
+	CB_BLOCK_STATUS_MAIN, /**< The block has extended the main chain. */
+	CB_BLOCK_STATUS_SIDE, /**< The block has extended a chain which is not the main chain. */
 	CB_BLOCK_STATUS_ORPHAN, /**< The block is an orphan */
 	CB_BLOCK_STATUS_BAD, /**< The block is not ok. */
 	CB_BLOCK_STATUS_BAD_TIME, /**< The block has a bad time */
 	CB_BLOCK_STATUS_DUPLICATE, /**< The block has already been received. */
 	CB_BLOCK_STATUS_ERROR, /**< There was an error while processing a block */
 	CB_BLOCK_STATUS_CONTINUE, /**< Continue with the validation */
-	CB_BLOCK_STATUS_NO_NEW, /**< Cannot remove a branch for a new one. */
 } CBBlockStatus;
 
 /**
@@ -65,46 +65,109 @@ typedef enum{
 	CB_BLOCK_VALIDATION_ERR, /**< There was an error during the validation processing. */
 } CBBlockValidationResult;
 
-#define CB_MAX_ORPHAN_CACHE 20
-#define CB_MAX_BRANCH_CACHE 5
-#define CB_NO_VALIDATION 0xFFFFFFFF
+/**
+ @brief Flags for header entries.
+ */
+typedef enum{
+	CB_HEADER_VALIDATED = 1, /**< The block has been fully validated, so it only needs the unspent outputs updating to rejoin the main chain. */
+	CB_HEADER_KEEP = 2, /**< Marks side chain blocks which are kept when pruning. */
+	CB_HEADER_PRUNED = 4, /**< The block's transactions have been removed from storage. */
+} CBHeaderFlags;
+
+#define CB_MAX_ORPHAN_BYTES 33554432 // Default memory budget for blocks waiting for their previous block (32MB).
+#define CB_ORPHAN_EVICTED_MEMORY 256 // Number of evicted orphan hashes remembered for counting re-downloads.
+#define CB_STALE_FORK_DEPTH 1000 // Default depth below the main chain tip at which side chains are pruned.
+#define CB_MIN_PRUNE_DEPTH 288 // Recommended minimum for pruneDepth, being two days of blocks.
 #define CB_COINBASE_MATURITY 100 // Number of confirming blocks before a block reward can be spent.
 #define CB_MAX_SIG_OPS 20000 // Maximum signature operations in a block.
 #define CB_BLOCK_ALLOWED_TIME_DRIFT 7200 // 2 Hours from network time
 
 /**
- @brief Gives the last block in a branch used in a chain.
+ @brief An entry in the block tree, which holds the header information of every block in storage in memory.
  */
-typedef struct{
-	uint8_t branch; /**< The branch in the chain */
-	uint32_t lastBlock; /**< The last block in the branch the chain uses before the next branch */
-} CBChainPath;
+typedef struct CBHeaderEntry{
+	uint8_t hash[32]; /**< The block hash. This comes first so that entries can be found by hash. */
+	struct CBHeaderEntry * prev; /**< The entry of the previous block, or NULL for the genesis block. */
+	uint32_t height; /**< The height of the block. */
+	uint32_t time; /**< The block timestamp. */
+	uint32_t target; /**< The block target. */
+	CBBigInt work; /**< The total work up to and including this block, not counting the genesis block. The chain with the most work is the main chain. */
+	uint32_t blockID; /**< The key of the block in storage. */
+	CBHeaderFlags flags; /**< Validation and pruning flags. */
+} CBHeaderEntry;
 
 /**
- @brief Represents a block branch.
+ @brief A block known to be in the main chain.
+ */
+typedef struct{
+	uint32_t height; /**< The height of the block. */
+	uint8_t hash[32]; /**< The block hash. */
+} CBCheckpoint;
+/**
+ @brief A change to the unspent outputs made by a block. The changes for a block are sorted by key and given to the storage together.
  */
 typedef struct{
-	uint32_t numBlocks; /**< The number of blocks in the branch */
-	uint32_t lastRetargetTime; /**< The block timestamp at the last retarget. */
-	uint8_t parentBranch; /**< The branch this branch is connected to. */
-	uint32_t parentBlockIndex; /**< The block index in the parent branch which this branch is connected to */
-	uint32_t startHeight; /**< The starting height where this branch begins */
-	uint32_t lastValidation; /**< The index of the last block in this branch that has been fully validated. */
-	CBBigInt work; /**< The total work for this branch. The branch with the highest work is the winner! */
-	bool working; /**< True if we this branch is being worked upon */
-} CBBlockBranch;
+	uint8_t key[36]; /**< The transaction hash followed by the output index as four little-endian bytes, as ordered in storage. */
+	CBTransactionOutput * output; /**< The output created by the block, or NULL if the output is spent by the block. */
+	bool coinbase; /**< true if the output is created by the coinbase transaction. */
+	bool cancelled; /**< true if the output is both created and spent by the block, so nothing needs to be stored. */
+} CBUnspentOutputChange;
+/**
+ @brief The earlier transactions and spent outputs of a block being validated, so that each input can be checked against them without searching the block.
+ */
+typedef struct{
+	CBAssociativeArray transactions; /**< The transactions validated so far, excluding the coinbase, by hash. Each element is the hash followed by the transaction index as four bytes. */
+	CBAssociativeArray spent; /**< The outputs spent by the inputs validated so far. Each element is the transaction hash followed by the output index as four bytes. */
+	uint8_t * hashes; /**< The memory for the elements of transactions. */
+	uint8_t * outpoints; /**< The memory for the elements of spent. */
+	uint32_t numTransactions; /**< The number of elements in transactions. */
+	uint32_t numSpent; /**< The number of elements in spent. */
+	bool assumedValid; /**< true if the block is the assume-valid block or one of its ancestors, so the scripts are not verified. */
+} CBBlockValidationContext;
+/**
+ @brief A block waiting for its previous block.
+ */
+typedef struct CBOrphan{
+	uint8_t hash[32]; /**< The block hash. This comes first so that orphans can be found by hash. */
+	uint8_t prevHash[32]; /**< The hash of the block this block is waiting for. */
+	CBBlock * block; /**< The block */
+	uint32_t size; /**< The serialised size of the block, counted against the memory budget. */
+	struct CBOrphan * nextSibling; /**< Another orphan waiting for the same block or NULL. */
+} CBOrphan;
 
 /**
  @brief Structure for CBFullValidator objects. @see CBFullValidator.h
  */
 typedef struct{
 	CBObject base;
-	uint8_t numOrphans; /**< The number of orhpans */
-	CBBlock * orphans[CB_MAX_ORPHAN_CACHE]; /**< The ophan block references */
-	uint8_t firstOrphan; /**< The orphan added first or rather the front of the orhpan queue (for overwriting) */
-	uint8_t mainBranch; /**< The index for the main branch */
-	uint8_t numBranches; /**< The number of block-chain branches. Cannot exceed CB_MAX_BRANCH_CACHE */
-	CBBlockBranch branches[CB_MAX_BRANCH_CACHE]; /**< The block-chain branches. */
+	CBAssociativeArray orphans; /**< The CBOrphan blocks which are waiting for their previous blocks, by hash. */
+	CBAssociativeArray orphansByPrev; /**< The first CBOrphan waiting for each previous block, by previous block hash. Other orphans waiting for the same block follow with nextSibling. */
+	uint32_t numOrphans; /**< The number of orphans */
+	uint32_t orphanBytes; /**< The total size of the orphans. */
+	uint32_t maxOrphanBytes; /**< Orphans furthest from the main chain tip are evicted to stay within this. Starts as CB_MAX_ORPHAN_BYTES. */
+	uint64_t orphansAdded; /**< Number of orphans added. */
+	uint64_t orphansConnected; /**< Number of orphans connected to the block tree once their previous block arrived. Over orphansAdded this gives the hit rate. */
+	uint64_t orphansEvicted; /**< Number of orphans evicted or refused to stay within maxOrphanBytes. */
+	uint64_t orphanRedownloads; /**< Number of blocks received again after being evicted. */
+	uint8_t evictedOrphans[CB_ORPHAN_EVICTED_MEMORY][32]; /**< The hashes of the last evicted orphans. */
+	uint16_t nextEvictedOrphan; /**< Where the next evicted hash goes in evictedOrphans. */
+	CBAssociativeArray headers; /**< The CBHeaderEntry of every block in storage, by hash. Loaded when the validator is initialised. */
+	CBHeaderEntry ** mainChain; /**< The entries of the main chain by height. */
+	uint32_t mainChainAlloc; /**< The number of entries allocated for mainChain. */
+	CBHeaderEntry * mainTip; /**< The last block of the main chain. */
+	CBHeaderEntry ** sideHeaders; /**< The entries which are not on the main chain. */
+	uint32_t numSideHeaders; /**< The number of side chain entries. */
+	uint32_t sideHeadersAlloc; /**< The number of entries allocated for sideHeaders. */
+	uint32_t staleForkDepth; /**< Side chains with no block within this many blocks of the main chain tip are pruned. Starts as CB_STALE_FORK_DEPTH. */
+	uint32_t pruneDepth; /**< If not zero, the transactions of main chain blocks more than this many blocks below the tip are removed from storage. Reorganisations can only go back this far. Starts as zero. */
+	uint64_t pruneBudget; /**< If not zero, blocks are only pruned while the stored blocks take more than this many bytes. Starts as zero. */
+	uint64_t blockBytes; /**< The size of the blocks in storage, not counting pruned blocks. */
+	uint32_t pruneHeight; /**< Main chain blocks below this height have been pruned. */
+	uint8_t assumeValid[32]; /**< The hash of the block at assumeValidHeight, which the scripts of the block and its ancestors are assumed to be valid for. */
+	uint32_t assumeValidHeight; /**< If not zero, the scripts of the assumeValid block and its ancestors are not verified, and the block at this height must be the assumeValid block. Starts as zero. @see CBFullValidatorSetAssumeValid */
+	uint8_t * assumeValidChain; /**< The hashes of the blocks from assumeValidChainStart up to the assumeValid block, 32 bytes each, or NULL if they are not known. @see CBFullValidatorSetAssumeValidChain */
+	uint32_t assumeValidChainStart; /**< The height of the first hash in assumeValidChain. */
+	uint32_t nextBlockID; /**< The storage key for the next block. */
 	uint64_t storage; /**< The storage component object */
 	CBFullValidatorFlags flags; /**< Flags for validation options */
 } CBFullValidator;
@@ -135,26 +198,38 @@ CBFullValidator * CBGetFullValidator(void * self);
  @returns true on success, false on failure.
  */
 bool CBInitFullValidator(CBFullValidator * self, uint64_t storage, bool * badDataBase, CBFullValidatorFlags flags);
+/**
+ @brief Initialises the context for validating a block, with space for every transaction and input of the block.
+ @param context The CBBlockValidationContext to initialise.
+ @param block The block to be validated.
+ @returns true on success, false on failure.
+ */
+bool CBInitBlockValidationContext(CBBlockValidationContext * context, CBBlock * block);
 
 /**
  @brief Frees a CBFullValidator object.
  @param self The CBFullValidator object to free.
  */
 void CBFreeFullValidator(void * vself);
+/**
+ @brief Frees the data of a CBBlockValidationContext.
+ @param context The CBBlockValidationContext.
+ */
+void CBFreeBlockValidationContext(CBBlockValidationContext * context);
 
 // Functions
 
 /**
- @brief Adds a block to a branch.
+ @brief Stores a block and adds it to the block tree as a side chain block.
  @param self The CBFullValidator object.
- @param branch The index of the branch to add the block to.
  @param block The block to add.
- @param work The new branch work. This is not the block work but the total work upto this block. This is taken by the function and the old work is freed.
- @returns true on success and false on failure.
+ @param prev The entry of the previous block.
+ @param work The total work up to this block. This is taken by the function.
+ @returns The new entry on success and NULL on failure.
  */
-bool CBFullValidatorAddBlockToBranch(CBFullValidator * self, uint8_t branch, CBBlock * block, CBBigInt work);
+CBHeaderEntry * CBFullValidatorAddBlockToTree(CBFullValidator * self, CBBlock * block, CBHeaderEntry * prev, CBBigInt work);
 /**
- @brief Adds a block to the orphans.
+ @brief Adds a block to the orphans. When the orphans would exceed maxOrphanBytes, the orphans with times furthest from the main chain tip are evicted, which may be the new block.
  @param self The CBFullValidator object.
  @param block The block to add.
  @returns true on success and false on error.
@@ -169,31 +244,78 @@ bool CBFullValidatorAddBlockToOrphans(CBFullValidator * self, CBBlock * block);
  */
 CBBlockStatus CBFullValidatorBasicBlockValidation(CBFullValidator * self, CBBlock * block, uint64_t networkTime);
 /**
- @brief Completes the validation for a block during main branch extention or reorganisation.
+ @brief Completes the validation for a block during main chain extention or reorganisation.
  @param self The CBFullValidator object.
- @param branch The branch being validated
  @param block The block to complete validation for.
  @param height The height of the block.
  @returns CB_BLOCK_VALIDATION_OK if the block passed validation, CB_BLOCK_VALIDATION_BAD if the block failed validation and CB_BLOCK_VALIDATION_ERR on an error.
  */
-CBBlockValidationResult CBFullValidatorCompleteBlockValidation(CBFullValidator * self, uint8_t branch, CBBlock * block, uint32_t height);
+CBBlockValidationResult CBFullValidatorCompleteBlockValidation(CBFullValidator * self, CBBlock * block, uint32_t height);
+/**
+ @brief Checks that a block has the hash of any checkpoint or assumed valid block at its height.
+ @param self The CBFullValidator object.
+ @param hash The block hash.
+ @param height The height of the block.
+ @returns true if the block does not conflict with a checkpoint or the assumed valid block, false otherwise.
+ */
+bool CBFullValidatorCheckpointMatches(CBFullValidator * self, uint8_t * hash, uint32_t height);
 /**
  @brief Ensures a file can be opened.
  @param self The CBFullValidator object.
  */
 void CBFullValidatorEnsureCanOpen(CBFullValidator * self);
 /**
- @brief Gets the mimimum time minus one allowed for a new block onto a branch.
+ @brief Finds the entry for a block in storage.
  @param self The CBFullValidator object.
- @param branch The id of the branch.
- @param prevIndex The index of the last block to determine the minimum time minus one for when adding onto this block.
- @returns The time on success, or 0 on failure.
+ @param hash The block hash.
+ @returns The header entry or NULL if the block is not in storage.
  */
-uint32_t CBFullValidatorGetMedianTime(CBFullValidator * self, uint8_t branch, uint32_t prevIndex);
+CBHeaderEntry * CBFullValidatorFindHeader(CBFullValidator * self, uint8_t * hash);
 /**
- @brief Validates a transaction input.
+ @brief Gets the entry for a block on the main chain.
  @param self The CBFullValidator object.
- @param branch The branch being validated.
+ @param height The height of the block.
+ @returns The header entry or NULL if the main chain is not that high.
+ */
+CBHeaderEntry * CBFullValidatorGetMainChainHeader(CBFullValidator * self, uint32_t height);
+/**
+ @brief Gets the last of the checkpoints for the network, which are the blocks at fixed heights in the main chain.
+ @returns The checkpoint with the greatest height.
+ */
+CBCheckpoint * CBFullValidatorGetLastCheckpoint(void);
+/**
+ @brief Gets the mimimum time minus one allowed for a new block.
+ @param self The CBFullValidator object.
+ @param prev The entry of the block the new block follows.
+ @returns The time.
+ */
+uint32_t CBFullValidatorGetMedianTime(CBFullValidator * self, CBHeaderEntry * prev);
+/**
+ @brief Gets the target required for a new block.
+ @param self The CBFullValidator object.
+ @param prev The entry of the block the new block follows.
+ @returns The target.
+ */
+uint32_t CBFullValidatorGetNextTarget(CBFullValidator * self, CBHeaderEntry * prev);
+/**
+ @brief Assumes the scripts of a block and its ancestors are valid, so that they are not verified during the initial download of the block-chain. The unspent outputs, values, coinbase and merkle root are still checked. A block is only known to be an ancestor once the assumed valid block is in the block tree, or from the headers given to CBFullValidatorSetAssumeValidChain, so the scripts of other blocks, such as those of forks below the height, are verified.
+ @param self The CBFullValidator object.
+ @param hash The hash of the block assumed to be valid.
+ @param height The height of the block. Zero verifies all scripts.
+ */
+void CBFullValidatorSetAssumeValid(CBFullValidator * self, uint8_t * hash, uint32_t height);
+/**
+ @brief Gives the hashes of the headers leading to the assume-valid block, so that its ancestors can be recognised before it is in the block tree. The headers must have been checked for proof of work and targets, as by headers-first synchronisation.
+ @param self The CBFullValidator object.
+ @param hashes The block hashes, 32 bytes each, from startHeight up to and including the assume-valid block. These are copied.
+ @param startHeight The height of the first hash, which must not be above assumeValidHeight.
+ @returns true on success, false if the last hash is not the assume-valid block or memory could not be allocated.
+ */
+bool CBFullValidatorSetAssumeValidChain(CBFullValidator * self, uint8_t * hashes, uint32_t startHeight);
+/**
+ @brief Validates a transaction input. For the assume-valid block and its ancestors, as found for the context, the previous output is checked but the scripts are not verified.
+ @param self The CBFullValidator object.
+ @param context The context for the block, with the earlier transactions of the block added. The spent output is added to it.
  @param block The block begin validated.
  @param blockHeight The height of the block being validated
  @param transactionIndex The index of the transaction to validate.
@@ -202,9 +324,16 @@ uint32_t CBFullValidatorGetMedianTime(CBFullValidator * self, uint8_t branch, ui
  @param sigOps Pointer to the total number of signature operations. This is increased by the signature operations for the input and verified to be less that the maximum allowed signature operations.
  @returns CB_BLOCK_VALIDATION_OK if the transaction passed validation, CB_BLOCK_VALIDATION_BAD if the transaction failed validation and CB_BLOCK_VALIDATION_ERR on an error.
  */
-CBBlockValidationResult CBFullValidatorInputValidation(CBFullValidator * self, uint8_t branch, CBBlock * block, uint32_t blockHeight, uint32_t transactionIndex, uint32_t inputIndex, uint64_t * value, uint32_t * sigOps);
+CBBlockValidationResult CBFullValidatorInputValidation(CBFullValidator * self, CBBlockValidationContext * context, CBBlock * block, uint32_t blockHeight, uint32_t transactionIndex, uint32_t inputIndex, uint64_t * value, uint32_t * sigOps);
+/**
+ @brief Reads the unspent outputs spent by a block from the storage before the block is validated, so that they are read in the order they are stored rather than one at a time as each input is validated.
+ @param self The CBFullValidator object.
+ @param block The deserialised block.
+ @returns true on success and false on error.
+ */
+bool CBFullValidatorPrefetchUnspentOutputs(CBFullValidator * self, CBBlock * block);
 /**
- @brief Processes a block. Block headers are validated, ensuring the integrity of the transaction data is OK, checking the block's proof of work and calculating the total branch work to the genesis block. If the block extends the main branch complete validation is done. If the block extends a branch to become the new main branch because it has the most work, a re-organisation of the block-chain is done.
+ @brief Processes a block. Block headers are validated, ensuring the integrity of the transaction data is OK, checking the block's proof of work and calculating the total work to the genesis block. If the block extends the main chain complete validation is done. If the block extends a side chain to have the most work, a re-organisation of the block-chain is done.
  @param self The CBFullValidator object.
  @param block The block to process.
  @param networkTime The network time.
@@ -212,52 +341,64 @@ CBBlockValidationResult CBFullValidatorInputValidation(CBFullValidator * self, u
  */
 CBBlockStatus CBFullValidatorProcessBlock(CBFullValidator * self, CBBlock * block, uint64_t networkTime);
 /**
- @brief Processes a block into a branch. This is used once basic validation is done on a block and it is determined what branch it needs to go into and when this branch is ready to receive the block.
+ @brief Processes a block which has passed basic validation and which has a previous block in storage. The block extends the main chain, is stored on a side chain or causes a reorganisation.
  @param self The CBFullValidator object.
  @param block The block to process.
  @param networkTime The network time.
- @param branch The branch to add to.
- @param prevBranch The branch of the previous block.
- @param prevBlockIndex The index of the previous block.
- @param prevBlockTarget The target of the previous block.
- @param txHashes The transaction hashes for the block.
+ @param prev The entry of the previous block.
  @return The status of the block.
  */
-CBBlockStatus CBFullValidatorProcessIntoBranch(CBFullValidator * self, CBBlock * block, uint64_t networkTime, uint8_t branch, uint8_t prevBranch, uint32_t prevBlockIndex, uint32_t prevBlockTarget);
+CBBlockStatus CBFullValidatorProcessConnectedBlock(CBFullValidator * self, CBBlock * block, uint64_t networkTime, CBHeaderEntry * prev);
+/**
+ @brief Processes the orphans waiting for a block which has been added to the block tree, and then the orphans waiting for those, so that a whole chain of orphans is connected at once. Each connected orphan is committed.
+ @param self The CBFullValidator object.
+ @param hash The hash of the block added to the block tree.
+ @param networkTime The network time.
+ @returns true on success and false on error.
+ */
+bool CBFullValidatorProcessOrphans(CBFullValidator * self, uint8_t * hash, uint64_t networkTime);
+/**
+ @brief Deletes the side chains which have no block within staleForkDepth blocks of the main chain tip.
+ @param self The CBFullValidator object.
+ @returns true on success and false on error.
+ */
+bool CBFullValidatorPrune(CBFullValidator * self);
+/**
+ @brief Removes the transactions of the main chain blocks which are more than pruneDepth blocks below the tip, oldest first, until the stored blocks are within pruneBudget. The headers are kept. Does nothing when pruneDepth is zero.
+ @param self The CBFullValidator object.
+ @returns true on success and false on error.
+ */
+bool CBFullValidatorPruneBlocks(CBFullValidator * self);
 /**
- @brief Saves the last validated blocks from startBranch to endBranch
+ @brief Makes the chain up to a side chain block the main chain. The main chain is unwound to the fork point and the side chain blocks are connected, being validated unless they have been before.
  @param self The CBFullValidator object.
- @param startBranch The branch with the earliest starting block.
- @param endBranch The endBranch that can go down to the startBranch.
- @returns true if the function executed successfully or false on an error.
+ @param newTip The side chain block to reorganise to.
+ @returns CB_BLOCK_VALIDATION_OK if the side chain is now the main chain, CB_BLOCK_VALIDATION_BAD if a side chain block failed validation and CB_BLOCK_VALIDATION_ERR on an error. On failure the storage needs to be reset.
  */
-bool CBFullValidatorSaveLastValidatedBlocks(CBFullValidator * self, uint8_t branches);
+CBBlockValidationResult CBFullValidatorReorganise(CBFullValidator * self, CBHeaderEntry * newTip);
 /**
- @brief Updates the unspent outputs and transaction index for a branch, for removing a block's transaction information.
+ @brief Updates the unspent outputs and transaction index for removing a block's transaction information. The spent outputs are restored from the undo data for the block.
  @param self The CBFullValidator object.
  @param block The block with the transaction data to search for changing unspent outputs.
- @param branch The branch the block is for.
- @param blockIndex The block index in the branch.
+ @param entry The entry of the block.
  @returns true on successful execution or false on error.
  */
-bool CBFullValidatorUpdateUnspentOutputsBackward(CBFullValidator * self, CBBlock * block, uint8_t branch, uint32_t blockIndex);
+bool CBFullValidatorUpdateUnspentOutputsBackward(CBFullValidator * self, CBBlock * block, CBHeaderEntry * entry);
 /**
- @brief Updates the unspent outputs and transaction index for a branch, for adding a block's transaction information.
+ @brief Updates the unspent outputs and transaction index for adding a block's transaction information. The spent outputs are saved as undo data for the block.
  @param self The CBFullValidator object.
  @param block The block with the transaction data to search for changing unspent outputs.
- @param branch The branch the block is for.
- @param blockIndex The block index in the branch.
+ @param entry The entry of the block.
  @returns true on successful execution or false on error.
  */
-bool CBFullValidatorUpdateUnspentOutputsForward(CBFullValidator * self, CBBlock * block, uint8_t branch, uint32_t blockIndex);
+bool CBFullValidatorUpdateUnspentOutputsForward(CBFullValidator * self, CBBlock * block, CBHeaderEntry * entry);
 /**
- @brief Updates the unspent outputs and transaction index for a branch in reverse and loads a block to do this.
+ @brief Updates the unspent outputs and transaction index for a block and loads the block to do this.
  @param self The CBFullValidator object.
- @param branch The branch the block is for.
- @param blockIndex The block index in the branch.
+ @param entry The entry of the block.
  @param forward If true the indices will be updated when adding blocks, else it will be updated removing blocks for re-organisation.
  @returns true on successful execution or false on error.
  */
-bool CBFullValidatorUpdateUnspentOutputsAndLoad(CBFullValidator * self, uint8_t branch, uint32_t blockIndex, bool forward);
+bool CBFullValidatorUpdateUnspentOutputsAndLoad(CBFullValidator * self, CBHeaderEntry * entry, bool forward);
 
 #endif
@@ -40,18 +40,71 @@
 #include <stdlib.h>
 #include "CBConstants.h"
 
+// Reference counting. Build with CB_ATOMIC_REFERENCES to use C11 atomics so that objects and byte array data can be retained and released by different threads.
+
+#ifdef CB_ATOMIC_REFERENCES
+#include <stdatomic.h>
+typedef _Atomic uint32_t CBReferenceCount;
+#define CBReferenceCountInit(count, val) atomic_init(count, val)
+#define CBReferenceCountIncrement(count) atomic_fetch_add_explicit(count, 1, memory_order_relaxed)
+// Evaluates to true when the last reference is removed. Releases are ordered before the acquire fence so that the thread freeing the data sees all writes to it.
+#define CBReferenceCountDecrement(count) (atomic_fetch_sub_explicit(count, 1, memory_order_release) == 1 && (atomic_thread_fence(memory_order_acquire), true))
+#else
+typedef uint32_t CBReferenceCount;
+#define CBReferenceCountInit(count, val) (*(count) = (val))
+#define CBReferenceCountIncrement(count) ((*(count))++)
+#define CBReferenceCountDecrement(count) (NOT --(*(count)))
+#endif
+
+// Constants
+
+#define CB_OBJECT_SLAB_CLASSES 32 // Slabs are used for objects of up to 32*16 bytes including the allocation header.
+#define CB_OBJECT_SLAB_CHUNK_SIZE 65536
+#define CB_OBJECT_ARENA_CHUNK_SIZE 65536
+
+/**
+ @brief How memory for objects is allocated. Objects are freed in the way they were allocated so the allocator can be changed at any time.
+ */
+typedef enum{
+	CB_OBJECT_ALLOCATOR_HEAP, /**< Each object is allocated with malloc. This is the default. */
+	CB_OBJECT_ALLOCATOR_SLAB, /**< Objects are allocated from slabs for each size class, and freed objects are kept for reuse by the same size class. */
+	CB_OBJECT_ALLOCATOR_BLOCK_ARENA, /**< As CB_OBJECT_ALLOCATOR_SLAB, but the objects created when deserialising a block come from an arena for the block, which is freed at once when the last of those objects is freed. */
+} CBObjectAllocator;
+
+/**
+ @brief Counts of object allocations. @see CBObjectGetAllocationCounters
+ */
+typedef struct{
+	uint64_t heapAllocations; /**< Objects allocated with malloc. */
+	uint64_t slabAllocations; /**< Objects allocated from slabs. */
+	uint64_t arenaAllocations; /**< Objects allocated from arenas. */
+	uint64_t chunkAllocations; /**< Slab and arena chunks allocated with malloc. */
+	uint64_t chunkFrees; /**< Arena chunks freed. Slab chunks are never freed. */
+	uint64_t frees; /**< Objects freed. */
+} CBObjectAllocationCounters;
+
+/**
+ @brief An arena for objects. @see CBObjectArenaBegin
+ */
+typedef struct CBObjectArena CBObjectArena;
+
 /**
  @brief Base structure for all other structures. @see CBObject.h
  */
 typedef struct CBObject{
 	void (*free)(void *); /**< Pointer to the function to free the object. */
-	uint32_t references; /**< Keeps a count of the references to an object for memory management. */
+	CBReferenceCount references; /**< Keeps a count of the references to an object for memory management. */
 } CBObject;
 /**
  @brief Creates a new CBObject.
  @returns A new CBObject.
  */
 CBObject * CBNewObject(void);
+/**
+ @brief Creates an arena for objects.
+ @returns The arena or NULL on failure.
+ */
+CBObjectArena * CBNewObjectArena(void);
 
 /**
  @brief Gets a CBObject from another object. Use this to avoid casts.
@@ -75,6 +128,66 @@ void CBFreeObject(void * self);
 
 //  Functions
 
+/**
+ @brief Allocates memory for an object using the selected allocator. Constructors use this instead of malloc, so that CBFreeObject can free the memory.
+ @param size The size of the object.
+ @returns The memory for the object or NULL on failure.
+ */
+void * CBAllocObject(size_t size);
+/**
+ @brief Frees memory given by CBAllocObject. This is used by CBFreeObject and by constructors when initialisation fails.
+ @param self The object memory.
+ */
+void CBDeallocObject(void * self);
+/**
+ @brief Determines if the library was built with CB_ATOMIC_REFERENCES, so that objects can be shared between threads.
+ @returns true if reference counts are atomic, false otherwise.
+ */
+bool CBObjectHasAtomicReferences(void);
+/**
+ @brief Gets the allocator used for new objects.
+ @returns The allocator.
+ */
+CBObjectAllocator CBObjectGetAllocator(void);
+/**
+ @brief Gets the allocation counters.
+ @param counters The structure to receive the counters.
+ */
+void CBObjectGetAllocationCounters(CBObjectAllocationCounters * counters);
+/**
+ @brief Begins allocating objects created by the calling thread from an arena. The arena is used regardless of the selected allocator until CBObjectArenaEnd is called.
+ @param arena The arena to allocate from.
+ @returns The arena which was being used before, or NULL. Give this to CBObjectArenaEnd.
+ */
+CBObjectArena * CBObjectArenaBegin(CBObjectArena * arena);
+/**
+ @brief Stops allocating objects from an arena. The arena and its memory are freed once all of its objects have been freed, which may be immediately.
+ @param arena The arena.
+ @param previous The arena returned by CBObjectArenaBegin, which is used again.
+ */
+void CBObjectArenaEnd(CBObjectArena * arena, CBObjectArena * previous);
+/**
+ @brief Gets the arena objects created by the calling thread are being allocated from.
+ @returns The arena or NULL.
+ */
+CBObjectArena * CBObjectGetCurrentArena(void);
+/**
+ @brief Resets the allocation counters to zero.
+ */
+void CBObjectResetAllocationCounters(void);
+/**
+ @brief Sets the allocator used for new objects. This should be done before other threads are started.
+ @param allocator The allocator.
+ */
+void CBObjectSetAllocator(CBObjectAllocator allocator);
+
+/**
+ @brief Enlarges the memory of an object given by CBAllocObject, like realloc.
+ @param self The object memory.
+ @param size The new size of the object.
+ @returns The moved object memory, or NULL on failure in which case the object is unchanged.
+ */
+void * CBReallocObject(void * self, size_t size);
 /**
  @brief Releases a CBObject. The reference counter is decremented and if the reference count is returned to 0, the object will be freed. The pointer will be assigned to NULL.
  @param self The pointer to the object to release.
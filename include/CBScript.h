@@ -32,6 +32,7 @@
 
 #include "CBByteArray.h"
 #include "CBDependencies.h"
+#include "CBSignatureCache.h"
 #include <stdbool.h>
 
 // Constants
@@ -183,8 +184,11 @@ typedef enum{
     CB_SCRIPT_OP_INVALIDOPCODE = 0xff,
 }CBScriptOp;
 
+#define CB_SCRIPT_STACK_MAX_ITEMS 1003 // The limit of 1000 items plus room for OP_3DUP which pushes three items before the limit is checked.
+#define CB_SCRIPT_STACK_ARENA_SIZE 32768 // Room for the results of 201 operations of up to 32 bytes for the input, output and P2SH scripts, plus a sub script of up to 10000 bytes for signature checking.
+
 /**
- @brief Structure for a stack item
+ @brief Structure for a stack item. Items are never modified in place, so items can be copied by value and the data can point into the script bytes, the stack arena or constant data.
  */
 typedef struct{
 	uint8_t * data; /**< Data for this stack item */
@@ -192,11 +196,14 @@ typedef struct{
 } CBScriptStackItem;
 
 /**
- @brief Structure that holds byte data in a stack.
+ @brief Structure that holds byte data in a stack. The stack has a fixed capacity and data created during execution is taken from the arena, so executing scripts needs no heap allocations. Data pushed by a script references the script, so the script must outlive the stack.
  */
 typedef struct{
-	CBScriptStackItem * elements; /**< Elements in the stack */
+	CBScriptStackItem elements[CB_SCRIPT_STACK_MAX_ITEMS]; /**< Elements in the stack */
 	uint16_t length; /**< Length of the stack */
+	uint32_t arenaUsed; /**< The number of bytes used in the arena */
+	uint8_t arena[CB_SCRIPT_STACK_ARENA_SIZE]; /**< Memory for item data created during execution. */
+	void * overflow; /**< Linked list of heap memory used when the arena is exhausted, which does not happen when executing the input, output and P2SH scripts of a transaction input with one stack. */
 } CBScriptStack;
 
 typedef CBByteArray CBScript;
@@ -265,6 +272,15 @@ CBScript * CBGetScript(void * self);
  */
 bool CBInitScriptFromString(CBScript * self, char * string);
 
+/**
+ @brief Initialises a CBScript which references data without taking ownership of it or allocating memory. This allows a CBScript on the C stack to be made for data such as script stack items. The script must not be retained or released, and the data must outlive it.
+ @param self The CBScript object to initialise
+ @param sharedData The shared data structure to use for the script, which can also be on the C stack.
+ @param data The data to reference.
+ @param size The size of the data.
+ */
+void CBInitScriptWithDataReference(CBScript * self, CBSharedData * sharedData, uint8_t * data, uint32_t size);
+
 /**
  @brief Does the processing to free a CBScript object. Should be called by the children when freeing objects.
  @param self The CBScript object to free.
@@ -274,19 +290,19 @@ void CBFreeProcessScript(CBScript * self);
 //  Functions
 
 /**
- @brief Frees a CBScriptStack
+ @brief Frees any heap memory used by a CBScriptStack. The stack can be initialised again to be reused.
  @param stack The stack to free
  */
-void CBFreeScriptStack(CBScriptStack stack);
+void CBFreeScriptStack(CBScriptStack * stack);
 /**
- @brief Returns a new empty stack.
- @returns The new empty stack.
+ @brief Initialises an empty stack.
+ @param stack The stack to initialise.
  */
-CBScriptStack CBNewEmptyScriptStack(void);
+void CBInitScriptStack(CBScriptStack * stack);
 /**
- @brief Executes a bitcoin script.
+ @brief Executes a bitcoin script. Signatures are verified through the signature cache, see CBSignatureCache.h
  @param self The CBScript object with the program
- @param stack A pointer to the input stack for the program.
+ @param stack A pointer to the input stack for the program. The stack keeps references to the program data so the program must outlive the stack.
  @param getHashForSig A pointer to the funtion to get the hash for checking the signature. Should take a CBTransaction object, input index, CBSignType and the CBDependencies object.
  @param transaction Transaction for checking the signatures.
  @param inputIndex The index of the input for the signature.
@@ -321,12 +337,19 @@ bool CBScriptIsPushOnly(CBScript * self);
  */
 void CBSubScriptRemoveSignature(uint8_t * subScript, uint32_t * subScriptLen, CBScriptStackItem signature);
 /**
- @brief Returns a copy of a stack item, "fromTop" from the top.
+ @brief Allocates memory for item data from the stack arena, falling back to the heap when the arena is exhausted. The memory lasts until the stack is freed.
+ @param stack A pointer to the stack.
+ @param size The number of bytes to allocate.
+ @returns A pointer to the memory or NULL on failure.
+ */
+uint8_t * CBScriptStackAllocate(CBScriptStack * stack, uint32_t size);
+/**
+ @brief Returns a copy of a stack item, "fromTop" from the top. The data is shared with the original item.
  @param stack A pointer to the stack.
  @param fromTop Number of items from the top to copy.
- @returns A copy of the stack item which should be freed.
+ @returns A copy of the stack item.
  */
-CBScriptStackItem CBScriptStackCopyItem(CBScriptStack * stack, uint8_t fromTop);
+CBScriptStackItem CBScriptStackCopyItem(CBScriptStack * stack, uint16_t fromTop);
 /**
  @brief Evaluates the top stack item as a bool. False if 0 or -0.
  @param stack The stack.
@@ -342,13 +365,14 @@ int64_t CBScriptStackItemToInt64(CBScriptStackItem item);
 /**
  @brief Removes the top item from the stack and returns it.
  @param stack A pointer to the stack to pop the data.
- @returns The top item. This must be freed.
+ @returns The top item. The data remains valid until the stack is freed.
  */
 CBScriptStackItem CBScriptStackPopItem(CBScriptStack * stack);
 /**
- @brief Push data onto the stack which is freed by the stack.
+ @brief Push an item onto the stack. The data should be in the stack arena or otherwise outlive the stack.
  @param stack A pointer to the stack to push data onto.
- @param data The item to push on the stack.
+ @param item The item to push on the stack.
+ @returns true on success or false if the stack is full.
  */
 bool CBScriptStackPushItem(CBScriptStack * stack, CBScriptStackItem item);
 /**
@@ -358,10 +382,10 @@ bool CBScriptStackPushItem(CBScriptStack * stack, CBScriptStackItem item);
 void CBScriptStackRemoveItem(CBScriptStack * stack);
 /**
  @brief Converts a int64_t to a CBScriptStackItem
- @param item Pass in a CBScriptStackItem for reallocating data.
+ @param stack A pointer to the stack to allocate the item data from.
  @param i The 64 bit signed integer.
- @returns A CBScriptStackItem.
+ @returns A CBScriptStackItem. On failure the data is NULL and the length is 1.
  */
-CBScriptStackItem CBInt64ToScriptStackItem(CBScriptStackItem item, int64_t i);
+CBScriptStackItem CBInt64ToScriptStackItem(CBScriptStack * stack, int64_t i);
 
 #endif
@@ -0,0 +1,65 @@
+//
+//  CBSignatureCache.h
+//  cbitcoin
+//
+//  Copyright (c) 2012 Matthew Mitchell
+//
+//  This file is part of cbitcoin.
+//
+//  cbitcoin is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  cbitcoin is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with cbitcoin.  If not, see <http://www.gnu.org/licenses/>.
+
+/**
+ @file
+ @brief A bounded cache of signatures which have been verified successfully, so that transactions which are verified when received and again in blocks or on reorganisation do not repeat the ECDSA verification. Entries are identified by the SHA-256 of a random salt, the signature hash, public key and signature. The salt comes from the random dependency when the cache is first used, so the bucket of an entry cannot be predicted by whoever supplies the signature. If it cannot be seeded the cache is not used. The cache is set-associative, each bucket holding CB_SIGNATURE_CACHE_WAYS entries, and when a bucket is full a random entry is evicted. Only valid signatures are cached. The cache is shared by all threads and is protected by a mutex.
+ */
+
+#ifndef CBSIGNATURECACHEH
+#define CBSIGNATURECACHEH
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "CBConstants.h"
+#include "CBDependencies.h"
+
+// Constants
+
+#define CB_SIGNATURE_CACHE_BUCKETS 16384 // Must be a power of two.
+#define CB_SIGNATURE_CACHE_WAYS 4 // Number of entries in each bucket. The cache holds 65536 entries using 2MB.
+
+/**
+ @brief Verifies an ECDSA signature using the cache. If the signature is in the cache, CBEcdsaVerify is not called. Otherwise CBEcdsaVerify is called and valid signatures are added to the cache.
+ @param signature BER encoded signature bytes.
+ @param sigLen The length of the signature bytes.
+ @param hash A 32 byte hash for checking the signature against.
+ @param pubKey Public key bytes to check this signature with.
+ @param keyLen The length of the public key bytes.
+ @returns true if the signature is valid and false if invalid.
+ */
+bool CBSignatureCacheVerify(uint8_t * signature, uint8_t sigLen, uint8_t * hash, uint8_t * pubKey, uint8_t keyLen);
+/**
+ @brief Removes all entries from the cache and resets the hit and miss counters.
+ */
+void CBSignatureCacheClear(void);
+/**
+ @brief Gets the number of verifications which were answered by the cache.
+ @returns The number of cache hits.
+ */
+uint64_t CBSignatureCacheGetHits(void);
+/**
+ @brief Gets the number of verifications which were not found in the cache and required CBEcdsaVerify.
+ @returns The number of cache misses.
+ */
+uint64_t CBSignatureCacheGetMisses(void);
+
+#endif
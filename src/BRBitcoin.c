@@ -2,7 +2,6 @@
 #include <stdio.h>
 #include <string.h>
 #include <unistd.h>
-#include <time.h>
 #include <readline/readline.h>
 #include <readline/history.h>
 #include <stdarg.h>
@@ -116,7 +115,15 @@ static void connections() {
     for (i = 0; i < connector->num_conns; ++i) {
         BRConnection *c = connector->conns[i];
         printf("\t%s:%hu on socket %d\n", c->ip, c->port, c->sock);
+        if (block_chain->headers != NULL)
+            printf("\t\t%d of %d blocks in flight, %llu bytes/s, %u responses\n",
+                    c->blocks_in_flight, c->window,
+                    (unsigned long long) BRThroughput(c), c->responses);
     }
+    if (block_chain->headers != NULL)
+        printf("Blocks downloaded: %llu, stalled: %llu\n",
+                (unsigned long long) connector->blocks_downloaded,
+                (unsigned long long) connector->blocks_stalled);
     if (connector->num_ho)
         printf("Opening connections:\n");
     for (i = 0; i < connector->num_ho; ++i) {
@@ -176,20 +183,76 @@ static char *make_dir(char *orig_dir) {
     return dir; /* dynamically allocated */
 }
 
-int main(int argc, char *argv[]) {
-    if (argc != 2) {
-        char usage[] = "%s block_directory\n\t"
-                        "Starts the bitcoin client with block chain storage "
-                        "in the specified directory\n";
-        printf(usage, argv[0]);
-        exit(2);
+/* parses height:hash, with the hash in the usual reversed hex, or
+ * "checkpoint" for the last hard-coded checkpoint */
+static int parse_assume_valid(char *arg, uint32_t *height, uint8_t *hash) {
+    if (strcmp(arg, "checkpoint") == 0) {
+        CBCheckpoint *checkpoint = CBFullValidatorGetLastCheckpoint();
+        *height = checkpoint->height;
+        memcpy(hash, checkpoint->hash, 32);
+        return 1;
+    }
+    char *end;
+    unsigned long h = strtoul(arg, &end, 10);
+    if (end == arg || *end != ':' || strlen(end + 1) != 64 || h == 0 || h > UINT32_MAX)
+        return 0;
+    int i;
+    for (i = 0; i < 32; ++i) {
+        unsigned int byte;
+        if (sscanf(end + 1 + 2 * i, "%2x", &byte) != 1)
+            return 0;
+        hash[31 - i] = byte;
     }
+    *height = h;
+    return 1;
+}
 
-    srand(time(NULL));
+static void print_usage(char *name) {
+    char usage[] = "%s [--headers-first] [--prune blocks] "
+                    "[--assume-valid height:hash|checkpoint] block_directory\n\t"
+                    "Starts the bitcoin client with block chain storage "
+                    "in the specified directory\n\t"
+                    "--headers-first downloads and validates the header "
+                    "chain before the blocks\n\t"
+                    "--prune removes the transactions of blocks deeper than "
+                    "this in the chain, which must be at least %d\n\t"
+                    "--assume-valid skips the script checks of this block "
+                    "and its ancestors, which must be in the chain. Use with "
+                    "--headers-first so that the ancestors are known before "
+                    "the block is downloaded\n";
+    printf(usage, name, CB_MIN_PRUNE_DEPTH);
+    exit(2);
+}
+
+int main(int argc, char *argv[]) {
+    int headers_first = 0, i;
+    long prune = 0;
+    uint32_t assume_valid_height = 0;
+    uint8_t assume_valid[32];
+    for (i = 1; i < argc - 1; ++i) {
+        if (strcmp(argv[i], "--headers-first") == 0)
+            headers_first = 1;
+        else if (strcmp(argv[i], "--prune") == 0 && i + 1 < argc - 1) {
+            char *end;
+            prune = strtol(argv[++i], &end, 10);
+            if (*end != '\0' || prune < CB_MIN_PRUNE_DEPTH)
+                print_usage(argv[0]);
+        } else if (strcmp(argv[i], "--assume-valid") == 0 && i + 1 < argc - 1) {
+            if (!parse_assume_valid(argv[++i], &assume_valid_height, assume_valid))
+                print_usage(argv[0]);
+        } else
+            print_usage(argv[0]);
+    }
+    if (argc < 2 || argv[argc - 1][0] == '-')
+        print_usage(argv[0]);
 
     /* initialize block chain and selector */
-    char *dir = make_dir(argv[1]);
-    block_chain = BRNewBlockChain(dir);
+    char *dir = make_dir(argv[argc - 1]);
+    block_chain = BRNewBlockChain(dir, headers_first);
+    block_chain->validator->pruneDepth = prune;
+    if (assume_valid_height)
+        CBFullValidatorSetAssumeValid(block_chain->validator, assume_valid,
+                assume_valid_height);
     selector = BRNewSelector();
 
     /* allow readline to work with select */
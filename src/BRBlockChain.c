@@ -13,7 +13,7 @@
 #include "BRCommon.h"
 #include "BRBlockChain.h"
 
-BRBlockChain *BRNewBlockChain(char *dir) {
+BRBlockChain *BRNewBlockChain(char *dir, int headers_first) {
     BRBlockChain *bc = calloc(1, sizeof(BRBlockChain));
     if (bc == NULL) {
         perror("calloc failed");
@@ -36,23 +36,22 @@ BRBlockChain *BRNewBlockChain(char *dir) {
         exit(1);
     }
 
+    if (headers_first)
+        bc->headers = BRNewHeaderChain(bc->validator);
+
     return bc;
 }
 
-static void BRChainDescriptorAddBlockIndex(CBChainDescriptor *chain,
-                    BRBlockChain *bc, uint8_t branch_idx, uint32_t block_idx) {
-    CBBlock *block = (CBBlock *) CBBlockChainStorageLoadBlock(bc->validator,
-                                        block_idx, branch_idx);
-    CBByteArray *hash = CBNewByteArrayWithDataCopy(CBBlockGetHash(block), 32);
+static void BRChainDescriptorAddHeader(CBChainDescriptor *chain,
+                    CBHeaderEntry *entry) {
+    CBByteArray *hash = CBNewByteArrayWithDataCopy(entry->hash, 32);
 
     /* add hash to chain; let chain take hash and free it later */
     CBChainDescriptorTakeHash(chain, hash);
 
 #ifdef BRDEBUG
-    printf("Adding block index %u from branch index %u\n", block_idx, branch_idx);
+    printf("Adding block at height %u\n", entry->height);
 #endif
-
-    CBFreeBlock(block);
 }
 
 CBChainDescriptor *BRKnownBlocks(BRBlockChain *bc) {
@@ -62,16 +61,19 @@ CBChainDescriptor *BRKnownBlocks(BRBlockChain *bc) {
         exit(1);
     }
 
-    /* block locator algorithm adapted from https://en.bitcoin.it/wiki/Protocol_Specification#getblocks */
-    uint8_t branch_idx = bc->validator->mainBranch;
-    CBBlockBranch branch = bc->validator->branches[branch_idx];
-    uint32_t top_depth = branch.numBlocks - 1, i, step = 1, start = 0;
-    for (i = top_depth; i > 0; i -= step, ++start) {
+    /* block locator algorithm adapted from https://en.bitcoin.it/wiki/Protocol_Specification#getblocks
+     * walking back through the validator's block tree */
+    CBHeaderEntry *entry = bc->validator->mainTip;
+    uint32_t i, step = 1, start = 0;
+    for (; entry->prev != NULL; ++start) {
         if (start >= 10)
             step *= 2;
-        BRChainDescriptorAddBlockIndex(chain, bc, branch_idx, i);
+        BRChainDescriptorAddHeader(chain, entry);
+        for (i = 0; i < step && entry->prev != NULL; ++i)
+            entry = entry->prev;
     }
-    BRChainDescriptorAddBlockIndex(chain, bc, branch_idx, 0);
+    /* the genesis block */
+    BRChainDescriptorAddHeader(chain, entry);
 
     return chain;
 }
@@ -89,7 +91,8 @@ CBInventoryBroadcast *BRUnknownBlocksFromInv(BRBlockChain *bc, CBInventoryBroadc
 #endif
 
         if (item->type == CB_INVENTORY_ITEM_BLOCK) {
-            if (!CBBlockChainStorageBlockExists(bc->validator, item->hash)) {
+            if (CBFullValidatorFindHeader(bc->validator,
+                        CBByteArrayGetData(item->hash)) == NULL) {
                 ++new_inv->itemNum;
                 new_inv->items = (CBInventoryItem **) realloc(new_inv->items,
                                 new_inv->itemNum * sizeof(CBInventoryItem *));
@@ -11,6 +11,7 @@
 #include <errno.h>
 
 #include "CBObject.h"
+#include "CBDependencies.h"
 #include "CBMessage.h"
 #include "CBVersion.h"
 #include "CBNetworkAddress.h"
@@ -20,6 +21,7 @@
 #include "CBInventoryItem.h"
 #include "CBChainDescriptor.h"
 #include "CBGetBlocks.h"
+#include "CBBlockHeaders.h"
 #include "CBBlock.h"
 #include "CBFullValidator.h"
 
@@ -27,11 +29,14 @@
 #include "BRConnection.h"
 #include "BRConnector.h"
 #include "BRBlockChain.h"
+#include "BRHeaderChain.h"
 
 /* Adapted from examples/pingpong.c */
 
 #define NETMAGIC 0xd0b4bef9 /* umdnet */
 #define VERSION_NUM 70001
+#define BR_OUTPUT_BUFFER_SIZE 4096 /* initial size, grown as needed */
+#define BR_MAX_HEADERS 2000 /* a full headers message, so ask for more */
 
 typedef enum {
     CB_MESSAGE_HEADER_NETWORK_ID = 0, /**< The network identifier bytes */
@@ -124,8 +129,21 @@ BRConnection *BRNewConnection(char *ip, uint16_t port,
         strcpy(c->ip, ip);
     }
 
+    /* output buffer with the message header reserved at the front */
+    c->out = CBNewByteArrayOfSize(BR_OUTPUT_BUFFER_SIZE);
+    c->out_payload = c->out ? CBNewByteArraySubReference(c->out, 24, BR_OUTPUT_BUFFER_SIZE - 24) : NULL;
+    if (c->out_payload == NULL) {
+        fprintf(stderr, "Could not allocate output buffer\n");
+        exit(1);
+    }
+
     c->ver_acked = c->ver_received = 0;
-    c->addr_sent = c->getblocks_sent = 0;
+    c->addr_sent = c->getblocks_sent = c->getheaders_sent = 0;
+    c->blocks_in_flight = 0;
+    c->window = BR_INITIAL_WINDOW;
+    c->download_time = c->download_amount = c->latency_time = 0;
+    c->responses = 0;
+    c->last_receive = c->stalled_at = 0;
     c->connector = connector; /* In reality is a (BRConnector *) */
     return c;
 }
@@ -135,12 +153,20 @@ void BRCloseConnection(BRConnection *conn) {
     BRConnector *connector = (BRConnector *) conn->connector;
     BRRemoveConnection(connector, conn);
 
+    /* let other peers download what was asked of this one */
+    if (connector->block_chain->headers != NULL) {
+        BRHeaderChainForgetRequests(connector->block_chain->headers, conn);
+        BRScheduleDownloads(connector);
+    }
+
     /* remove from selector */
     BRRemoveSelectable(connector->selector, conn->sock);
 
     /* free object */
     free(conn->ip);
     CBReleaseObject(conn->address); /* should free all associated data */
+    CBReleaseObject(conn->out_payload);
+    CBReleaseObject(conn->out);
     close(conn->sock);
     free(conn);
 }
@@ -260,6 +286,9 @@ void BRPeerCallback(void *arg) {
         } else if (!strncmp(header + CB_MESSAGE_HEADER_TYPE, "block\0\0\0\0\0\0\0", 12)) {
             printf("Received block header\n\n");
             BRHandleBlock(c, ba);
+        } else if (!strncmp(header + CB_MESSAGE_HEADER_TYPE, "headers\0\0\0\0\0", 12)) {
+            printf("Received headers header\n\n");
+            BRHandleHeaders(c, ba);
         }
 
 
@@ -267,7 +296,10 @@ void BRPeerCallback(void *arg) {
         if (!c->addr_sent) {
             BRSendAddr(c);
         }
-        if (!c->getblocks_sent) {
+        if (((BRConnector *) c->connector)->block_chain->headers != NULL) {
+            if (!c->getheaders_sent)
+                BRSendGetHeaders(c);
+        } else if (!c->getblocks_sent) {
             /* TODO should wait for blocks instead of spamming getblocks
              * after every inv received; maybe change it to
              * blocks_received instead of getblocks_sent */
@@ -281,64 +313,82 @@ void BRPeerCallback(void *arg) {
 }
 
 
-void BRSendMessage(BRConnection *c, CBMessage *message, char *command) {
-    /* partially adapted from examples/pingpong.c */
-    char header[24] = {0}; /* zeros help us out places */
-    
-    memcpy(header + CB_MESSAGE_HEADER_TYPE, command, strlen(command));
-    
-    uint8_t hash[32];
-    uint8_t hash2[32];
-    if (message->bytes)
-        CBSha256(CBByteArrayGetData(message->bytes), message->bytes->length, hash);
-    else {
-        /* Get the checksum right -- handles problem where checksum not calculated
-         * for messages with no payload */
-        CBSha256(NULL, 0, hash);
+/* Makes sure the output buffer can hold a payload of length bytes after the
+ * reserved header space and returns the payload array, sized to the whole
+ * remaining capacity so serialisers can write without measuring first. */
+static CBByteArray *BRReserveOutput(BRConnection *c, uint32_t length) {
+    if (length > c->out->length - 24) {
+        uint32_t size = c->out->length;
+        while (size - 24 < length)
+            size *= 2;
+        uint8_t *data = realloc(c->out->sharedData->data, size);
+        if (data == NULL) {
+            perror("realloc failed");
+            exit(1);
+        }
+        /* sub references share the data so they see the new pointer */
+        c->out->sharedData->data = data;
+        c->out->length = size;
     }
-    CBSha256(hash, 32, hash2);
-    message->checksum[0] = hash2[0];
-    message->checksum[1] = hash2[1];
-    message->checksum[2] = hash2[2];
-    message->checksum[3] = hash2[3];
+    c->out_payload->length = c->out->length - 24;
+    return c->out_payload;
+}
 
-    CBInt32ToArray(header, CB_MESSAGE_HEADER_NETWORK_ID, NETMAGIC);
-    if (message->bytes) {
-        CBInt32ToArray(header, CB_MESSAGE_HEADER_LENGTH, message->bytes->length);
-    }
-    memcpy(header + CB_MESSAGE_HEADER_CHECKSUM, message->checksum, 4);
+/* Writes the header in front of the length payload bytes already in the
+ * output buffer, checksumming them in place, and sends it all at once */
+static void BRFlushOutput(BRConnection *c, char *command, uint32_t length) {
+    uint8_t *header = CBByteArrayGetData(c->out);
+    uint8_t hash[32];
 
-    int sent = send(c->sock, header, 24, 0);
-    if (sent < 0) {
-        perror("send failed");
-        exit(1);
-    }
-    if (sent != 24) {
-        fprintf(stderr, "send sent %d, not 24 bytes\n", sent);
-        exit(1);
-    }
-    if (message->bytes) {
-        sent = send(c->sock, message->bytes->sharedData->data + message->bytes->offset,
-                    message->bytes->length, 0);
-        if (sent < 0) {
+    memset(header, 0, 24); /* zeros help us out places */
+    CBInt32ToArray(header, CB_MESSAGE_HEADER_NETWORK_ID, NETMAGIC);
+    memcpy(header + CB_MESSAGE_HEADER_TYPE, command, strlen(command));
+    CBInt32ToArray(header, CB_MESSAGE_HEADER_LENGTH, length);
+    CBSha256(header + 24, length, hash);
+    CBSha256(hash, 32, hash);
+    memcpy(header + CB_MESSAGE_HEADER_CHECKSUM, hash, 4);
+
+    uint32_t total = 24 + length, sent = 0;
+    while (sent < total) {
+        ssize_t n = send(c->sock, header + sent, total - sent, 0);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
             perror("send failed");
             exit(1);
         }
-        if (sent != message->bytes->length) {
-            fprintf(stderr, "send sent %d, not %d bytes\n", sent, message->bytes->length);
-            exit(1);
-        }
+        sent += n;
     }
 
 #ifdef BRDEBUG
-    print_header(header);
-    printf("message len: %d\n", message->bytes ? message->bytes->length : 0);
-    printf("checksum: %x\n", *((uint32_t *) message->checksum));
-    print_hex(message->bytes);
+    print_header((char *) header);
+    printf("message len: %d\n", length);
+    printf("checksum: %x\n", *((uint32_t *) (header + CB_MESSAGE_HEADER_CHECKSUM)));
+    c->out_payload->length = length;
+    print_hex(c->out_payload);
     printf("\n");
 #endif
 }
 
+/* Hands out the output buffer as the bytes of a message to be serialised
+ * straight behind the reserved header. bound is an upper bound on the
+ * serialised length; the serialisers shorten the array to what they write. */
+static CBByteArray *BRBeginMessage(BRConnection *c, uint32_t bound) {
+    CBByteArray *payload = BRReserveOutput(c, bound);
+    CBRetainObject(payload); /* released when the message is freed */
+    return payload;
+}
+
+/* Sends a message serialised after BRBeginMessage. Serialisers return 0 on
+ * failure. */
+static void BRFinishMessage(BRConnection *c, char *command, uint32_t length) {
+    if (!length) {
+        fprintf(stderr, "Could not serialise %s message\n", command);
+        exit(1);
+    }
+    BRFlushOutput(c, command, length);
+}
+
 void BRSendGetBlocks(BRConnection *c) {
     BRConnector *connector = (BRConnector *) c->connector;
     CBChainDescriptor *chain = BRKnownBlocks(connector->block_chain);
@@ -349,10 +399,10 @@ void BRSendGetBlocks(BRConnection *c) {
 
     CBGetBlocks *get_blocks = CBNewGetBlocks(VERSION_NUM, chain, stop);
 
-    uint32_t length = CBGetBlocksCalculateLength(get_blocks);
-    get_blocks->base.bytes = CBNewByteArrayOfSize(length);
-    CBGetBlocksSerialise(get_blocks, false);
-    BRSendMessage(c, &get_blocks->base, "getblocks");
+    /* the output buffer is reused by every message, so force serialisation
+     * rather than copying data other messages may have overwritten */
+    get_blocks->base.bytes = BRBeginMessage(c, CBGetBlocksCalculateLength(get_blocks));
+    BRFinishMessage(c, "getblocks", CBGetBlocksSerialise(get_blocks, true));
 
     CBReleaseObject(stop);
     CBReleaseObject(chain);
@@ -362,17 +412,57 @@ void BRSendGetBlocks(BRConnection *c) {
     c->getblocks_sent = 1;
 }
 
+void BRSendGetHeaders(BRConnection *c) {
+    BRConnector *connector = (BRConnector *) c->connector;
+    CBChainDescriptor *chain = BRHeaderChainLocator(connector->block_chain->headers);
+
+    /* 0 to get as many headers as possible (2000) */
+    uint8_t zero[32] = {0};
+    CBByteArray *stop = CBNewByteArrayWithDataCopy(zero, 32);
+
+    /* getheaders has the same payload as getblocks */
+    CBGetBlocks *get_headers = CBNewGetBlocks(VERSION_NUM, chain, stop);
+    get_headers->base.bytes = BRBeginMessage(c, CBGetBlocksCalculateLength(get_headers));
+    BRFinishMessage(c, "getheaders", CBGetBlocksSerialise(get_headers, true));
+
+    CBReleaseObject(stop);
+    CBReleaseObject(chain);
+    CBFreeGetBlocks(get_headers);
+
+    c->getheaders_sent = 1;
+}
+
 void BRSendGetAddr(BRConnection *c) {
     printf("Sending getaddr\n");
-    CBMessage *m = CBNewMessageByObject();
-    BRSendMessage(c, m, "getaddr");
-    CBFreeMessage(m);
+    BRFlushOutput(c, "getaddr", 0);
 }
 
 void BRHandleBlock(BRConnection *c, CBByteArray *message) {
     BRBlockChain *bc = ((BRConnector *) c->connector)->block_chain;
     CBBlock *block = CBNewBlockFromData(message);
-    CBBlockDeserialise(block, true);
+    if (!CBBlockDeserialise(block, true)) {
+        fprintf(stderr, "Could not deserialise a block\n");
+        CBReleaseObject(block);
+        return;
+    }
+
+    BRHeader *h = bc->headers != NULL ?
+        BRHeaderChainFind(bc->headers, CBBlockGetHash(block)) : NULL;
+    if (h != NULL && h->height > bc->headers->connected) {
+        /* a body we asked for: hold it until the ones below it arrive */
+        BRBlockDownloaded(c->connector, c, h, message->length);
+        if (h->block == NULL) {
+            h->block = block;
+            CBRetainObject(block);
+        }
+        BRHeaderChainConnect(bc->headers, bc->validator);
+#ifdef BRDEBUG
+        printf("Connected blocks up to height %u\n", bc->headers->connected);
+#endif
+        BRScheduleDownloads(c->connector);
+        CBReleaseObject(block);
+        return;
+    }
 
     /* process block */
     CBBlockStatus status = CBFullValidatorProcessBlock(bc->validator,
@@ -395,11 +485,12 @@ void BRHandleInv(BRConnection *c, CBByteArray *message) {
     CBInventoryBroadcastDeserialise(inv);
 
     CBInventoryBroadcast *new_inv = BRUnknownBlocksFromInv(connector->block_chain, inv);
-    if (new_inv->itemNum > 0) {
-        uint32_t length = CBInventoryBroadcastCalculateLength(new_inv);
-        new_inv->base.bytes = CBNewByteArrayOfSize(length);
-        CBInventoryBroadcastSerialise(new_inv, false);
-        BRSendMessage(c, &new_inv->base, "getdata");
+    if (new_inv->itemNum > 0 && connector->block_chain->headers != NULL) {
+        /* new blocks are fetched through their headers */
+        BRSendGetHeaders(c);
+    } else if (new_inv->itemNum > 0) {
+        new_inv->base.bytes = BRBeginMessage(c, CBInventoryBroadcastCalculateLength(new_inv));
+        BRFinishMessage(c, "getdata", CBInventoryBroadcastSerialise(new_inv, true));
 
         /* ask for more */
         c->getblocks_sent = 0;
@@ -409,6 +500,65 @@ void BRHandleInv(BRConnection *c, CBByteArray *message) {
     CBFreeInventoryBroadcast(inv);
 }
 
+void BRHandleHeaders(BRConnection *c, CBByteArray *message) {
+    BRBlockChain *bc = ((BRConnector *) c->connector)->block_chain;
+    if (bc->headers == NULL)
+        return;
+    CBBlockHeaders *headers = CBNewBlockHeadersFromData(message);
+    if (!CBBlockHeadersDeserialise(headers)) {
+        /* also what an empty headers message gives */
+        CBReleaseObject(headers);
+        return;
+    }
+
+    int i, added = 0;
+    for (i = 0; i < headers->headerNum; ++i) {
+        BRHeaderStatus status = BRHeaderChainAdd(bc->headers,
+                headers->blockHeaders[i], time(NULL));
+        if (status == BR_HEADER_ADDED)
+            ++added;
+        else if (status == BR_HEADER_BAD) {
+            fprintf(stderr, "Peer %s:%hu sent an invalid header\n", c->ip, c->port);
+            break;
+        } else if (status == BR_HEADER_UNCONNECTED) {
+            /* reorganisations of the header chain are left to the validator */
+            break;
+        }
+    }
+#ifdef BRDEBUG
+    printf("Added %d of %d headers, header tip at height %u\n", added,
+            headers->headerNum, BRHeaderChainTip(bc->headers)->height);
+#endif
+
+    /* a full message means the peer has more */
+    if (added > 0 && headers->headerNum == BR_MAX_HEADERS)
+        BRSendGetHeaders(c);
+    CBReleaseObject(headers);
+
+    if (added > 0) {
+        BRHeaderChainGiveAssumeValid(bc->headers, bc->validator);
+        BRScheduleDownloads(c->connector);
+    }
+}
+
+/* asks this peer for the bodies of num headers */
+void BRSendGetData(BRConnection *c, BRHeader **headers, int num) {
+    CBInventoryBroadcast *get_data = CBNewInventoryBroadcast();
+    get_data->items = malloc(num * sizeof(CBInventoryItem *));
+    if (get_data->items == NULL) {
+        perror("malloc failed");
+        exit(1);
+    }
+    for (get_data->itemNum = 0; get_data->itemNum < num; ++get_data->itemNum) {
+        CBByteArray *hash = CBNewByteArrayWithDataCopy(headers[get_data->itemNum]->hash, 32);
+        get_data->items[get_data->itemNum] = CBNewInventoryItem(CB_INVENTORY_ITEM_BLOCK, hash);
+        CBReleaseObject(hash);
+    }
+    get_data->base.bytes = BRBeginMessage(c, CBInventoryBroadcastCalculateLength(get_data));
+    BRFinishMessage(c, "getdata", CBInventoryBroadcastSerialise(get_data, true));
+    CBFreeInventoryBroadcast(get_data);
+}
+
 void BRHandleAddr(BRConnection *c, CBByteArray *message) {
     CBAddressBroadcast *b = CBNewAddressBroadcastFromData(message, true);
     CBAddressBroadcastDeserialise(b);
@@ -441,20 +591,37 @@ void BRHandleAddr(BRConnection *c, CBByteArray *message) {
     CBFreeAddressBroadcast(b);
 }
 
+/* Copies an address with its own ip bytes. Serialising into the output
+ * buffer points the ip at the buffer, which the next message overwrites, so
+ * addresses kept by the connector must never be serialised themselves. */
+static CBNetworkAddress *BRCopyNetworkAddress(CBNetworkAddress *address) {
+    CBByteArray *ip = CBNewByteArrayWithDataCopy(CBByteArrayGetData(address->ip), 16);
+    CBNetworkAddress *copy = ip == NULL ? NULL :
+        CBNewNetworkAddress(address->lastSeen, ip, address->port,
+                address->services, address->isPublic);
+    if (copy == NULL) {
+        fprintf(stderr, "Could not copy a network address\n");
+        exit(1);
+    }
+    copy->penalty = address->penalty;
+    CBReleaseObject(ip);
+    return copy;
+}
+
 void BRSendAddr(BRConnection *c) {
     BRConnector *connector = (BRConnector *) c->connector;
     CBAddressBroadcast *b = CBNewAddressBroadcast(true);
     
     int i;
     for (i = 0; i < connector->num_conns; ++i)
-        CBAddressBroadcastAddNetworkAddress(b, connector->conns[i]->address);
+        CBAddressBroadcastTakeNetworkAddress(b,
+                BRCopyNetworkAddress(connector->conns[i]->address));
     /* add mine too */
-    CBAddressBroadcastAddNetworkAddress(b, connector->my_address);
+    CBAddressBroadcastTakeNetworkAddress(b,
+            BRCopyNetworkAddress(connector->my_address));
 
-    uint32_t length = CBAddressBroadcastCalculateLength(b);
-    b->base.bytes = CBNewByteArrayOfSize(length);
-    CBAddressBroadcastSerialise(b, false);
-    BRSendMessage(c, &b->base, "addr");
+    b->base.bytes = BRBeginMessage(c, CBAddressBroadcastCalculateLength(b));
+    BRFinishMessage(c, "addr", CBAddressBroadcastSerialise(b, true));
 
     CBFreeAddressBroadcast(b);
 
@@ -465,15 +632,13 @@ void BRSendAddr(BRConnection *c) {
 void BRSendPing(BRConnection *c) {
     printf("Sending ping\n");
     
-    CBMessage *m = CBNewMessageByObject();
-    uint64_t nonce = rand();
-    CBByteArray *ba = CBNewByteArrayWithDataCopy((uint8_t *) &nonce, 8);
-    CBInitMessageByData(m, ba);
-
-    BRSendMessage(c, m, "ping");
-
-    CBReleaseObject(ba);
-    CBFreeMessage(m);
+    /* the nonce is generated straight into the output buffer */
+    CBByteArray *payload = BRReserveOutput(c, 8);
+    if (!CBSecureRandomBytes(CBByteArrayGetData(payload), 8)) {
+        fprintf(stderr, "Could not generate ping nonce\n");
+        exit(1);
+    }
+    BRFlushOutput(c, "ping", 8);
 }
 
 void BRSendPong(BRConnection *c, CBByteArray *nonce, uint32_t length) {
@@ -482,39 +647,40 @@ void BRSendPong(BRConnection *c, CBByteArray *nonce, uint32_t length) {
         exit(1);
     }
     printf("Sending pong reply\n");
-    CBMessage *m = CBNewMessageByObject();
-    CBInitMessageByData(m, nonce);
-    BRSendMessage(c, m, "pong");
-    CBFreeMessage(m);
+    CBByteArray *payload = BRReserveOutput(c, 8);
+    memcpy(CBByteArrayGetData(payload), CBByteArrayGetData(nonce), 8);
+    BRFlushOutput(c, "pong", 8);
 }
 
 void BRSendVerack(BRConnection *c) {
     printf("Sending verack reply\n");
-    CBMessage *m = CBNewMessageByObject();
-    BRSendMessage(c, m, "verack");
-    CBFreeMessage(m);
+    BRFlushOutput(c, "verack", 0);
 }
 
 void BRSendVersion(BRConnection *c) {
     /* current version number according to http://bitcoin.stackexchange.com/questions/13537/how-do-i-find-out-what-the-latest-protocol-version-is */
-    CBVersionServices services = CB_SERVICE_FULL_BLOCKS;
+    /* a pruning node cannot give peers the whole block chain */
+    BRBlockChain *bc = ((BRConnector *) c->connector)->block_chain;
+    CBVersionServices services = bc->validator->pruneDepth ? 0 : CB_SERVICE_FULL_BLOCKS;
     int64_t t = time(NULL);
-    CBNetworkAddress *r_addr = c->address;
-    CBNetworkAddress *s_addr = c->my_address;
-    uint64_t nonce = rand();
+    /* copies, as serialising would point them at the output buffer */
+    CBNetworkAddress *r_addr = BRCopyNetworkAddress(c->address);
+    CBNetworkAddress *s_addr = BRCopyNetworkAddress(c->my_address);
+    uint64_t nonce;
+    if (!CBSecureRandomBytes((uint8_t *) &nonce, 8)) {
+        fprintf(stderr, "Could not generate version nonce\n");
+        exit(1);
+    }
     CBByteArray *ua = CBNewByteArrayFromString("br_cmsc417_v0.1", false);
     int32_t block_height = 0; /* TODO get real number */
 
     CBVersion *v = CBNewVersion(VERSION_NUM, services, t, r_addr, s_addr,
             nonce, ua, block_height);
-    uint32_t length = CBVersionCalculateLength(v);
-    v->base.bytes = CBNewByteArrayOfSize(length);
-    CBVersionSerialise(v, false);
-
-    BRSendMessage(c, &v->base, "version");
+    v->base.bytes = BRBeginMessage(c, CBVersionCalculateLength(v));
+    BRFinishMessage(c, "version", CBVersionSerialise(v, true));
 
-    /* don't release remote and local addresses just yet.
-     * need them for other messages */
+    CBReleaseObject(r_addr);
+    CBReleaseObject(s_addr);
     CBReleaseObject(ua);
     CBFreeVersion(v);
 }
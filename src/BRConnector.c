@@ -8,6 +8,7 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <time.h>
+#include <sys/time.h>
 
 #include "CBObject.h"
 #include "CBNetworkAddress.h"
@@ -57,6 +58,8 @@ BRConnector *BRNewConnector(char *ip, int port, BRSelector *s, BRBlockChain *bc)
     BRAddSelectable(s, c->sock, BRListenerCallback, c, 0, FOR_READING);
     c->selector = s;
     c->block_chain = bc;
+    if (bc->headers != NULL)
+        BRAddSelectable(s, 0, BRDownloadCallback, c, BR_DOWNLOAD_INTERVAL, FOR_TIMING);
 
     if (ip != NULL) {
         uint64_t last_seen = time(NULL);
@@ -228,3 +231,119 @@ void BRPingCallback(void *arg) {
             BRSendPing(c->conns[i]);
 }
 
+
+static uint64_t BRMilliseconds(void) {
+    struct timeval t;
+    gettimeofday(&t, NULL);
+    return (uint64_t) t.tv_sec * 1000 + t.tv_usec / 1000;
+}
+
+uint64_t BRThroughput(BRConnection *conn) {
+    if (conn->download_time == 0)
+        return 0;
+    return conn->download_amount * 1000 / conn->download_time;
+}
+
+/* fastest peers first; unmeasured peers after them */
+static int BRCompareThroughput(const void *a, const void *b) {
+    uint64_t ta = BRThroughput(*(BRConnection **) a);
+    uint64_t tb = BRThroughput(*(BRConnection **) b);
+    return ta < tb ? 1 : (ta > tb ? -1 : 0);
+}
+
+/* fills the window of each peer with the lowest heights nobody was asked
+ * for, going through the peers from the fastest so that the bodies needed
+ * soonest come from them */
+void BRScheduleDownloads(BRConnector *c) {
+    BRHeaderChain *hc = c->block_chain->headers;
+    if (hc == NULL || c->num_conns == 0)
+        return;
+
+    BRConnection **peers = malloc(c->num_conns * sizeof(BRConnection *));
+    BRHeader **wanted = malloc(BR_MAX_WINDOW * sizeof(BRHeader *));
+    if (peers == NULL || wanted == NULL) {
+        perror("malloc failed");
+        exit(1);
+    }
+    int num_peers = 0, i;
+    for (i = 0; i < c->num_conns; ++i)
+        if (BRVersionExchanged(c->conns[i]))
+            peers[num_peers++] = c->conns[i];
+    qsort(peers, num_peers, sizeof(BRConnection *), BRCompareThroughput);
+
+    uint64_t now = BRMilliseconds();
+    uint32_t height = hc->connected + 1, last = BRHeaderChainTip(hc)->height;
+    if (last > hc->connected + BR_DOWNLOAD_WINDOW)
+        last = hc->connected + BR_DOWNLOAD_WINDOW;
+    for (i = 0; i < num_peers && height <= last; ++i) {
+        BRConnection *peer = peers[i];
+        /* leave a peer that just stalled alone unless it is the only one */
+        if (num_peers > 1 && peer->stalled_at != 0
+                && now - peer->stalled_at < BR_BLOCK_TIMEOUT)
+            continue;
+        int num = 0;
+        for (; height <= last && peer->blocks_in_flight + num < peer->window; ++height) {
+            BRHeader *h = BRHeaderChainGet(hc, height);
+            if (h->block != NULL || h->requested_from != NULL)
+                continue;
+            h->requested_from = peer;
+            h->requested_at = now;
+            wanted[num++] = h;
+        }
+        if (num > 0) {
+            peer->blocks_in_flight += num;
+            BRSendGetData(peer, wanted, num);
+        }
+    }
+
+    free(wanted);
+    free(peers);
+}
+
+/* records a body arriving from conn and the throughput of whoever was asked */
+void BRBlockDownloaded(BRConnector *c, BRConnection *conn, BRHeader *h, uint32_t length) {
+    BRConnection *peer = (BRConnection *) BRHeaderReleaseRequest(h);
+    ++c->blocks_downloaded;
+    if (peer == NULL)
+        return;
+    if (peer != conn)
+        return;
+
+    /* as CBPeer, download time excludes the latency of the request when
+     * other bodies were already on their way */
+    uint64_t now = BRMilliseconds();
+    uint64_t start = conn->last_receive > h->requested_at ?
+                        conn->last_receive : h->requested_at;
+    conn->download_time += now - start;
+    conn->download_amount += length;
+    conn->latency_time += now - h->requested_at;
+    ++conn->responses;
+    conn->last_receive = now;
+    if (conn->window < BR_MAX_WINDOW)
+        ++conn->window;
+}
+
+/* takes bodies back from peers which did not send them in time */
+void BRDownloadCallback(void *arg) {
+    BRConnector *c = (BRConnector *) arg;
+    BRHeaderChain *hc = c->block_chain->headers;
+    uint64_t now = BRMilliseconds();
+    uint32_t height, last = BRHeaderChainTip(hc)->height;
+    if (last > hc->connected + BR_DOWNLOAD_WINDOW)
+        last = hc->connected + BR_DOWNLOAD_WINDOW;
+    for (height = hc->connected + 1; height <= last; ++height) {
+        BRHeader *h = BRHeaderChainGet(hc, height);
+        BRConnection *peer = (BRConnection *) h->requested_from;
+        if (peer == NULL || now - h->requested_at < BR_BLOCK_TIMEOUT)
+            continue;
+#ifdef BRDEBUG
+        printf("Block at height %u from %s:%hu stalled\n", height, peer->ip, peer->port);
+#endif
+        BRHeaderReleaseRequest(h);
+        if (peer->stalled_at != now && peer->window > 1)
+            peer->window /= 2;
+        peer->stalled_at = now;
+        ++c->blocks_stalled;
+    }
+    BRScheduleDownloads(c);
+}
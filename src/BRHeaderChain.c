@@ -0,0 +1,298 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "CBDependencies.h"
+#include "CBValidationFunctions.h"
+#include "CBByteArray.h"
+#include "CBObject.h"
+
+#include "BRCommon.h"
+#include "BRHeaderChain.h"
+#include "BRConnection.h"
+
+static CBCompare BRHeaderCompare(void *a, void *b) {
+    int cmp = memcmp(a, b, 32);
+    if (cmp > 0)
+        return CB_COMPARE_MORE_THAN;
+    if (cmp < 0)
+        return CB_COMPARE_LESS_THAN;
+    return CB_COMPARE_EQUAL;
+}
+
+/* appends an entry for height, allocating a new chunk when needed */
+static BRHeader *BRHeaderChainAppend(BRHeaderChain *hc, uint8_t *hash,
+        uint32_t time, uint32_t target, uint32_t retarget_time) {
+    if (hc->num_headers == hc->num_chunks * BR_HEADER_CHUNK) {
+        ++hc->num_chunks;
+        hc->chunks = realloc(hc->chunks, hc->num_chunks * sizeof(BRHeader *));
+        if (hc->chunks == NULL) {
+            perror("realloc failed");
+            exit(1);
+        }
+        hc->chunks[hc->num_chunks - 1] = calloc(BR_HEADER_CHUNK, sizeof(BRHeader));
+        if (hc->chunks[hc->num_chunks - 1] == NULL) {
+            perror("calloc failed");
+            exit(1);
+        }
+    }
+    BRHeader *h = &hc->chunks[hc->num_headers / BR_HEADER_CHUNK][hc->num_headers % BR_HEADER_CHUNK];
+    memcpy(h->hash, hash, 32);
+    h->height = hc->base_height + hc->num_headers;
+    h->time = time;
+    h->target = target;
+    h->retarget_time = retarget_time;
+    h->block = NULL;
+    h->requested_from = NULL;
+    h->requested_at = 0;
+    if (!CBAssociativeArrayInsert(&hc->index, h,
+                CBAssociativeArrayFind(&hc->index, h).position, NULL)) {
+        fprintf(stderr, "Could not index a header\n");
+        exit(1);
+    }
+    ++hc->num_headers;
+    return h;
+}
+
+BRHeaderChain *BRNewHeaderChain(CBFullValidator *v) {
+    BRHeaderChain *hc = calloc(1, sizeof(BRHeaderChain));
+    if (hc == NULL) {
+        perror("calloc failed");
+        exit(1);
+    }
+    if (!CBInitAssociativeArray(&hc->index, BRHeaderCompare, NULL)) {
+        fprintf(stderr, "Could not create the header index\n");
+        exit(1);
+    }
+
+    hc->check_pow = !(v->flags & CB_FULL_VALIDATOR_DISABLE_POW_CHECK);
+
+    /* start from the validator's tip with enough blocks behind it for the
+     * median time of the next header, taken from its block tree */
+    CBHeaderEntry *entries[BR_MEDIAN_TIME_SPAN], *entry = v->mainTip;
+    uint32_t tip = entry->height;
+    int num = 0, i;
+    for (; num < BR_MEDIAN_TIME_SPAN && entry != NULL; entry = entry->prev)
+        entries[num++] = entry;
+    hc->base_height = tip - (num - 1);
+    hc->connected = tip;
+    /* only the tip's retarget time is used, as headers only extend the tip */
+    uint32_t retarget_time = CBFullValidatorGetMainChainHeader(v, tip - tip % 2016)->time;
+    for (i = num - 1; i >= 0; --i)
+        BRHeaderChainAppend(hc, entries[i]->hash, entries[i]->time,
+                entries[i]->target, i == 0 ? retarget_time : 0);
+    memcpy(hc->genesis, CBFullValidatorGetMainChainHeader(v, 0)->hash, 32);
+
+#ifdef BRDEBUG
+    printf("Header chain starts at height %u\n", tip);
+#endif
+    return hc;
+}
+
+void BRFreeHeaderChain(BRHeaderChain *hc) {
+    uint32_t i;
+    for (i = 0; i < hc->num_headers; ++i) {
+        BRHeader *h = BRHeaderChainGet(hc, hc->base_height + i);
+        if (h->block != NULL)
+            CBReleaseObject(h->block);
+    }
+    for (i = 0; i < hc->num_chunks; ++i)
+        free(hc->chunks[i]);
+    free(hc->chunks);
+    CBFreeAssociativeArray(&hc->index);
+    free(hc);
+}
+
+BRHeader *BRHeaderChainGet(BRHeaderChain *hc, uint32_t height) {
+    if (height < hc->base_height || height - hc->base_height >= hc->num_headers)
+        return NULL;
+    uint32_t i = height - hc->base_height;
+    return &hc->chunks[i / BR_HEADER_CHUNK][i % BR_HEADER_CHUNK];
+}
+
+BRHeader *BRHeaderChainFind(BRHeaderChain *hc, uint8_t *hash) {
+    CBFindResult res = CBAssociativeArrayFind(&hc->index, hash);
+    if (!res.found)
+        return NULL;
+    return res.position.node->elements[res.position.index];
+}
+
+BRHeader *BRHeaderChainTip(BRHeaderChain *hc) {
+    return BRHeaderChainGet(hc, hc->base_height + hc->num_headers - 1);
+}
+
+static uint32_t BRHeaderChainMedianTime(BRHeaderChain *hc) {
+    uint32_t times[BR_MEDIAN_TIME_SPAN];
+    int num = 0, i;
+    uint32_t height = BRHeaderChainTip(hc)->height;
+    for (; num < BR_MEDIAN_TIME_SPAN; ++num, --height) {
+        BRHeader *h = BRHeaderChainGet(hc, height);
+        if (h == NULL)
+            break;
+        /* insertion sort */
+        for (i = num; i > 0 && times[i - 1] > h->time; --i)
+            times[i] = times[i - 1];
+        times[i] = h->time;
+        if (height == 0) {
+            ++num;
+            break;
+        }
+    }
+    return times[num / 2];
+}
+
+static int BRHeaderChainIsRejected(BRHeaderChain *hc, uint8_t *hash) {
+    uint32_t i, num = hc->num_rejected < BR_REJECTED_HEADERS ?
+                        hc->num_rejected : BR_REJECTED_HEADERS;
+    for (i = 0; i < num; ++i)
+        if (!memcmp(hc->rejected[i], hash, 32))
+            return 1;
+    return 0;
+}
+
+static void BRHeaderChainReject(BRHeaderChain *hc, uint8_t *hash) {
+    memcpy(hc->rejected[hc->num_rejected++ % BR_REJECTED_HEADERS], hash, 32);
+}
+
+BRHeaderStatus BRHeaderChainAdd(BRHeaderChain *hc, CBBlock *header, uint64_t now) {
+    uint8_t *hash = CBBlockGetHash(header);
+    if (BRHeaderChainFind(hc, hash) != NULL)
+        return BR_HEADER_KNOWN;
+
+    /* peers send the headers of a rejected block again, which would have
+     * the body downloaded and rejected over and over */
+    if (BRHeaderChainIsRejected(hc, hash))
+        return BR_HEADER_BAD;
+    if (BRHeaderChainIsRejected(hc, CBByteArrayGetData(header->prevBlockHash))) {
+        BRHeaderChainReject(hc, hash);
+        return BR_HEADER_BAD;
+    }
+
+    BRHeader *tip = BRHeaderChainTip(hc);
+    if (memcmp(CBByteArrayGetData(header->prevBlockHash), tip->hash, 32))
+        return BR_HEADER_UNCONNECTED;
+
+    if (hc->check_pow && !CBValidateProofOfWork(hash, header->target))
+        return BR_HEADER_BAD;
+    if (header->time <= BRHeaderChainMedianTime(hc)
+            || header->time > now + CB_BLOCK_ALLOWED_TIME_DRIFT)
+        return BR_HEADER_BAD;
+
+    /* retarget exactly as CBFullValidatorGetNextTarget does so that the
+     * bodies pass validation later */
+    uint32_t height = tip->height + 1, target = tip->target;
+    if (height % 2016 == 0)
+        target = CBCalculateTarget(tip->target, tip->time - tip->retarget_time);
+    if (header->target != target)
+        return BR_HEADER_BAD;
+
+    BRHeaderChainAppend(hc, hash, header->time, header->target,
+            height % 2016 == 0 ? header->time : tip->retarget_time);
+    return BR_HEADER_ADDED;
+}
+
+CBChainDescriptor *BRHeaderChainLocator(BRHeaderChain *hc) {
+    CBChainDescriptor *chain = CBNewChainDescriptor();
+    if (chain == NULL) {
+        fprintf(stderr, "Failed to create chain descriptor\n");
+        exit(1);
+    }
+
+    /* same spacing as BRKnownBlocks, but from headers in memory */
+    uint32_t height = BRHeaderChainTip(hc)->height, step = 1, num = 0;
+    for (;;) {
+        BRHeader *h = BRHeaderChainGet(hc, height);
+        CBChainDescriptorTakeHash(chain, CBNewByteArrayWithDataCopy(h->hash, 32));
+        if (height == hc->base_height)
+            break;
+        if (++num >= 10)
+            step *= 2;
+        height = height - hc->base_height > step ? height - step : hc->base_height;
+    }
+    if (hc->base_height != 0)
+        CBChainDescriptorTakeHash(chain, CBNewByteArrayWithDataCopy(hc->genesis, 32));
+    return chain;
+}
+
+void BRHeaderChainForgetRequests(BRHeaderChain *hc, void *conn) {
+    uint32_t height, last = BRHeaderChainTip(hc)->height;
+    if (last > hc->connected + BR_DOWNLOAD_WINDOW)
+        last = hc->connected + BR_DOWNLOAD_WINDOW;
+    for (height = hc->connected + 1; height <= last; ++height) {
+        BRHeader *h = BRHeaderChainGet(hc, height);
+        if (h->requested_from == conn)
+            BRHeaderReleaseRequest(h);
+    }
+}
+
+/* gives back the peer's download slot for the body, returning the peer it
+ * was requested from or NULL. The only place slots are released. */
+void *BRHeaderReleaseRequest(BRHeader *h) {
+    BRConnection *peer = (BRConnection *) h->requested_from;
+    if (peer != NULL) {
+        --peer->blocks_in_flight;
+        h->requested_from = NULL;
+    }
+    return peer;
+}
+
+/* drops every header above the connected height, after a body failed */
+static void BRHeaderChainTruncate(BRHeaderChain *hc) {
+    while (BRHeaderChainTip(hc)->height > hc->connected) {
+        BRHeader *h = BRHeaderChainTip(hc);
+        if (h->block != NULL)
+            CBReleaseObject(h->block);
+        /* the body will no longer be recognised when it arrives, so give
+         * the peer its slot back now */
+        BRHeaderReleaseRequest(h);
+        CBAssociativeArrayDelete(&hc->index,
+                CBAssociativeArrayFind(&hc->index, h).position, false);
+        --hc->num_headers;
+    }
+}
+
+int BRHeaderChainConnect(BRHeaderChain *hc, CBFullValidator *v) {
+    int num = 0;
+    BRHeader *h;
+    while ((h = BRHeaderChainGet(hc, hc->connected + 1)) != NULL
+            && h->block != NULL) {
+        CBBlockStatus status = CBFullValidatorProcessBlock(v, h->block, time(NULL));
+        CBReleaseObject(h->block);
+        h->block = NULL;
+        if (status != CB_BLOCK_STATUS_MAIN && status != CB_BLOCK_STATUS_DUPLICATE) {
+            fprintf(stderr, "Block at height %u was rejected. Status: %d\n",
+                    h->height, status);
+            BRHeaderChainReject(hc, h->hash);
+            BRHeaderChainTruncate(hc);
+            break;
+        }
+        ++hc->connected;
+        ++num;
+    }
+    return num;
+}
+
+/* once the assume-valid header is in the chain, tells the validator which
+ * blocks lead to it so that only their scripts are skipped */
+void BRHeaderChainGiveAssumeValid(BRHeaderChain *hc, CBFullValidator *v) {
+    if (v->assumeValidHeight == 0 || v->assumeValidChain != NULL
+            || v->assumeValidHeight < hc->base_height)
+        return;
+    BRHeader *h = BRHeaderChainGet(hc, v->assumeValidHeight);
+    if (h == NULL || memcmp(h->hash, v->assumeValid, 32))
+        return;
+
+    uint32_t i, num = v->assumeValidHeight - hc->base_height + 1;
+    uint8_t *hashes = malloc(num * 32);
+    if (hashes == NULL) {
+        perror("malloc failed");
+        exit(1);
+    }
+    for (i = 0; i < num; ++i)
+        memcpy(hashes + i * 32, BRHeaderChainGet(hc, hc->base_height + i)->hash, 32);
+    if (!CBFullValidatorSetAssumeValidChain(v, hashes, hc->base_height))
+        fprintf(stderr, "Could not give the assume-valid headers to the validator\n");
+    free(hashes);
+}
@@ -27,7 +27,7 @@
 //  Constructors
 
 CBAddress * CBNewAddressFromRIPEMD160Hash(uint8_t * hash, uint8_t networkCode, bool cacheString){
-	CBAddress * self = malloc(sizeof(*self));
+	CBAddress * self = CBAllocObject(sizeof(*self));
 	if (NOT self) {
 		CBLogError("Cannot allocate %i bytes of memory in CBNewAddressFromRIPEMD160Hash\n", sizeof(*self));
 		return NULL;
@@ -35,11 +35,11 @@ CBAddress * CBNewAddressFromRIPEMD160Hash(uint8_t * hash, uint8_t networkCode, b
 	CBGetObject(self)->free = CBFreeAddress;
 	if (CBInitAddressFromRIPEMD160Hash(self, networkCode, hash, cacheString))
 		return self;
-	free(self);
+	CBDeallocObject(self);
 	return NULL;
 }
 CBAddress * CBNewAddressFromString(CBByteArray * string, bool cacheString){
-	CBAddress * self = malloc(sizeof(*self));
+	CBAddress * self = CBAllocObject(sizeof(*self));
 	if (NOT self) {
 		CBLogError("Cannot allocate %i bytes of memory in CBNewAddressFromString\n", sizeof(*self));
 		return NULL;
@@ -47,7 +47,7 @@ CBAddress * CBNewAddressFromString(CBByteArray * string, bool cacheString){
 	CBGetObject(self)->free = CBFreeAddress;
 	if (CBInitAddressFromString(self, string, cacheString))
 		return self;
-	free(self);
+	CBDeallocObject(self);
 	return NULL;
 }
 
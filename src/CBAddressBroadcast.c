@@ -27,7 +27,7 @@
 //  Constructors
 
 CBAddressBroadcast * CBNewAddressBroadcast(bool timeStamps){
-	CBAddressBroadcast * self = malloc(sizeof(*self));
+	CBAddressBroadcast * self = CBAllocObject(sizeof(*self));
 	if (NOT self) {
 		CBLogError("Cannot allocate %i bytes of memory in CBNewAddressBroadcast\n", sizeof(*self));
 		return NULL;
@@ -35,11 +35,11 @@ CBAddressBroadcast * CBNewAddressBroadcast(bool timeStamps){
 	CBGetObject(self)->free = CBFreeAddressBroadcast;
 	if (CBInitAddressBroadcast(self, timeStamps))
 		return self;
-	free(self);
+	CBDeallocObject(self);
 	return NULL;
 }
 CBAddressBroadcast * CBNewAddressBroadcastFromData(CBByteArray * data, bool timeStamps){
-	CBAddressBroadcast * self = malloc(sizeof(*self));
+	CBAddressBroadcast * self = CBAllocObject(sizeof(*self));
 	if (NOT self) {
 		CBLogError("Cannot allocate %i bytes of memory in CBNewAddressBroadcast\n", sizeof(*self));
 		return NULL;
@@ -47,7 +47,7 @@ CBAddressBroadcast * CBNewAddressBroadcastFromData(CBByteArray * data, bool time
 	CBGetObject(self)->free = CBFreeAddressBroadcast;
 	if (CBInitAddressBroadcastFromData(self, timeStamps, data))
 		return self;
-	free(self);
+	CBDeallocObject(self);
 	return NULL;
 }
 
@@ -27,7 +27,7 @@
 //  Constructors
 
 CBAlert * CBNewAlert(int32_t version, int64_t relayUntil, int64_t expiration, int32_t ID, int32_t cancel, int32_t minVer, int32_t maxVer, int32_t priority, CBByteArray * hiddenComment, CBByteArray * displayedComment, CBByteArray * reserved, CBByteArray * signature){
-	CBAlert * self = malloc(sizeof(*self));
+	CBAlert * self = CBAllocObject(sizeof(*self));
 	if (NOT self) {
 		CBLogError("Cannot allocate %i bytes of memory in CBNewAlert\n", sizeof(*self));
 		return NULL;
@@ -35,11 +35,11 @@ CBAlert * CBNewAlert(int32_t version, int64_t relayUntil, int64_t expiration, in
 	CBGetObject(self)->free = CBFreeAlert;
 	if(CBInitAlert(self, version, relayUntil, expiration, ID, cancel, minVer, maxVer, priority, hiddenComment, displayedComment, reserved, signature))
 		return self;
-	free(self);
+	CBDeallocObject(self);
 	return NULL;
 }
 CBAlert * CBNewAlertFromData(CBByteArray * data){
-	CBAlert * self = malloc(sizeof(*self));
+	CBAlert * self = CBAllocObject(sizeof(*self));
 	if (NOT self) {
 		CBLogError("Cannot allocate %i bytes of memory in CBNewAlertFromData\n", sizeof(*self));
 		return NULL;
@@ -47,7 +47,7 @@ CBAlert * CBNewAlertFromData(CBByteArray * data){
 	CBGetObject(self)->free = CBFreeAlert;
 	if(CBInitAlertFromData(self, data))
 		return self;
-	free(self);
+	CBDeallocObject(self);
 	return NULL;
 }
 
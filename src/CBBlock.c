@@ -27,7 +27,7 @@
 //  Constructor2
 
 CBBlock * CBNewBlock(){
-	CBBlock * self = malloc(sizeof(*self));
+	CBBlock * self = CBAllocObject(sizeof(*self));
 	if (NOT self) {
 		CBLogError("Cannot allocate %i bytes of memory in CBNewBlock\n", sizeof(*self));
 		return NULL;
@@ -35,11 +35,11 @@ CBBlock * CBNewBlock(){
 	CBGetObject(self)->free = CBFreeBlock;
 	if(CBInitBlock(self))
 		return self;
-	free(self);
+	CBDeallocObject(self);
 	return NULL;
 }
 CBBlock * CBNewBlockFromData(CBByteArray * data){
-	CBBlock * self = malloc(sizeof(*self));
+	CBBlock * self = CBAllocObject(sizeof(*self));
 	if (NOT self) {
 		CBLogError("Cannot allocate %i bytes of memory in CBNewBlockFromData\n", sizeof(*self));
 		return NULL;
@@ -47,11 +47,11 @@ CBBlock * CBNewBlockFromData(CBByteArray * data){
 	CBGetObject(self)->free = CBFreeBlock;
 	if(CBInitBlockFromData(self, data))
 		return self;
-	free(self);
+	CBDeallocObject(self);
 	return NULL;
 }
 CBBlock * CBNewBlockGenesis(){
-	CBBlock * self = malloc(sizeof(*self));
+	CBBlock * self = CBAllocObject(sizeof(*self));
 	if (NOT self) {
 		CBLogError("Cannot allocate %i bytes of memory in CBNewBlockGenesis\n", sizeof(*self));
 		return NULL;
@@ -63,7 +63,7 @@ CBBlock * CBNewBlockGenesis(){
 	if(CBInitBlockGenesis(self))
 #endif
 		return self;
-	free(self);
+	CBDeallocObject(self);
 	return NULL;
 }
 
@@ -192,7 +192,7 @@ uint8_t * CBBlockCalculateMerkleRoot(CBBlock * self){
 	CBCalculateMerkleRoot(txHashes, self->transactionNum);
 	return txHashes;
 }
-uint32_t CBBlockDeserialise(CBBlock * self, bool transactions){
+static uint32_t CBBlockDeserialiseData(CBBlock * self, bool transactions){
 	CBByteArray * bytes = CBGetMessage(self)->bytes;
 	if (NOT bytes) {
 		CBLogError("Attempting to deserialise a CBBlock with no bytes.");
@@ -284,6 +284,18 @@ uint32_t CBBlockDeserialise(CBBlock * self, bool transactions){
 		return 80 + x + 1; // 80 header bytes, the var int and the null byte
 	}
 }
+uint32_t CBBlockDeserialise(CBBlock * self, bool transactions){
+	if (CBObjectGetAllocator() != CB_OBJECT_ALLOCATOR_BLOCK_ARENA || NOT transactions || CBObjectGetCurrentArena())
+		return CBBlockDeserialiseData(self, transactions);
+	// Allocate the objects for the block from an arena, which is freed once the block has released them.
+	CBObjectArena * arena = CBNewObjectArena();
+	if (NOT arena)
+		return CBBlockDeserialiseData(self, transactions);
+	CBObjectArena * previous = CBObjectArenaBegin(arena);
+	uint32_t len = CBBlockDeserialiseData(self, transactions);
+	CBObjectArenaEnd(arena, previous);
+	return len;
+}
 
 uint8_t * CBBlockGetHash(CBBlock * self){
 	if (NOT self->hashSet){
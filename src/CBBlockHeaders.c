@@ -27,7 +27,7 @@
 //  Constructors
 
 CBBlockHeaders * CBNewBlockHeaders(){
-	CBBlockHeaders * self = malloc(sizeof(*self));
+	CBBlockHeaders * self = CBAllocObject(sizeof(*self));
 	if (NOT self) {
 		CBLogError("Cannot allocate %i bytes of memory in CBNewBlockHeaders\n", sizeof(*self));
 		return NULL;
@@ -35,11 +35,11 @@ CBBlockHeaders * CBNewBlockHeaders(){
 	CBGetObject(self)->free = CBFreeBlockHeaders;
 	if(CBInitBlockHeaders(self))
 		return self;
-	free(self);
+	CBDeallocObject(self);
 	return NULL;
 }
 CBBlockHeaders * CBNewBlockHeadersFromData(CBByteArray * data){
-	CBBlockHeaders * self = malloc(sizeof(*self));
+	CBBlockHeaders * self = CBAllocObject(sizeof(*self));
 	if (NOT self) {
 		CBLogError("Cannot allocate %i bytes of memory in CBNewBlockHeadersFromData\n", sizeof(*self));
 		return NULL;
@@ -47,7 +47,7 @@ CBBlockHeaders * CBNewBlockHeadersFromData(CBByteArray * data){
 	CBGetObject(self)->free = CBFreeBlockHeaders;
 	if(CBInitBlockHeadersFromData(self, data))
 		return self;
-	free(self);
+	CBDeallocObject(self);
 	return NULL;
 }
 
@@ -116,7 +116,7 @@ uint32_t CBBlockHeadersDeserialise(CBBlockHeaders * self){
 		return 0;
 	}
 	self->headerNum = headerNum.val;
-	uint16_t cursor = headerNum.size;
+	uint32_t cursor = headerNum.size;
 	for (uint16_t x = 0; x < headerNum.val; x++) {
 		// Make new CBBlock from the rest of the data.
 		CBByteArray * data = CBByteArraySubReference(bytes, cursor, bytes->length-cursor);
@@ -156,7 +156,7 @@ uint32_t CBBlockHeadersSerialise(CBBlockHeaders * self, bool force){
 	}
 	CBVarInt num = CBVarIntFromUInt64(self->headerNum);
 	CBVarIntEncode(bytes, 0, num);
-	uint16_t cursor = num.size;
+	uint32_t cursor = num.size;
 	for (uint16_t x = 0; x < num.val; x++) {
 		if (NOT CBGetMessage(self->blockHeaders[x])->serialised // Serailise if not serialised yet.
 			// Serialise if force is true.
@@ -0,0 +1,231 @@
+//
+//  CBBlockView.c
+//  cbitcoin
+//
+//  Copyright (c) 2012 Matthew Mitchell
+//
+//  This file is part of cbitcoin.
+//
+//  cbitcoin is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  cbitcoin is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with cbitcoin.  If not, see <http://www.gnu.org/licenses/>.
+
+//  SEE HEADER FILE FOR DOCUMENTATION
+
+#include "CBBlockView.h"
+#include <stdlib.h>
+#include <string.h>
+#include "CBValidationFunctions.h"
+
+// Implementation
+
+static uint32_t CBBlockViewReadInt32(uint8_t * data){
+	return data[0] | data[1] << 8 | data[2] << 16 | (uint32_t)data[3] << 24;
+}
+static uint64_t CBBlockViewReadInt64(uint8_t * data){
+	return CBBlockViewReadInt32(data) | (uint64_t)CBBlockViewReadInt32(data + 4) << 32;
+}
+// Decodes a variable size integer at the cursor, returning its size or 0 if there are not enough bytes.
+static uint8_t CBBlockViewReadVarInt(uint8_t * data, uint32_t length, uint32_t cursor, uint64_t * val){
+	if (cursor >= length)
+		return 0;
+	uint8_t first = data[cursor];
+	if (first < 253) {
+		*val = first;
+		return 1;
+	}
+	uint8_t size = first == 253 ? 3 : (first == 254 ? 5 : 9);
+	if (length - cursor < size)
+		return 0;
+	if (size == 3)
+		*val = data[cursor + 1] | data[cursor + 2] << 8;
+	else if (size == 5)
+		*val = CBBlockViewReadInt32(data + cursor + 1);
+	else
+		*val = CBBlockViewReadInt64(data + cursor + 1);
+	return size;
+}
+
+void CBInitBlockView(CBBlockView * self){
+	memset(self, 0, sizeof(*self));
+}
+void CBFreeBlockView(CBBlockView * self){
+	free(self->arena);
+	self->arena = NULL;
+	self->arenaSize = 0;
+}
+
+//  Functions
+
+void CBBlockViewCalculateTransactionHash(CBBlockView * self, uint32_t tx, uint8_t * hash){
+	uint8_t hash2[32];
+	CBSha256(self->data + self->transactions[tx].offset, self->transactions[tx].length, hash2);
+	CBSha256(hash2, 32, hash);
+}
+void CBBlockViewCalculateMerkleRoot(CBBlockView * self, uint8_t * root){
+	for (uint32_t x = 0; x < self->transactionNum; x++)
+		CBBlockViewCalculateTransactionHash(self, x, self->hashes + 32*x);
+	CBCalculateMerkleRoot(self->hashes, self->transactionNum);
+	memcpy(root, self->hashes, 32);
+}
+uint8_t * CBBlockViewGetMerkleRoot(CBBlockView * self){
+	return self->data + 36;
+}
+uint8_t * CBBlockViewGetPrevBlockHash(CBBlockView * self){
+	return self->data + 4;
+}
+uint8_t * CBBlockViewGetPrevOutHash(CBBlockView * self, uint32_t input){
+	return self->data + self->inputs[input].offset;
+}
+void CBBlockViewGetInputScript(CBBlockView * self, uint32_t input, CBScript * script, CBSharedData * sharedData){
+	CBInitScriptWithDataReference(script, sharedData, self->data + self->inputs[input].scriptOffset, self->inputs[input].scriptLength);
+}
+void CBBlockViewGetOutputScript(CBBlockView * self, uint32_t output, CBScript * script, CBSharedData * sharedData){
+	CBInitScriptWithDataReference(script, sharedData, self->data + self->outputs[output].scriptOffset, self->outputs[output].scriptLength);
+}
+bool CBBlockViewTransactionIsCoinBase(CBBlockView * self, uint32_t tx){
+	CBBlockViewTransaction * transaction = self->transactions + tx;
+	if (transaction->inputNum != 1)
+		return false;
+	CBBlockViewInput * input = self->inputs + transaction->firstInput;
+	if (input->prevOutIndex != 0xFFFFFFFF)
+		return false;
+	for (uint8_t x = 0; x < 32; x++)
+		if (self->data[input->offset + x])
+			return false;
+	return true;
+}
+uint32_t CBBlockViewParse(CBBlockView * self, uint8_t * data, uint32_t length){
+	if (length < 89) {
+		CBLogError("Attempting to parse a block view with less than 89 bytes.");
+		return 0;
+	}
+	self->data = data;
+	self->version = CBBlockViewReadInt32(data);
+	self->time = CBBlockViewReadInt32(data + 68);
+	self->target = CBBlockViewReadInt32(data + 72);
+	self->nonce = CBBlockViewReadInt32(data + 76);
+	uint64_t val;
+	uint8_t size = CBBlockViewReadVarInt(data, length, 80, &val);
+	// Compare by division so that large counts cannot overflow.
+	if (NOT size || NOT val || val > (length - 81) / 60) {
+		CBLogError("Attempting to parse a block view with a bad number of transactions for the byte data length.");
+		return 0;
+	}
+	self->transactionNum = (uint32_t)val;
+	uint32_t cursor = 80 + size;
+	// The sizes of the tables are limited by the minimum sizes of inputs and outputs, so they can be laid out in the arena before parsing.
+	uint32_t maxInputs = (length - cursor) / 41;
+	uint32_t maxOutputs = (length - cursor) / 9;
+	uint64_t arenaSize = (uint64_t)maxOutputs * sizeof(*self->outputs)
+		+ (uint64_t)self->transactionNum * sizeof(*self->transactions)
+		+ (uint64_t)maxInputs * sizeof(*self->inputs)
+		+ (uint64_t)self->transactionNum * 32;
+	if (arenaSize > CB_BLOCK_VIEW_MAX_ARENA_SIZE) {
+		CBLogError("Attempting to parse a block view which needs %llu bytes for the tables, more than the maximum.", (unsigned long long)arenaSize);
+		return 0;
+	}
+	if (self->arenaSize < arenaSize) {
+		free(self->arena);
+		self->arena = malloc(arenaSize);
+		if (NOT self->arena) {
+			CBLogError("Cannot allocate %zu bytes of memory in CBBlockViewParse\n", (size_t)arenaSize);
+			self->arenaSize = 0;
+			return 0;
+		}
+		self->arenaSize = (size_t)arenaSize;
+	}
+	// Outputs first as they have the greatest alignment.
+	self->outputs = (CBBlockViewOutput *)self->arena;
+	self->transactions = (CBBlockViewTransaction *)(self->outputs + maxOutputs);
+	self->inputs = (CBBlockViewInput *)(self->transactions + self->transactionNum);
+	self->hashes = (uint8_t *)(self->inputs + maxInputs);
+	self->inputNum = 0;
+	self->outputNum = 0;
+	for (uint32_t x = 0; x < self->transactionNum; x++) {
+		CBBlockViewTransaction * tx = self->transactions + x;
+		tx->offset = cursor;
+		if (length - cursor < 10) {
+			CBLogError("Attempting to parse a transaction with less than 10 bytes in a block view for the transaction number %u.", x);
+			return 0;
+		}
+		tx->version = CBBlockViewReadInt32(data + cursor);
+		cursor += 4;
+		size = CBBlockViewReadVarInt(data, length, cursor, &val);
+		if (NOT size || NOT val || val > (length - cursor) / 41) {
+			CBLogError("Attempting to parse a transaction with a bad var int for the number of inputs in a block view for the transaction number %u.", x);
+			return 0;
+		}
+		cursor += size;
+		tx->firstInput = self->inputNum;
+		tx->inputNum = (uint32_t)val;
+		for (uint32_t y = 0; y < tx->inputNum; y++) {
+			CBBlockViewInput * input = self->inputs + self->inputNum++;
+			if (length - cursor < 41) {
+				CBLogError("Attempting to parse an input with less than 41 bytes in a block view for the transaction number %u.", x);
+				return 0;
+			}
+			input->offset = cursor;
+			input->prevOutIndex = CBBlockViewReadInt32(data + cursor + 32);
+			size = CBBlockViewReadVarInt(data, length, cursor + 36, &val);
+			if (NOT size || val > 10000) {
+				CBLogError("Attempting to parse an input with too big a script in a block view for the transaction number %u.", x);
+				return 0;
+			}
+			if (length - cursor < 40 + size + val) {
+				CBLogError("Attempting to parse an input with less bytes than needed according to the length for the script in a block view for the transaction number %u.", x);
+				return 0;
+			}
+			input->scriptOffset = cursor + 36 + size;
+			input->scriptLength = (uint32_t)val;
+			input->sequence = CBBlockViewReadInt32(data + input->scriptOffset + input->scriptLength);
+			cursor = input->scriptOffset + input->scriptLength + 4;
+		}
+		size = CBBlockViewReadVarInt(data, length, cursor, &val);
+		if (NOT size || NOT val || val > (length - cursor) / 9) {
+			CBLogError("Attempting to parse a transaction with a bad var int for the number of outputs in a block view for the transaction number %u.", x);
+			return 0;
+		}
+		cursor += size;
+		tx->firstOutput = self->outputNum;
+		tx->outputNum = (uint32_t)val;
+		for (uint32_t y = 0; y < tx->outputNum; y++) {
+			CBBlockViewOutput * output = self->outputs + self->outputNum++;
+			if (length - cursor < 9) {
+				CBLogError("Attempting to parse an output with less than 9 bytes in a block view for the transaction number %u.", x);
+				return 0;
+			}
+			output->value = CBBlockViewReadInt64(data + cursor);
+			size = CBBlockViewReadVarInt(data, length, cursor + 8, &val);
+			if (NOT size || val > 10000) {
+				CBLogError("Attempting to parse an output with too big a script in a block view for the transaction number %u.", x);
+				return 0;
+			}
+			if (length - cursor < 8 + size + val) {
+				CBLogError("Attempting to parse an output with less bytes than needed according to the length for the script in a block view for the transaction number %u.", x);
+				return 0;
+			}
+			output->scriptOffset = cursor + 8 + size;
+			output->scriptLength = (uint32_t)val;
+			cursor = output->scriptOffset + output->scriptLength;
+		}
+		if (length - cursor < 4) {
+			CBLogError("Attempting to parse a transaction with not enough bytes for the lockTime in a block view for the transaction number %u.", x);
+			return 0;
+		}
+		tx->lockTime = CBBlockViewReadInt32(data + cursor);
+		cursor += 4;
+		tx->length = cursor - tx->offset;
+	}
+	self->length = cursor;
+	return cursor;
+}
@@ -23,11 +23,14 @@
 //  SEE HEADER FILE FOR DOCUMENTATION
 
 #include "CBByteArray.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 //  Constructor
 
 CBByteArray * CBNewByteArrayFromString(char * string, bool terminator){
-	CBByteArray * self = malloc(sizeof(*self));
+	CBByteArray * self = CBAllocObject(sizeof(*self));
 	if (NOT self) {
 		CBLogError("Cannot allocate %i bytes of memory in CBNewByteArrayFromString\n", sizeof(*self));
 		return NULL;
@@ -35,11 +38,11 @@ CBByteArray * CBNewByteArrayFromString(char * string, bool terminator){
 	CBGetObject(self)->free = CBFreeByteArray;
 	if(CBInitByteArrayFromString(self, string, terminator))
 		return self;
-	free(self);
+	CBDeallocObject(self);
 	return NULL;
 }
 CBByteArray * CBNewByteArrayOfSize(uint32_t size){
-	CBByteArray * self = malloc(sizeof(*self));
+	CBByteArray * self = CBAllocObject(sizeof(*self));
 	if (NOT self) {
 		CBLogError("Cannot allocate %i bytes of memory in CBNewByteArrayOfSize\n", sizeof(*self));
 		return NULL;
@@ -47,11 +50,11 @@ CBByteArray * CBNewByteArrayOfSize(uint32_t size){
 	CBGetObject(self)->free = CBFreeByteArray;
 	if(CBInitByteArrayOfSize(self, size))
 		return self;
-	free(self);
+	CBDeallocObject(self);
 	return NULL;
 }
 CBByteArray * CBNewByteArraySubReference(CBByteArray * ref, uint32_t offset, uint32_t length){
-	CBByteArray * self = malloc(sizeof(*self));
+	CBByteArray * self = CBAllocObject(sizeof(*self));
 	if (NOT self) {
 		CBLogError("Cannot allocate %i bytes of memory in CBNewByteArraySubReference\n", sizeof(*self));
 		return NULL;
@@ -59,11 +62,11 @@ CBByteArray * CBNewByteArraySubReference(CBByteArray * ref, uint32_t offset, uin
 	CBGetObject(self)->free = CBFreeByteArray;
 	if(CBInitByteArraySubReference(self, ref, offset, length))
 		return self;
-	free(self);
+	CBDeallocObject(self);
 	return NULL;
 }
 CBByteArray * CBNewByteArrayWithData(uint8_t * data, uint32_t size){
-	CBByteArray * self = malloc(sizeof(*self));
+	CBByteArray * self = CBAllocObject(sizeof(*self));
 	if (NOT self) {
 		CBLogError("Cannot allocate %i bytes of memory in CBNewByteArrayWithData\n", sizeof(*self));
 		return NULL;
@@ -71,11 +74,11 @@ CBByteArray * CBNewByteArrayWithData(uint8_t * data, uint32_t size){
 	CBGetObject(self)->free = CBFreeByteArray;
 	if(CBInitByteArrayWithData(self, data, size))
 		return self;
-	free(self);
+	CBDeallocObject(self);
 	return NULL;
 }
 CBByteArray * CBNewByteArrayWithDataCopy(uint8_t * data, uint32_t size){
-	CBByteArray * self = malloc(sizeof(*self));
+	CBByteArray * self = CBAllocObject(sizeof(*self));
 	if (NOT self) {
 		CBLogError("Cannot allocate %i bytes of memory in CBNewByteArrayWithDataCopy\n", sizeof(*self));
 		return NULL;
@@ -83,7 +86,7 @@ CBByteArray * CBNewByteArrayWithDataCopy(uint8_t * data, uint32_t size){
 	CBGetObject(self)->free = CBFreeByteArray;
 	if(CBInitByteArrayWithDataCopy(self, data, size))
 		return self;
-	free(self);
+	CBDeallocObject(self);
 	return NULL;
 }
 
@@ -110,7 +113,7 @@ bool CBInitByteArrayFromString(CBByteArray * self, char * string, bool terminato
 		CBLogError("Cannot allocate %i bytes of memory in CBInitByteArrayFromString for the shared data.\n", self->length);
 		return false;
 	}
-	self->sharedData->references = 1;
+	CBReferenceCountInit(&self->sharedData->references, 1);
 	self->offset = 0;
 	memmove(self->sharedData->data, string, self->length);
 	return true;
@@ -129,7 +132,7 @@ bool CBInitByteArrayOfSize(CBByteArray * self, uint32_t size){
 		CBLogError("Cannot allocate %i bytes of memory in CBInitByteArrayOfSize for the sharedData structure.\n", sizeof(*self->sharedData));
 		return false;
 	}
-	self->sharedData->references = 1;
+	CBReferenceCountInit(&self->sharedData->references, 1);
 	self->sharedData->data = malloc(size);
 	if (NOT self->sharedData->data) {
 		CBLogError("Cannot allocate %i bytes of memory in CBInitByteArrayOfSize for the shared data.\n", size);
@@ -141,7 +144,7 @@ bool CBInitByteArraySubReference(CBByteArray * self, CBByteArray * ref, uint32_t
 	if (NOT CBInitObject(CBGetObject(self)))
 		return false;
 	self->sharedData = ref->sharedData;
-	self->sharedData->references++; // Since a new reference to the shared data is being made, an increase in the reference count must be made.
+	CBReferenceCountIncrement(&self->sharedData->references); // Since a new reference to the shared data is being made, an increase in the reference count must be made.
 	self->length = length;
 	self->offset = ref->offset + offset;
 	return true;
@@ -155,7 +158,7 @@ bool CBInitByteArrayWithData(CBByteArray * self, uint8_t * data, uint32_t size){
 		return false;
 	}
 	self->sharedData->data = data;
-	self->sharedData->references = 1;
+	CBReferenceCountInit(&self->sharedData->references, 1);
 	self->length = size;
 	self->offset = 0;
 	return true;
@@ -174,7 +177,7 @@ bool CBInitByteArrayWithDataCopy(CBByteArray * self, uint8_t * data, uint32_t si
 		return false;
 	}
 	memmove(self->sharedData->data, data, size);
-	self->sharedData->references = 1;
+	CBReferenceCountInit(&self->sharedData->references, 1);
 	self->length = size;
 	self->offset = 0;
 	return true;
@@ -189,8 +192,7 @@ void CBFreeByteArray(void * self){
 void CBByteArrayReleaseSharedData(CBByteArray * self){
 	if (NOT self->sharedData)
 		return;
-	self->sharedData->references--;
-	if (self->sharedData->references < 1) {
+	if (CBReferenceCountDecrement(&self->sharedData->references)) {
 		// Shared data now owned by nothing so free it 
 		free(self->sharedData->data);
 		free(self->sharedData);
@@ -204,6 +206,8 @@ CBCompare CBByteArrayCompare(CBByteArray * self, CBByteArray * second){
 		return CB_COMPARE_MORE_THAN;
 	else if (self->length < second->length)
 		return CB_COMPARE_LESS_THAN;
+	if (self->length == 32)
+		return CBHashCompare(CBByteArrayGetData(self), CBByteArrayGetData(second));
 	int res = memcmp(CBByteArrayGetData(self), CBByteArrayGetData(second), self->length);
 	if (res > 0)
 		return CB_COMPARE_MORE_THAN;
@@ -238,8 +242,16 @@ uint8_t CBByteArrayGetLastByte(CBByteArray * self){
 	return self->sharedData->data[self->offset+self->length];
 }
 bool CBByteArrayIsNull(CBByteArray * self){
-	for (uint32_t x = 0; x < self->length; x++)
-		if (self->sharedData->data[self->offset+x])
+	uint8_t * data = CBByteArrayGetData(self);
+	if (self->length == 32)
+		return CBHashIsNull(data);
+	// Check eight bytes at a time and then the remainder.
+	uint32_t x = 0;
+	for (; x + 8 <= self->length; x += 8)
+		if (CBLoadInt64(data + x))
+			return false;
+	for (; x < self->length; x++)
+		if (data[x])
 			return false;
 	return true;
 }
@@ -277,6 +289,10 @@ uint16_t CBByteArrayReadPort(CBByteArray * self, uint32_t offset){
 	return result;
 }
 void CBByteArrayReverseBytes(CBByteArray * self){
+	if (self->length == 32) {
+		CBHashReverse(CBByteArrayGetData(self));
+		return;
+	}
 	for (int x = 0; x < self->length / 2; x++) {
 		uint8_t temp = self->sharedData->data[self->offset+x];
 		self->sharedData->data[self->offset+x] = self->sharedData->data[self->offset+self->length-x-1];
@@ -286,7 +302,7 @@ void CBByteArrayReverseBytes(CBByteArray * self){
 void CBByteArrayChangeReference(CBByteArray * self, CBByteArray * ref, uint32_t offset){
 	CBByteArrayReleaseSharedData(self); // Release last shared data.
 	self->sharedData = ref->sharedData;
-	self->sharedData->references++; // Since a new reference to the shared data is being made, an increase in the reference count must be made.
+	CBReferenceCountIncrement(&self->sharedData->references); // Since a new reference to the shared data is being made, an increase in the reference count must be made.
 	self->offset = ref->offset + offset; // New offset for shared data
 }
 CBByteArray * CBByteArraySubCopy(CBByteArray * self, uint32_t offset, uint32_t length){
@@ -299,3 +315,56 @@ CBByteArray * CBByteArraySubCopy(CBByteArray * self, uint32_t offset, uint32_t l
 CBByteArray * CBByteArraySubReference(CBByteArray * self, uint32_t offset, uint32_t length){
 	return CBNewByteArraySubReference(self, offset, length);
 }
+CBCompare CBHashCompare(uint8_t * hash1, uint8_t * hash2){
+#ifdef __SSE2__
+	// Find the first different byte from the equality masks of both halves.
+	uint32_t equal = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((__m128i *)hash1), _mm_loadu_si128((__m128i *)hash2)))
+		| (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((__m128i *)(hash1 + 16)), _mm_loadu_si128((__m128i *)(hash2 + 16)))) << 16;
+	if (equal == 0xFFFFFFFF)
+		return CB_COMPARE_EQUAL;
+	uint8_t x = __builtin_ctz(~equal);
+	return hash1[x] > hash2[x] ? CB_COMPARE_MORE_THAN : CB_COMPARE_LESS_THAN;
+#else
+	// Compare as big-endian words so that the order is that of the bytes.
+	for (uint8_t x = 0; x < 32; x += 8) {
+		uint64_t a = CBLoadInt64(hash1 + x), b = CBLoadInt64(hash2 + x);
+		if (a != b) {
+			a = CB_LITTLE_ENDIAN_HOST ? CBSwap64(a) : a;
+			b = CB_LITTLE_ENDIAN_HOST ? CBSwap64(b) : b;
+			return a > b ? CB_COMPARE_MORE_THAN : CB_COMPARE_LESS_THAN;
+		}
+	}
+	return CB_COMPARE_EQUAL;
+#endif
+}
+bool CBHashIsNull(uint8_t * hash){
+#ifdef __SSE2__
+	__m128i both = _mm_or_si128(_mm_loadu_si128((__m128i *)hash), _mm_loadu_si128((__m128i *)(hash + 16)));
+	return _mm_movemask_epi8(_mm_cmpeq_epi8(both, _mm_setzero_si128())) == 0xFFFF;
+#else
+	return NOT (CBLoadInt64(hash) | CBLoadInt64(hash + 8) | CBLoadInt64(hash + 16) | CBLoadInt64(hash + 24));
+#endif
+}
+#ifdef __SSE2__
+static __m128i CBReverse128(__m128i v){
+	v = _mm_shuffle_epi32(v, _MM_SHUFFLE(0, 1, 2, 3)); // Reverse the 32-bit words.
+	v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(2, 3, 0, 1)); // Swap the 16-bit halves of each word.
+	v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+	return _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8)); // Swap the bytes of each half.
+}
+#endif
+void CBHashReverse(uint8_t * hash){
+#ifdef __SSE2__
+	__m128i low = _mm_loadu_si128((__m128i *)hash);
+	__m128i high = _mm_loadu_si128((__m128i *)(hash + 16));
+	_mm_storeu_si128((__m128i *)hash, CBReverse128(high));
+	_mm_storeu_si128((__m128i *)(hash + 16), CBReverse128(low));
+#else
+	uint64_t words[4];
+	memcpy(words, hash, 32);
+	for (uint8_t x = 0; x < 4; x++)
+		words[x] = CBSwap64(words[x]);
+	for (uint8_t x = 0; x < 4; x++)
+		memcpy(hash + x*8, &words[3 - x], 8);
+#endif
+}
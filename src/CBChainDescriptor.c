@@ -27,7 +27,7 @@
 //  Constructors
 
 CBChainDescriptor * CBNewChainDescriptor(){
-	CBChainDescriptor * self = malloc(sizeof(*self));
+	CBChainDescriptor * self = CBAllocObject(sizeof(*self));
 	if (NOT self) {
 		CBLogError("Cannot allocate %i bytes of memory in CBNewChainDescriptor\n", sizeof(*self));
 		return NULL;
@@ -35,11 +35,11 @@ CBChainDescriptor * CBNewChainDescriptor(){
 	CBGetObject(self)->free = CBFreeChainDescriptor;
 	if(CBInitChainDescriptor(self))
 		return self;
-	free(self);
+	CBDeallocObject(self);
 	return NULL;
 }
 CBChainDescriptor * CBNewChainDescriptorFromData(CBByteArray * data){
-	CBChainDescriptor * self = malloc(sizeof(*self));
+	CBChainDescriptor * self = CBAllocObject(sizeof(*self));
 	if (NOT self) {
 		CBLogError("Cannot allocate %i bytes of memory in CBNewChainDescriptorFromData\n", sizeof(*self));
 		return NULL;
@@ -47,7 +47,7 @@ CBChainDescriptor * CBNewChainDescriptorFromData(CBByteArray * data){
 	CBGetObject(self)->free = CBFreeChainDescriptor;
 	if(CBInitChainDescriptorFromData(self, data))
 		return self;
-	free(self);
+	CBDeallocObject(self);
 	return NULL;
 }
 
@@ -24,10 +24,354 @@
 
 #include "CBFullValidator.h"
 
+// Blocks at fixed heights in the main chain. UMDNet has no blocks which are checkpointed besides the genesis block.
+static CBCheckpoint CBCheckpoints[] = {
+#ifdef UMDNET
+	{0, {0xf8, 0x47, 0x41, 0xcb, 0xe4, 0x20, 0xeb, 0x7c, 0xdb, 0xb1, 0xf9, 0x74, 0x3b, 0xf0, 0x6b, 0x64, 0xc5, 0x9f, 0x5f, 0xca, 0x50, 0x46, 0xc0, 0xf1, 0xd6, 0xec, 0xba, 0xb0, 0x00, 0x00, 0x00, 0x00}},
+#else
+	{11111, {0x1d, 0x7c, 0x6e, 0xb2, 0xfd, 0x42, 0xf5, 0x59, 0x25, 0xe9, 0x2e, 0xfa, 0xd6, 0x8b, 0x61, 0xed, 0xd2, 0x2f, 0xba, 0x29, 0xfd, 0xe8, 0x78, 0x3d, 0xf7, 0x44, 0xe2, 0x69, 0x00, 0x00, 0x00, 0x00}},
+	{33333, {0xa6, 0xd0, 0xb5, 0xdf, 0x7d, 0x0d, 0xf0, 0x69, 0xce, 0xb1, 0xe7, 0x36, 0xa2, 0x16, 0xad, 0x18, 0x7a, 0x50, 0xb0, 0x7a, 0xaa, 0x4e, 0x78, 0x74, 0x8a, 0x58, 0xd5, 0x2d, 0x00, 0x00, 0x00, 0x00}},
+	{74000, {0x20, 0x1a, 0x66, 0xb8, 0x53, 0xf9, 0xe7, 0x81, 0x4a, 0x82, 0x0e, 0x2a, 0xf5, 0xf5, 0xdc, 0x79, 0xc0, 0x71, 0x44, 0xe3, 0x1c, 0xe4, 0xc9, 0xa3, 0x93, 0x39, 0x57, 0x00, 0x00, 0x00, 0x00, 0x00}},
+	{105000, {0x97, 0xdc, 0x6b, 0x1d, 0x15, 0xfb, 0xee, 0xf3, 0x73, 0xa7, 0x44, 0xfe, 0xe0, 0xb2, 0x54, 0xb0, 0xd2, 0xc8, 0x20, 0xa3, 0xae, 0x7f, 0x02, 0x28, 0xce, 0x91, 0x02, 0x00, 0x00, 0x00, 0x00, 0x00}},
+	{134444, {0xfe, 0xb0, 0xd2, 0x42, 0x0d, 0x4a, 0x18, 0x91, 0x4c, 0x81, 0xac, 0x30, 0xf4, 0x94, 0xa5, 0xd4, 0xff, 0x34, 0xcd, 0x15, 0xd3, 0x4c, 0xfd, 0x2f, 0xb1, 0x05, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}},
+	{168000, {0x63, 0xb7, 0x03, 0x83, 0x5c, 0xb7, 0x35, 0xcb, 0x9a, 0x89, 0xd7, 0x33, 0xcb, 0xe6, 0x6f, 0x21, 0x2f, 0x63, 0x79, 0x5e, 0x01, 0x72, 0xea, 0x61, 0x9e, 0x09, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}},
+	{193000, {0x17, 0x13, 0x8b, 0xca, 0x83, 0xbd, 0xc3, 0xe6, 0xf6, 0x0f, 0x01, 0x17, 0x7c, 0x38, 0x77, 0xa9, 0x82, 0x66, 0xde, 0x40, 0x73, 0x5f, 0x2a, 0x45, 0x9f, 0x05, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}},
+	{210000, {0x2e, 0x34, 0x71, 0xa1, 0x9b, 0x8e, 0x22, 0xb7, 0xf9, 0x39, 0xc6, 0x36, 0x63, 0x07, 0x66, 0x03, 0xcf, 0x69, 0x2f, 0x19, 0x83, 0x7e, 0x34, 0x95, 0x8b, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}},
+	{216116, {0x4e, 0xdf, 0x23, 0x1b, 0xf1, 0x70, 0x23, 0x4e, 0x6a, 0x81, 0x14, 0x60, 0xf9, 0x5c, 0x94, 0xaf, 0x94, 0x64, 0xe4, 0x1e, 0xe8, 0x33, 0xb4, 0xf4, 0xb4, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}},
+	{225430, {0x32, 0x59, 0x57, 0x30, 0xb1, 0x65, 0xf0, 0x97, 0xe7, 0xb8, 0x06, 0xa6, 0x79, 0xcf, 0x7f, 0x3e, 0x43, 0x90, 0x40, 0xf7, 0x50, 0x43, 0x38, 0x08, 0xc1, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}},
+	{250000, {0x14, 0xd2, 0xf2, 0x4d, 0x29, 0xbe, 0xd7, 0x53, 0x54, 0xf3, 0xf8, 0x8a, 0x5f, 0xb5, 0x00, 0x22, 0xfc, 0x06, 0x4b, 0x02, 0x29, 0x1f, 0xdf, 0x87, 0x38, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}},
+#endif
+};
+#define CB_NUM_CHECKPOINTS (sizeof(CBCheckpoints) / sizeof(*CBCheckpoints))
+
+// Compares the hashes which begin orphans and header entries.
+static CBCompare CBHashKeyCompare(void * hash1, void * hash2){
+	return CBHashCompare(hash1, hash2);
+}
+
+// Compares outputs as a transaction hash followed by an output index.
+static CBCompare CBOutpointCompare(void * outpoint1, void * outpoint2){
+	CBCompare cmp = CBHashCompare(outpoint1, outpoint2);
+	if (cmp != CB_COMPARE_EQUAL)
+		return cmp;
+	uint32_t index1 = CBArrayToInt32((uint8_t *)outpoint1, 32), index2 = CBArrayToInt32((uint8_t *)outpoint2, 32);
+	if (index1 > index2)
+		return CB_COMPARE_MORE_THAN;
+	if (index1 < index2)
+		return CB_COMPARE_LESS_THAN;
+	return CB_COMPARE_EQUAL;
+}
+
+//  Orphan pool helpers
+
+static CBCompare CBOrphanCompareByPrev(void * orphan1, void * orphan2){
+	return CBHashKeyCompare(((CBOrphan *)orphan1)->prevHash, ((CBOrphan *)orphan2)->prevHash);
+}
+static void CBFreeOrphan(void * vorphan){
+	CBOrphan * orphan = vorphan;
+	CBReleaseObject(orphan->block);
+	free(orphan);
+}
+// Removes all orphans waiting for a block and returns them as a list joined by nextSibling, or NULL if there are none.
+static CBOrphan * CBFullValidatorTakeOrphans(CBFullValidator * self, uint8_t * prevHash){
+	CBOrphan key;
+	memcpy(key.prevHash, prevHash, 32);
+	CBFindResult res = CBAssociativeArrayFind(&self->orphansByPrev, &key);
+	if (NOT res.found)
+		return NULL;
+	CBOrphan * first = res.position.node->elements[res.position.index];
+	CBAssociativeArrayDelete(&self->orphansByPrev, res.position, false);
+	for (CBOrphan * orphan = first; orphan; orphan = orphan->nextSibling) {
+		CBAssociativeArrayDelete(&self->orphans, CBAssociativeArrayFind(&self->orphans, orphan->hash).position, false);
+		self->numOrphans--;
+		self->orphanBytes -= orphan->size;
+	}
+	return first;
+}
+// Removes and frees a single orphan.
+static void CBFullValidatorRemoveOrphan(CBFullValidator * self, CBOrphan * orphan){
+	CBAssociativeArrayDelete(&self->orphans, CBAssociativeArrayFind(&self->orphans, orphan->hash).position, false);
+	CBFindResult res = CBAssociativeArrayFind(&self->orphansByPrev, orphan);
+	CBOrphan * first = res.position.node->elements[res.position.index];
+	if (first == orphan) {
+		if (orphan->nextSibling)
+			// The sibling has the same key so can take the place of this orphan.
+			res.position.node->elements[res.position.index] = orphan->nextSibling;
+		else
+			CBAssociativeArrayDelete(&self->orphansByPrev, res.position, false);
+	}else{
+		while (first->nextSibling != orphan)
+			first = first->nextSibling;
+		first->nextSibling = orphan->nextSibling;
+	}
+	self->numOrphans--;
+	self->orphanBytes -= orphan->size;
+	CBFreeOrphan(orphan);
+}
+// Remembers the hash of an evicted orphan so that it can be counted if downloaded again.
+static void CBFullValidatorRememberEvicted(CBFullValidator * self, uint8_t * hash){
+	memcpy(self->evictedOrphans[self->nextEvictedOrphan], hash, 32);
+	self->nextEvictedOrphan = (self->nextEvictedOrphan + 1) % CB_ORPHAN_EVICTED_MEMORY;
+	self->orphansEvicted++;
+}
+
+//  Block tree helpers
+
+// Orders unspent output changes by key, with the creation of an output before its spend.
+static int CBUnspentOutputChangeCompare(const void * vchange1, const void * vchange2){
+	const CBUnspentOutputChange * change1 = vchange1, * change2 = vchange2;
+	int cmp = memcmp(change1->key, change2->key, 36);
+	if (cmp)
+		return cmp;
+	return (change1->output == NULL) - (change2->output == NULL);
+}
+static void CBFreeHeaderEntry(void * ventry){
+	CBHeaderEntry * entry = ventry;
+	free(entry->work.data);
+	free(entry);
+}
+// Adds an entry for a block in storage to the block tree. The work is taken by the entry.
+static CBHeaderEntry * CBFullValidatorAddHeader(CBFullValidator * self, uint8_t * hash, CBHeaderEntry * prev, uint32_t time, uint32_t target, CBBigInt work, uint32_t blockID){
+	CBHeaderEntry * entry = malloc(sizeof(*entry));
+	if (NOT entry) {
+		CBLogError("Could not allocate %i bytes of memory for a header entry.", sizeof(*entry));
+		free(work.data);
+		return NULL;
+	}
+	memcpy(entry->hash, hash, 32);
+	entry->prev = prev;
+	entry->height = prev ? prev->height + 1 : 0;
+	entry->time = time;
+	entry->target = target;
+	entry->work = work;
+	entry->blockID = blockID;
+	entry->flags = 0;
+	if (NOT CBAssociativeArrayInsert(&self->headers, entry, CBAssociativeArrayFind(&self->headers, entry).position, NULL)) {
+		CBLogError("Could not insert a header entry.");
+		CBFreeHeaderEntry(entry);
+		return NULL;
+	}
+	return entry;
+}
+static bool CBFullValidatorIsMainChain(CBFullValidator * self, CBHeaderEntry * entry){
+	return entry->height <= self->mainTip->height && self->mainChain[entry->height] == entry;
+}
+// Places an entry in the main chain at its height, making room as needed.
+static bool CBFullValidatorSetMainChainHeader(CBFullValidator * self, CBHeaderEntry * entry){
+	if (entry->height >= self->mainChainAlloc) {
+		uint32_t alloc = self->mainChainAlloc ? self->mainChainAlloc : 1024;
+		while (alloc <= entry->height)
+			alloc *= 2;
+		CBHeaderEntry ** mainChain = realloc(self->mainChain, alloc * sizeof(*mainChain));
+		if (NOT mainChain) {
+			CBLogError("Could not allocate %i bytes of memory for the main chain.", alloc * sizeof(*mainChain));
+			return false;
+		}
+		self->mainChain = mainChain;
+		self->mainChainAlloc = alloc;
+	}
+	self->mainChain[entry->height] = entry;
+	return true;
+}
+static bool CBFullValidatorAddSideHeader(CBFullValidator * self, CBHeaderEntry * entry){
+	if (self->numSideHeaders == self->sideHeadersAlloc) {
+		uint32_t alloc = self->sideHeadersAlloc ? self->sideHeadersAlloc * 2 : 16;
+		CBHeaderEntry ** sideHeaders = realloc(self->sideHeaders, alloc * sizeof(*sideHeaders));
+		if (NOT sideHeaders) {
+			CBLogError("Could not allocate %i bytes of memory for the side chain entries.", alloc * sizeof(*sideHeaders));
+			return false;
+		}
+		self->sideHeaders = sideHeaders;
+		self->sideHeadersAlloc = alloc;
+	}
+	self->sideHeaders[self->numSideHeaders++] = entry;
+	return true;
+}
+static void CBFullValidatorRemoveSideHeader(CBFullValidator * self, CBHeaderEntry * entry){
+	for (uint32_t x = 0; x < self->numSideHeaders; x++)
+		if (self->sideHeaders[x] == entry) {
+			self->sideHeaders[x] = self->sideHeaders[--self->numSideHeaders];
+			return;
+		}
+}
+// Makes the chain up to an entry the main chain in memory, moving the entries between the main chain and side headers.
+static bool CBFullValidatorSetMainTip(CBFullValidator * self, CBHeaderEntry * newTip){
+	CBHeaderEntry * fork = newTip;
+	while (NOT CBFullValidatorIsMainChain(self, fork))
+		fork = fork->prev;
+	for (uint32_t x = self->mainTip->height; x > fork->height; x--)
+		if (NOT CBFullValidatorAddSideHeader(self, self->mainChain[x]))
+			return false;
+	for (CBHeaderEntry * entry = newTip; entry != fork; entry = entry->prev) {
+		if (NOT CBFullValidatorSetMainChainHeader(self, entry))
+			return false;
+		CBFullValidatorRemoveSideHeader(self, entry);
+	}
+	self->mainTip = newTip;
+	return true;
+}
+// Reads a block header from storage and adds the entry for it to the block tree. The previous block always has a lower ID.
+static CBHeaderEntry * CBFullValidatorLoadHeader(CBFullValidator * self, uint32_t blockID){
+	uint8_t header[80];
+	if (NOT CBBlockChainStorageLoadBlockHeader(self, blockID, header))
+		return NULL;
+	uint8_t hash[32], hash2[32];
+	CBSha256(header, 80, hash2);
+	CBSha256(hash2, 32, hash);
+	uint32_t target = CBArrayToInt32(header, 72);
+	CBHeaderEntry * prev = NULL;
+	CBBigInt work;
+	if (blockID) {
+		prev = CBFullValidatorFindHeader(self, header + 4);
+		if (NOT prev) {
+			CBLogError("Could not find the previous block for block %u.", blockID);
+			return NULL;
+		}
+		if (NOT CBCalculateBlockWork(&work, target))
+			return NULL;
+		if (NOT CBBigIntEqualsAdditionByBigInt(&work, &prev->work)) {
+			free(work.data);
+			return NULL;
+		}
+	}else{
+		// The genesis block work is not counted.
+		if (NOT CBBigIntAlloc(&work, 1))
+			return NULL;
+		work.length = 1;
+		work.data[0] = 0;
+	}
+	return CBFullValidatorAddHeader(self, hash, prev, CBArrayToInt32(header, 68), target, work, blockID);
+}
+// Loads the block tree from storage and finds the main chain.
+static bool CBFullValidatorLoadHeaders(CBFullValidator * self, uint32_t mainTipID){
+	self->mainTip = NULL;
+	for (uint32_t x = 0; x < self->nextBlockID; x++) {
+		// Pruned blocks leave gaps
+		if (NOT CBBlockChainStorageBlockExists(self, x))
+			continue;
+		CBHeaderEntry * entry = CBFullValidatorLoadHeader(self, x);
+		if (NOT entry) {
+			CBLogError("Could not load the header of block %u.", x);
+			return false;
+		}
+		uint32_t size = CBBlockChainStorageBlockSize(self, x);
+		if (size)
+			self->blockBytes += size;
+		else
+			entry->flags |= CB_HEADER_PRUNED;
+		if (x == mainTipID)
+			self->mainTip = entry;
+	}
+	if (NOT self->mainTip) {
+		CBLogError("The main chain tip is not in storage.");
+		return false;
+	}
+	for (CBHeaderEntry * entry = self->mainTip; entry; entry = entry->prev) {
+		if (NOT CBFullValidatorSetMainChainHeader(self, entry))
+			return false;
+		entry->flags |= CB_HEADER_VALIDATED;
+	}
+	// Pruning continues from the first main chain block with its transactions.
+	while (self->pruneHeight < self->mainTip->height
+		   && self->mainChain[self->pruneHeight]->flags & CB_HEADER_PRUNED)
+		self->pruneHeight++;
+	CBPosition it;
+	if (CBAssociativeArrayGetFirst(&self->headers, &it)) for (;;) {
+		CBHeaderEntry * entry = it.node->elements[it.index];
+		if (NOT CBFullValidatorIsMainChain(self, entry)
+			&& NOT CBFullValidatorAddSideHeader(self, entry))
+			return false;
+		if (CBAssociativeArrayIterate(&self->headers, &it))
+			break;
+	}
+	return true;
+}
+
+//  Block validation helpers
+
+// Determines whether a block is the assume-valid block or one of its ancestors, so that its scripts need not be verified.
+static bool CBFullValidatorIsAssumedValid(CBFullValidator * self, CBBlock * block, uint32_t height){
+	if (NOT self->assumeValidHeight || height > self->assumeValidHeight)
+		return false;
+	uint8_t * hash = CBBlockGetHash(block);
+	if (height == self->assumeValidHeight)
+		return NOT memcmp(hash, self->assumeValid, 32);
+	// Use the headers leading to the assume-valid block when they have been given.
+	if (self->assumeValidChain && height >= self->assumeValidChainStart)
+		return NOT memcmp(hash, self->assumeValidChain + (height - self->assumeValidChainStart) * 32, 32);
+	// Otherwise the assume-valid block must be in the block tree, with this block on the way back from it.
+	CBHeaderEntry * entry = CBFullValidatorFindHeader(self, self->assumeValid);
+	if (NOT entry)
+		return false;
+	if (CBFullValidatorGetMainChainHeader(self, entry->height) == entry)
+		// The ancestors of a main chain block are the main chain below it.
+		entry = CBFullValidatorGetMainChainHeader(self, height);
+	else
+		while (entry->height > height)
+			entry = entry->prev;
+	return NOT memcmp(hash, entry->hash, 32);
+}
+// Validates the transactions of a block for CBFullValidatorCompleteBlockValidation, adding the fees to the block reward.
+static CBBlockValidationResult CBFullValidatorValidateTransactions(CBFullValidator * self, CBBlockValidationContext * context, CBBlock * block, uint32_t height, uint64_t * blockReward, uint64_t * coinbaseOutputValue, uint32_t * sigOps){
+	// Do validation for transactions.
+	for (uint32_t x = 0; x < block->transactionNum; x++) {
+		// Check for duplicate transactions which have unspent outputs, except for two blocks (See BIP30 https://en.bitcoin.it/wiki/BIP_0030 and https://github.com/bitcoin/bitcoin/blob/master/src/main.cpp#L1568)
+		if (memcmp(CBBlockGetHash(block), (uint8_t []){0xec, 0xca, 0xe0, 0x00, 0xe3, 0xc8, 0xe4, 0xe0, 0x93, 0x93, 0x63, 0x60, 0x43, 0x1f, 0x3b, 0x76, 0x03, 0xc5, 0x63, 0xc1, 0xff, 0x61, 0x81, 0x39, 0x0a, 0x4d, 0x0a, 0x00, 0x00, 0x00, 0x00, 0x00}, 32)
+			&& memcmp(CBBlockGetHash(block), (uint8_t []){0x21, 0xd7, 0x7c, 0xcb, 0x4c, 0x08, 0x38, 0x6a, 0x04, 0xac, 0x01, 0x96, 0xae, 0x10, 0xf6, 0xa1, 0xd2, 0xc2, 0xa3, 0x77, 0x55, 0x8c, 0xa1, 0x90, 0xf1, 0x43, 0x07, 0x00, 0x00, 0x00, 0x00, 0x00}, 32)) {
+			// Now check for duplicate in previous blocks, which would have an unspent output with the same hash and index.
+			uint8_t * txHash = CBTransactionGetHash(block->transactions[x]);
+			for (uint32_t y = 0; y < block->transactions[x]->outputNum; y++)
+				if (CBBlockChainStorageUnspentOutputExists(self, txHash, y))
+					return CB_BLOCK_VALIDATION_BAD;
+		}
+		// Check that the transaction is final.
+		if (NOT CBTransactionIsFinal(block->transactions[x], block->time, height))
+			return CB_BLOCK_VALIDATION_BAD;
+		// Do the basic validation
+		uint64_t outputValue;
+		if (NOT CBTransactionValidateBasic(block->transactions[x], NOT x, &outputValue))
+			return CB_BLOCK_VALIDATION_BAD;
+		// Count and verify sigops
+		*sigOps += CBTransactionGetSigOps(block->transactions[x]);
+		if (*sigOps > CB_MAX_SIG_OPS)
+			return CB_BLOCK_VALIDATION_BAD;
+		if (NOT x)
+			// This is the coinbase, take the output as the coinbase output.
+			*coinbaseOutputValue = outputValue;
+		else {
+			uint64_t inputValue = 0;
+			// Verify each input and count input values
+			for (uint32_t y = 0; y < block->transactions[x]->inputNum; y++) {
+				CBBlockValidationResult res = CBFullValidatorInputValidation(self, context, block, height, x, y, &inputValue, sigOps);
+				if (res != CB_BLOCK_VALIDATION_OK)
+					return res;
+			}
+			// Verify values and add to block reward
+			if (inputValue < outputValue)
+				return CB_BLOCK_VALIDATION_BAD;
+			*blockReward += inputValue - outputValue;
+			// Later transactions can spend the outputs of this transaction.
+			uint8_t * hash = context->hashes + context->numTransactions * 36;
+			memcpy(hash, CBTransactionGetHash(block->transactions[x]), 32);
+			CBInt32ToArray(hash, 32, x);
+			CBFindResult find = CBAssociativeArrayFind(&context->transactions, hash);
+			// For a duplicate transaction the first is kept, as the outputs of the second cannot be spent without spending the first twice.
+			if (NOT find.found) {
+				if (NOT CBAssociativeArrayInsert(&context->transactions, hash, find.position, NULL)) {
+					CBLogError("Could not add a transaction to the context of a block.");
+					return CB_BLOCK_VALIDATION_ERR;
+				}
+				context->numTransactions++;
+			}
+		}
+	}
+	return CB_BLOCK_VALIDATION_OK;
+}
+
 //  Constructor
 
 CBFullValidator * CBNewFullValidator(uint64_t storage, bool * badDataBase, CBFullValidatorFlags flags){
-	CBFullValidator * self = malloc(sizeof(*self));
+	CBFullValidator * self = CBAllocObject(sizeof(*self));
 	if (NOT self) {
 		CBLogError("Cannot allocate %i bytes of memory in CBNewFullNode\n", sizeof(*self));
 		return NULL;
@@ -54,73 +398,88 @@ bool CBInitFullValidator(CBFullValidator * self, uint64_t storage, bool * badDat
 	*badDataBase = false;
 	self->storage = storage;
 	self->flags = flags;
+	// Orphans are only kept in memory
+	if (NOT CBInitAssociativeArray(&self->orphans, CBHashKeyCompare, CBFreeOrphan)) {
+		CBLogError("Could not initialise the orphans.");
+		return false;
+	}
+	if (NOT CBInitAssociativeArray(&self->orphansByPrev, CBOrphanCompareByPrev, NULL)) {
+		CBLogError("Could not initialise the orphans by previous block.");
+		CBFreeAssociativeArray(&self->orphans);
+		return false;
+	}
+	if (NOT CBInitAssociativeArray(&self->headers, CBHashKeyCompare, CBFreeHeaderEntry)) {
+		CBLogError("Could not initialise the header index.");
+		CBFreeAssociativeArray(&self->orphansByPrev);
+		CBFreeAssociativeArray(&self->orphans);
+		return false;
+	}
+	self->numOrphans = 0;
+	self->orphanBytes = 0;
+	self->maxOrphanBytes = CB_MAX_ORPHAN_BYTES;
+	self->orphansAdded = 0;
+	self->orphansConnected = 0;
+	self->orphansEvicted = 0;
+	self->orphanRedownloads = 0;
+	memset(self->evictedOrphans, 0, sizeof(self->evictedOrphans));
+	self->nextEvictedOrphan = 0;
+	self->mainChain = NULL;
+	self->mainChainAlloc = 0;
+	self->mainTip = NULL;
+	self->sideHeaders = NULL;
+	self->numSideHeaders = 0;
+	self->sideHeadersAlloc = 0;
+	self->staleForkDepth = CB_STALE_FORK_DEPTH;
+	self->pruneDepth = 0;
+	self->pruneBudget = 0;
+	self->blockBytes = 0;
+	self->pruneHeight = 0;
+	memset(self->assumeValid, 0, 32);
+	self->assumeValidHeight = 0;
+	self->assumeValidChain = NULL;
 	// Check whether the database has been created.
 	if (CBBlockChainStorageExists(self->storage)) {
 		// Found now load information from storage
 		// Basic validator information
-		if (NOT CBBlockChainStorageLoadBasicValidator(self)){
+		uint32_t mainTipID;
+		if (NOT CBBlockChainStorageLoadBasicValidator(self, &mainTipID)){
 			CBLogError("There was an error when loading the validator information.");
 			return false;
 		}
-		// Loop through the orphans
-		for (uint8_t x = 0; x < self->numOrphans; x++) {
-			if (NOT CBBlockChainStorageLoadOrphan(self, x)) {
-				CBLogError("Could not load orphan %u.", x);
-				return false;
-			}
-		}
-		// Loop through the branches
-		for (uint8_t x = 0; x < self->numBranches; x++) {
-			if (NOT CBBlockChainStorageLoadBranch(self, x)) {
-				CBLogError("Could not load branch %u.", x);
-				return false;
-			}
-			if (NOT CBBlockChainStorageLoadBranchWork(self, x)) {
-				CBLogError("Could not load work for branch %u.", x);
-				return false;
-			}
+		// Build the block tree in memory
+		if (NOT CBFullValidatorLoadHeaders(self, mainTipID)) {
+			CBLogError("Could not load the block tree.");
+			return false;
 		}
 	}else{
 		// Write the genesis block
 		CBBlock * genesis = CBNewBlockGenesis();
-		if (NOT CBBlockChainStorageSaveBlock(self, genesis, 0, 0)) {
+		if (NOT CBBlockChainStorageSaveBlock(self, genesis, 0)) {
 			CBLogError("Could not save genesis block.");
+			CBReleaseObject(genesis);
 			return false;
 		}
+		CBBigInt genesisWork;
+		if (NOT CBBigIntAlloc(&genesisWork, 1)) {
+			CBLogError("Could not allocate the work for the genesis header entry.");
+			CBReleaseObject(genesis);
+			return false;
+		}
+		genesisWork.length = 1;
+		genesisWork.data[0] = 0;
+		self->mainTip = CBFullValidatorAddHeader(self, CBBlockGetHash(genesis), NULL, genesis->time, genesis->target, genesisWork, 0);
+		self->blockBytes = CBGetMessage(genesis)->bytes->length;
 		CBReleaseObject(genesis);
-		// Create initial data
-		self->mainBranch = 0;
-		self->numBranches = 1;
-		self->numOrphans = 0;
-		self->firstOrphan = 0;
+		if (NOT self->mainTip
+			|| NOT CBFullValidatorSetMainChainHeader(self, self->mainTip))
+			return false;
+		self->mainTip->flags = CB_HEADER_VALIDATED;
+		self->nextBlockID = 1;
 		// Write basic validator information
 		if (NOT CBBlockChainStorageSaveBasicValidator(self)) {
 			CBLogError("Could not save the initial basic validation information.");
 			return false;
 		}
-		// Create initial branch information
-		self->branches[0].lastRetargetTime = 1231006505;
-		self->branches[0].startHeight = 0;
-		self->branches[0].numBlocks = 1;
-		self->branches[0].lastValidation = 0;
-		// Write branch information
-		if (NOT CBBlockChainStorageSaveBranch(self, 0)) {
-			CBLogError("Could not save the initial branch information.");
-			return false;
-		}
-		// Create work CBBigInt
-		self->branches[0].work.length = 1;
-		self->branches[0].work.data = malloc(1);
-		if (NOT self->branches[0].work.data) {
-			CBLogError("Could not allocate 1 byte of memory for the initial branch work.");
-			return false;
-		}
-		self->branches[0].work.data[0] = 0;
-		// Write branch work
-		if (NOT CBBlockChainStorageSaveBranchWork(self, 0)) {
-			CBLogError("Could not save the initial work.");
-			return false;
-		}
 		// Now try to commit the data
 		if (NOT CBBlockChainStorageCommitData(storage)){
 			CBLogError("Could not commit initial block-chain data.");
@@ -131,89 +490,148 @@ bool CBInitFullValidator(CBFullValidator * self, uint64_t storage, bool * badDat
 	return true;
 }
 
+bool CBInitBlockValidationContext(CBBlockValidationContext * context, CBBlock * block){
+	uint32_t numInputs = 0;
+	for (uint32_t x = 1; x < block->transactionNum; x++)
+		numInputs += block->transactions[x]->inputNum;
+	context->hashes = malloc(block->transactionNum * 36);
+	context->outpoints = malloc(numInputs * 36 + 1);
+	context->numTransactions = 0;
+	context->numSpent = 0;
+	context->assumedValid = false;
+	if (NOT context->hashes || NOT context->outpoints) {
+		CBLogError("Could not allocate memory for the validation of a block.");
+		free(context->hashes);
+		free(context->outpoints);
+		return false;
+	}
+	if (NOT CBInitAssociativeArray(&context->transactions, CBHashKeyCompare, NULL)) {
+		CBLogError("Could not initialise the transactions of a block for validation.");
+		free(context->hashes);
+		free(context->outpoints);
+		return false;
+	}
+	if (NOT CBInitAssociativeArray(&context->spent, CBOutpointCompare, NULL)) {
+		CBLogError("Could not initialise the spent outputs of a block for validation.");
+		CBFreeAssociativeArray(&context->transactions);
+		free(context->hashes);
+		free(context->outpoints);
+		return false;
+	}
+	return true;
+}
+
 //  Destructor
 
 void CBFreeFullValidator(void * vself){
 	CBFullValidator * self = vself;
 	// Release orphans
-	for (uint8_t x = 0; x < self->numOrphans; x++)
-		CBReleaseObject(self->orphans[x]);
-	// Release branches
-	for (uint8_t x = 0; x < self->numBranches; x++)
-		free(self->branches[x].work.data);
+	CBFreeAssociativeArray(&self->orphansByPrev);
+	CBFreeAssociativeArray(&self->orphans);
+	// Release the block tree
+	CBFreeAssociativeArray(&self->headers);
+	free(self->mainChain);
+	free(self->sideHeaders);
+	free(self->assumeValidChain);
 	CBFreeObject(self);
 }
+void CBFreeBlockValidationContext(CBBlockValidationContext * context){
+	CBFreeAssociativeArray(&context->transactions);
+	CBFreeAssociativeArray(&context->spent);
+	free(context->hashes);
+	free(context->outpoints);
+}
 
 //  Functions
 
-bool CBFullValidatorAddBlockToBranch(CBFullValidator * self, uint8_t branch, CBBlock * block, CBBigInt work){
+CBHeaderEntry * CBFullValidatorAddBlockToTree(CBFullValidator * self, CBBlock * block, CBHeaderEntry * prev, CBBigInt work){
 	// Store the block
-	if (NOT CBBlockChainStorageSaveBlock(self, block, branch, self->branches[branch].numBlocks)) {
+	if (NOT CBBlockChainStorageSaveBlock(self, block, self->nextBlockID)) {
 		CBLogError("Could not save a block");
-		return false;
-	}
-	// Increase number of blocks.
-	self->branches[branch].numBlocks++; 
-	// Modify branch information
-	free(self->branches[branch].work.data);
-	self->branches[branch].work = work;
-	if (NOT (self->branches[branch].startHeight + self->branches[branch].numBlocks) % 2016)
-		self->branches[branch].lastRetargetTime = block->time;
-	// Save branch information
-	if (NOT CBBlockChainStorageSaveBranch(self, branch)) {
-		CBLogError("Could not write the branch information for branch %u.", branch);
-		return false;
+		free(work.data);
+		return NULL;
 	}
-	// Update the branch work in storage
-	if (NOT CBBlockChainStorageSaveBranchWork(self, branch)) {
-		CBLogError("Could not write the branch work for branch %u.", branch);
-		return false;
+	CBHeaderEntry * entry = CBFullValidatorAddHeader(self, CBBlockGetHash(block), prev, block->time, block->target, work, self->nextBlockID);
+	if (NOT entry) {
+		CBLogError("Could not add a block to the block tree.");
+		return NULL;
 	}
-	return true;
+	if (NOT CBFullValidatorAddSideHeader(self, entry))
+		return NULL;
+	self->blockBytes += CBGetMessage(block)->bytes->length;
+	self->nextBlockID++;
+	return entry;
 }
 bool CBFullValidatorAddBlockToOrphans(CBFullValidator * self, CBBlock * block){
-	// Save orphan.
-	uint8_t pos;
-	if (self->numOrphans == CB_MAX_ORPHAN_CACHE) {
-		// Release old orphan
-#ifdef BRDEBUG
-        printf("Max cache %d\nfirstOrphan %d\n", CB_MAX_ORPHAN_CACHE, self->firstOrphan);
-#endif
-		CBReleaseObject(self->orphans[self->firstOrphan]);
-		pos = self->firstOrphan;
-		self->firstOrphan = (self->firstOrphan + 1) % CB_MAX_ORPHAN_CACHE;
-	}else
-		// Adding an orphan.
-		pos = self->numOrphans++;
-	// Update validation information in storage
-	if (NOT CBBlockChainStorageSaveBasicValidator(self)) {
-		CBLogError("There was an error when saving the basic validation information when adding an orhpan block.");
+	uint8_t * hash = CBBlockGetHash(block);
+	uint32_t size = CBGetMessage(block)->bytes->length;
+	self->orphansAdded++;
+	if (self->orphanBytes + size > self->maxOrphanBytes) {
+		// Make room by evicting the orphans with times furthest from the main chain tip, as these are the least likely to be connected soon.
+		uint32_t tipTime = self->mainTip->time;
+		uint32_t distance = block->time > tipTime ? block->time - tipTime : tipTime - block->time;
+		while (self->orphanBytes + size > self->maxOrphanBytes) {
+			CBOrphan * furthest = NULL;
+			uint32_t furthestDistance = 0;
+			CBPosition it;
+			if (CBAssociativeArrayGetFirst(&self->orphans, &it)) for (;;) {
+				CBOrphan * orphan = it.node->elements[it.index];
+				uint32_t orphanDistance = orphan->block->time > tipTime ? orphan->block->time - tipTime : tipTime - orphan->block->time;
+				if (NOT furthest || orphanDistance > furthestDistance) {
+					furthest = orphan;
+					furthestDistance = orphanDistance;
+				}
+				if (CBAssociativeArrayIterate(&self->orphans, &it))
+					break;
+			}
+			if (NOT furthest || distance >= furthestDistance) {
+				// The new block is the furthest so do not keep it.
+				CBFullValidatorRememberEvicted(self, hash);
+				return true;
+			}
+			CBFullValidatorRememberEvicted(self, furthest->hash);
+			CBFullValidatorRemoveOrphan(self, furthest);
+		}
+	}
+	CBOrphan * orphan = malloc(sizeof(*orphan));
+	if (NOT orphan) {
+		CBLogError("Could not allocate %i bytes of memory for an orphan.", sizeof(*orphan));
 		return false;
 	}
-	// Add to memory
-	self->orphans[pos] = block;
+	memcpy(orphan->hash, hash, 32);
+	memcpy(orphan->prevHash, CBByteArrayGetData(block->prevBlockHash), 32);
+	orphan->block = block;
+	orphan->size = size;
+	orphan->nextSibling = NULL;
 	CBRetainObject(block);
-	// Add to storage
-	if (NOT CBBlockChainStorageSaveOrphan(self, block, pos)) {
-		CBLogError("Could not save an orphan.");
+	if (NOT CBAssociativeArrayInsert(&self->orphans, orphan, CBAssociativeArrayFind(&self->orphans, orphan).position, NULL)) {
+		CBLogError("Could not insert an orphan.");
+		CBFreeOrphan(orphan);
 		return false;
 	}
-	// Commit data
-	if (NOT CBBlockChainStorageCommitData(self->storage)) {
-		CBLogError("There was commiting data for an orphan.");
+	CBFindResult res = CBAssociativeArrayFind(&self->orphansByPrev, orphan);
+	if (res.found) {
+		// Another orphan is waiting for the same block.
+		CBOrphan * first = res.position.node->elements[res.position.index];
+		orphan->nextSibling = first->nextSibling;
+		first->nextSibling = orphan;
+	}else if (NOT CBAssociativeArrayInsert(&self->orphansByPrev, orphan, res.position, NULL)) {
+		CBLogError("Could not insert an orphan by previous block.");
+		CBAssociativeArrayDelete(&self->orphans, CBAssociativeArrayFind(&self->orphans, orphan).position, true);
 		return false;
 	}
+	self->numOrphans++;
+	self->orphanBytes += size;
 	return true;
 }
 CBBlockStatus CBFullValidatorBasicBlockValidation(CBFullValidator * self, CBBlock * block, uint64_t networkTime){
 	// Get the block hash
 	uint8_t * hash = CBBlockGetHash(block);
 	// Check if duplicate.
-	for (uint8_t x = 0; x < self->numOrphans; x++)
-		if (NOT memcmp(CBBlockGetHash(self->orphans[x]), hash, 32))
-			return CB_BLOCK_STATUS_DUPLICATE;
-	// Look in block hash index
-	if (CBBlockChainStorageBlockExists(self, hash))
+	if (CBAssociativeArrayFind(&self->orphans, hash).found)
+		return CB_BLOCK_STATUS_DUPLICATE;
+	// Look in the header index
+	if (CBFullValidatorFindHeader(self, hash))
 		return CB_BLOCK_STATUS_DUPLICATE;
 	// Check block has transactions
 	if (NOT block->transactionNum)
@@ -235,103 +653,119 @@ CBBlockStatus CBFullValidatorBasicBlockValidation(CBFullValidator * self, CBBloc
 		return CB_BLOCK_STATUS_BAD;
 	return CB_BLOCK_STATUS_CONTINUE;
 }
-CBBlockValidationResult CBFullValidatorCompleteBlockValidation(CBFullValidator * self, uint8_t branch, CBBlock * block, uint32_t height){
+CBBlockValidationResult CBFullValidatorCompleteBlockValidation(CBFullValidator * self, CBBlock * block, uint32_t height){
 	// Check that the first transaction is a coinbase transaction.
 	if (NOT CBTransactionIsCoinBase(block->transactions[0]))
 		return CB_BLOCK_VALIDATION_BAD;
 	uint64_t blockReward = CBCalculateBlockReward(height);
 	uint64_t coinbaseOutputValue;
 	uint32_t sigOps = 0;
-	// Do validation for transactions.
-	for (uint32_t x = 0; x < block->transactionNum; x++) {
-		// Check for duplicate transactions which have unspent outputs, except for two blocks (See BIP30 https://en.bitcoin.it/wiki/BIP_0030 and https://github.com/bitcoin/bitcoin/blob/master/src/main.cpp#L1568)
-		if (memcmp(CBBlockGetHash(block), (uint8_t []){0xec, 0xca, 0xe0, 0x00, 0xe3, 0xc8, 0xe4, 0xe0, 0x93, 0x93, 0x63, 0x60, 0x43, 0x1f, 0x3b, 0x76, 0x03, 0xc5, 0x63, 0xc1, 0xff, 0x61, 0x81, 0x39, 0x0a, 0x4d, 0x0a, 0x00, 0x00, 0x00, 0x00, 0x00}, 32)
-			&& memcmp(CBBlockGetHash(block), (uint8_t []){0x21, 0xd7, 0x7c, 0xcb, 0x4c, 0x08, 0x38, 0x6a, 0x04, 0xac, 0x01, 0x96, 0xae, 0x10, 0xf6, 0xa1, 0xd2, 0xc2, 0xa3, 0x77, 0x55, 0x8c, 0xa1, 0x90, 0xf1, 0x43, 0x07, 0x00, 0x00, 0x00, 0x00, 0x00}, 32)) {
-			// Now check for duplicate in previous blocks.
-			bool exists;
-			if (NOT CBBlockChainStorageIsTransactionWithUnspentOutputs(self, CBTransactionGetHash(block->transactions[x]), &exists)) {
-				CBLogError("Could not detemine if a transaction exists with unspent outputs.");
-				return CB_BLOCK_VALIDATION_ERR;
-			}
-			if (exists)
-				return CB_BLOCK_VALIDATION_BAD;
-		}
-		// Check that the transaction is final.
-		if (NOT CBTransactionIsFinal(block->transactions[x], block->time, height))
-			return CB_BLOCK_VALIDATION_BAD;
-		// Do the basic validation
-		uint64_t outputValue;
-		if (NOT CBTransactionValidateBasic(block->transactions[x], NOT x, &outputValue))
-			return CB_BLOCK_VALIDATION_BAD;
-		// Count and verify sigops
-		sigOps += CBTransactionGetSigOps(block->transactions[x]);
-		if (sigOps > CB_MAX_SIG_OPS)
-			return CB_BLOCK_VALIDATION_BAD;
-		if (NOT x)
-			// This is the coinbase, take the output as the coinbase output.
-			coinbaseOutputValue = outputValue;
-		else {
-			uint64_t inputValue = 0;
-			// Verify each input and count input values
-			for (uint32_t y = 0; y < block->transactions[x]->inputNum; y++) {
-				CBBlockValidationResult res = CBFullValidatorInputValidation(self, branch, block, height, x, y, &inputValue, &sigOps);
-				if (res != CB_BLOCK_VALIDATION_OK)
-					return res;
-			}
-			// Verify values and add to block reward
-			if (inputValue < outputValue)
-				return CB_BLOCK_VALIDATION_BAD;
-			blockReward += inputValue - outputValue;
-		}
-	}
+	CBBlockValidationContext context;
+	if (NOT CBInitBlockValidationContext(&context, block))
+		return CB_BLOCK_VALIDATION_ERR;
+	context.assumedValid = CBFullValidatorIsAssumedValid(self, block, height);
+	CBBlockValidationResult res = CBFullValidatorValidateTransactions(self, &context, block, height, &blockReward, &coinbaseOutputValue, &sigOps);
+	CBFreeBlockValidationContext(&context);
+	if (res != CB_BLOCK_VALIDATION_OK)
+		return res;
 	// Verify coinbase output for reward
 	if (coinbaseOutputValue > blockReward)
 		return CB_BLOCK_VALIDATION_BAD;
 	return CB_BLOCK_VALIDATION_OK;
 }
-uint32_t CBFullValidatorGetMedianTime(CBFullValidator * self, uint8_t branch, uint32_t prevIndex){
-	uint32_t height = self->branches[branch].startHeight + prevIndex;
-	height = (height > 12)? 12 : height;
-	uint8_t x = height/2; // Go back median amount
-	for (;;) {
-		if (prevIndex >= x) {
-			prevIndex -= x;
-			return CBBlockChainStorageGetBlockTime(self, branch, prevIndex);
-		}
-		x -= prevIndex + 1;
-		branch = self->branches[branch].parentBranch;
-		prevIndex = self->branches[branch].numBlocks - 1;
+bool CBFullValidatorCheckpointMatches(CBFullValidator * self, uint8_t * hash, uint32_t height){
+	if (self->assumeValidHeight
+		&& height == self->assumeValidHeight
+		&& memcmp(hash, self->assumeValid, 32))
+		return false;
+	for (uint8_t x = 0; x < CB_NUM_CHECKPOINTS; x++)
+		if (CBCheckpoints[x].height == height)
+			return NOT memcmp(hash, CBCheckpoints[x].hash, 32);
+	return true;
+}
+CBHeaderEntry * CBFullValidatorFindHeader(CBFullValidator * self, uint8_t * hash){
+	CBFindResult res = CBAssociativeArrayFind(&self->headers, hash);
+	if (NOT res.found)
+		return NULL;
+	return res.position.node->elements[res.position.index];
+}
+CBHeaderEntry * CBFullValidatorGetMainChainHeader(CBFullValidator * self, uint32_t height){
+	if (height > self->mainTip->height)
+		return NULL;
+	return self->mainChain[height];
+}
+CBCheckpoint * CBFullValidatorGetLastCheckpoint(void){
+	return CBCheckpoints + CB_NUM_CHECKPOINTS - 1;
+}
+uint32_t CBFullValidatorGetMedianTime(CBFullValidator * self, CBHeaderEntry * prev){
+	// Go back median amount
+	for (uint8_t x = (prev->height > 12 ? 12 : prev->height)/2; x--;)
+		prev = prev->prev;
+	return prev->time;
+}
+uint32_t CBFullValidatorGetNextTarget(CBFullValidator * self, CBHeaderEntry * prev){
+	if ((prev->height + 1) % 2016)
+		return prev->target;
+	// Difficulty change, using the time taken by the 2016 blocks up to the previous block.
+	CBHeaderEntry * first = prev;
+	for (uint16_t x = 2015; x--;)
+		first = first->prev;
+	return CBCalculateTarget(prev->target, prev->time - first->time);
+}
+void CBFullValidatorSetAssumeValid(CBFullValidator * self, uint8_t * hash, uint32_t height){
+	memcpy(self->assumeValid, hash, 32);
+	self->assumeValidHeight = height;
+	// The headers given before were for the previous block.
+	free(self->assumeValidChain);
+	self->assumeValidChain = NULL;
+}
+bool CBFullValidatorSetAssumeValidChain(CBFullValidator * self, uint8_t * hashes, uint32_t startHeight){
+	if (NOT self->assumeValidHeight || startHeight > self->assumeValidHeight)
+		return false;
+	uint32_t length = (self->assumeValidHeight - startHeight + 1) * 32;
+	if (memcmp(hashes + length - 32, self->assumeValid, 32))
+		return false;
+	uint8_t * chain = malloc(length);
+	if (NOT chain) {
+		CBLogError("Could not allocate %u bytes for the headers leading to the assume-valid block.", length);
+		return false;
 	}
+	memcpy(chain, hashes, length);
+	free(self->assumeValidChain);
+	self->assumeValidChain = chain;
+	self->assumeValidChainStart = startHeight;
+	return true;
 }
-CBBlockValidationResult CBFullValidatorInputValidation(CBFullValidator * self, uint8_t branch, CBBlock * block, uint32_t blockHeight, uint32_t transactionIndex, uint32_t inputIndex, uint64_t * value, uint32_t * sigOps){
+CBBlockValidationResult CBFullValidatorInputValidation(CBFullValidator * self, CBBlockValidationContext * context, CBBlock * block, uint32_t blockHeight, uint32_t transactionIndex, uint32_t inputIndex, uint64_t * value, uint32_t * sigOps){
 	// Create variable for the previous output reference.
 	CBPrevOut prevOutRef = block->transactions[transactionIndex]->inputs[inputIndex]->prevOut;
 	// Check that the previous output is not already spent by this block.
-	for (uint32_t a = 0; a < transactionIndex; a++)
-		for (uint32_t b = 0; b < block->transactions[a]->inputNum; b++)
-			if (CBByteArrayCompare(prevOutRef.hash, block->transactions[a]->inputs[b]->prevOut.hash) == CB_COMPARE_EQUAL
-				&& prevOutRef.index == block->transactions[a]->inputs[b]->prevOut.index)
-				// Duplicate found.
-				return CB_BLOCK_VALIDATION_BAD;
+	uint8_t * outpoint = context->outpoints + context->numSpent * 36;
+	memcpy(outpoint, CBByteArrayGetData(prevOutRef.hash), 32);
+	CBInt32ToArray(outpoint, 32, prevOutRef.index);
+	CBFindResult find = CBAssociativeArrayFind(&context->spent, outpoint);
+	if (find.found)
+		// Duplicate found.
+		return CB_BLOCK_VALIDATION_BAD;
+	if (NOT CBAssociativeArrayInsert(&context->spent, outpoint, find.position, NULL)) {
+		CBLogError("Could not add a spent output to the context of a block.");
+		return CB_BLOCK_VALIDATION_ERR;
+	}
+	context->numSpent++;
 	// Now we need to check that the output is in this block (before this transaction) or unspent elsewhere in the blockchain.
 	CBTransactionOutput * prevOut;
-	bool found = false;
-	// Start transaction search at 1. We cannot spend the coinbase output.
-	for (uint32_t a = 1; a < transactionIndex; a++) {
-		if (NOT memcmp(CBTransactionGetHash(block->transactions[a]), CBByteArrayGetData(prevOutRef.hash), 32)) {
-			// This is the transaction hash. Make sure there is the output.
-			if (block->transactions[a]->outputNum <= prevOutRef.index)
-				// Too few outputs.
-				return CB_BLOCK_VALIDATION_BAD;
-			prevOut = block->transactions[a]->outputs[prevOutRef.index];
-			// Retain previous output, as though it was retained when returned by a function
-			CBRetainObject(prevOut);
-			// Yes we have found a previous output in the block.
-			found = true;
-			break;
-		}
-	}
-	if (NOT found) {
+	// Only transactions before this one are in the context, and never the coinbase, as we cannot spend the coinbase output.
+	find = CBAssociativeArrayFind(&context->transactions, CBByteArrayGetData(prevOutRef.hash));
+	if (find.found) {
+		uint32_t a = CBArrayToInt32((uint8_t *)find.position.node->elements[find.position.index], 32);
+		// This is the transaction hash. Make sure there is the output.
+		if (block->transactions[a]->outputNum <= prevOutRef.index)
+			// Too few outputs.
+			return CB_BLOCK_VALIDATION_BAD;
+		prevOut = block->transactions[a]->outputs[prevOutRef.index];
+		// Retain previous output, as though it was retained when returned by a function
+		CBRetainObject(prevOut);
+	}else{
 		// Not found in this block. Look in database for the unspent output.
 		if (NOT CBBlockChainStorageUnspentOutputExists(self, CBByteArrayGetData(prevOutRef.hash), prevOutRef.index))
 			return CB_BLOCK_VALIDATION_BAD;
@@ -347,18 +781,25 @@ CBBlockValidationResult CBFullValidatorInputValidation(CBFullValidator * self, u
 		if (coinbase && blockHeight - outputHeight < CB_COINBASE_MATURITY)
 			return CB_BLOCK_VALIDATION_BAD;
 	}
+	if (context->assumedValid) {
+		// The scripts are assumed to be valid, so only count the value.
+		*value += prevOut->value;
+		CBReleaseObject(prevOut);
+		return CB_BLOCK_VALIDATION_OK;
+	}
 	// We have sucessfully received an output for this input. Verify the input script for the output script.
-	CBScriptStack stack = CBNewEmptyScriptStack();
+	CBScriptStack stack;
+	CBInitScriptStack(&stack);
 	// Execute the input script.
 	CBScriptExecuteReturn res = CBScriptExecute(block->transactions[transactionIndex]->inputs[inputIndex]->scriptObject, &stack, CBTransactionGetInputHashForSignature, block->transactions[transactionIndex], inputIndex, false);
 	if (res == CB_SCRIPT_ERR){
-		CBFreeScriptStack(stack);
+		CBFreeScriptStack(&stack);
 		CBReleaseObject(prevOut);
 		return CB_BLOCK_VALIDATION_ERR;
 	}
 	// Check is script is invalid, but for input scripts, do not care if false.
 	if (res == CB_SCRIPT_INVALID){
-		CBFreeScriptStack(stack);
+		CBFreeScriptStack(&stack);
 		CBReleaseObject(prevOut);
 		return CB_BLOCK_VALIDATION_BAD;
 	}
@@ -368,7 +809,7 @@ CBBlockValidationResult CBFullValidatorInputValidation(CBFullValidator * self, u
 		if (NOT CBScriptIsPushOnly(block->transactions[transactionIndex]->inputs[inputIndex]->scriptObject)
 			// We must have data in the stack.
 			|| NOT stack.length){
-			CBFreeScriptStack(stack);
+			CBFreeScriptStack(&stack);
 			CBReleaseObject(prevOut);
 			return CB_BLOCK_VALIDATION_BAD;
 		}
@@ -380,7 +821,7 @@ CBBlockValidationResult CBFullValidatorInputValidation(CBFullValidator * self, u
 		}
 		*sigOps += CBScriptGetSigOpCount(p2shScript, true);
 		if (*sigOps > CB_MAX_SIG_OPS){
-			CBFreeScriptStack(stack);
+			CBFreeScriptStack(&stack);
 			CBReleaseObject(prevOut);
 			return CB_BLOCK_VALIDATION_BAD;
 		}
@@ -389,7 +830,7 @@ CBBlockValidationResult CBFullValidatorInputValidation(CBFullValidator * self, u
 	// Execute the output script.
 	res = CBScriptExecute(prevOut->scriptObject, &stack, CBTransactionGetInputHashForSignature, block->transactions[transactionIndex], inputIndex, true);
 	// Finished with the stack.
-	CBFreeScriptStack(stack);
+	CBFreeScriptStack(&stack);
 	// Increment the value with the input value then be done with the output
 	*value += prevOut->value;
 	CBReleaseObject(prevOut);
@@ -401,24 +842,43 @@ CBBlockValidationResult CBFullValidatorInputValidation(CBFullValidator * self, u
 		return CB_BLOCK_VALIDATION_BAD;
 	return CB_BLOCK_VALIDATION_OK;
 }
+bool CBFullValidatorPrefetchUnspentOutputs(CBFullValidator * self, CBBlock * block){
+	uint32_t numOutpoints = 0;
+	for (uint32_t x = 1; x < block->transactionNum; x++)
+		numOutpoints += block->transactions[x]->inputNum;
+	uint8_t * outpoints = malloc(numOutpoints * 36 + 1);
+	if (NOT outpoints) {
+		CBLogError("Could not allocate memory for the unspent outputs to prefetch for a block.");
+		return false;
+	}
+	// Outputs created by the block are included, as they are found in the block first.
+	uint8_t * outpoint = outpoints;
+	for (uint32_t x = 1; x < block->transactionNum; x++)
+		for (uint32_t y = 0; y < block->transactions[x]->inputNum; y++) {
+			memcpy(outpoint, CBByteArrayGetData(block->transactions[x]->inputs[y]->prevOut.hash), 32);
+			CBInt32ToArray(outpoint, 32, block->transactions[x]->inputs[y]->prevOut.index);
+			outpoint += 36;
+		}
+	bool ok = CBBlockChainStoragePrefetchUnspentOutputs(self, outpoints, numOutpoints);
+	free(outpoints);
+	if (NOT ok)
+		CBLogError("Could not prefetch the unspent outputs for a block.");
+	return ok;
+}
 CBBlockStatus CBFullValidatorProcessBlock(CBFullValidator * self, CBBlock * block, uint64_t networkTime){
-	uint8_t prevBranch;
-	uint32_t prevBlockIndex;
-	uint32_t prevBlockTarget;
+	// Count blocks which come back after being evicted from the orphans.
+	if (self->orphansEvicted) {
+		uint8_t * hash = CBBlockGetHash(block);
+		for (uint16_t x = 0; x < CB_ORPHAN_EVICTED_MEMORY; x++)
+			if (NOT memcmp(self->evictedOrphans[x], hash, 32)) {
+				self->orphanRedownloads++;
+				memset(self->evictedOrphans[x], 0, 32);
+				break;
+			}
+	}
 	// Determine what type of block this is.
-	if (CBBlockChainStorageBlockExists(self, CBByteArrayGetData(block->prevBlockHash))) {
-		// Has a block in the block hash index. Get branch and index.
-		if (NOT CBBlockChainStorageGetBlockLocation(self, CBByteArrayGetData(block->prevBlockHash), &prevBranch, &prevBlockIndex)) {
-			CBLogError("Could not get the location of a previous block.");
-			return CB_BLOCK_STATUS_ERROR;
-		}
-		// Get previous block target
-		prevBlockTarget = CBBlockChainStorageGetBlockTarget(self, prevBranch, prevBlockIndex);
-		if (NOT prevBlockTarget) {
-			CBLogError("Could not get the target of a previous block.");
-			return CB_BLOCK_STATUS_ERROR;
-		}
-	}else{
+	CBHeaderEntry * prev = CBFullValidatorFindHeader(self, CBByteArrayGetData(block->prevBlockHash));
+	if (NOT prev) {
 		// Orphan block. End here.
 		// Do basic validation
 		CBBlockStatus res = CBFullValidatorBasicBlockValidation(self, block, networkTime);
@@ -433,207 +893,33 @@ CBBlockStatus CBFullValidatorProcessBlock(CBFullValidator * self, CBBlock * bloc
 	CBBlockStatus status = CBFullValidatorBasicBlockValidation(self, block, networkTime);
 	if (status != CB_BLOCK_STATUS_CONTINUE)
 		return status;
-	// Not an orphan. See if this is an extention or new branch.
-	uint8_t branch;
-	if (prevBlockIndex == self->branches[prevBranch].numBlocks - 1)
-		// Extension
-		branch = prevBranch;
-	else{
-		// New branch
-		if (self->numBranches == CB_MAX_BRANCH_CACHE) {
-			// ??? SINCE BRANCHES ARE TRIMMED OR DELETED THERE ARE SECURITY IMPLICATIONS: A peer could prevent other branches having a chance by creating many branches when the node is not up-to-date. To protect against this potential attack peers should only be allowed to provide one branch at a time and before accepting new branches from peers there should be a completed branch which is not the main branch.
-			// Trim branch from longest ago which is not being worked on and isn't main branch
-			uint8_t earliestBranch = 0;
-			uint32_t earliestIndex = self->branches[0].parentBlockIndex + self->branches[0].numBlocks;
-			for (uint8_t x = 1; x < self->numBranches; x++) {
-				if (NOT self->branches[x].working
-					&& self->branches[x].parentBlockIndex + self->branches[x].numBlocks < earliestIndex) {
-					earliestIndex = self->branches[x].parentBlockIndex + self->branches[x].numBlocks;
-					earliestBranch = x;
-				}
-			}
-			if (self->branches[earliestBranch].working || earliestBranch == self->mainBranch)
-				// Cannot overwrite branch
-				return CB_BLOCK_STATUS_NO_NEW;
-			// Check to see the highest block dependency for other branches.
-			uint32_t highestDependency = 0;
-			uint8_t mergeBranch = 255;
-			for (uint8_t x = 0; x < self->numBranches; x++) {
-				if (self->branches[x].parentBranch == earliestBranch) {
-					if (self->branches[x].parentBlockIndex > highestDependency) {
-						highestDependency = self->branches[x].parentBlockIndex;
-						mergeBranch = x;
-					}
-				}
-			}
-			if (mergeBranch != 255) {
-				// Merge the branch with the branch with the highest dependent branch.
-				// Delete blocks after highest dependency
-				for (uint32_t x = highestDependency; x < self->branches[earliestBranch].numBlocks; x++){
-					// Delete
-					if (NOT CBBlockChainStorageDeleteBlock(self, earliestBranch, x)) {
-						CBLogError("Could not delete a block when removing a branch.");
-						return CB_BLOCK_STATUS_ERROR;
-					}
-				}
-				// Change block keys from earliest branch to dependent branch
-				for (uint8_t x = 0; x < highestDependency; x++) {
-					if (NOT CBBlockChainStorageMoveBlock(self, earliestBranch, x, mergeBranch, x)) {
-						CBLogError("Could not move a block for merging two branches.");
-						return CB_BLOCK_STATUS_ERROR;
-					}
-				}
-				// Make parent information for dependent branch reflect the earliest branch
-				self->branches[mergeBranch].numBlocks += self->branches[earliestBranch].numBlocks;
-				self->branches[mergeBranch].parentBlockIndex = self->branches[earliestBranch].parentBlockIndex;
-				self->branches[mergeBranch].parentBranch = self->branches[earliestBranch].parentBranch;
-				self->branches[mergeBranch].startHeight = self->branches[earliestBranch].startHeight;
-				// Write updated branch information to storage
-				if (NOT CBBlockChainStorageSaveBranch(self, mergeBranch)) {
-					CBLogError("Could not save the updated branch information for merging two branches together.");
-					return CB_BLOCK_STATUS_ERROR;
-				}
-				// Find all of the other dependent branches for the earliest branch and update the parent branch information.
-				for (uint8_t x = 0; x < self->numBranches; x++) {
-					if (x != mergeBranch && self->branches[x].parentBranch == earliestBranch) {
-						self->branches[x].parentBranch = mergeBranch;
-						// Update in storage
-						if (NOT CBBlockChainStorageSaveBranch(self, x)) {
-							CBLogError("Could not write the updated parent branch from the overwritten branch during a merge.");
-							return CB_BLOCK_STATUS_ERROR;
-						}
-					}
-				}
-				// Find all of the dependent branches for the dependent branch and update the parent block index.
-				for (uint8_t x = 0; x < self->numBranches; x++) {
-					if (self->branches[x].parentBranch == mergeBranch) {
-						self->branches[x].parentBlockIndex += self->branches[earliestBranch].numBlocks;
-						// Update in storage
-						if (NOT CBBlockChainStorageSaveBranch(self, x)) {
-							CBLogError("Could not write an updated parent block index during a merge.");
-							return CB_BLOCK_STATUS_ERROR;
-						}
-					}
-				}
-			}
-			// Overwrite earliest branch
-			branch = earliestBranch;
-			// Delete work
-			free(self->branches[branch].work.data);
-			// Do not delete from storage as it will get overwritten immediately anyway.
-			// Do not commit here either as the branch needs to be overwritten in order for the database to be consistent.
-		}else{
-			// No overwritting
-			branch = self->numBranches++;
-			// Update number of branches into storage
-			if (NOT CBBlockChainStorageSaveBasicValidator(self)) {
-				CBLogError("Could not write the new number of branches.");
-				return CB_BLOCK_STATUS_ERROR;
-			}
-		}
-		// Initialise minimal data the new branch.
-		// Record parent branch.
-		self->branches[branch].parentBranch = prevBranch;
-		self->branches[branch].parentBlockIndex = prevBlockIndex;
-		// Set retarget time
-		self->branches[branch].lastRetargetTime = self->branches[prevBranch].lastRetargetTime;
-		// Calculate the work
-		self->branches[branch].work.length = self->branches[prevBranch].work.length;
-		self->branches[branch].work.data = malloc(self->branches[branch].work.length);
-		// Copy work over
-		memcpy(self->branches[branch].work.data, self->branches[prevBranch].work.data, self->branches[branch].work.length);
-		// Remove later block work down to the fork
-		for (uint32_t y = prevBlockIndex + 1; y < self->branches[prevBranch].numBlocks; y++) {
-			CBBigInt tempWork;
-			if (NOT CBCalculateBlockWork(&tempWork, prevBlockTarget))
-				return CB_BLOCK_STATUS_ERROR;
-			CBBigIntEqualsSubtractionByBigInt(&self->branches[branch].work, &tempWork);
-			free(tempWork.data); 
-		}
-		// Set the remaining data
-		self->branches[branch].working = false;
-		self->branches[branch].numBlocks = 0;
-		self->branches[branch].lastValidation = CB_NO_VALIDATION;
-		self->branches[branch].startHeight = self->branches[prevBranch].startHeight + prevBlockIndex + 1;
-		// Write branch info
-		if (NOT CBBlockChainStorageSaveBranch(self, branch)) {
-			CBLogError("Could not save new branch data.");
-			return CB_BLOCK_STATUS_ERROR;
-		}
-		// Write branch work
-		if (NOT CBBlockChainStorageSaveBranchWork(self, branch)) {
-			CBLogError("Could not save the new branch's work.");
-			return CB_BLOCK_STATUS_ERROR;
-		}
-	}
-	// Got branch ready for block. Now process into the branch.
-	status = CBFullValidatorProcessIntoBranch(self, block, networkTime, branch, prevBranch, prevBlockIndex, prevBlockTarget);
+	status = CBFullValidatorProcessConnectedBlock(self, block, networkTime, prev);
 	if (status != CB_BLOCK_STATUS_MAIN
 		&& status != CB_BLOCK_STATUS_SIDE)
 		return status;
-	// Now go through any orphans
-	bool first = true;
-	for (uint8_t x = 0; x < self->numOrphans;){
-		if (NOT memcmp(CBBlockGetHash(block), CBByteArrayGetData(self->orphans[x]->prevBlockHash), 32)) {
-			if (first)
-				// Do not release the block passed to this function
-				first = false;
-			else
-				// Release orphan blocks.
-				CBReleaseObject(block);
-			// Moving onto this block.
-			// Get previous block target for orphan.
-			uint32_t target = CBBlockChainStorageGetBlockTarget(self, branch, self->branches[branch].numBlocks - 1);
-			if (NOT target) {
-				CBLogError("Could not get a block target for an orphan.");
-				return CB_BLOCK_STATUS_ERROR;
-			}
-			// Process into the branch.
-			CBBlockStatus orphanStatus = CBFullValidatorProcessIntoBranch(self, self->orphans[x], networkTime, branch, branch, self->branches[branch].numBlocks - 1, target);
-			if (orphanStatus == CB_BLOCK_STATUS_ERROR) {
-				CBLogError("There was an error when processing an orphan into a branch.");
-				return CB_BLOCK_STATUS_ERROR;
-			}
-			// Remove orphan now we are done.
-			self->numOrphans--;
-			if (NOT self->numOrphans){
-				// No more orphans left. End here and release the orphan.
-				CBReleaseObject(self->orphans[x]);
-				break;
-			}
-			// Store orphan as temporary value used for checking the block hash.
-			block = self->orphans[x];
-			if (self->numOrphans > x)
-				// Move orphans down
-				memmove(self->orphans + x, self->orphans + x + 1, sizeof(*self->orphans) * (self->numOrphans - x));
-			// Reset x and set the block as we will now go through the orphans again until no more can be satisfied for this branch.
-			x = 0;
-		}else
-			// Try next orphan
-			x++;
-	}
-	// Finally commit all data
+	// Commit the block before any orphans, so that a bad orphan cannot undo it.
 	if (NOT CBBlockChainStorageCommitData(self->storage)) {
 		CBLogError("Could not commit updated data when adding a new block to the main chain.");
 		return CB_BLOCK_STATUS_ERROR;
 	}
+	// Now go through any orphans
+	if (NOT CBFullValidatorProcessOrphans(self, CBBlockGetHash(block), networkTime))
+		return CB_BLOCK_STATUS_ERROR;
 	return status;
 }
-CBBlockStatus CBFullValidatorProcessIntoBranch(CBFullValidator * self, CBBlock * block, uint64_t networkTime, uint8_t branch, uint8_t prevBranch, uint32_t prevBlockIndex, uint32_t prevBlockTarget){
+CBBlockStatus CBFullValidatorProcessConnectedBlock(CBFullValidator * self, CBBlock * block, uint64_t networkTime, CBHeaderEntry * prev){
 	// Check timestamp
-	if (block->time <= CBFullValidatorGetMedianTime(self, prevBranch, prevBlockIndex)){
+	if (block->time <= CBFullValidatorGetMedianTime(self, prev)){
 		CBBlockChainStorageReset(self->storage);
 		return CB_BLOCK_STATUS_BAD;
 	}
-	uint32_t target;
-	bool change = NOT ((self->branches[prevBranch].startHeight + prevBlockIndex + 1) % 2016);
-	if (change)
-		// Difficulty change for this branch
-		target = CBCalculateTarget(prevBlockTarget, block->time - self->branches[branch].lastRetargetTime);
-	else
-		target = prevBlockTarget;
 	// Check target
-	if (block->target != target){
+	if (block->target != CBFullValidatorGetNextTarget(self, prev)){
+		CBBlockChainStorageReset(self->storage);
+		return CB_BLOCK_STATUS_BAD;
+	}
+	// Check the block is not in place of a checkpoint
+	if (NOT CBFullValidatorCheckpointMatches(self, CBBlockGetHash(block), prev->height + 1)){
 		CBBlockChainStorageReset(self->storage);
 		return CB_BLOCK_STATUS_BAD;
 	}
@@ -641,305 +927,344 @@ CBBlockStatus CBFullValidatorProcessIntoBranch(CBFullValidator * self, CBBlock *
 	CBBigInt work;
 	if (NOT CBCalculateBlockWork(&work, block->target))
 		return CB_BLOCK_STATUS_ERROR;
-	if (NOT CBBigIntEqualsAdditionByBigInt(&work, &self->branches[branch].work))
+	if (NOT CBBigIntEqualsAdditionByBigInt(&work, &prev->work)) {
+		free(work.data);
 		return CB_BLOCK_STATUS_ERROR;
-	if (branch != self->mainBranch) {
-		// Check if the block is adding to a side branch without becoming the main branch
-		if (CBBigIntCompareToBigInt(&work, &self->branches[self->mainBranch].work) != CB_COMPARE_MORE_THAN){
-			// Add to branch without complete validation
-			if (NOT CBFullValidatorAddBlockToBranch(self, branch, block, work))
+	}
+	CBHeaderEntry * oldTip = self->mainTip;
+	if (prev != oldTip) {
+		// Check if the block is adding to a side chain without it becoming the main chain
+		if (CBBigIntCompareToBigInt(&work, &oldTip->work) != CB_COMPARE_MORE_THAN){
+			// Add to the block tree without complete validation
+			if (NOT CBFullValidatorAddBlockToTree(self, block, prev, work))
 				return CB_BLOCK_STATUS_ERROR;
-			return CB_BLOCK_STATUS_SIDE;
-		}
-		// Potential block-chain reorganisation. Validate the side branch. THIS NEEDS TO START AT THE FIRST BRANCH BACK WHERE VALIDATION IS NOT COMPLETE AND GO UP THROUGH THE BLOCKS VALIDATING THEM. Includes Prior Branches!
-		uint8_t tempBranch = prevBranch;
-		CBChainPath chainPathStack[CB_MAX_BRANCH_CACHE]; // Used to store the last blocks in each branch in the potential new path upto the newest branch in the path.
-		uint8_t pathIndex = 0; // The starting index of the path stack. If 0 then we are only validating the branch we added to.
-		// Modify unspent output and transaction indices to start validation.
-		// Make the first last block, the last block in the branch we are validating up-to.
-		chainPathStack[pathIndex].lastBlock = self->branches[prevBranch].numBlocks - 1;
-		// Get all last blocks and next branches for path information
-		while (tempBranch) { // While not the genesis branch
-			// Add path information
-			chainPathStack[pathIndex].branch = tempBranch;
-			chainPathStack[++pathIndex].lastBlock = self->branches[tempBranch].parentBlockIndex;
-			tempBranch = self->branches[tempBranch].parentBranch;
-		}
-		// Add the genesis branch
-		chainPathStack[pathIndex].branch = 0;
-		// Get unspent output index for validating the potential new main chain
-		// Start at the main branch and go backwards until we reach the path of the potential new chain, and thus the fork point.
-		tempBranch = self->mainBranch;
-		// Start at the latest block in the main chain
-		uint32_t tempBlockIndex = self->branches[self->mainBranch].numBlocks - 1;
-		// Go backwards towards fork
-		for (;;) {
-			// See if the main-chain branch we are currently at, is in the chain path for the potetial new chain.
-			bool done = false;
-			for (uint8_t x = pathIndex + 1; x--;) {
-				if (chainPathStack[x].branch == tempBranch) {
-					// The branch for the main-chain path is a branch in the potential new main chain branch path.
-					// Go down to fork point, unless this is the fork point
-					if (tempBlockIndex > chainPathStack[x].lastBlock) {
-						// Above fork point, go down to fork point
-						for (;; tempBlockIndex--) {
-							// Change unspent output and transaction information, as going backwards through the main-chain.
-							if (NOT CBFullValidatorUpdateUnspentOutputsAndLoad(self, tempBranch, tempBlockIndex, false)){
-								CBLogError("Could not reverse indicies for unspent outputs and transactions during reorganisation.");
-								return CB_BLOCK_STATUS_ERROR;
-							}
-							// Break before tempBlockIndex becomes the last block. We only want to remove everything over the last block in the potential new chain path branch. And we want tempBlockIndex to equal the block above the last block.
-							if (tempBlockIndex == chainPathStack[x].lastBlock + 1)
-								break;
-						}
-					}
-					// We have gone down to the fork point, so we are done.
-					done = true;
-					// Set the path index of the fork point.
-					pathIndex = x;
-					break;
-				}
-			}
-			if (done)
-				// If done, exit now and do not go to the next branch
-				break;
-			// We need to go down to next branch, to see if that is included in the potential new chain.
-			// Update information for all the blocks in the branch
-			for (tempBlockIndex++; tempBlockIndex--;) {
-				// Change unspent output and transaction information, going backwards.
-				if (NOT CBFullValidatorUpdateUnspentOutputsAndLoad(self, tempBranch, tempBlockIndex, false)){
-					CBLogError("Could not reverse indicies for unspent outputs and transactions during reorganisation.");
-					return CB_BLOCK_STATUS_ERROR;
-				}
-			}
-			// Go down a branch
-			tempBlockIndex = self->branches[tempBranch].parentBlockIndex;
-			tempBranch = self->branches[tempBranch].parentBranch;
-		}
-		// Go upwards to last validation point in new chain path. Then we need to start validating for the potential new chain.
-		for (;; pathIndex--) {
-			// See if the last block in the path branch is higher or equal to the last validation point. In this case we go to the validation point and end there.
-			if (chainPathStack[pathIndex].lastBlock >= self->branches[chainPathStack[pathIndex].branch].lastValidation) {
-				// Go up to last validation point, updating unspent output and transaction information.
-				for (;tempBlockIndex <= self->branches[chainPathStack[pathIndex].branch].lastValidation; tempBlockIndex++) {
-					if (NOT CBFullValidatorUpdateUnspentOutputsAndLoad(self, chainPathStack[pathIndex].branch, tempBlockIndex, true)){
-						CBLogError("Could not update indicies for going to a previously validated point during reorganisation.");
-						return CB_BLOCK_STATUS_ERROR;
-					}
-				}
-				break;
-			}else if (self->branches[chainPathStack[pathIndex].branch].lastValidation != CB_NO_VALIDATION){
-				// The branch is validated enough to reach the last block. Go up to last block, updating unspent output and transaction information.
-				for (;tempBlockIndex <= chainPathStack[pathIndex].lastBlock; tempBlockIndex++) {
-					if (NOT CBFullValidatorUpdateUnspentOutputsAndLoad(self, chainPathStack[pathIndex].branch, tempBlockIndex, true)){
-						CBLogError("Could not update indicies for going to the last block for a path during reorganisation.");
-						return CB_BLOCK_STATUS_ERROR;
-					}
-				}
-				// If the pathIndex is to the last branch, we can end here.
-				if (NOT pathIndex)
-					// Done
-					break;
-				// Reset block index for next branch
-				tempBlockIndex = 0;
-			}else
-				// This is the block we should start at, as no validation has been done on this branch.
-				break;
-		}
-		// At this point tempBlockIndex is the block we start at and chainPathStack[pathIndex].branch is the branch.
-		// Now validate all blocks going up.
-		bool atLeastOne = false; // True when at least one block passed validation for a branch
-		tempBranch = chainPathStack[pathIndex].branch;
-		// Saving the first branch for updating last validated blocks.
-		uint8_t branches = 1 << tempBranch;
-		// Loop through blocks unless we have reached the newest block already.
-		if (tempBlockIndex < self->branches[branch].numBlocks || tempBranch != branch){
-			for (;;) {
-				// Get block to validate
-				CBBlock * tempBlock = CBBlockChainStorageLoadBlock(self, tempBlockIndex, tempBranch);
-				if (NOT tempBlock)
-					return CB_BLOCK_STATUS_ERROR;
-				if (NOT CBBlockDeserialise(tempBlock, true))
-					return CB_BLOCK_STATUS_ERROR;
-				// Validate block
-				CBBlockValidationResult res = CBFullValidatorCompleteBlockValidation(self, tempBranch, tempBlock, self->branches[tempBranch].startHeight + tempBlockIndex);
-				if (res == CB_BLOCK_VALIDATION_BAD
-					|| res == CB_BLOCK_VALIDATION_ERR){
-					CBReleaseObject(tempBlock);
-					// Clear IO operations, thus reverting to previous main-chain.
-					CBBlockChainStorageReset(self->storage);
-					if (res == CB_BLOCK_VALIDATION_BAD) {
-						// Save last valided blocks for each branch
-						if (NOT CBFullValidatorSaveLastValidatedBlocks(self, branches)) {
-							CBLogError("Could not save the last validated blocks for a validatation error during reorganisation");
-							return CB_BLOCK_STATUS_ERROR;
-						}
-						if (NOT CBBlockChainStorageCommitData(self->storage)) {
-							CBLogError("Could not commit the last validated block for a validatation error during reorganisation.");
-							return CB_BLOCK_STATUS_ERROR;
-						}
-					}
-					if (res == CB_BLOCK_VALIDATION_BAD)
-						return CB_BLOCK_STATUS_BAD;
-					if (res == CB_BLOCK_VALIDATION_ERR)
-						return CB_BLOCK_STATUS_ERROR;
-				}
-				// Update the validation information, if this block is the latest validated.
-				if (tempBlockIndex > self->branches[tempBranch].lastValidation
-					|| self->branches[tempBranch].lastValidation == CB_NO_VALIDATION){
-					self->branches[tempBranch].lastValidation = tempBlockIndex;
-					if (NOT atLeastOne){
-						// Add this branch to be updated
-						branches |= 1 << tempBranch;
-						atLeastOne = true;
-					}
-				}
-				// This block passed validation. Move onto next block.
-				if (tempBlockIndex == chainPathStack[pathIndex].lastBlock) {
-					// We came to the last block in the branch for the potential new chain.
-					// Check if last block
-					if (tempBlockIndex == self->branches[branch].numBlocks - 1 && tempBranch == branch)
-						break;
-					// Go to next branch
-					tempBranch = chainPathStack[--pathIndex].branch;
-					tempBlockIndex = 0;
-					atLeastOne = false;
-				}else
-					// We have not reached the end of this branch for the chain yet. Thus move to the next block in the branch.
-					tempBlockIndex++;
-				// We are done with the block.
-				CBReleaseObject(tempBlock);
-			}
-			// Save last validated blocks
-			if (NOT CBFullValidatorSaveLastValidatedBlocks(self, branches)) {
-				CBLogError("Could not save the last validated blocks during reorganisation");
+			if (NOT CBBlockChainStorageSaveBasicValidator(self)) {
+				CBLogError("Could not save the next block ID when adding a side chain block.");
 				return CB_BLOCK_STATUS_ERROR;
 			}
+			return CB_BLOCK_STATUS_SIDE;
+		}
+		// Reorganise to the previous block, and then validate the new block on top of it.
+		CBBlockValidationResult res = CBFullValidatorReorganise(self, prev);
+		if (res != CB_BLOCK_VALIDATION_OK) {
+			free(work.data);
+			// Clear IO operations, thus reverting to previous main chain.
+			CBBlockChainStorageReset(self->storage);
+			return res == CB_BLOCK_VALIDATION_BAD ? CB_BLOCK_STATUS_BAD : CB_BLOCK_STATUS_ERROR;
 		}
-		// We are done with the reorganisation. Now we validate the block for the new main chain.
 	}
 	// Validate a new block for the main chain.
-	CBBlockValidationResult res = CBFullValidatorCompleteBlockValidation(self, branch, block, self->branches[branch].startHeight + self->branches[branch].numBlocks);
-	// If the validation was bad then reset the pending IO and return.
-	if (res == CB_BLOCK_VALIDATION_BAD) {
+	CBBlockValidationResult res = CBFullValidatorPrefetchUnspentOutputs(self, block) ? CBFullValidatorCompleteBlockValidation(self, block, prev->height + 1) : CB_BLOCK_VALIDATION_ERR;
+	if (res != CB_BLOCK_VALIDATION_OK) {
+		free(work.data);
+		// Reset the pending IO and go back to the previous main chain if there was a reorganisation.
 		CBBlockChainStorageReset(self->storage);
-		return CB_BLOCK_STATUS_BAD;
+		if (prev != oldTip && NOT CBFullValidatorSetMainTip(self, oldTip))
+			return CB_BLOCK_STATUS_ERROR;
+		return res == CB_BLOCK_VALIDATION_BAD ? CB_BLOCK_STATUS_BAD : CB_BLOCK_STATUS_ERROR;
 	}
-	if (res == CB_BLOCK_VALIDATION_ERR)
+	// Everything is OK so add the block and update the unspent outputs.
+	CBHeaderEntry * entry = CBFullValidatorAddBlockToTree(self, block, prev, work);
+	if (NOT entry){
+		CBLogError("There was an error when adding a new block to the block tree.");
 		return CB_BLOCK_STATUS_ERROR;
-	// Everything is OK so update branch and unspent outputs.
-	if (NOT CBFullValidatorAddBlockToBranch(self, branch, block, work)){
-		CBLogError("There was an error when adding a new block to the branch.");
+	}
+	if (NOT CBFullValidatorUpdateUnspentOutputsForward(self, block, entry)) {
+		CBLogError("Could not update the unspent outputs when adding a block to the main chain.");
 		return CB_BLOCK_STATUS_ERROR;
 	}
-	self->branches[branch].lastValidation = self->branches[branch].numBlocks - 1;
-	// Update storage
-	if (NOT CBBlockChainStorageSaveBranch(self, branch)) {
-		CBLogError("Could not save the last validated block for a branch when adding a new block to the main chain.");
+	entry->flags |= CB_HEADER_VALIDATED;
+	if (NOT CBFullValidatorSetMainTip(self, entry))
+		return CB_BLOCK_STATUS_ERROR;
+	if (NOT CBBlockChainStorageSaveBasicValidator(self)) {
+		CBLogError("Could not save the new main chain tip when adding a new block to the main chain.");
 		return CB_BLOCK_STATUS_ERROR;
 	}
-	if (branch != self->mainBranch) {
-		// Update main branch
-		self->mainBranch = branch;
-		if (NOT CBBlockChainStorageSaveBasicValidator(self)) {
-			CBLogError("Could not save the new main branch when adding a new block to the main chain.");
-			return CB_BLOCK_STATUS_ERROR;
-		}
+	// Remove side chains which have fallen too far behind.
+	if (NOT CBFullValidatorPrune(self)) {
+		CBLogError("Could not prune the stale side chains.");
+		return CB_BLOCK_STATUS_ERROR;
 	}
-	// Update the unspent output indicies.
-	if (NOT CBFullValidatorUpdateUnspentOutputsForward(self, block, branch, self->branches[branch].lastValidation)) {
-		CBLogError("Could not update the unspent outputs when adding a block to the main chain.");
+	if (NOT CBFullValidatorPruneBlocks(self)) {
+		CBLogError("Could not prune the old main chain blocks.");
 		return CB_BLOCK_STATUS_ERROR;
 	}
 	return CB_BLOCK_STATUS_MAIN;
 }
-bool CBFullValidatorSaveLastValidatedBlocks(CBFullValidator * self, uint8_t branches){
-	for (uint8_t x = 0; x < 5; x++) {
-		if (branches & (1 << x)
-			&& NOT CBBlockChainStorageSaveBranch(self, x)) {
-			CBLogError("Could not save the last validated block for a branch.");
+bool CBFullValidatorProcessOrphans(CBFullValidator * self, uint8_t * hash, uint64_t networkTime){
+	// Depth first, so the orphans waiting for a connected orphan go in before its siblings.
+	CBOrphan * stack = CBFullValidatorTakeOrphans(self, hash);
+	while (stack) {
+		CBOrphan * orphan = stack;
+		stack = orphan->nextSibling;
+		CBHeaderEntry * prev = CBFullValidatorFindHeader(self, orphan->prevHash);
+		if (NOT prev) {
+			CBLogError("Could not find the previous block for an orphan.");
+			stack = orphan;
+			break;
+		}
+		CBBlockStatus status = CBFullValidatorProcessConnectedBlock(self, orphan->block, networkTime, prev);
+		if (status == CB_BLOCK_STATUS_ERROR) {
+			CBLogError("There was an error when processing an orphan into the block tree.");
+			stack = orphan;
+			break;
+		}
+		if (status == CB_BLOCK_STATUS_MAIN
+			|| status == CB_BLOCK_STATUS_SIDE) {
+			if (NOT CBBlockChainStorageCommitData(self->storage)) {
+				CBLogError("Could not commit updated data when adding an orphan.");
+				stack = orphan;
+				break;
+			}
+			self->orphansConnected++;
+			// Put the orphans waiting for this one on top of the stack.
+			CBOrphan * children = CBFullValidatorTakeOrphans(self, orphan->hash);
+			if (children) {
+				CBOrphan * last = children;
+				while (last->nextSibling)
+					last = last->nextSibling;
+				last->nextSibling = stack;
+				stack = children;
+			}
+		}
+		// Orphans waiting for a bad orphan stay until they are evicted.
+		CBFreeOrphan(orphan);
+	}
+	if (NOT stack)
+		return true;
+	// Free what is left after an error, including the orphan which failed.
+	while (stack) {
+		CBOrphan * orphan = stack;
+		stack = orphan->nextSibling;
+		CBFreeOrphan(orphan);
+	}
+	return false;
+}
+bool CBFullValidatorPrune(CBFullValidator * self){
+	if (self->mainTip->height <= self->staleForkDepth)
+		return true;
+	// Keep the side chain blocks near the tip and the side chain blocks they build upon.
+	for (uint32_t x = 0; x < self->numSideHeaders; x++) {
+		if (self->sideHeaders[x]->height + self->staleForkDepth < self->mainTip->height)
+			continue;
+		for (CBHeaderEntry * entry = self->sideHeaders[x];
+			 NOT (entry->flags & CB_HEADER_KEEP) && NOT CBFullValidatorIsMainChain(self, entry);
+			 entry = entry->prev)
+			entry->flags |= CB_HEADER_KEEP;
+	}
+	// Delete everything else
+	for (uint32_t x = 0; x < self->numSideHeaders;) {
+		CBHeaderEntry * entry = self->sideHeaders[x];
+		if (entry->flags & CB_HEADER_KEEP) {
+			entry->flags &= ~CB_HEADER_KEEP;
+			x++;
+			continue;
+		}
+		self->blockBytes -= CBBlockChainStorageBlockSize(self, entry->blockID);
+		if (NOT CBBlockChainStorageDeleteBlock(self, entry->blockID)) {
+			CBLogError("Could not delete a stale side chain block.");
 			return false;
 		}
+		self->sideHeaders[x] = self->sideHeaders[--self->numSideHeaders];
+		CBAssociativeArrayDelete(&self->headers, CBAssociativeArrayFind(&self->headers, entry).position, true);
 	}
 	return true;
 }
-bool CBFullValidatorUpdateUnspentOutputsBackward(CBFullValidator * self, CBBlock * block, uint8_t branch, uint32_t blockIndex){
-	// Update unspent outputs... Go through transactions, adding the prevOut references and removing the outputs for one transaction at a time.
-	uint8_t * txReadData = NULL;
-	uint32_t txReadDataSize = 0;
-	for (uint32_t x = block->transactionNum; x--;) {
-		// Remove transaction from transaction index.
-		uint8_t * txHash = CBTransactionGetHash(block->transactions[x]);
-		if (NOT CBBlockChainStorageDeleteTransactionRef(self, txHash)) {
-			CBLogError("Could not remove transaction reference from the transaction index.");
-			free(txReadData);
+bool CBFullValidatorPruneBlocks(CBFullValidator * self){
+	if (NOT self->pruneDepth)
+		return true;
+	for (; self->pruneHeight + self->pruneDepth < self->mainTip->height; self->pruneHeight++) {
+		if (self->pruneBudget && self->blockBytes <= self->pruneBudget)
+			break;
+		CBHeaderEntry * entry = self->mainChain[self->pruneHeight];
+		uint32_t size = CBBlockChainStorageBlockSize(self, entry->blockID);
+		if (NOT CBBlockChainStoragePruneBlock(self, entry->blockID)) {
+			CBLogError("Could not prune the block at height %u.", self->pruneHeight);
 			return false;
 		}
-		// Loop thorugh inputs
+		self->blockBytes -= size;
+		entry->flags |= CB_HEADER_PRUNED;
+	}
+	return true;
+}
+CBBlockValidationResult CBFullValidatorReorganise(CBFullValidator * self, CBHeaderEntry * newTip){
+	// Find the fork point
+	CBHeaderEntry * fork = newTip;
+	while (NOT CBFullValidatorIsMainChain(self, fork))
+		fork = fork->prev;
+	if (fork->height + 1 < self->pruneHeight) {
+		CBLogError("Cannot reorganise to a chain which forks below the pruned blocks.");
+		return CB_BLOCK_VALIDATION_ERR;
+	}
+	// Go backwards through the main chain to the fork point
+	for (uint32_t x = self->mainTip->height; x > fork->height; x--) {
+		if (NOT CBFullValidatorUpdateUnspentOutputsAndLoad(self, self->mainChain[x], false)){
+			CBLogError("Could not reverse indicies for unspent outputs and transactions during reorganisation.");
+			return CB_BLOCK_VALIDATION_ERR;
+		}
+	}
+	// Get the path from the fork point to the new tip
+	uint32_t pathLen = newTip->height - fork->height;
+	CBHeaderEntry ** path = malloc(pathLen * sizeof(*path));
+	if (NOT path) {
+		CBLogError("Could not allocate %i bytes of memory for the reorganisation path.", pathLen * sizeof(*path));
+		return CB_BLOCK_VALIDATION_ERR;
+	}
+	uint32_t x = pathLen;
+	for (CBHeaderEntry * entry = newTip; entry != fork; entry = entry->prev)
+		path[--x] = entry;
+	// Go up the path, validating blocks which have not been validated before.
+	for (; x < pathLen; x++) {
+		if (path[x]->flags & CB_HEADER_VALIDATED) {
+			if (NOT CBFullValidatorUpdateUnspentOutputsAndLoad(self, path[x], true)){
+				CBLogError("Could not update indicies for going to a previously validated block during reorganisation.");
+				free(path);
+				return CB_BLOCK_VALIDATION_ERR;
+			}
+			continue;
+		}
+		CBBlock * block = CBBlockChainStorageLoadBlock(self, path[x]->blockID);
+		if (NOT block) {
+			free(path);
+			return CB_BLOCK_VALIDATION_ERR;
+		}
+		if (NOT CBBlockDeserialise(block, true)) {
+			CBReleaseObject(block);
+			free(path);
+			return CB_BLOCK_VALIDATION_ERR;
+		}
+		CBBlockValidationResult res = CBFullValidatorPrefetchUnspentOutputs(self, block) ? CBFullValidatorCompleteBlockValidation(self, block, path[x]->height) : CB_BLOCK_VALIDATION_ERR;
+		if (res != CB_BLOCK_VALIDATION_OK) {
+			CBReleaseObject(block);
+			free(path);
+			return res;
+		}
+		if (NOT CBFullValidatorUpdateUnspentOutputsForward(self, block, path[x])) {
+			CBLogError("Could not update indicies for a validated block during reorganisation.");
+			CBReleaseObject(block);
+			free(path);
+			return CB_BLOCK_VALIDATION_ERR;
+		}
+		CBReleaseObject(block);
+		path[x]->flags |= CB_HEADER_VALIDATED;
+	}
+	free(path);
+	if (NOT CBFullValidatorSetMainTip(self, newTip))
+		return CB_BLOCK_VALIDATION_ERR;
+	return CB_BLOCK_VALIDATION_OK;
+}
+// Restores the outputs spent by a block by finding them in the blocks they were created in, for blocks connected before undo data was stored.
+static bool CBFullValidatorRestoreSpentOutputsFromBlocks(CBFullValidator * self, CBBlock * block){
+	uint8_t * txReadData = NULL;
+	uint32_t txReadDataSize = 0;
+	// Only non-coinbase transactions contain prevOut references in inputs.
+	for (uint32_t x = block->transactionNum; x-- > 1;) {
 		for (uint32_t y = block->transactions[x]->inputNum; y--;) {
-			if (x) {
-				// Only non-coinbase transactions contain prevOut references in inputs.
-				uint8_t * prevTxHash = CBByteArrayGetData(block->transactions[x]->inputs[y]->prevOut.hash);
-				uint32_t outputIndex = block->transactions[x]->inputs[y]->prevOut.index;
-				// Add to storage
-				// Read transaction outputs from the block
-				uint32_t outputsPos;
-				if (NOT CBBlockChainStorageLoadOutputs(self, prevTxHash, &txReadData, &txReadDataSize, &outputsPos)) {
-					CBLogError("Could not load a transaction's outputs for re-organisation.");
-					free(txReadData);
-					return false;
-				}
-				// Find the position of the output by looping through outputs
-				uint32_t txCursor = 0;
-				for (uint32_t z = block->transactions[x]->inputs[y]->prevOut.index; z--;) {
-					// Add 8 for value
-					txCursor += 8;
-					// Add script value
-					if (txReadData[txCursor] < 253)
-						txCursor += 1 + txReadData[txCursor];
-					else if (txReadData[txCursor] == 253)
-						txCursor += 3 + CBArrayToInt16(txReadData, txCursor + 1);
-					else if (txReadData[txCursor] == 254)
-						txCursor += 5 + CBArrayToInt32(txReadData, txCursor + 1);
-					else if (txReadData[txCursor] == 255)
-						txCursor += 9 + CBArrayToInt64(txReadData, txCursor + 1);
-				}
-				// Add the posiion within the outputs to the start of the outputs.
-				outputsPos += txCursor;
-				// Get length
-				uint32_t outputLen = 8;
+			uint8_t * prevTxHash = CBByteArrayGetData(block->transactions[x]->inputs[y]->prevOut.hash);
+			uint32_t outputIndex = block->transactions[x]->inputs[y]->prevOut.index;
+			// Read transaction outputs from the block
+			uint32_t outputsPos, height;
+			bool coinbase;
+			if (NOT CBBlockChainStorageLoadOutputs(self, prevTxHash, &txReadData, &txReadDataSize, &outputsPos, &height, &coinbase)) {
+				CBLogError("Could not load a transaction's outputs for re-organisation.");
+				free(txReadData);
+				return false;
+			}
+			// Find the position of the output by looping through outputs
+			uint32_t txCursor = 0;
+			for (uint32_t z = block->transactions[x]->inputs[y]->prevOut.index; z--;) {
+				// Add 8 for value
+				txCursor += 8;
+				// Add script value
 				if (txReadData[txCursor] < 253)
-					outputLen += 1 + txReadData[txCursor];
+					txCursor += 1 + txReadData[txCursor];
 				else if (txReadData[txCursor] == 253)
-					outputLen += 3 + CBArrayToInt16(txReadData, txCursor + 1);
+					txCursor += 3 + CBArrayToInt16(txReadData, txCursor + 1);
 				else if (txReadData[txCursor] == 254)
-					outputLen += 5 + CBArrayToInt32(txReadData, txCursor + 1);
+					txCursor += 5 + CBArrayToInt32(txReadData, txCursor + 1);
 				else if (txReadData[txCursor] == 255)
-					outputLen += 9 + CBArrayToInt64(txReadData, txCursor + 1);
-				// Save unspent output
-				if (NOT CBBlockChainStorageSaveUnspentOutput(self, prevTxHash, outputIndex, outputsPos, outputLen, true)) {
-					CBLogError("Could not save an unspent output reference when going backwards during re-organisation.");
-					free(txReadData);
-					return false;
-				}
+					txCursor += 9 + CBArrayToInt64(txReadData, txCursor + 1);
+			}
+			// Get length
+			uint32_t outputLen = 8;
+			if (txReadData[txCursor + 8] < 253)
+				outputLen += 1 + txReadData[txCursor + 8];
+			else if (txReadData[txCursor + 8] == 253)
+				outputLen += 3 + CBArrayToInt16(txReadData, txCursor + 9);
+			else if (txReadData[txCursor + 8] == 254)
+				outputLen += 5 + CBArrayToInt32(txReadData, txCursor + 9);
+			else if (txReadData[txCursor + 8] == 255)
+				outputLen += 9 + CBArrayToInt64(txReadData, txCursor + 9);
+			// Recreate the output for the unspent output record
+			CBByteArray * outputBytes = CBNewByteArrayWithDataCopy(txReadData + txCursor, outputLen);
+			CBTransactionOutput * output = outputBytes ? CBNewTransactionOutputFromData(outputBytes) : NULL;
+			if (outputBytes)
+				CBReleaseObject(outputBytes);
+			if (NOT output || NOT CBTransactionOutputDeserialise(output)) {
+				CBLogError("Could not read an output when going backwards during re-organisation.");
+				if (output)
+					CBReleaseObject(output);
+				free(txReadData);
+				return false;
+			}
+			// Save unspent output
+			bool saved = CBBlockChainStorageSaveUnspentOutput(self, prevTxHash, outputIndex, output, height, coinbase);
+			CBReleaseObject(output);
+			if (NOT saved) {
+				CBLogError("Could not save an unspent output when going backwards during re-organisation.");
+				free(txReadData);
+				return false;
 			}
 		}
+	}
+	// Free transaction read memory.
+	free(txReadData);
+	return true;
+}
+bool CBFullValidatorUpdateUnspentOutputsBackward(CBFullValidator * self, CBBlock * block, CBHeaderEntry * entry){
+	// Restore the outputs spent by the block first, so that outputs spent within the block are removed with the rest of their transaction's outputs.
+	if (CBBlockChainStorageUndoExists(self, entry->blockID)) {
+		if (NOT CBBlockChainStorageRestoreUndo(self, entry->blockID)) {
+			CBLogError("Could not restore the outputs spent by a block from undo data.");
+			return false;
+		}
+	}else if (NOT (self->flags & CB_FULL_VALIDATOR_TRANSACTION_INDEX)) {
+		CBLogError("A block without undo data cannot be removed from the main chain without the transaction index.");
+		return false;
+	}else if (NOT CBFullValidatorRestoreSpentOutputsFromBlocks(self, block))
+		return false;
+	// Go through transactions, removing the outputs and the transaction references.
+	for (uint32_t x = block->transactionNum; x--;) {
+		// Remove transaction from transaction index.
+		uint8_t * txHash = CBTransactionGetHash(block->transactions[x]);
+		if (self->flags & CB_FULL_VALIDATOR_TRANSACTION_INDEX
+			&& NOT CBBlockChainStorageDeleteTransactionRef(self, txHash, entry->blockID)) {
+			CBLogError("Could not remove transaction reference from the transaction index.");
+			return false;
+		}
 		// Loop through outputs
 		for (uint32_t y = block->transactions[x]->outputNum; y--;) {
 			// Remove output from storage
-			if (NOT CBBlockChainStorageDeleteUnspentOutput(self, txHash, y, false)) {
+			if (NOT CBBlockChainStorageDeleteUnspentOutput(self, txHash, y)) {
 				CBLogError("Could not remove unspent output reference during re-organisation.");
-				free(txReadData);
 				return false;
 			}
 		}
 	}
-	// Free transaction read memory.
-	free(txReadData);
 	return true;
 }
-bool CBFullValidatorUpdateUnspentOutputsForward(CBFullValidator * self, CBBlock * block, uint8_t branch, uint32_t blockIndex){
-	// Update unspent outputs... Go through transactions, removing the prevOut references and adding the outputs for one transaction at a time.
+bool CBFullValidatorUpdateUnspentOutputsForward(CBFullValidator * self, CBBlock * block, CBHeaderEntry * entry){
+	// Collect the outputs spent and created by the block, to be sorted and given to the storage together.
+	// The spent outputs are kept as undo data for removing the block from the main chain.
+	uint32_t numChanges = 0;
+	for (uint32_t x = 0; x < block->transactionNum; x++)
+		numChanges += (x ? block->transactions[x]->inputNum : 0) + block->transactions[x]->outputNum;
+	CBUnspentOutputChange * changes = malloc(sizeof(*changes) * (numChanges ? numChanges : 1));
+	if (NOT changes) {
+		CBLogError("Could not allocate memory for the unspent output changes of a block.");
+		return false;
+	}
+	CBUnspentOutputChange * change = changes;
 	uint32_t cursor = 80; // Cursor to find output positions.
 	uint8_t byte = CBByteArrayGetByte(CBGetMessage(block)->bytes, 80);
 	cursor += byte < 253 ? 1 : (byte == 253 ? 3 : (byte == 254 ? 5 : 9));
@@ -949,17 +1274,15 @@ bool CBFullValidatorUpdateUnspentOutputsForward(CBFullValidator * self, CBBlock
 		// Move along input number
 		byte = CBByteArrayGetByte(CBGetMessage(block)->bytes, cursor);
 		cursor += byte < 253 ? 1 : (byte == 253 ? 3 : (byte == 254 ? 5 : 9));
-		// First remove output references than add new outputs.
+		// Collect the spent outputs, then the new outputs.
 		for (uint32_t y = 0; y < block->transactions[x]->inputNum; y++) {
 			if (x) {
 				// Only non-coinbase transactions contain prevOut references in inputs.
-				uint8_t * txHash = CBByteArrayGetData(block->transactions[x]->inputs[y]->prevOut.hash);
-				uint32_t outputIndex = block->transactions[x]->inputs[y]->prevOut.index;
-				// Remove output
-				if (NOT CBBlockChainStorageDeleteUnspentOutput(self, txHash, outputIndex, true)) {
-					CBLogError("Could not remove an output as unspent.");
-					return false;
-				}
+				memcpy(change->key, CBByteArrayGetData(block->transactions[x]->inputs[y]->prevOut.hash), 32);
+				CBInt32ToArray(change->key, 32, block->transactions[x]->inputs[y]->prevOut.index);
+				change->output = NULL;
+				change->cancelled = false;
+				change++;
 			}
 			// Move cursor along script varint. We look at byte data in case it is longer than needed.
 			cursor += CBTransactionInputCalculateLength(block->transactions[x]->inputs[y]);
@@ -972,29 +1295,46 @@ bool CBFullValidatorUpdateUnspentOutputsForward(CBFullValidator * self, CBBlock
 		// For adding the size of outputs
 		uint32_t outputsPos = cursor;
 		for (uint32_t y = 0; y < block->transactions[x]->outputNum; y++) {
-			// Add to storage.
-			if (NOT CBBlockChainStorageSaveUnspentOutput(self, txHash, y, cursor, 
-														 CBGetMessage(block->transactions[x]->outputs[y])->bytes->length, false)) {
-				CBLogError("Could not write a new unspent output reference.");
-				return false;
-			}
+			memcpy(change->key, txHash, 32);
+			CBInt32ToArray(change->key, 32, y);
+			change->output = block->transactions[x]->outputs[y];
+			change->coinbase = x == 0;
+			change->cancelled = false;
+			change++;
 			// Move cursor past the output
 			cursor += CBTransactionOutputCalculateLength(block->transactions[x]->outputs[y]);
 		}
 		// Add transaction to transaction index
-		if (NOT CBBlockChainStorageSaveTransactionRef(self, txHash, branch, blockIndex, outputsPos, cursor - outputsPos, 
-													  x == 0, block->transactions[x]->outputNum)) {
+		if (self->flags & CB_FULL_VALIDATOR_TRANSACTION_INDEX
+			&& NOT CBBlockChainStorageSaveTransactionRef(self, txHash, entry->blockID, entry->height, outputsPos, cursor - outputsPos, x == 0)) {
 			CBLogError("Could not write transaction reference to transaction index.");
+			free(changes);
 			return false;
 		}
 		// Move along locktime
 		cursor += 4;
 	}
-	return true;
+	// Sort the changes into the order of the storage. An output created and spent by the block is then followed by its spend, and neither needs storing.
+	qsort(changes, numChanges, sizeof(*changes), CBUnspentOutputChangeCompare);
+	for (uint32_t x = 1; x < numChanges; x++)
+		if (NOT changes[x].output && changes[x - 1].output
+			&& NOT memcmp(changes[x].key, changes[x - 1].key, 36))
+			changes[x].cancelled = changes[x - 1].cancelled = true;
+	uint8_t * undo = NULL;
+	uint32_t undoLength = 0;
+	uint32_t undoAllocSize = 0;
+	bool saved = CBBlockChainStorageApplyUnspentOutputChanges(self, changes, numChanges, entry->height, &undo, &undoLength, &undoAllocSize);
+	free(changes);
+	if (NOT saved)
+		CBLogError("Could not apply the changes to the unspent outputs for a block.");
+	else if (NOT (saved = CBBlockChainStorageSaveUndo(self, entry->blockID, undo, undoLength)))
+		CBLogError("Could not save the undo data for a block.");
+	free(undo);
+	return saved;
 }
-bool CBFullValidatorUpdateUnspentOutputsAndLoad(CBFullValidator * self, uint8_t branch, uint32_t blockIndex, bool forward){
+bool CBFullValidatorUpdateUnspentOutputsAndLoad(CBFullValidator * self, CBHeaderEntry * entry, bool forward){
 	// Load the block
-	CBBlock * block = CBBlockChainStorageLoadBlock(self, blockIndex, branch);
+	CBBlock * block = CBBlockChainStorageLoadBlock(self, entry->blockID);
 	if (NOT block) {
 		CBReleaseObject(block);
 		CBLogError("Could not deserailise a block for re-organisation.");
@@ -1008,9 +1348,9 @@ bool CBFullValidatorUpdateUnspentOutputsAndLoad(CBFullValidator * self, uint8_t
 	// Update indices going backwards
 	bool res;
 	if (forward)
-		res = CBFullValidatorUpdateUnspentOutputsForward(self, block, branch, blockIndex);
+		res = CBFullValidatorUpdateUnspentOutputsForward(self, block, entry);
 	else
-		res = CBFullValidatorUpdateUnspentOutputsBackward(self, block, branch, blockIndex);
+		res = CBFullValidatorUpdateUnspentOutputsBackward(self, block, entry);
 	if (NOT res)
 		CBLogError("Could not update the unspent outputs and transaction indices.");
 	// Free the block
@@ -27,7 +27,7 @@
 //  Constructors
 
 CBGetBlocks * CBNewGetBlocks(uint32_t version, CBChainDescriptor * chainDescriptor, CBByteArray * stopAtHash){
-	CBGetBlocks * self = malloc(sizeof(*self));
+	CBGetBlocks * self = CBAllocObject(sizeof(*self));
 	if (NOT self) {
 		CBLogError("Cannot allocate %i bytes of memory in CBNewGetBlocks\n", sizeof(*self));
 		return NULL;
@@ -35,11 +35,11 @@ CBGetBlocks * CBNewGetBlocks(uint32_t version, CBChainDescriptor * chainDescript
 	CBGetObject(self)->free = CBFreeGetBlocks;
 	if(CBInitGetBlocks(self, version, chainDescriptor, stopAtHash))
 		return self;
-	free(self);
+	CBDeallocObject(self);
 	return NULL;
 }
 CBGetBlocks * CBNewGetBlocksFromData(CBByteArray * data){
-	CBGetBlocks * self = malloc(sizeof(*self));
+	CBGetBlocks * self = CBAllocObject(sizeof(*self));
 	if (NOT self) {
 		CBLogError("Cannot allocate %i bytes of memory in CBNewGetBlocksFromData\n", sizeof(*self));
 		return NULL;
@@ -47,7 +47,7 @@ CBGetBlocks * CBNewGetBlocksFromData(CBByteArray * data){
 	CBGetObject(self)->free = CBFreeGetBlocks;
 	if(CBInitGetBlocksFromData(self, data))
 		return self;
-	free(self);
+	CBDeallocObject(self);
 	return NULL;
 }
 
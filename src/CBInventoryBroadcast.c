@@ -27,7 +27,7 @@
 //  Constructors
 
 CBInventoryBroadcast * CBNewInventoryBroadcast(){
-	CBInventoryBroadcast * self = malloc(sizeof(*self));
+	CBInventoryBroadcast * self = CBAllocObject(sizeof(*self));
 	if (NOT self) {
 		CBLogError("Cannot allocate %i bytes of memory in CBNewInventoryBroadcast\n", sizeof(*self));
 		return NULL;
@@ -35,11 +35,11 @@ CBInventoryBroadcast * CBNewInventoryBroadcast(){
 	CBGetObject(self)->free = CBFreeInventoryBroadcast;
 	if(CBInitInventoryBroadcast(self))
 		return self;
-	free(self);
+	CBDeallocObject(self);
 	return NULL;
 }
 CBInventoryBroadcast * CBNewInventoryBroadcastFromData(CBByteArray * data){
-	CBInventoryBroadcast * self = malloc(sizeof(*self));
+	CBInventoryBroadcast * self = CBAllocObject(sizeof(*self));
 	if (NOT self) {
 		CBLogError("Cannot allocate %i bytes of memory in CBNewInventoryBroadcastFromData\n", sizeof(*self));
 		return NULL;
@@ -47,7 +47,7 @@ CBInventoryBroadcast * CBNewInventoryBroadcastFromData(CBByteArray * data){
 	CBGetObject(self)->free = CBFreeInventoryBroadcast;
 	if(CBInitInventoryBroadcastFromData(self, data))
 		return self;
-	free(self);
+	CBDeallocObject(self);
 	return NULL;
 }
 
@@ -27,7 +27,7 @@
 //  Constructors
 
 CBInventoryItem * CBNewInventoryItem(CBInventoryItemType type, CBByteArray * hash){
-	CBInventoryItem * self = malloc(sizeof(*self));
+	CBInventoryItem * self = CBAllocObject(sizeof(*self));
 	if (NOT self) {
 		CBLogError("Cannot allocate %i bytes of memory in CBNewInventoryItem\n", sizeof(*self));
 		return NULL;
@@ -35,11 +35,11 @@ CBInventoryItem * CBNewInventoryItem(CBInventoryItemType type, CBByteArray * has
 	CBGetObject(self)->free = CBFreeInventoryItem;
 	if(CBInitInventoryItem(self, type, hash))
 		return self;
-	free(self);
+	CBDeallocObject(self);
 	return NULL;
 }
 CBInventoryItem * CBNewInventoryItemFromData(CBByteArray * data){
-	CBInventoryItem * self = malloc(sizeof(*self));
+	CBInventoryItem * self = CBAllocObject(sizeof(*self));
 	if (NOT self) {
 		CBLogError("Cannot allocate %i bytes of memory in CBNewInventoryItemFromData\n", sizeof(*self));
 		return NULL;
@@ -47,7 +47,7 @@ CBInventoryItem * CBNewInventoryItemFromData(CBByteArray * data){
 	CBGetObject(self)->free = CBFreeInventoryItem;
 	if(CBInitInventoryItemFromData(self, data))
 		return self;
-	free(self);
+	CBDeallocObject(self);
 	return NULL;
 }
 
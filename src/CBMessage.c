@@ -27,7 +27,7 @@
 //  Constructor
 
 CBMessage * CBNewMessageByObject(){
-	CBMessage * self = malloc(sizeof(*self));
+	CBMessage * self = CBAllocObject(sizeof(*self));
 	if (NOT self) {
 		CBLogError("Cannot allocate %i bytes of memory in CBNewMessageByObject\n", sizeof(*self));
 		return NULL;
@@ -35,7 +35,7 @@ CBMessage * CBNewMessageByObject(){
 	CBGetObject(self)->free = CBFreeMessage;
 	if (CBInitMessageByObject(self))
 		return self;
-	free(self);
+	CBDeallocObject(self);
 	return NULL;
 }
 
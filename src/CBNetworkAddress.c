@@ -27,7 +27,7 @@
 //  Constructor
 
 CBNetworkAddress * CBNewNetworkAddress(uint64_t lastSeen, CBByteArray * ip, uint16_t port, CBVersionServices services, bool isPublic){
-	CBNetworkAddress * self = malloc(sizeof(*self));
+	CBNetworkAddress * self = CBAllocObject(sizeof(*self));
 	if (NOT self) {
 		CBLogError("Cannot allocate %i bytes of memory in CBNewNetworkAddress\n", sizeof(*self));
 		return NULL;
@@ -35,11 +35,11 @@ CBNetworkAddress * CBNewNetworkAddress(uint64_t lastSeen, CBByteArray * ip, uint
 	CBGetObject(self)->free = CBFreeNetworkAddress;
 	if (CBInitNetworkAddress(self, lastSeen, ip, port, services, isPublic))
 		return self;
-	free(self);
+	CBDeallocObject(self);
 	return NULL;
 }
 CBNetworkAddress * CBNewNetworkAddressFromData(CBByteArray * data, bool isPublic){
-	CBNetworkAddress * self = malloc(sizeof(*self));
+	CBNetworkAddress * self = CBAllocObject(sizeof(*self));
 	if (NOT self) {
 		CBLogError("Cannot allocate %i bytes of memory in CBNewNetworkAddressFromData\n", sizeof(*self));
 		return NULL;
@@ -47,7 +47,7 @@ CBNetworkAddress * CBNewNetworkAddressFromData(CBByteArray * data, bool isPublic
 	CBGetObject(self)->free = CBFreeNetworkAddress;
 	if(CBInitNetworkAddressFromData(self, data, isPublic))
 		return self;
-	free(self);
+	CBDeallocObject(self);
 	return NULL;
 }
 
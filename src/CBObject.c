@@ -23,19 +23,143 @@
 //  SEE HEADER FILE FOR DOCUMENTATION
 
 #include "CBObject.h"
+#include "CBDependencies.h"
+#include <pthread.h>
+#include <string.h>
+
+// Object memory is preceded by a header giving where it came from, keeping the object aligned to 16 bytes.
+
+typedef enum{
+	CB_OBJECT_FROM_HEAP,
+	CB_OBJECT_FROM_SLAB,
+	CB_OBJECT_FROM_ARENA,
+} CBObjectSource;
+
+typedef union{
+	struct{
+		void * owner; // The CBObjectSlab or CBObjectArena.
+		CBObjectSource source;
+		uint32_t size; // The size of the allocation including the header.
+	} info;
+	uint64_t align[2];
+} CBObjectHeader;
+
+typedef struct{
+	pthread_mutex_t lock;
+	void * freeList; // Freed objects, each pointing to the next.
+	uint8_t * chunk;
+	uint32_t chunkUsed;
+	uint32_t size; // Size of allocations including the header.
+} CBObjectSlab;
+
+struct CBObjectArena{
+	pthread_mutex_t lock;
+	void * chunks; // Each chunk begins with a pointer to the previous chunk.
+	uint32_t chunkUsed;
+	uint32_t live; // The number of objects not yet freed.
+	bool open; // True until CBObjectArenaEnd.
+};
+
+static CBObjectAllocator CBObjectCurrentAllocator = CB_OBJECT_ALLOCATOR_HEAP;
+static CBObjectAllocationCounters CBObjectCounters;
+static CBObjectSlab CBObjectSlabs[CB_OBJECT_SLAB_CLASSES];
+static pthread_key_t CBObjectArenaKey;
+static pthread_once_t CBObjectAllocatorOnce = PTHREAD_ONCE_INIT;
+
+static void CBObjectAllocatorInit(void){
+	for (uint8_t x = 0; x < CB_OBJECT_SLAB_CLASSES; x++) {
+		pthread_mutex_init(&CBObjectSlabs[x].lock, NULL);
+		CBObjectSlabs[x].size = (x + 1) * sizeof(CBObjectHeader);
+		CBObjectSlabs[x].chunkUsed = CB_OBJECT_SLAB_CHUNK_SIZE;
+	}
+	pthread_key_create(&CBObjectArenaKey, NULL);
+}
+static CBObjectHeader * CBObjectAllocFromArena(CBObjectArena * arena, size_t size){
+	pthread_mutex_lock(&arena->lock);
+	if (arena->chunkUsed + size > CB_OBJECT_ARENA_CHUNK_SIZE) {
+		void ** chunk = malloc(CB_OBJECT_ARENA_CHUNK_SIZE);
+		if (NOT chunk) {
+			pthread_mutex_unlock(&arena->lock);
+			return NULL;
+		}
+		__sync_fetch_and_add(&CBObjectCounters.chunkAllocations, 1);
+		*chunk = arena->chunks;
+		arena->chunks = chunk;
+		arena->chunkUsed = sizeof(CBObjectHeader); // The first header size is used by the chunk pointer, keeping alignment.
+	}
+	CBObjectHeader * header = (CBObjectHeader *)((uint8_t *)arena->chunks + arena->chunkUsed);
+	arena->chunkUsed += size;
+	arena->live++;
+	pthread_mutex_unlock(&arena->lock);
+	header->info.owner = arena;
+	header->info.source = CB_OBJECT_FROM_ARENA;
+	header->info.size = (uint32_t)size;
+	__sync_fetch_and_add(&CBObjectCounters.arenaAllocations, 1);
+	return header;
+}
+static CBObjectHeader * CBObjectAllocFromSlab(CBObjectSlab * slab){
+	pthread_mutex_lock(&slab->lock);
+	CBObjectHeader * header;
+	if (slab->freeList) {
+		header = slab->freeList;
+		slab->freeList = *(void **)header;
+	}else{
+		if (slab->chunkUsed + slab->size > CB_OBJECT_SLAB_CHUNK_SIZE) {
+			uint8_t * chunk = malloc(CB_OBJECT_SLAB_CHUNK_SIZE);
+			if (NOT chunk) {
+				pthread_mutex_unlock(&slab->lock);
+				return NULL;
+			}
+			__sync_fetch_and_add(&CBObjectCounters.chunkAllocations, 1);
+			slab->chunk = chunk;
+			slab->chunkUsed = 0;
+		}
+		header = (CBObjectHeader *)(slab->chunk + slab->chunkUsed);
+		slab->chunkUsed += slab->size;
+	}
+	pthread_mutex_unlock(&slab->lock);
+	header->info.owner = slab;
+	header->info.source = CB_OBJECT_FROM_SLAB;
+	header->info.size = slab->size;
+	__sync_fetch_and_add(&CBObjectCounters.slabAllocations, 1);
+	return header;
+}
+static void CBObjectFreeArena(CBObjectArena * arena){
+	while (arena->chunks) {
+		void * prev = *(void **)arena->chunks;
+		free(arena->chunks);
+		__sync_fetch_and_add(&CBObjectCounters.chunkFrees, 1);
+		arena->chunks = prev;
+	}
+	pthread_mutex_destroy(&arena->lock);
+	free(arena);
+}
 
 //  Constructor
 
 CBObject * CBNewObject(){
-	CBObject * self = malloc(sizeof(*self));
+	CBObject * self = CBAllocObject(sizeof(*self));
 	if (NOT self)
 		return NULL;
 	self->free = CBFreeObject;
 	if(CBInitObject(self))
 		return self;
-	free(self);
+	CBDeallocObject(self);
 	return NULL;
 }
+CBObjectArena * CBNewObjectArena(){
+	CBObjectArena * self = malloc(sizeof(*self));
+	if (NOT self) {
+		CBLogError("Cannot allocate %i bytes of memory in CBNewObjectArena\n", sizeof(*self));
+		return NULL;
+	}
+	pthread_mutex_init(&self->lock, NULL);
+	self->chunks = NULL;
+	self->chunkUsed = CB_OBJECT_ARENA_CHUNK_SIZE;
+	self->live = 0;
+	self->open = true;
+	return self;
+}
 
 //  Object Getter
 
@@ -46,27 +170,129 @@ CBObject * CBGetObject(void * self){
 //  Initialiser
 
 bool CBInitObject(CBObject * self){
-	self->references = 1;
+	CBReferenceCountInit(&self->references, 1);
 	return true;
 }
 
 //  Destructor
 
 void CBFreeObject(void * self){
-	free(self);
+	CBDeallocObject(self);
 }
 
 //  Functions
 
+void * CBAllocObject(size_t size){
+	pthread_once(&CBObjectAllocatorOnce, CBObjectAllocatorInit);
+	// Round up to a multiple of the header size to keep objects aligned.
+	size = (size + 2*sizeof(CBObjectHeader) - 1) / sizeof(CBObjectHeader) * sizeof(CBObjectHeader);
+	CBObjectHeader * header = NULL;
+	CBObjectArena * arena = pthread_getspecific(CBObjectArenaKey);
+	if (arena && size <= CB_OBJECT_ARENA_CHUNK_SIZE / 4)
+		header = CBObjectAllocFromArena(arena, size);
+	else if (CBObjectCurrentAllocator != CB_OBJECT_ALLOCATOR_HEAP && size <= CB_OBJECT_SLAB_CLASSES * sizeof(CBObjectHeader))
+		header = CBObjectAllocFromSlab(CBObjectSlabs + size / sizeof(CBObjectHeader) - 1);
+	else{
+		header = malloc(size);
+		if (header) {
+			header->info.owner = NULL;
+			header->info.source = CB_OBJECT_FROM_HEAP;
+			header->info.size = (uint32_t)size;
+			__sync_fetch_and_add(&CBObjectCounters.heapAllocations, 1);
+		}
+	}
+	if (NOT header)
+		return NULL;
+	return header + 1;
+}
+void CBDeallocObject(void * self){
+	CBObjectHeader * header = (CBObjectHeader *)self - 1;
+	__sync_fetch_and_add(&CBObjectCounters.frees, 1);
+	if (header->info.source == CB_OBJECT_FROM_HEAP)
+		free(header);
+	else if (header->info.source == CB_OBJECT_FROM_SLAB) {
+		CBObjectSlab * slab = header->info.owner;
+		pthread_mutex_lock(&slab->lock);
+		*(void **)header = slab->freeList;
+		slab->freeList = header;
+		pthread_mutex_unlock(&slab->lock);
+	}else{
+		CBObjectArena * arena = header->info.owner;
+		pthread_mutex_lock(&arena->lock);
+		bool done = NOT --arena->live && NOT arena->open;
+		pthread_mutex_unlock(&arena->lock);
+		if (done)
+			CBObjectFreeArena(arena);
+	}
+}
+bool CBObjectHasAtomicReferences(){
+#ifdef CB_ATOMIC_REFERENCES
+	return true;
+#else
+	return false;
+#endif
+}
+CBObjectAllocator CBObjectGetAllocator(){
+	return CBObjectCurrentAllocator;
+}
+void CBObjectGetAllocationCounters(CBObjectAllocationCounters * counters){
+	// Read each counter atomically, as other threads may be allocating.
+	counters->heapAllocations = __sync_fetch_and_add(&CBObjectCounters.heapAllocations, 0);
+	counters->slabAllocations = __sync_fetch_and_add(&CBObjectCounters.slabAllocations, 0);
+	counters->arenaAllocations = __sync_fetch_and_add(&CBObjectCounters.arenaAllocations, 0);
+	counters->chunkAllocations = __sync_fetch_and_add(&CBObjectCounters.chunkAllocations, 0);
+	counters->chunkFrees = __sync_fetch_and_add(&CBObjectCounters.chunkFrees, 0);
+	counters->frees = __sync_fetch_and_add(&CBObjectCounters.frees, 0);
+}
+CBObjectArena * CBObjectArenaBegin(CBObjectArena * arena){
+	pthread_once(&CBObjectAllocatorOnce, CBObjectAllocatorInit);
+	CBObjectArena * previous = pthread_getspecific(CBObjectArenaKey);
+	pthread_setspecific(CBObjectArenaKey, arena);
+	return previous;
+}
+void CBObjectArenaEnd(CBObjectArena * arena, CBObjectArena * previous){
+	pthread_setspecific(CBObjectArenaKey, previous);
+	pthread_mutex_lock(&arena->lock);
+	arena->open = false;
+	bool done = NOT arena->live;
+	pthread_mutex_unlock(&arena->lock);
+	if (done)
+		CBObjectFreeArena(arena);
+}
+CBObjectArena * CBObjectGetCurrentArena(){
+	pthread_once(&CBObjectAllocatorOnce, CBObjectAllocatorInit);
+	return pthread_getspecific(CBObjectArenaKey);
+}
+void CBObjectResetAllocationCounters(){
+	__sync_fetch_and_and(&CBObjectCounters.heapAllocations, 0);
+	__sync_fetch_and_and(&CBObjectCounters.slabAllocations, 0);
+	__sync_fetch_and_and(&CBObjectCounters.arenaAllocations, 0);
+	__sync_fetch_and_and(&CBObjectCounters.chunkAllocations, 0);
+	__sync_fetch_and_and(&CBObjectCounters.chunkFrees, 0);
+	__sync_fetch_and_and(&CBObjectCounters.frees, 0);
+}
+void CBObjectSetAllocator(CBObjectAllocator allocator){
+	CBObjectCurrentAllocator = allocator;
+}
+void * CBReallocObject(void * self, size_t size){
+	CBObjectHeader * header = (CBObjectHeader *)self - 1;
+	size_t oldSize = header->info.size - sizeof(CBObjectHeader);
+	if (size <= oldSize)
+		return self;
+	void * new = CBAllocObject(size);
+	if (NOT new)
+		return NULL;
+	memcpy(new, self, oldSize);
+	CBDeallocObject(self);
+	return new;
+}
 void CBReleaseObject(void * self){
 	CBObject * obj = self;
 	// Decrement reference counter. Free if no more references.
-	obj->references--;
-	if (obj->references < 1){
+	if (CBReferenceCountDecrement(&obj->references))
 		obj->free(obj);
-	}
 }
 void CBRetainObject(void * self){
 	// Increment reference counter.
-	((CBObject *)self)->references++;
+	CBReferenceCountIncrement(&((CBObject *)self)->references);
 }
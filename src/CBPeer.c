@@ -28,14 +28,14 @@
 
 CBPeer * CBNewPeerByTakingNetworkAddress(CBNetworkAddress * addr){
 	CBPeer * self = CBGetPeer(addr);
-	self = realloc(self, sizeof(*self));
+	self = CBReallocObject(self, sizeof(*self));
 	if (NOT self) {
 		CBLogError("Cannot reallocate to %i bytes of memory in CBNewNodeByTakingNetworkAddress\n", sizeof(*self));
 		return NULL;
 	}
 	if(CBInitPeerByTakingNetworkAddress(self))
 		return self;
-	free(self);
+	CBDeallocObject(self);
 	return NULL;
 }
 
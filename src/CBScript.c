@@ -24,6 +24,16 @@
 
 #include "CBScript.h"
 
+//  Constants
+
+// Data for items pushed by the small integer operations and for the results of operations which give constant values. Items are never modified so they can point to this data.
+static uint8_t CB_SCRIPT_SMALL_INTEGERS[16] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16};
+static uint8_t CB_SCRIPT_NEGATIVE_ONE = 0x81; // 10000001 Not like normal signed integers, most significant bit applies sign, making the rest of the bits take away from zero.
+static uint8_t CB_SCRIPT_NEGATIVE_ZERO = 0x80;
+static uint8_t CB_SCRIPT_FALSE_BYTE = 0;
+#define CB_SCRIPT_TRUE_ITEM ((CBScriptStackItem){CB_SCRIPT_SMALL_INTEGERS, 1})
+#define CB_SCRIPT_BOOL_ITEM(b) ((CBScriptStackItem){(b) ? CB_SCRIPT_SMALL_INTEGERS : &CB_SCRIPT_FALSE_BYTE, 1})
+
 //  Constructor
 
 CBScript * CBNewScriptFromReference(CBByteArray * program, uint32_t offset, uint32_t len){
@@ -33,7 +43,7 @@ CBScript * CBNewScriptOfSize(uint32_t size){
 	return CBNewByteArrayOfSize(size);
 }
 CBScript * CBNewScriptFromString(char * string){
-	CBScript * self = malloc(sizeof(*self));
+	CBScript * self = CBAllocObject(sizeof(*self));
 	if (NOT self) {
 		CBLogError("Cannot allocate %i bytes of memory in CBNewScriptFromString\n", sizeof(*self));
 		return NULL;
@@ -41,7 +51,7 @@ CBScript * CBNewScriptFromString(char * string){
 	CBGetObject(self)->free = CBFreeByteArray;
 	if (CBInitScriptFromString(self, string))
 		return self;
-	free(self);
+	CBDeallocObject(self);
 	return NULL;
 }
 CBScript * CBNewScriptWithData(uint8_t * data, uint32_t size){
@@ -561,24 +571,35 @@ bool CBInitScriptFromString(CBScript * self, char * string){
 		return false;
 	return true;
 }
+void CBInitScriptWithDataReference(CBScript * self, CBSharedData * sharedData, uint8_t * data, uint32_t size){
+	CBInitObject(CBGetObject(self));
+	CBGetObject(self)->free = NULL;
+	sharedData->data = data;
+	CBReferenceCountInit(&sharedData->references, 1);
+	self->sharedData = sharedData;
+	self->offset = 0;
+	self->length = size;
+}
 
 //  Functions
 
-void CBFreeScriptStack(CBScriptStack stack){
-	for (int x = 0; x < stack.length; x++)
-		free(stack.elements[x].data);
-	free(stack.elements);
+void CBFreeScriptStack(CBScriptStack * stack){
+	while (stack->overflow) {
+		void * next = *(void **)stack->overflow;
+		free(stack->overflow);
+		stack->overflow = next;
+	}
 }
-CBScriptStack CBNewEmptyScriptStack(){
-	CBScriptStack stack;
-	stack.elements = NULL;
-	stack.length = 0;
-	return stack;
+void CBInitScriptStack(CBScriptStack * stack){
+	stack->length = 0;
+	stack->arenaUsed = 0;
+	stack->overflow = NULL;
 }
 CBScriptExecuteReturn CBScriptExecute(CBScript * self, CBScriptStack * stack, CBGetHashReturn (*getHashForSig)(void *, CBByteArray *, uint32_t, CBSignType, uint8_t *), void * transaction, uint32_t inputIndex, bool p2sh){
 	// ??? Adding syntax parsing to the begining of the interpreter is maybe a good idea.
 	// This looks confusing but isn't too bad, trust me.
-	CBScriptStack altStack = CBNewEmptyScriptStack();
+	CBScriptStackItem altStack[CB_SCRIPT_STACK_MAX_ITEMS];
+	uint16_t altStackLength = 0;
 	uint16_t skipIfElseBlock = 0xffff; // Skips all instructions on or over this if/else level.
 	uint16_t ifElseSize = 0; // Amount of if/else block levels
 	uint32_t beginSubScript = 0;
@@ -589,12 +610,14 @@ CBScriptExecuteReturn CBScriptExecute(CBScript * self, CBScriptStack * stack, CB
 	CBScriptStackItem p2shScript;
 	bool isP2SH;
 	if (p2sh && CBScriptIsP2SH(self)) {
+		if (NOT stack->length)
+			return CB_SCRIPT_INVALID; // Nothing to give the P2SH script.
 		p2shScript = CBScriptStackCopyItem(stack, 0);
-		if (NOT p2shScript.data && p2shScript.length)
-			return CB_SCRIPT_ERR;
 		isP2SH = true;
 	}else isP2SH = false;
 	for (uint8_t opCount = 0; self->length - cursor > 0;) {
+		if (stack->length + altStackLength > 1000)
+			return CB_SCRIPT_INVALID; // Stack size over the limit
 		CBScriptOp byte = CBByteArrayGetByte(self, cursor);
 		if (byte > CB_SCRIPT_OP_16 && ++opCount > 201)
 			return CB_SCRIPT_INVALID; // Too many op codes
@@ -641,15 +664,10 @@ CBScriptExecuteReturn CBScriptExecute(CBScript * self, CBScriptStack * stack, CB
 				// Check size
 				if ((self->length - cursor) < byte)
 					return CB_SCRIPT_INVALID; // Not enough space.
-				// Push data the size of the value of the byte
+				// Push data the size of the value of the byte. The item references the data in the script.
 				CBScriptStackItem item;
-				item.data = malloc(byte);
-				if (NOT item.data){
-					CBLogError("Run out of memory during a script push operation. Attempted to push %i bytes\n", byte);
-					return CB_SCRIPT_ERR;
-				}
+				item.data = CBByteArrayGetData(self) + cursor;
 				item.length = byte;
-				memmove(item.data, CBByteArrayGetData(self) + cursor, byte);
 				if (NOT CBScriptStackPushItem(stack, item))
 					return CB_SCRIPT_ERR;
 				cursor += byte;
@@ -679,56 +697,31 @@ CBScriptExecuteReturn CBScriptExecute(CBScript * self, CBScriptStack * stack, CB
 				if (self->length - cursor < amount)
 					return CB_SCRIPT_INVALID; // Not enough space.
 				CBScriptStackItem item;
-				if (amount){
-					item.data = malloc(amount);
-					if (NOT item.data){
-						CBLogError("Run out of memory during a script push operation. Attempted to push %i bytes\n", amount);
-						return CB_SCRIPT_ERR;
-					}
-					memmove(item.data, CBByteArrayGetData(self) + cursor, amount);
-				}else{
-					item.data = NULL;
-				}
+				item.data = amount ? CBByteArrayGetData(self) + cursor : NULL;
 				item.length = amount;
 				if (NOT CBScriptStackPushItem(stack, item))
 					return CB_SCRIPT_ERR;
 				cursor += amount;
 			}else if (byte == CB_SCRIPT_OP_1NEGATE){
 				// Push -1 onto the stack
-				CBScriptStackItem item;
-				item.data = malloc(1);
-				if (NOT item.data){
-					CBLogError("Run out of memory during OP_1NEGATE\n");
-					return CB_SCRIPT_ERR;
-				}
-				item.length = 1;
-				item.data[0] = 0x81; // 10000001 Not like normal signed integers, most significant bit applies sign, making the rest of the bits take away from zero.
-				if (NOT CBScriptStackPushItem(stack, item))
+				if (NOT CBScriptStackPushItem(stack, (CBScriptStackItem){&CB_SCRIPT_NEGATIVE_ONE, 1}))
 					return CB_SCRIPT_ERR;
 			}else if(byte == CB_SCRIPT_OP_RESERVED){
 				return CB_SCRIPT_INVALID;
 			}else if (byte < 97){
 				// Push a number onto the stack
-				CBScriptStackItem item;
-				item.data = malloc(1);
-				if (NOT item.data){
-					CBLogError("Run out of memory during OP_%i\n", byte - CB_SCRIPT_OP_1 + 1);
-					return CB_SCRIPT_ERR;
-				}
-				item.length = 1;
-				item.data[0] = byte - CB_SCRIPT_OP_1 + 1;
-				if (NOT CBScriptStackPushItem(stack, item))
+				if (NOT CBScriptStackPushItem(stack, (CBScriptStackItem){CB_SCRIPT_SMALL_INTEGERS + byte - CB_SCRIPT_OP_1, 1}))
 					return CB_SCRIPT_ERR;
 			}else if (byte == CB_SCRIPT_OP_NOP){
 				// Nothing...
-			}else if (byte == CB_SCRIPT_OP_IF 
+			}else if (byte == CB_SCRIPT_OP_IF
 					  || byte == CB_SCRIPT_OP_NOTIF){
 				// If top of stack is true, continue, else goto OP_ELSE or OP_ENDIF.
 				ifElseSize++;
 				if (NOT stack->length)
 					return CB_SCRIPT_INVALID; // Stack empty
 				bool res = CBScriptStackEvalBool(stack);
-				if ((res && byte == CB_SCRIPT_OP_IF) 
+				if ((res && byte == CB_SCRIPT_OP_IF)
 					|| (NOT res && byte == CB_SCRIPT_OP_NOTIF))
 					skipIfElseBlock = 0xffff;
 				else
@@ -756,26 +749,22 @@ CBScriptExecuteReturn CBScriptExecute(CBScript * self, CBScriptStack * stack, CB
 			}else if (byte == CB_SCRIPT_OP_TOALTSTACK){
 				if (NOT stack->length)
 					return CB_SCRIPT_INVALID; // Stack empty
-				if (NOT CBScriptStackPushItem(&altStack, CBScriptStackPopItem(stack)))
-					return CB_SCRIPT_ERR;
+				altStack[altStackLength++] = CBScriptStackPopItem(stack);
 			}else if (byte == CB_SCRIPT_OP_FROMALTSTACK){
-				if (NOT altStack.length)
+				if (NOT altStackLength)
 					return CB_SCRIPT_INVALID; // Alternative stack empty
-				if (NOT CBScriptStackPushItem(stack, CBScriptStackPopItem(&altStack)))
+				if (NOT CBScriptStackPushItem(stack, altStack[--altStackLength]))
 					return CB_SCRIPT_ERR;
 			}else if (byte == CB_SCRIPT_OP_IFDUP){
 				if (NOT stack->length)
 					return CB_SCRIPT_INVALID; // Stack empty
 				if (CBScriptStackEvalBool(stack)){
 					//Duplicate top stack item
-					CBScriptStackItem item = CBScriptStackCopyItem(stack, 0);
-					if (NOT item.data && item.length)
-						return CB_SCRIPT_ERR;
-					if (NOT CBScriptStackPushItem(stack, item))
+					if (NOT CBScriptStackPushItem(stack, CBScriptStackCopyItem(stack, 0)))
 						return CB_SCRIPT_ERR;
 				}
 			}else if (byte == CB_SCRIPT_OP_DEPTH){
-				CBScriptStackItem temp = CBInt64ToScriptStackItem((CBScriptStackItem){NULL, 0}, stack->length);
+				CBScriptStackItem temp = CBInt64ToScriptStackItem(stack, stack->length);
 				if (NOT temp.data && temp.length)
 					return CB_SCRIPT_ERR;
 				if (NOT CBScriptStackPushItem(stack, temp))
@@ -788,30 +777,18 @@ CBScriptExecuteReturn CBScriptExecute(CBScript * self, CBScriptStack * stack, CB
 				if (NOT stack->length)
 					return CB_SCRIPT_INVALID; // Stack empty
 				//Duplicate top stack item
-				CBScriptStackItem item = CBScriptStackCopyItem(stack, 0);
-				if (NOT item.data && item.length)
-					return CB_SCRIPT_ERR;
-				if (NOT CBScriptStackPushItem(stack, item))
+				if (NOT CBScriptStackPushItem(stack, CBScriptStackCopyItem(stack, 0)))
 					return CB_SCRIPT_ERR;
 			}else if (byte == CB_SCRIPT_OP_NIP){
 				if (stack->length < 2)
 					return CB_SCRIPT_INVALID; // Stack needs 2 or more elements.
 				// Remove second from top item.
 				stack->length--;
-				free(stack->elements[stack->length-1].data);
 				stack->elements[stack->length-1] = stack->elements[stack->length]; // Top item moves down
-				CBScriptStackItem * temp = realloc(stack->elements, sizeof(*stack->elements)*stack->length);
-				if (NOT temp) {
-					return CB_SCRIPT_ERR;
-				}
-				stack->elements = temp;
 			}else if (byte == CB_SCRIPT_OP_OVER){
 				if (stack->length < 2)
 					return CB_SCRIPT_INVALID; // Stack needs 2 or more elements.
-				CBScriptStackItem item = CBScriptStackCopyItem(stack, 1);
-				if (NOT item.data && item.length)
-					return CB_SCRIPT_ERR;
-				if (NOT CBScriptStackPushItem(stack, item)) // Copies second from top and pushes it on the top.
+				if (NOT CBScriptStackPushItem(stack, CBScriptStackCopyItem(stack, 1))) // Copies second from top and pushes it on the top.
 					return CB_SCRIPT_ERR;
 			}else if (byte == CB_SCRIPT_OP_PICK || byte == CB_SCRIPT_OP_ROLL){
 				if (stack->length < 2)
@@ -826,10 +803,7 @@ CBScriptExecuteReturn CBScriptExecute(CBScript * self, CBScriptStack * stack, CB
 					return CB_SCRIPT_INVALID; // Must be smaller than the stack size
 				if (byte == CB_SCRIPT_OP_PICK) {
 					// Copy element
-					CBScriptStackItem item = CBScriptStackCopyItem(stack, i);
-					if (NOT item.data && item.length)
-						return CB_SCRIPT_ERR;
-					if (NOT CBScriptStackPushItem(stack, item))
+					if (NOT CBScriptStackPushItem(stack, CBScriptStackCopyItem(stack, i)))
 						return CB_SCRIPT_ERR;
 				}else{ // CB_SCRIPT_OP_ROLL
 					// Move element.
@@ -856,16 +830,9 @@ CBScriptExecuteReturn CBScriptExecute(CBScript * self, CBScriptStack * stack, CB
 				if (stack->length < 2)
 					return CB_SCRIPT_INVALID; // Stack needs 2 or more elements.
 				CBScriptStackItem item = CBScriptStackCopyItem(stack, 0);
-				if (NOT item.data && item.length)
-					return CB_SCRIPT_ERR;
 				// New copy three down.
-				stack->length++;
-				CBScriptStackItem * temp = realloc(stack->elements, sizeof(*stack->elements)*stack->length);
-				if (NOT temp) {
+				if (NOT CBScriptStackPushItem(stack, item))
 					return CB_SCRIPT_ERR;
-				}
-				stack->elements = temp;
-				stack->elements[stack->length-1] = stack->elements[stack->length-2];
 				stack->elements[stack->length-2] = stack->elements[stack->length-3];
 				stack->elements[stack->length-3] = item;
 			}else if (byte == CB_SCRIPT_OP_2DROP){
@@ -877,25 +844,15 @@ CBScriptExecuteReturn CBScriptExecute(CBScript * self, CBScriptStack * stack, CB
 					  || byte == CB_SCRIPT_OP_3DUP){
 				if (stack->length < byte - CB_SCRIPT_OP_2DUP + 2)
 					return CB_SCRIPT_INVALID; // Stack needs more elements.
-				for (uint8_t x = 0; x < byte - CB_SCRIPT_OP_2DUP + 2; x++) {
-					CBScriptStackItem i = CBScriptStackCopyItem(stack, byte - CB_SCRIPT_OP_2DUP + 1); 
-					if (NOT i.data && i.length)
-						return CB_SCRIPT_ERR;
-					if (NOT CBScriptStackPushItem(stack, i))
+				for (uint8_t x = 0; x < byte - CB_SCRIPT_OP_2DUP + 2; x++)
+					if (NOT CBScriptStackPushItem(stack, CBScriptStackCopyItem(stack, byte - CB_SCRIPT_OP_2DUP + 1)))
 						return CB_SCRIPT_ERR;
-				}
 			}else if (byte == CB_SCRIPT_OP_2OVER){
 				if (stack->length < 4)
 					return CB_SCRIPT_INVALID; // Stack needs 4 or more elements.
-				CBScriptStackItem i = CBScriptStackCopyItem(stack, 3);
-				if (NOT i.data && i.length)
-					return CB_SCRIPT_ERR;
-				if (NOT CBScriptStackPushItem(stack, i))
-					return CB_SCRIPT_ERR;
-				i = CBScriptStackCopyItem(stack, 3);
-				if (NOT i.data && i.length)
+				if (NOT CBScriptStackPushItem(stack, CBScriptStackCopyItem(stack, 3)))
 					return CB_SCRIPT_ERR;
-				if (NOT CBScriptStackPushItem(stack, i))
+				if (NOT CBScriptStackPushItem(stack, CBScriptStackCopyItem(stack, 3)))
 					return CB_SCRIPT_ERR;
 			}else if (byte == CB_SCRIPT_OP_2ROT){
 				if (stack->length < 6)
@@ -921,47 +878,28 @@ CBScriptExecuteReturn CBScriptExecute(CBScript * self, CBScriptStack * stack, CB
 			}else if (byte == CB_SCRIPT_OP_SIZE){
 				if (NOT stack->length)
 					return CB_SCRIPT_INVALID; // Stack empty
-				CBScriptStackItem temp = CBInt64ToScriptStackItem((CBScriptStackItem){NULL, 0}, stack->elements[stack->length-1].length);
+				CBScriptStackItem temp = CBInt64ToScriptStackItem(stack, stack->elements[stack->length-1].length);
 				if (NOT temp.data && temp.length)
 					return CB_SCRIPT_ERR;
 				if (NOT CBScriptStackPushItem(stack, temp))
 					return CB_SCRIPT_ERR;
-			}else if (byte == CB_SCRIPT_OP_EQUAL 
+			}else if (byte == CB_SCRIPT_OP_EQUAL
 					  || byte == CB_SCRIPT_OP_EQUALVERIFY){
 				if (stack->length < 2)
 					return CB_SCRIPT_INVALID; // Stack needs 2 or more elements.
 				CBScriptStackItem i1 = CBScriptStackPopItem(stack);
 				CBScriptStackItem i2 = CBScriptStackPopItem(stack);
-				bool ok = true;
-				if (i1.length != i2.length)
-					ok = false;
-				else for (uint16_t x = 0; x < i1.length; x++)
-					if (i1.data[x] != i2.data[x]) {
-						ok = false;
-						break;
-					}
+				bool ok = i1.length == i2.length && (NOT i1.length || NOT memcmp(i1.data, i2.data, i1.length));
 				if (byte == CB_SCRIPT_OP_EQUALVERIFY){
 					if (NOT ok)
 						return CB_SCRIPT_INVALID; // Failed verification
 				}else{
 					// Push result onto stack
-					CBScriptStackItem item;
-					if (ok) {
-						item.data = malloc(1);
-						if (NOT item.data){
-							CBLogError("Run out of memory during OP_EQUAL\n");
-							return CB_SCRIPT_ERR;
-						}
-						item.length = 1;
-						item.data[0] = 1;
-					}else{
-						item.data = NULL;
-						item.length = 0;
-					}
+					CBScriptStackItem item = ok ? CB_SCRIPT_TRUE_ITEM : (CBScriptStackItem){NULL, 0};
 					if (NOT CBScriptStackPushItem(stack, item))
 						return CB_SCRIPT_ERR;
 				}
-			}else if (byte == CB_SCRIPT_OP_1ADD 
+			}else if (byte == CB_SCRIPT_OP_1ADD
 					  || byte == CB_SCRIPT_OP_1SUB){
 				if (NOT stack->length)
 					return CB_SCRIPT_INVALID; // Stack empty
@@ -974,8 +912,8 @@ CBScriptExecuteReturn CBScriptExecute(CBScript * self, CBScriptStack * stack, CB
 					res++;
 				else
 					res--;
-				// Convert back to bitcoin format. Re-assign item as length may have changed.
-				stack->elements[stack->length-1] = CBInt64ToScriptStackItem(item, res);
+				// Convert back to bitcoin format as a new item.
+				stack->elements[stack->length-1] = CBInt64ToScriptStackItem(stack, res);
 				if (NOT stack->elements[stack->length-1].data && stack->elements[stack->length-1].length)
 					// Detected error.
 					return CB_SCRIPT_ERR;
@@ -987,62 +925,63 @@ CBScriptExecuteReturn CBScriptExecute(CBScript * self, CBScriptStack * stack, CB
 					return CB_SCRIPT_INVALID; // Protocol does not except integers more than 32 bits.
 				if (item->data == NULL) { // Zero
 					// Zero becomes 0x80 :-( Sorry, this madness comes from the C++ client which represents zero in a horrid way.
-					item->data = malloc(1);
-					if (NOT item->data){
+					item->data = &CB_SCRIPT_NEGATIVE_ZERO;
+					item->length = 1;
+				}else if(item->data[0] != 0x80){
+					// Toggles most significant bit on a new copy since the item may reference the script.
+					uint8_t * data = CBScriptStackAllocate(stack, item->length);
+					if (NOT data){
 						CBLogError("Run out of memory during OP_NEGATE\n");
 						return CB_SCRIPT_ERR;
 					}
-					item->length = 1;
-					item->data[0] = 0x80; // -0
-				}else if(item->data[0] != 0x80){
-					item->data[item->length-1] ^= 0x80; // Toggles most significant bit.
+					memcpy(data, item->data, item->length);
+					data[item->length-1] ^= 0x80;
+					item->data = data;
 				}else{
 					// Negative zero becomes NULL. Positive zero is NULL to support weirdness with the C++ client. Arghh. ??? Needs checking over for inevitable inconsistencies with C++.
-					free(item->data);
 					item->data = NULL;
 					item->length = 0;
 				}
 			}else if (byte == CB_SCRIPT_OP_ABS){
 				if (NOT stack->length)
 					return CB_SCRIPT_INVALID; // Stack empty
-				CBScriptStackItem item = stack->elements[stack->length-1];
-				if (item.length > 4)
+				CBScriptStackItem * item = &stack->elements[stack->length-1];
+				if (item->length > 4)
 					return CB_SCRIPT_INVALID; // Protocol does not except integers more than 32 bits.
-				if (item.data != NULL) { // If not zero
-					item.data[item.length-1] &= 0x7F; // Unsets most significant bit.
+				if (item->data != NULL // If not zero
+					&& item->data[item->length-1] & 0x80) { // and negative.
+					// Unsets most significant bit on a new copy.
+					uint8_t * data = CBScriptStackAllocate(stack, item->length);
+					if (NOT data){
+						CBLogError("Run out of memory during OP_ABS\n");
+						return CB_SCRIPT_ERR;
+					}
+					memcpy(data, item->data, item->length);
+					data[item->length-1] &= 0x7F;
+					item->data = data;
 				}
-			}else if (byte == CB_SCRIPT_OP_NOT 
+			}else if (byte == CB_SCRIPT_OP_NOT
 					  || byte == CB_SCRIPT_OP_0NOTEQUAL){
 				if (NOT stack->length)
 					return CB_SCRIPT_INVALID; // Stack empty
-				CBScriptStackItem item = stack->elements[stack->length-1];
-				if (item.length > 4)
+				if (stack->elements[stack->length-1].length > 4)
 					return CB_SCRIPT_INVALID; // Protocol does not except integers more than 32 bits.
 				bool res = CBScriptStackEvalBool(stack);
-				if ((NOT res && byte == CB_SCRIPT_OP_NOT) || (res && byte == CB_SCRIPT_OP_0NOTEQUAL)) {
-					item.length = 1;
-					uint8_t * temp = realloc(item.data, 1);
-					if (NOT temp)
-						return CB_SCRIPT_ERR;
-					item.data = temp;
-					item.data[0] = 1;
-				}else{
+				if ((NOT res && byte == CB_SCRIPT_OP_NOT) || (res && byte == CB_SCRIPT_OP_0NOTEQUAL))
+					stack->elements[stack->length-1] = CB_SCRIPT_TRUE_ITEM;
+				else
 					// Should be zero as NULL. Remember the C++ represents zero as an empty vector. Here NULL is used. This can be slightly annoying.
-					free(item.data);
-					item.data = NULL;
-					item.length = 0;
-				}
-				stack->elements[stack->length-1] = item;
-			}else if (byte == CB_SCRIPT_OP_ADD 
-					  || byte == CB_SCRIPT_OP_SUB 
-					  || byte == CB_SCRIPT_OP_NUMEQUAL 
-					  || byte == CB_SCRIPT_OP_NUMNOTEQUAL 
-					  || byte == CB_SCRIPT_OP_NUMEQUALVERIFY 
-					  || byte == CB_SCRIPT_OP_LESSTHAN 
-					  || byte == CB_SCRIPT_OP_LESSTHANOREQUAL 
-					  || byte == CB_SCRIPT_OP_GREATERTHAN 
-					  || byte == CB_SCRIPT_OP_GREATERTHANOREQUAL 
-					  || byte == CB_SCRIPT_OP_MIN 
+					stack->elements[stack->length-1] = (CBScriptStackItem){NULL, 0};
+			}else if (byte == CB_SCRIPT_OP_ADD
+					  || byte == CB_SCRIPT_OP_SUB
+					  || byte == CB_SCRIPT_OP_NUMEQUAL
+					  || byte == CB_SCRIPT_OP_NUMNOTEQUAL
+					  || byte == CB_SCRIPT_OP_NUMEQUALVERIFY
+					  || byte == CB_SCRIPT_OP_LESSTHAN
+					  || byte == CB_SCRIPT_OP_LESSTHANOREQUAL
+					  || byte == CB_SCRIPT_OP_GREATERTHAN
+					  || byte == CB_SCRIPT_OP_GREATERTHANOREQUAL
+					  || byte == CB_SCRIPT_OP_MIN
 					  || byte == CB_SCRIPT_OP_MAX){
 				if (stack->length < 2)
 					return CB_SCRIPT_INVALID; // Stack needs 2 or more elements.
@@ -1053,7 +992,6 @@ CBScriptExecuteReturn CBScriptExecute(CBScript * self, CBScriptStack * stack, CB
 					return CB_SCRIPT_INVALID; // Protocol does not except integers more than 32 bits.
 				int64_t res = CBScriptStackItemToInt64(i1);
 				int64_t second = CBScriptStackItemToInt64(i2);
-				free(i2.data); // No longer need i2
 				switch (byte) {
 					case CB_SCRIPT_OP_ADD: res += second; break;
 					case CB_SCRIPT_OP_SUB: res -= second; break;
@@ -1072,8 +1010,8 @@ CBScriptExecuteReturn CBScriptExecute(CBScript * self, CBScriptStack * stack, CB
 						return CB_SCRIPT_INVALID;
 					CBScriptStackRemoveItem(stack); // Remove top item that will not hold the rest as this is OP_NUMEQUALVERIFY
 				}else{
-					// Convert back to bitcoin format. Re-assign item as length may have changed. i1 now goes on top.
-					stack->elements[stack->length-1] = CBInt64ToScriptStackItem(i1, res);
+					// Convert back to bitcoin format as a new item which goes on top.
+					stack->elements[stack->length-1] = CBInt64ToScriptStackItem(stack, res);
 					if (NOT stack->elements[stack->length-1].data && stack->elements[stack->length-1].length)
 						// Detected error.
 						return CB_SCRIPT_ERR;
@@ -1089,14 +1027,7 @@ CBScriptExecuteReturn CBScriptExecute(CBScript * self, CBScriptStack * stack, CB
 				bool i1bool = CBScriptStackEvalBool(stack);
 				if (i1.length > 4 || i2.length > 4)
 					return CB_SCRIPT_INVALID; // Protocol does not except integers more than 32 bits.
-				free(i2.data); // No longer need i2.
-				i1.length = 1;
-				uint8_t * temp = realloc(i1.data, 1);
-				if (NOT temp)
-					return CB_SCRIPT_ERR;
-				i1.data = temp;
-				i1.data[0] = (byte == CB_SCRIPT_OP_BOOLAND)? i1bool && i2bool : i1bool || i2bool;
-				stack->elements[stack->length-1] = i1;
+				stack->elements[stack->length-1] = CB_SCRIPT_BOOL_ITEM((byte == CB_SCRIPT_OP_BOOLAND)? i1bool && i2bool : i1bool || i2bool);
 			}else if (byte == CB_SCRIPT_OP_WITHIN){
 				if (stack->length < 3)
 					return CB_SCRIPT_INVALID; // Stack needs 3 or more elements
@@ -1107,16 +1038,8 @@ CBScriptExecuteReturn CBScriptExecute(CBScript * self, CBScriptStack * stack, CB
 					return CB_SCRIPT_INVALID; // Protocol does not except integers more than 32 bits.
 				int64_t res = CBScriptStackItemToInt64(item);
 				int64_t topi = CBScriptStackItemToInt64(top);
-				free(top.data); // No longer need top.
 				int64_t bottomi = CBScriptStackItemToInt64(bottom);
-				free(bottom.data); // No longer need bottom.
-				item.length = 1;
-				uint8_t * temp = realloc(item.data, 1);
-				if (NOT temp)
-					return CB_SCRIPT_ERR;
-				item.data = temp;
-				item.data[0] = bottomi <= res && res < topi;
-				stack->elements[stack->length-1] = item;
+				stack->elements[stack->length-1] = CB_SCRIPT_BOOL_ITEM(bottomi <= res && res < topi);
 			}else if (byte == CB_SCRIPT_OP_RIPEMD160
 					  || byte == CB_SCRIPT_OP_SHA1
 					  || byte == CB_SCRIPT_OP_HASH160
@@ -1124,67 +1047,46 @@ CBScriptExecuteReturn CBScriptExecute(CBScript * self, CBScriptStack * stack, CB
 					  || byte == CB_SCRIPT_OP_HASH256){
 				if (NOT stack->length)
 					return CB_SCRIPT_INVALID; // Stack cannot be empty
-				CBScriptStackItem item = stack->elements[stack->length-1];
-				uint8_t * data;
+				CBScriptStackItem * item = &stack->elements[stack->length-1];
+				uint8_t length = (byte == CB_SCRIPT_OP_SHA256 || byte == CB_SCRIPT_OP_HASH256)? 32 : 20;
+				uint8_t * data = CBScriptStackAllocate(stack, length);
+				if (NOT data){
+					CBLogError("Run out of memory during a hash operation\n");
+					return CB_SCRIPT_ERR;
+				}
 				uint8_t dataTemp[32];
 				switch (byte) {
 					case CB_SCRIPT_OP_RIPEMD160:
-						data = malloc(20);
-						if (NOT data){
-							CBLogError("Run out of memory during OP_RIPEMD160\n");
-							return CB_SCRIPT_ERR;
-						}
-						CBRipemd160(item.data, item.length, data);
+						CBRipemd160(item->data, item->length, data);
 						break;
 					case CB_SCRIPT_OP_SHA1:
-						data = malloc(20);
-						if (NOT data){
-							CBLogError("Run out of memory during OP_SHA1\n");
-							return CB_SCRIPT_ERR;
-						}
-						CBSha160(item.data, item.length, data);
+						CBSha160(item->data, item->length, data);
 						break;
 					case CB_SCRIPT_OP_HASH160:
-						CBSha256(item.data, item.length, dataTemp);
-						data = malloc(20);
-						if (NOT data){
-							CBLogError("Run out of memory during OP_HASH160\n");
-							return CB_SCRIPT_ERR;
-						}
+						CBSha256(item->data, item->length, dataTemp);
 						CBRipemd160(dataTemp, 32, data);
 						break;
 					case CB_SCRIPT_OP_SHA256:
-						data = malloc(32);
-						if (NOT data){
-							CBLogError("Run out of memory during OP_SHA256\n");
-							return CB_SCRIPT_ERR;
-						}
-						CBSha256(item.data, item.length, data);
+						CBSha256(item->data, item->length, data);
 						break;
 					default:
-						CBSha256(item.data, item.length, dataTemp);
-						data = malloc(32);
-						if (NOT data){
-							CBLogError("Run out of memory during OP_HASH256\n");
-							return CB_SCRIPT_ERR;
-						}
+						CBSha256(item->data, item->length, dataTemp);
 						CBSha256(dataTemp, 32, data);
 						break;
 				}
-				free(item.data);
-				item.data = data;
-				item.length = (byte == CB_SCRIPT_OP_SHA256 || byte == CB_SCRIPT_OP_HASH256)? 32 : 20;
-				stack->elements[stack->length-1] = item;
+				item->data = data;
+				item->length = length;
 			}else if (byte == CB_SCRIPT_OP_CODESEPARATOR){
 				beginSubScript = cursor;
 			}else if (byte == CB_SCRIPT_OP_CHECKSIG
 					  || byte == CB_SCRIPT_OP_CHECKSIGVERIFY
 					  || byte == CB_SCRIPT_OP_CHECKMULTISIG
 					  || byte == CB_SCRIPT_OP_CHECKMULTISIGVERIFY){
-				// Get sub script and remove OP_CODESEPARATORs
+				// Get sub script and remove OP_CODESEPARATORs. The sub script is temporary so the arena space is given back afterwards.
+				uint32_t arenaMark = stack->arenaUsed;
 				uint32_t subScriptLen = self->length - beginSubScript;
-				uint8_t * subScript = malloc(subScriptLen);
-				if (NOT subScript){
+				uint8_t * subScript = CBScriptStackAllocate(stack, subScriptLen);
+				if (NOT subScript && subScriptLen){
 					CBLogError("Run out of memory during CHECKSIG operation\n");
 					return CB_SCRIPT_ERR;
 				}
@@ -1208,13 +1110,13 @@ CBScriptExecuteReturn CBScriptExecute(CBScript * self, CBScriptStack * stack, CB
 						subScriptLen--; // One less element.
 					}
 					// Move to next operation
-					if(*ptr < 0x4f && *ptr){ 
+					if(*ptr < 0x4f && *ptr){
                                             /* ops less than 0x4f are pushdata */
-						// If pushing bytes, skip these bytes. 
+						// If pushing bytes, skip these bytes.
                                                 /* ops less than 0x4c are data */
 						if (*ptr < 0x4c) {
 							ptr += *ptr + 1;
-						}else{ 
+						}else{
 							uint32_t move;
 							if (*ptr == CB_SCRIPT_OP_PUSHDATA1){
 								move = 2;
@@ -1248,18 +1150,17 @@ CBScriptExecuteReturn CBScriptExecute(CBScript * self, CBScriptStack * stack, CB
 						ptr++; // Not a push operation, move along one.
 					}
 				}
-				if (fail) { // Push failure.
-					free(subScript);
+				if (fail) // Push failure.
 					return CB_SCRIPT_INVALID;
-				}
 				bool res;
 				uint8_t hash[32];
+				// The sub script is given to getHashForSig through a CBScript on the C stack.
+				CBSharedData subScriptData;
+				CBScript subScriptByteArray;
 				if (byte == CB_SCRIPT_OP_CHECKSIG
 					|| byte == CB_SCRIPT_OP_CHECKSIGVERIFY){
-					if (stack->length < 2){
-						free(subScript);
+					if (stack->length < 2)
 						return CB_SCRIPT_INVALID; // Stack needs 2 or more elements
-					}
 					CBScriptStackItem publicKey = CBScriptStackPopItem(stack);
 					CBScriptStackItem signature = CBScriptStackPopItem(stack);
 					if (signature.data == NULL || publicKey.data == NULL) {
@@ -1270,64 +1171,39 @@ CBScriptExecuteReturn CBScriptExecute(CBScript * self, CBScriptStack * stack, CB
 						// Delete any instances of the signature
 						CBSubScriptRemoveSignature(subScript, &subScriptLen, signature);
 						// Complete verification
-						CBByteArray * subScriptByteArray = CBNewByteArrayWithData(subScript, subScriptLen);
-						if (NOT subScriptByteArray) {
-							free(publicKey.data);
-							free(signature.data);
+						CBInitScriptWithDataReference(&subScriptByteArray, &subScriptData, subScript, subScriptLen);
+						CBGetHashReturn hashRes = getHashForSig(transaction, &subScriptByteArray, inputIndex, signType, hash);
+						if (hashRes == CB_TX_HASH_ERR)
 							return CB_SCRIPT_ERR;
-						}
-						CBGetHashReturn hashRes = getHashForSig(transaction, subScriptByteArray, inputIndex, signType, hash);
-						if (hashRes == CB_TX_HASH_ERR){
-							free(publicKey.data);
-							free(signature.data);
-							CBReleaseObject(subScriptByteArray);
-							return CB_SCRIPT_ERR;
-						}else if (hashRes == CB_TX_HASH_OK){
+						else if (hashRes == CB_TX_HASH_OK){
 							// Use minus one on the signature length because the hash type
-							res = CBEcdsaVerify(signature.data, signature.length-1, hash, publicKey.data, publicKey.length);
+							res = CBSignatureCacheVerify(signature.data, signature.length-1, hash, publicKey.data, publicKey.length);
 						}else res = false;
-						CBReleaseObject(subScriptByteArray);
 					}
-					free(publicKey.data);
-					free(signature.data);
 				}else{
-					if (stack->length < 5){
-						free(subScript);
+					if (stack->length < 5)
 						return CB_SCRIPT_INVALID; // Stack needs 5 or more elements. At least for numSig, numKeys, one key and signature and the dummy value due to an issue with the protocol.
-					}
 					int64_t numKeys = CBScriptStackItemToInt64(stack->elements[stack->length-1]);
 					uint8_t sig = 3 + numKeys; // To first signature.
 					uint8_t key = 2; // To first key.
-					if (numKeys < 0 || numKeys > 20){
-						free(subScript);
+					if (numKeys < 0 || numKeys > 20)
                         return CB_SCRIPT_INVALID;
-					}
 					opCount += numKeys;
-					if (opCount > 201){
-						free(subScript);
+					if (opCount > 201)
                         return CB_SCRIPT_INVALID;
-					}
-					if (stack->length < numKeys + 4){
-						free(subScript);
+					if (stack->length < numKeys + 4)
 						return CB_SCRIPT_INVALID; // Not enough space on stack for keys
-					}
 					int64_t numSigs = CBScriptStackItemToInt64(stack->elements[stack->length-2-numKeys]); // Go back the number of keys to find the number of signatures.
-					if (numSigs < 0 || numSigs > numKeys){
-						free(subScript);
+					if (numSigs < 0 || numSigs > numKeys)
                         return CB_SCRIPT_INVALID; // The number of signatures must be positive and blow or equal to the number of keys.
-					}
-					if (stack->length < 3 + numKeys + numSigs){
-						free(subScript);
+					if (stack->length < 3 + numKeys + numSigs)
 						return CB_SCRIPT_INVALID; // Not enough space for keys, signatures, numSig, numKeys and the dummy value.
-					}
 					// Remove signatures from subScript
 					for (uint8_t x = 0; x < numSigs; x++) {
 						CBScriptStackItem sigItem = stack->elements[stack->length-sig-x];
 						CBSubScriptRemoveSignature(subScript, &subScriptLen, sigItem);
 					}
-					CBByteArray * subScriptByteArray = CBNewByteArrayWithData(subScript, subScriptLen);
-					if (NOT subScriptByteArray)
-						return CB_SCRIPT_ERR;
+					CBInitScriptWithDataReference(&subScriptByteArray, &subScriptData, subScript, subScriptLen);
 					res = true;
 					uint8_t removeItemsNum = 3 + numKeys + numSigs;
 					while (res && numSigs > 0){
@@ -1342,13 +1218,12 @@ CBScriptExecuteReturn CBScriptExecute(CBScript * self, CBScriptStack * stack, CB
 							// Get sign type
 							CBSignType signType = signature->data[signature->length-1];
 							// Check signature
-							CBGetHashReturn hashRes = getHashForSig(transaction, subScriptByteArray, inputIndex, signType, hash);
-							if (hashRes == CB_TX_HASH_ERR){
-								CBReleaseObject(subScriptByteArray);
+							CBGetHashReturn hashRes = getHashForSig(transaction, &subScriptByteArray, inputIndex, signType, hash);
+							if (hashRes == CB_TX_HASH_ERR)
 								return CB_SCRIPT_ERR;
-							}else if (hashRes == CB_TX_HASH_OK){
+							else if (hashRes == CB_TX_HASH_OK){
 								// Use minus one on the signature length because the hash type
-								if (CBEcdsaVerify(signature->data, signature->length-1, hash, publicKey.data, publicKey.length)){
+								if (CBSignatureCacheVerify(signature->data, signature->length-1, hash, publicKey.data, publicKey.length)){
 									sig++;
 									numSigs--;
 								}
@@ -1359,26 +1234,16 @@ CBScriptExecuteReturn CBScriptExecute(CBScript * self, CBScriptStack * stack, CB
                         if (numSigs > numKeys)
                             res = false; // More signatures than keys. Cannot verify all signatures.
                     }
-					CBReleaseObject(subScriptByteArray);
 					// Remove the items from the stack including an additional dummy value because of a problem in the bitcoin protocol.
 					for (uint8_t x = 0; x < removeItemsNum; x++)
 						CBScriptStackRemoveItem(stack);
 				}
+				// Finished with the sub script.
+				if (stack->arenaUsed > arenaMark)
+					stack->arenaUsed = arenaMark;
 				if (byte == CB_SCRIPT_OP_CHECKSIG
 					|| byte == CB_SCRIPT_OP_CHECKMULTISIG) {
-					CBScriptStackItem item;
-					if (res) {
-						item.data = malloc(1);
-						if (NOT item.data){
-							CBLogError("Run out of memory during CHECKSIG operation push.\n");
-							return CB_SCRIPT_ERR;
-						}
-						item.length = 1;
-						item.data[0] = 1;
-					}else{
-						item.data = NULL;
-						item.length = 0;
-					}
+					CBScriptStackItem item = res ? CB_SCRIPT_TRUE_ITEM : (CBScriptStackItem){NULL, 0};
 					if(NOT CBScriptStackPushItem(stack, item))
 						return CB_SCRIPT_ERR;
 				}else if (NOT res){
@@ -1389,7 +1254,7 @@ CBScriptExecuteReturn CBScriptExecute(CBScript * self, CBScriptStack * stack, CB
 			}else{
 				return CB_SCRIPT_INVALID;
 			}
-			if (stack->length + altStack.length > 1000)
+			if (stack->length + altStackLength > 1000)
 				return CB_SCRIPT_INVALID; // Stack size over the limit
 		}
 	}
@@ -1399,13 +1264,12 @@ CBScriptExecuteReturn CBScriptExecute(CBScript * self, CBScriptStack * stack, CB
 		return CB_SCRIPT_FALSE; // Stack empty.
 	if (CBScriptStackEvalBool(stack)) {
 		if (isP2SH){
-			CBScript * p2shScriptObj = CBNewScriptWithData(p2shScript.data, p2shScript.length);
-			if (NOT p2shScriptObj)
-				return CB_SCRIPT_ERR;
+			// Execute the serialised script without copying it.
+			CBSharedData p2shScriptData;
+			CBScript p2shScriptObj;
+			CBInitScriptWithDataReference(&p2shScriptObj, &p2shScriptData, p2shScript.data, p2shScript.length);
 			CBScriptStackRemoveItem(stack); // Remove OP_TRUE
-			bool res = CBScriptExecute(p2shScriptObj, stack, getHashForSig, transaction, inputIndex, false);
-			CBReleaseObject(p2shScriptObj);
-			return res;
+			return CBScriptExecute(&p2shScriptObj, stack, getHashForSig, transaction, inputIndex, false);
 		}
 		return CB_SCRIPT_TRUE;
 	}else return CB_SCRIPT_FALSE;
@@ -1527,23 +1391,24 @@ void CBSubScriptRemoveSignature(uint8_t * subScript, uint32_t * subScriptLen, CB
 		}
 	}
 }
-CBScriptStackItem CBScriptStackCopyItem(CBScriptStack * stack, uint8_t fromTop){
-	CBScriptStackItem oldItem = stack->elements[stack->length - fromTop - 1];
-	CBScriptStackItem newItem;
-	if (oldItem.data == NULL) { // Zero
-		newItem.data = NULL;
-		newItem.length = 0;
-	}else{
-		newItem.data = malloc(oldItem.length);
-		if (NOT newItem.data){
-			newItem.data = NULL;
-			newItem.length = 1; // Detect not zero.
-			return newItem;
-		}
-		newItem.length = oldItem.length;
-		memmove(newItem.data, oldItem.data, newItem.length);
+uint8_t * CBScriptStackAllocate(CBScriptStack * stack, uint32_t size){
+	if (CB_SCRIPT_STACK_ARENA_SIZE - stack->arenaUsed >= size) {
+		uint8_t * data = stack->arena + stack->arenaUsed;
+		stack->arenaUsed += size;
+		return data;
+	}
+	// The arena is exhausted so use the heap, keeping the memory in a list to be freed with the stack.
+	void ** block = malloc(sizeof(*block) + size);
+	if (NOT block) {
+		CBLogError("Cannot allocate %i bytes of memory in CBScriptStackAllocate\n", sizeof(*block) + size);
+		return NULL;
 	}
-	return newItem;
+	*block = stack->overflow;
+	stack->overflow = block;
+	return (uint8_t *)(block + 1);
+}
+CBScriptStackItem CBScriptStackCopyItem(CBScriptStack * stack, uint16_t fromTop){
+	return stack->elements[stack->length - fromTop - 1];
 }
 bool CBScriptStackEvalBool(CBScriptStack * stack){
 	CBScriptStackItem item = stack->elements[stack->length-1];
@@ -1576,28 +1441,23 @@ int64_t CBScriptStackItemToInt64(CBScriptStackItem item){
 }
 CBScriptStackItem CBScriptStackPopItem(CBScriptStack * stack){
 	stack->length--;
-	CBScriptStackItem item = stack->elements[stack->length];
-	// Do not bother reallocing. Data will be freed at the end.
-	return item;
+	return stack->elements[stack->length];
 }
 bool CBScriptStackPushItem(CBScriptStack * stack, CBScriptStackItem item){
-	stack->length++;
-	CBScriptStackItem * temp = realloc(stack->elements, sizeof(*stack->elements)*stack->length);
-	if (NOT temp)
+	if (stack->length == CB_SCRIPT_STACK_MAX_ITEMS)
 		return false;
-	stack->elements = temp;
-	stack->elements[stack->length-1] = item;
+	stack->elements[stack->length] = item;
+	stack->length++;
 	return true;
 }
 void CBScriptStackRemoveItem(CBScriptStack * stack){
+	// The data stays in the arena until the stack is freed.
 	stack->length--;
-	free(stack->elements[stack->length].data);
-	// Do not bother reallocing. Data will be freed at the end.
 }
-CBScriptStackItem CBInt64ToScriptStackItem(CBScriptStackItem item, int64_t i){
+CBScriptStackItem CBInt64ToScriptStackItem(CBScriptStack * stack, int64_t i){
+	CBScriptStackItem item;
 	if (i == 0) {
 		// Represented as NULL unfortunately. No other solution I'm afraid. Blame Satoshi I guess.
-		free(item.data);
 		item.data = NULL;
 		item.length = 0;
 		return item;
@@ -1616,14 +1476,11 @@ CBScriptStackItem CBInt64ToScriptStackItem(CBScriptStackItem item, int64_t i){
 		if(NOT x)
 			break;
 	}
-	uint8_t * temp = realloc(item.data, item.length);
-	if (NOT temp) {
-		free(item.data);
-		item.data = NULL;
+	item.data = CBScriptStackAllocate(stack, item.length);
+	if (NOT item.data) {
 		item.length = 1; // Detect err and not zero.
 		return item;
 	}
-	item.data = temp;
 	// Add data
 	for (uint8_t x = 0; x < item.length; x++)
 		if (x == 8)
@@ -0,0 +1,129 @@
+//
+//  CBSignatureCache.c
+//  cbitcoin
+//
+//  Copyright (c) 2012 Matthew Mitchell
+//
+//  This file is part of cbitcoin.
+//
+//  cbitcoin is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  cbitcoin is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with cbitcoin.  If not, see <http://www.gnu.org/licenses/>.
+
+//  SEE HEADER FILE FOR DOCUMENTATION
+
+#include "CBSignatureCache.h"
+#include <pthread.h>
+#include <string.h>
+
+// Entries which are all zero are empty.
+static uint8_t CBSignatureCacheEntries[CB_SIGNATURE_CACHE_BUCKETS][CB_SIGNATURE_CACHE_WAYS][32];
+static uint64_t CBSignatureCacheHits = 0;
+static uint64_t CBSignatureCacheMisses = 0;
+static uint32_t CBSignatureCacheEvictState = 0x9E3779B9; // xorshift state for choosing evictions.
+static uint8_t CBSignatureCacheSalt[16]; // Hashed into every identifier, so that the bucket of an entry cannot be chosen by whoever supplies the signature.
+static bool CBSignatureCacheSalted = false;
+static pthread_once_t CBSignatureCacheOnce = PTHREAD_ONCE_INIT;
+static pthread_mutex_t CBSignatureCacheMutex = PTHREAD_MUTEX_INITIALIZER;
+
+//  Functions
+
+// Seeds the salt and the eviction state from the random dependency when the cache is first used.
+static void CBSignatureCacheCreate(void){
+	uint32_t evictState;
+	CBSignatureCacheSalted = CBSecureRandomBytes(CBSignatureCacheSalt, 16)
+		&& CBSecureRandomBytes((uint8_t *)&evictState, 4);
+	if (NOT CBSignatureCacheSalted) {
+		CBLogError("Could not seed the signature cache. Signatures will be verified without it.");
+		return;
+	}
+	// xorshift must not start from zero.
+	if (evictState)
+		CBSignatureCacheEvictState = evictState;
+}
+static bool CBSignatureCacheEntryIsEmpty(uint8_t * entry){
+	for (uint8_t x = 0; x < 32; x++)
+		if (entry[x])
+			return false;
+	return true;
+}
+bool CBSignatureCacheVerify(uint8_t * signature, uint8_t sigLen, uint8_t * hash, uint8_t * pubKey, uint8_t keyLen){
+	pthread_once(&CBSignatureCacheOnce, CBSignatureCacheCreate);
+	if (NOT CBSignatureCacheSalted)
+		// Without the salt entries could be forced into chosen buckets, so do not use the cache.
+		return CBEcdsaVerify(signature, sigLen, hash, pubKey, keyLen);
+	// Identify the entry by the hash of the salt, signature hash, public key and signature, with lengths so that the boundaries are unambiguous.
+	uint8_t data[16 + 32 + 1 + 255 + 1 + 255];
+	memcpy(data, CBSignatureCacheSalt, 16);
+	uint16_t len = 16;
+	memcpy(data + len, hash, 32);
+	len += 32;
+	data[len++] = keyLen;
+	memcpy(data + len, pubKey, keyLen);
+	len += keyLen;
+	data[len++] = sigLen;
+	memcpy(data + len, signature, sigLen);
+	len += sigLen;
+	uint8_t id[32];
+	CBSha256(data, len, id);
+	// Never use the empty value as an identifier.
+	if (CBSignatureCacheEntryIsEmpty(id))
+		id[0] = 1;
+	// The identifier depends on the salt, so its first bytes give an unpredictable bucket.
+	uint8_t (* bucket)[32] = CBSignatureCacheEntries[(id[0] | id[1] << 8 | id[2] << 16 | (uint32_t)id[3] << 24) & (CB_SIGNATURE_CACHE_BUCKETS - 1)];
+	pthread_mutex_lock(&CBSignatureCacheMutex);
+	for (uint8_t x = 0; x < CB_SIGNATURE_CACHE_WAYS; x++)
+		if (NOT memcmp(bucket[x], id, 32)) {
+			CBSignatureCacheHits++;
+			pthread_mutex_unlock(&CBSignatureCacheMutex);
+			return true;
+		}
+	CBSignatureCacheMisses++;
+	pthread_mutex_unlock(&CBSignatureCacheMutex);
+	// Not in the cache so verify outside of the lock.
+	if (NOT CBEcdsaVerify(signature, sigLen, hash, pubKey, keyLen))
+		return false;
+	pthread_mutex_lock(&CBSignatureCacheMutex);
+	uint8_t x = 0;
+	for (; x < CB_SIGNATURE_CACHE_WAYS; x++)
+		if (CBSignatureCacheEntryIsEmpty(bucket[x]) || NOT memcmp(bucket[x], id, 32))
+			break;
+	if (x == CB_SIGNATURE_CACHE_WAYS) {
+		// The bucket is full, so evict a random entry.
+		CBSignatureCacheEvictState ^= CBSignatureCacheEvictState << 13;
+		CBSignatureCacheEvictState ^= CBSignatureCacheEvictState >> 17;
+		CBSignatureCacheEvictState ^= CBSignatureCacheEvictState << 5;
+		x = CBSignatureCacheEvictState % CB_SIGNATURE_CACHE_WAYS;
+	}
+	memcpy(bucket[x], id, 32);
+	pthread_mutex_unlock(&CBSignatureCacheMutex);
+	return true;
+}
+void CBSignatureCacheClear(void){
+	pthread_mutex_lock(&CBSignatureCacheMutex);
+	memset(CBSignatureCacheEntries, 0, sizeof(CBSignatureCacheEntries));
+	CBSignatureCacheHits = 0;
+	CBSignatureCacheMisses = 0;
+	pthread_mutex_unlock(&CBSignatureCacheMutex);
+}
+uint64_t CBSignatureCacheGetHits(void){
+	pthread_mutex_lock(&CBSignatureCacheMutex);
+	uint64_t hits = CBSignatureCacheHits;
+	pthread_mutex_unlock(&CBSignatureCacheMutex);
+	return hits;
+}
+uint64_t CBSignatureCacheGetMisses(void){
+	pthread_mutex_lock(&CBSignatureCacheMutex);
+	uint64_t misses = CBSignatureCacheMisses;
+	pthread_mutex_unlock(&CBSignatureCacheMutex);
+	return misses;
+}
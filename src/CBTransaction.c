@@ -29,7 +29,7 @@
 //  Constructor
 
 CBTransaction * CBNewTransaction(uint32_t lockTime, uint32_t version){
-	CBTransaction * self = malloc(sizeof(*self));
+	CBTransaction * self = CBAllocObject(sizeof(*self));
 	if (NOT self) {
 		CBLogError("Cannot allocate %i bytes of memory in CBNewTransaction\n", sizeof(*self));
 		return NULL;
@@ -37,11 +37,11 @@ CBTransaction * CBNewTransaction(uint32_t lockTime, uint32_t version){
 	CBGetObject(self)->free = CBFreeTransaction;
 	if(CBInitTransaction(self, lockTime, version))
 		return self;
-	free(self);
+	CBDeallocObject(self);
 	return NULL;
 }
 CBTransaction * CBNewTransactionFromData(CBByteArray * bytes){
-	CBTransaction * self = malloc(sizeof(*self));
+	CBTransaction * self = CBAllocObject(sizeof(*self));
 	if (NOT self) {
 		CBLogError("Cannot allocate %i bytes of memory in CBNewTransactionFromData\n", sizeof(*self));
 		return NULL;
@@ -49,7 +49,7 @@ CBTransaction * CBNewTransactionFromData(CBByteArray * bytes){
 	CBGetObject(self)->free = CBFreeTransaction;
 	if(CBInitTransactionFromData(self, bytes))
 		return self;
-	free(self);
+	CBDeallocObject(self);
 	return NULL;
 }
 
@@ -27,7 +27,7 @@
 //  Constructors
 
 CBTransactionInput * CBNewTransactionInput(CBScript * script, uint32_t sequence, CBByteArray * prevOutHash, uint32_t prevOutIndex){
-	CBTransactionInput * self = malloc(sizeof(*self));
+	CBTransactionInput * self = CBAllocObject(sizeof(*self));
 	if (NOT self) {
 		CBLogError("Cannot allocate %i bytes of memory in CBNewTransactionInput\n", sizeof(*self));
 		return NULL;
@@ -35,11 +35,11 @@ CBTransactionInput * CBNewTransactionInput(CBScript * script, uint32_t sequence,
 	CBGetObject(self)->free = CBFreeTransactionInput;
 	if(CBInitTransactionInput(self, script, sequence, prevOutHash, prevOutIndex))
 		return self;
-	free(self);
+	CBDeallocObject(self);
 	return NULL;
 }
 CBTransactionInput * CBNewTransactionInputFromData(CBByteArray * data){
-	CBTransactionInput * self = malloc(sizeof(*self));
+	CBTransactionInput * self = CBAllocObject(sizeof(*self));
 	if (NOT self) {
 		CBLogError("Cannot allocate %i bytes of memory in CBNewTransactionInputFromData\n", sizeof(*self));
 		return NULL;
@@ -47,11 +47,11 @@ CBTransactionInput * CBNewTransactionInputFromData(CBByteArray * data){
 	CBGetObject(self)->free = CBFreeTransactionInput;
 	if(CBInitTransactionInputFromData(self, data))
 		return self;
-	free(self);
+	CBDeallocObject(self);
 	return NULL;
 }
 CBTransactionInput * CBNewUnsignedTransactionInput(uint32_t sequence, CBByteArray * prevOutHash, uint32_t prevOutIndex){
-	CBTransactionInput * self = malloc(sizeof(*self));
+	CBTransactionInput * self = CBAllocObject(sizeof(*self));
 	if (NOT self) {
 		CBLogError("Cannot allocate %i bytes of memory in CBNewUnsignedTransactionInput\n", sizeof(*self));
 		return NULL;
@@ -59,7 +59,7 @@ CBTransactionInput * CBNewUnsignedTransactionInput(uint32_t sequence, CBByteArra
 	CBGetObject(self)->free = CBFreeTransactionInput;
 	if(CBInitUnsignedTransactionInput(self, sequence, prevOutHash, prevOutIndex))
 		return self;
-	free(self);
+	CBDeallocObject(self);
 	return NULL;
 }
 
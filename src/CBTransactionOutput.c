@@ -27,7 +27,7 @@
 //  Constructors
 
 CBTransactionOutput * CBNewTransactionOutput(uint64_t value, CBScript * script){
-	CBTransactionOutput * self = malloc(sizeof(*self));
+	CBTransactionOutput * self = CBAllocObject(sizeof(*self));
 	if (NOT self) {
 		CBLogError("Cannot allocate %i bytes of memory in CBNewTransactionOutput\n", sizeof(*self));
 		return NULL;
@@ -35,11 +35,11 @@ CBTransactionOutput * CBNewTransactionOutput(uint64_t value, CBScript * script){
 	CBGetObject(self)->free = CBFreeTransactionOutput;
 	if(CBInitTransactionOutput(self, value, script))
 		return self;
-	free(self);
+	CBDeallocObject(self);
 	return NULL;
 }
 CBTransactionOutput * CBNewTransactionOutputFromData(CBByteArray * data){
-	CBTransactionOutput * self = malloc(sizeof(*self));
+	CBTransactionOutput * self = CBAllocObject(sizeof(*self));
 	if (NOT self) {
 		CBLogError("Cannot allocate %i bytes of memory in CBNewTransactionOutputFromData\n", sizeof(*self));
 		return NULL;
@@ -47,7 +47,7 @@ CBTransactionOutput * CBNewTransactionOutputFromData(CBByteArray * data){
 	CBGetObject(self)->free = CBFreeTransactionOutput;
 	if(CBInitTransactionOutputFromData(self, data))
 		return self;
-	free(self);
+	CBDeallocObject(self);
 	return NULL;
 }
 
@@ -27,7 +27,7 @@
 //  Constructor
 
 CBVersion * CBNewVersion(int32_t version, CBVersionServices services, int64_t time, CBNetworkAddress * addRecv, CBNetworkAddress * addSource, uint64_t nounce, CBByteArray * userAgent, int32_t blockHeight){
-	CBVersion * self = malloc(sizeof(*self));
+	CBVersion * self = CBAllocObject(sizeof(*self));
 	if (NOT self) {
 		CBLogError("Cannot allocate %i bytes of memory in CBNewVersion\n", sizeof(*self));
 		return NULL;
@@ -35,11 +35,11 @@ CBVersion * CBNewVersion(int32_t version, CBVersionServices services, int64_t ti
 	CBGetObject(self)->free = CBFreeVersion;
 	if(CBInitVersion(self, version, services, time, addRecv, addSource, nounce, userAgent, blockHeight))
 		return self;
-	free(self);
+	CBDeallocObject(self);
 	return NULL;
 }
 CBVersion * CBNewVersionFromData(CBByteArray * data){
-	CBVersion * self = malloc(sizeof(*self));
+	CBVersion * self = CBAllocObject(sizeof(*self));
 	if (NOT self) {
 		CBLogError("Cannot allocate %i bytes of memory in CBNewVersionFromData\n", sizeof(*self));
 		return NULL;
@@ -47,7 +47,7 @@ CBVersion * CBNewVersionFromData(CBByteArray * data){
 	CBGetObject(self)->free = CBFreeVersion;
 	if(CBInitVersionFromData(self, data))
 		return self;
-	free(self);
+	CBDeallocObject(self);
 	return NULL;
 }
 
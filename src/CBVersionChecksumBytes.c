@@ -27,7 +27,7 @@
 //  Constructors
 
 CBVersionChecksumBytes * CBNewVersionChecksumBytesFromString(CBByteArray * string, bool cacheString){
-	CBVersionChecksumBytes * self = malloc(sizeof(*self));
+	CBVersionChecksumBytes * self = CBAllocObject(sizeof(*self));
 	if (NOT self) {
 		CBLogError("Cannot allocate %i bytes of memory in CBNewVersionChecksumBytesFromString\n", sizeof(*self));
 		return NULL;
@@ -35,11 +35,11 @@ CBVersionChecksumBytes * CBNewVersionChecksumBytesFromString(CBByteArray * strin
 	CBGetObject(self)->free = CBFreeVersionChecksumBytes;
 	if(CBInitVersionChecksumBytesFromString(self, string, cacheString))
 		return self;
-	free(self);
+	CBDeallocObject(self);
 	return NULL;
 }
 CBVersionChecksumBytes * CBNewVersionChecksumBytesFromBytes(uint8_t * bytes, uint32_t size, bool cacheString){
-	CBVersionChecksumBytes * self = malloc(sizeof(*self));
+	CBVersionChecksumBytes * self = CBAllocObject(sizeof(*self));
 	if (NOT self) {
 		CBLogError("Cannot allocate %i bytes of memory in CBNewVersionChecksumBytesFromBytes\n", sizeof(*self));
 		return NULL;
@@ -47,7 +47,7 @@ CBVersionChecksumBytes * CBNewVersionChecksumBytesFromBytes(uint8_t * bytes, uin
 	CBGetObject(self)->free = CBFreeVersionChecksumBytes;
 	if(CBInitVersionChecksumBytesFromBytes(self, bytes, size, cacheString))
 		return self;
-	free(self);
+	CBDeallocObject(self);
 	return NULL;
 }
 
@@ -0,0 +1,136 @@
+//
+//  testBRHeaderChain.c
+//  cbitcoin
+//
+//  Copyright (c) 2012 Matthew Mitchell
+//
+//  This file is part of cbitcoin.
+//
+//  cbitcoin is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  cbitcoin is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with cbitcoin.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "CBBlockChainStorage.h"
+#include "BRHeaderChain.h"
+#include "BRConnection.h"
+
+#define NUM_HEADERS 6
+
+void CBLogError(char * format, ...);
+void CBLogError(char * format, ...){
+	va_list argptr;
+	va_start(argptr, format);
+	vfprintf(stderr, format, argptr);
+	va_end(argptr);
+	fprintf(stderr, "\n");
+}
+
+// Removes the storage of the test validator.
+static void BRRemoveTestStorage(void){
+	remove("./headerchain/blk_log.dat");
+	remove("./headerchain/blk_0.dat");
+	remove("./headerchain/blk_1.dat");
+	remove("./headerchain/blk_2.dat");
+	remove("./headerchain/blk00000.dat");
+}
+
+// Makes a block header without transactions on top of prevHash.
+static CBBlock * BRMakeTestHeader(uint8_t * prevHash, uint32_t time, uint32_t target){
+	CBBlock * header = CBNewBlock();
+	header->version = 1;
+	header->prevBlockHash = CBNewByteArrayWithDataCopy(prevHash, 32);
+	header->merkleRoot = CBNewByteArrayOfSize(32);
+	memset(CBByteArrayGetData(header->merkleRoot), 0, 32);
+	header->time = time;
+	header->target = target;
+	header->nonce = 0;
+	header->transactionNum = 0;
+	CBGetMessage(header)->bytes = CBNewByteArrayOfSize(CBBlockCalculateLength(header, false));
+	CBBlockSerialise(header, false, false);
+	return header;
+}
+
+int main(){
+	mkdir("./headerchain", 0777);
+	BRRemoveTestStorage();
+	uint64_t storage = CBNewBlockChainStorage("./headerchain/");
+	bool bad;
+	CBFullValidator * validator = CBNewFullValidator(storage, &bad, CB_FULL_VALIDATOR_DISABLE_POW_CHECK);
+	if (NOT validator || bad) {
+		printf("VALIDATOR INIT FAIL\n");
+		return 1;
+	}
+	BRHeaderChain * hc = BRNewHeaderChain(validator);
+	// Add headers above the genesis block.
+	uint32_t time = validator->mainTip->time;
+	CBBlock * headers[NUM_HEADERS + 1];
+	for (uint32_t x = 1; x <= NUM_HEADERS; x++) {
+		headers[x] = BRMakeTestHeader(BRHeaderChainTip(hc)->hash, time + 600*x, CB_MAX_TARGET);
+		if (BRHeaderChainAdd(hc, headers[x], time + 600*x) != BR_HEADER_ADDED) {
+			printf("ADD HEADER %u FAIL\n", x);
+			return 1;
+		}
+	}
+	// Two peers have bodies in flight above the first block.
+	BRConnection peers[2];
+	memset(peers, 0, sizeof(peers));
+	for (uint32_t x = 2; x <= NUM_HEADERS; x++) {
+		BRConnection * peer = peers + x % 2;
+		BRHeaderChainGet(hc, x)->requested_from = peer;
+		peer->blocks_in_flight++;
+	}
+	// The body of the first block arrives without transactions and is rejected.
+	BRHeader * first = BRHeaderChainGet(hc, 1);
+	first->block = BRMakeTestHeader(BRHeaderChainGet(hc, 0)->hash, first->time, CB_MAX_TARGET);
+	if (BRHeaderChainConnect(hc, validator) != 0) {
+		printf("CONNECT BAD BODY FAIL\n");
+		return 1;
+	}
+	if (BRHeaderChainTip(hc)->height != 0 || hc->connected != 0) {
+		printf("TRUNCATE FAIL\n");
+		return 1;
+	}
+	// The peers get their slots back, as the bodies they were asked for are no longer wanted.
+	if (peers[0].blocks_in_flight || peers[1].blocks_in_flight) {
+		printf("BLOCKS IN FLIGHT AFTER TRUNCATE FAIL %i %i\n", peers[0].blocks_in_flight, peers[1].blocks_in_flight);
+		return 1;
+	}
+	// The rejected header and its descendants are refused when a peer sends them again.
+	if (BRHeaderChainAdd(hc, headers[1], time + 600*NUM_HEADERS) != BR_HEADER_BAD) {
+		printf("READD REJECTED HEADER FAIL\n");
+		return 1;
+	}
+	if (BRHeaderChainAdd(hc, headers[2], time + 600*NUM_HEADERS) != BR_HEADER_BAD) {
+		printf("ADD REJECTED DESCENDANT FAIL\n");
+		return 1;
+	}
+	// A different block at the same height is still accepted.
+	CBBlock * other = BRMakeTestHeader(BRHeaderChainTip(hc)->hash, time + 601, CB_MAX_TARGET);
+	if (BRHeaderChainAdd(hc, other, time + 601) != BR_HEADER_ADDED) {
+		printf("ADD OTHER HEADER FAIL\n");
+		return 1;
+	}
+	CBReleaseObject(other);
+	for (uint32_t x = 1; x <= NUM_HEADERS; x++)
+		CBReleaseObject(headers[x]);
+	BRFreeHeaderChain(hc);
+	CBReleaseObject(validator);
+	CBFreeBlockChainStorage(storage);
+	BRRemoveTestStorage();
+	rmdir("./headerchain");
+	return 0;
+}
@@ -0,0 +1,610 @@
+//
+//  testCBBlockChainStorage.c
+//  cbitcoin
+//
+//  Copyright (c) 2012 Matthew Mitchell
+//
+//  This file is part of cbitcoin.
+//
+//  cbitcoin is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  cbitcoin is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with cbitcoin.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "CBBlockChainStorage.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <time.h>
+#include <sys/time.h>
+
+#define NUM_OUTPUTS 3000
+
+void CBLogError(char * format, ...);
+void CBLogError(char * format, ...){
+	va_list argptr;
+	va_start(argptr, format);
+	vfprintf(stderr, format, argptr);
+	va_end(argptr);
+	printf("\n");
+}
+
+static double seconds(void){
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+// Makes the script for an output, cycling through pay-to-pubkey-hash, pay-to-script-hash and pay-to-pubkey.
+static CBScript * makeScript(uint32_t x){
+	uint8_t data[35];
+	for (uint8_t y = 0; y < 35; y++)
+		data[y] = (uint8_t)(x * 7 + y);
+	switch (x % 3) {
+		case 0:
+			data[0] = CB_SCRIPT_OP_DUP;
+			data[1] = CB_SCRIPT_OP_HASH160;
+			data[2] = 20;
+			data[23] = CB_SCRIPT_OP_EQUALVERIFY;
+			data[24] = CB_SCRIPT_OP_CHECKSIG;
+			return CBNewScriptWithDataCopy(data, 25);
+		case 1:
+			data[0] = CB_SCRIPT_OP_HASH160;
+			data[1] = 20;
+			data[22] = CB_SCRIPT_OP_EQUAL;
+			return CBNewScriptWithDataCopy(data, 23);
+		default:
+			data[0] = 33;
+			data[34] = CB_SCRIPT_OP_CHECKSIG;
+			return CBNewScriptWithDataCopy(data, 35);
+	}
+}
+
+static uint64_t makeValue(uint32_t x){
+	return x % 2 ? 5000000000 : 1234567 * (uint64_t)x + 1;
+}
+
+// Loads an output through the references into the block, as unspent outputs were before the records.
+static CBTransactionOutput * loadReferencedOutput(CBDatabase * database, uint8_t * txHash, uint32_t outputIndex){
+	uint8_t key[38] = {37, CB_STORAGE_UNSPENT_OUTPUT};
+	memcpy(key + 2, txHash, 32);
+	CBInt32ToArray(key, 34, outputIndex);
+	uint8_t ref[8];
+	if (NOT CBDatabaseReadValue(database, key, ref, 8, 0))
+		return NULL;
+	uint8_t txKey[34] = {33, CB_STORAGE_TRANSACTION_INDEX};
+	memcpy(txKey + 2, txHash, 32);
+	uint8_t txRef[CB_TRANSACTION_REF_SIZE];
+	if (NOT CBDatabaseReadValue(database, txKey, txRef, CB_TRANSACTION_REF_IS_COINBASE, 0))
+		return NULL;
+	uint8_t blockKey[6] = {5, CB_STORAGE_BLOCK};
+	memcpy(blockKey + 2, txRef + CB_TRANSACTION_REF_BLOCK_ID, 4);
+	CBByteArray * outputBytes = CBNewByteArrayOfSize(CBArrayToInt32(ref, CB_UNSPENT_OUTPUT_REF_LENGTH));
+	if (NOT CBDatabaseReadValue(database, blockKey, CBByteArrayGetData(outputBytes), outputBytes->length, CBArrayToInt32(ref, CB_UNSPENT_OUTPUT_REF_POSITION))) {
+		CBReleaseObject(outputBytes);
+		return NULL;
+	}
+	CBTransactionOutput * output = CBNewTransactionOutputFromData(outputBytes);
+	CBReleaseObject(outputBytes);
+	CBTransactionOutputDeserialise(output);
+	return output;
+}
+
+static bool outputMatches(CBTransactionOutput * output, uint64_t value, CBScript * script){
+	return output->value == value
+		&& output->scriptObject->length == script->length
+		&& (NOT script->length || NOT memcmp(CBByteArrayGetData(output->scriptObject), CBByteArrayGetData(script), script->length));
+}
+
+// Orders unspent output changes by key, with the creation of an output before its spend, as the validator does.
+static int changeCompare(const void * vchange1, const void * vchange2){
+	const CBUnspentOutputChange * change1 = vchange1, * change2 = vchange2;
+	int cmp = memcmp(change1->key, change2->key, 36);
+	if (cmp)
+		return cmp;
+	return (change1->output == NULL) - (change2->output == NULL);
+}
+
+int main(){
+	unsigned int s = (unsigned int)time(NULL);
+	printf("Session = %ui\n", s);
+	srand(s);
+	// Amount compression
+	uint64_t amounts[] = {0, 1, 9, 10, 50, 1000000, 5000000000, 2100000000000000, 123456789, 1000000000};
+	for (uint8_t x = 0; x < sizeof(amounts) / sizeof(*amounts); x++)
+		if (CBBlockChainStorageDecompressAmount(CBBlockChainStorageCompressAmount(amounts[x])) != amounts[x]) {
+			printf("AMOUNT COMPRESSION %llu FAIL\n", (unsigned long long)amounts[x]);
+			return 1;
+		}
+	for (uint32_t x = 0; x < 10000; x++) {
+		uint64_t amount = ((uint64_t)rand() * rand()) % 2100000000000001;
+		if (CBBlockChainStorageDecompressAmount(CBBlockChainStorageCompressAmount(amount)) != amount) {
+			printf("AMOUNT COMPRESSION RANDOM %llu FAIL\n", (unsigned long long)amount);
+			return 1;
+		}
+	}
+	if (CBBlockChainStorageCompressAmount(5000000000) > 0x7F) {
+		printf("AMOUNT COMPRESSION SIZE FAIL\n");
+		return 1;
+	}
+	remove("./blk_log.dat");
+	remove("./blk_0.dat");
+	remove("./blk_1.dat");
+	remove("./blk_2.dat");
+	remove("./blk00000.dat");
+	remove("./blk00001.dat");
+	remove("./blk00002.dat");
+	remove("./blk00003.dat");
+	uint64_t storage = CBNewBlockChainStorage("./");
+	CBDatabase * database = (CBDatabase *)storage;
+	CBFullValidator validator;
+	validator.storage = storage;
+	// Write a database with unspent outputs referencing a block, as before CB_BLOCK_CHAIN_STORAGE_VERSION 1.
+	uint8_t txHash[32];
+	for (uint8_t x = 0; x < 32; x++)
+		txHash[x] = x;
+	CBScript * scripts[NUM_OUTPUTS];
+	uint32_t blockSize = 10;
+	for (uint32_t x = 0; x < NUM_OUTPUTS; x++) {
+		scripts[x] = makeScript(x);
+		blockSize += 9 + scripts[x]->length;
+	}
+	uint8_t * block = malloc(blockSize);
+	memset(block, 0, 10);
+	uint32_t cursor = 10;
+	uint8_t key[38] = {37, CB_STORAGE_UNSPENT_OUTPUT};
+	memcpy(key + 2, txHash, 32);
+	for (uint32_t x = 0; x < NUM_OUTPUTS; x++) {
+		CBTransactionOutput * output = CBNewTransactionOutput(makeValue(x), scripts[x]);
+		uint32_t len = CBTransactionOutputCalculateLength(output);
+		CBGetMessage(output)->bytes = CBNewByteArrayOfSize(len);
+		CBTransactionOutputSerialise(output);
+		memcpy(block + cursor, CBByteArrayGetData(CBGetMessage(output)->bytes), len);
+		uint8_t ref[8];
+		CBInt32ToArray(ref, CB_UNSPENT_OUTPUT_REF_POSITION, cursor);
+		CBInt32ToArray(ref, CB_UNSPENT_OUTPUT_REF_LENGTH, len);
+		CBInt32ToArray(key, 34, x);
+		CBDatabaseWriteValue(database, key, ref, 8);
+		cursor += len;
+		CBReleaseObject(output);
+	}
+	CBDatabaseWriteValue(database, (uint8_t [6]){5, CB_STORAGE_BLOCK, 1, 0, 0, 0}, block, cursor);
+	uint8_t txRef[CB_TRANSACTION_REF_SIZE] = {0};
+	CBInt32ToArray(txRef, CB_TRANSACTION_REF_BLOCK_ID, 1);
+	CBInt32ToArray(txRef, CB_TRANSACTION_REF_HEIGHT, 5);
+	CBInt32ToArray(txRef, CB_TRANSACTION_REF_POSITION_OUPTUTS, 10);
+	CBInt32ToArray(txRef, CB_TRANSACTION_REF_LENGTH_OUTPUTS, cursor - 10);
+	CBInt32ToArray(txRef, CB_TRANSACTION_REF_NUM_UNSPENT_OUTPUTS, NUM_OUTPUTS);
+	CBInt32ToArray(txRef, CB_TRANSACTION_REF_INSTANCE_COUNT, 1);
+	uint8_t txKey[34] = {33, CB_STORAGE_TRANSACTION_INDEX};
+	memcpy(txKey + 2, txHash, 32);
+	CBDatabaseWriteValue(database, txKey, txRef, CB_TRANSACTION_REF_SIZE);
+	uint8_t info[8] = {1, 0, 0, 0, 2, 0, 0, 0};
+	CBDatabaseWriteValue(database, (uint8_t [2]){1, CB_STORAGE_VALIDATOR_INFO}, info, 8);
+	if (NOT CBDatabaseCommit(database)) {
+		printf("COMMIT OLD DATABASE FAIL\n");
+		return 1;
+	}
+	// The old database should not be used before migration.
+	uint32_t mainTip;
+	if (CBBlockChainStorageLoadBasicValidator(&validator, &mainTip)) {
+		printf("LOAD BEFORE MIGRATION FAIL\n");
+		return 1;
+	}
+	double start = seconds();
+	for (uint32_t x = 0; x < NUM_OUTPUTS; x++) {
+		CBTransactionOutput * output = loadReferencedOutput(database, txHash, x);
+		if (NOT output || NOT outputMatches(output, makeValue(x), scripts[x])) {
+			printf("LOAD REFERENCED OUTPUT FAIL\n");
+			return 1;
+		}
+		CBReleaseObject(output);
+	}
+	double referenced = seconds() - start;
+	// Migrate
+	if (NOT CBBlockChainStorageMigrateUnspentOutputs(storage)) {
+		printf("MIGRATE FAIL\n");
+		return 1;
+	}
+	CBFreeBlockChainStorage(storage);
+	storage = CBNewBlockChainStorage("./");
+	database = (CBDatabase *)storage;
+	validator.storage = storage;
+	// The blocks are still in the database
+	if (CBBlockChainStorageLoadBasicValidator(&validator, &mainTip)) {
+		printf("LOAD BEFORE BLOCK MIGRATION FAIL\n");
+		return 1;
+	}
+	if (NOT CBBlockChainStorageMigrateBlocks(storage)) {
+		printf("MIGRATE BLOCKS FAIL\n");
+		return 1;
+	}
+	if (CBBlockChainStorageLoadBasicValidator(&validator, &mainTip)
+		|| NOT CBBlockChainStorageMigrateTransactionIndex(storage, true)) {
+		printf("MIGRATE TRANSACTION INDEX FAIL\n");
+		return 1;
+	}
+	if (NOT CBBlockChainStorageLoadBasicValidator(&validator, &mainTip) || mainTip != 1) {
+		printf("LOAD AFTER MIGRATION FAIL\n");
+		return 1;
+	}
+	CBBlock * blockObj = CBBlockChainStorageLoadBlock(&validator, 1);
+	if (CBBlockChainStorageBlockSize(&validator, 1) != cursor
+		|| CBDatabaseGetLength(database, (uint8_t [6]){5, CB_STORAGE_BLOCK, 1, 0, 0, 0}) != CB_BLOCK_INDEX_SIZE
+		|| NOT blockObj
+		|| CBGetMessage(blockObj)->bytes->length != cursor
+		|| memcmp(CBByteArrayGetData(CBGetMessage(blockObj)->bytes), block, cursor)) {
+		printf("LOAD MIGRATED BLOCK FAIL\n");
+		return 1;
+	}
+	CBReleaseObject(blockObj);
+	// The transaction reference is in the compact transaction index
+	uint8_t * outputs = NULL;
+	uint32_t outputsAllocSize = 0, outputsPos, outputsHeight;
+	bool outputsCoinbase;
+	if (CBDatabaseGetLength(database, txKey)
+		|| NOT CBBlockChainStorageLoadOutputs(&validator, txHash, &outputs, &outputsAllocSize, &outputsPos, &outputsHeight, &outputsCoinbase)
+		|| outputsPos != 10
+		|| outputsHeight != 5
+		|| outputsCoinbase
+		|| outputsAllocSize < cursor - 10
+		|| memcmp(outputs, block + 10, cursor - 10)) {
+		printf("MIGRATED TRANSACTION INDEX FAIL\n");
+		return 1;
+	}
+	free(block);
+	start = seconds();
+	for (uint32_t x = 0; x < NUM_OUTPUTS; x++) {
+		bool coinbase;
+		uint32_t height;
+		CBTransactionOutput * output = CBBlockChainStorageLoadUnspentOutput(&validator, txHash, x, &coinbase, &height);
+		if (NOT output || NOT outputMatches(output, makeValue(x), scripts[x]) || coinbase || height != 5) {
+			printf("LOAD MIGRATED OUTPUT %u FAIL\n", x);
+			return 1;
+		}
+		CBReleaseObject(output);
+	}
+	double records = seconds() - start;
+	printf("%u unspent outputs loaded in %.0fus via block references, %.0fus from records\n", NUM_OUTPUTS, referenced * 1000000, records * 1000000);
+	// The templated scripts should only store their hashes.
+	CBInt32ToArray(key, 34, 0);
+	if (CBDatabaseGetLength(database, key) != 1 + 1 + 1 + 20) {
+		printf("P2PKH RECORD SIZE FAIL\n");
+		return 1;
+	}
+	CBInt32ToArray(key, 34, 1);
+	if (CBDatabaseGetLength(database, key) != 1 + 1 + 1 + 20) {
+		printf("P2SH RECORD SIZE FAIL\n");
+		return 1;
+	}
+	// Migrating again does nothing
+	if (NOT CBBlockChainStorageMigrateUnspentOutputs(storage)) {
+		printf("MIGRATE AGAIN FAIL\n");
+		return 1;
+	}
+	// Round trip a coinbase output with an empty script at a height needing a longer variable integer.
+	CBScript * empty = CBNewScriptOfSize(0);
+	CBTransactionOutput * output = CBNewTransactionOutput(2100000000000000, empty);
+	uint8_t coinbaseHash[32] = {0xFF};
+	if (NOT CBBlockChainStorageSaveUnspentOutput(&validator, coinbaseHash, 3, output, 250000, true)) {
+		printf("SAVE COINBASE OUTPUT FAIL\n");
+		return 1;
+	}
+	CBReleaseObject(output);
+	bool coinbase;
+	uint32_t height;
+	output = CBBlockChainStorageLoadUnspentOutput(&validator, coinbaseHash, 3, &coinbase, &height);
+	if (NOT output || NOT outputMatches(output, 2100000000000000, empty) || NOT coinbase || height != 250000) {
+		printf("LOAD COINBASE OUTPUT FAIL\n");
+		return 1;
+	}
+	CBReleaseObject(output);
+	CBReleaseObject(empty);
+	// New blocks are appended to the block files, starting a new file when a block does not fit.
+	CBBlockChainStorage * blockStorage = (CBBlockChainStorage *)storage;
+	blockStorage->blockFileMaxSize = 400;
+	uint8_t blockData[3][300];
+	CBBlock * blocks[3];
+	for (uint8_t x = 0; x < 3; x++) {
+		for (uint16_t y = 0; y < 300; y++)
+			blockData[x][y] = rand();
+		CBByteArray * bytes = CBNewByteArrayWithDataCopy(blockData[x], 300);
+		blocks[x] = CBNewBlockFromData(bytes);
+		CBReleaseObject(bytes);
+	}
+	if (NOT CBBlockChainStorageSaveBlock(&validator, blocks[0], 2)
+		|| NOT CBBlockChainStorageSaveBlock(&validator, blocks[1], 3)
+		|| NOT CBBlockChainStorageCommitData(storage)
+		|| blockStorage->numBlockFiles != 3
+		|| access("./blk00001.dat", F_OK)
+		|| access("./blk00002.dat", F_OK)) {
+		printf("SAVE BLOCKS TO FILES FAIL\n");
+		return 1;
+	}
+	for (uint8_t x = 0; x < 2; x++) {
+		blockObj = CBBlockChainStorageLoadBlock(&validator, 2 + x);
+		if (NOT blockObj
+			|| CBBlockChainStorageBlockSize(&validator, 2 + x) != 300
+			|| memcmp(CBByteArrayGetData(CBGetMessage(blockObj)->bytes), blockData[x], 300)) {
+			printf("LOAD BLOCK %u FROM FILE FAIL\n", 2 + x);
+			return 1;
+		}
+		CBReleaseObject(blockObj);
+	}
+	// Transactions with the same key in the compact transaction index are told apart, and a transaction can be in more than one block.
+	uint8_t sameKeyHash[32];
+	memcpy(sameKeyHash, txHash, 32);
+	sameKeyHash[CB_TRANSACTION_INDEX_KEY_HASH] ^= 0xFF;
+	uint8_t compactKey[CB_TRANSACTION_INDEX_KEY_HASH + 2] = {CB_TRANSACTION_INDEX_KEY_HASH + 1, CB_STORAGE_COMPACT_TRANSACTION_INDEX};
+	memcpy(compactKey + 2, txHash, CB_TRANSACTION_INDEX_KEY_HASH);
+	uint32_t entryLength = CBDatabaseGetLength(database, compactKey);
+	if (NOT CBBlockChainStorageSaveTransactionRef(&validator, sameKeyHash, 2, 6, 81, 40, true)
+		|| NOT CBDatabaseCommit(database)
+		|| NOT CBBlockChainStorageSaveTransactionRef(&validator, txHash, 3, 6, 90, 20, true)
+		|| NOT CBDatabaseCommit(database)
+		|| CBDatabaseGetLength(database, compactKey) <= 2 * entryLength) {
+		printf("SAVE TRANSACTION REFS FAIL\n");
+		return 1;
+	}
+	if (entryLength + sizeof(compactKey) > (CB_TRANSACTION_REF_SIZE + 34) / 2) {
+		printf("COMPACT TRANSACTION INDEX SIZE FAIL\n");
+		return 1;
+	}
+	if (NOT CBBlockChainStorageLoadOutputs(&validator, txHash, &outputs, &outputsAllocSize, &outputsPos, &outputsHeight, &outputsCoinbase)
+		|| outputsPos != 90
+		|| outputsHeight != 6
+		|| NOT outputsCoinbase
+		|| memcmp(outputs, blockData[1] + 90, 20)) {
+		printf("LOAD LATEST INSTANCE FAIL\n");
+		return 1;
+	}
+	if (NOT CBBlockChainStorageDeleteTransactionRef(&validator, txHash, 3)
+		|| NOT CBDatabaseCommit(database)
+		|| NOT CBBlockChainStorageLoadOutputs(&validator, txHash, &outputs, &outputsAllocSize, &outputsPos, &outputsHeight, &outputsCoinbase)
+		|| outputsPos != 10
+		|| outputsHeight != 5) {
+		printf("DELETE INSTANCE FAIL\n");
+		return 1;
+	}
+	if (NOT CBBlockChainStorageDeleteTransactionRef(&validator, txHash, 1)
+		|| NOT CBDatabaseCommit(database)
+		|| CBBlockChainStorageLoadOutputs(&validator, txHash, &outputs, &outputsAllocSize, &outputsPos, &outputsHeight, &outputsCoinbase)
+		|| CBBlockChainStorageDeleteTransactionRef(&validator, txHash, 1)) {
+		printf("DELETE TRANSACTION REF FAIL\n");
+		return 1;
+	}
+	if (NOT CBBlockChainStorageDeleteTransactionRef(&validator, sameKeyHash, 2)
+		|| NOT CBDatabaseCommit(database)
+		|| CBDatabaseGetLength(database, compactKey)) {
+		printf("DELETE LAST TRANSACTION REF FAIL\n");
+		return 1;
+	}
+	free(outputs);
+	// Resetting removes a block file started since the commit
+	if (NOT CBBlockChainStorageSaveBlock(&validator, blocks[2], 4)
+		|| access("./blk00003.dat", F_OK)) {
+		printf("SAVE BLOCK TO NEW FILE FAIL\n");
+		return 1;
+	}
+	CBBlockChainStorageReset(storage);
+	if (CBBlockChainStorageBlockExists(&validator, 4)
+		|| blockStorage->numBlockFiles != 3
+		|| NOT access("./blk00003.dat", F_OK)) {
+		printf("RESET BLOCK FILES FAIL\n");
+		return 1;
+	}
+	// Blocks appended without a commit are removed when opening the storage again.
+	blockStorage->blockFileMaxSize = 1000;
+	if (NOT CBBlockChainStorageSaveBlock(&validator, blocks[2], 4)
+		|| blockStorage->numBlockFiles != 3
+		|| blockStorage->blockFiles[2].length != 600) {
+		printf("APPEND BLOCK FAIL\n");
+		return 1;
+	}
+	CBFreeBlockChainStorage(storage);
+	storage = CBNewBlockChainStorage("./");
+	database = (CBDatabase *)storage;
+	blockStorage = (CBBlockChainStorage *)storage;
+	validator.storage = storage;
+	uint64_t file = CBFileOpen("./blk00002.dat", false);
+	uint32_t fileLength;
+	if (NOT storage
+		|| CBBlockChainStorageBlockExists(&validator, 4)
+		|| blockStorage->blockFiles[2].length != 300
+		|| NOT file
+		|| NOT CBFileGetLength(file, &fileLength)
+		|| fileLength != 300) {
+		printf("UNCOMMITTED BLOCK FAIL\n");
+		return 1;
+	}
+	CBFileClose(file);
+	if (NOT CBBlockChainStorageSaveBlock(&validator, blocks[2], 4)
+		|| NOT CBBlockChainStorageCommitData(storage)) {
+		printf("SAVE BLOCK AFTER REOPENING FAIL\n");
+		return 1;
+	}
+	for (uint8_t x = 0; x < 3; x++) {
+		blockObj = CBBlockChainStorageLoadBlock(&validator, 2 + x);
+		if (NOT blockObj
+			|| memcmp(CBByteArrayGetData(CBGetMessage(blockObj)->bytes), blockData[x], 300)) {
+			printf("LOAD BLOCK %u AFTER REOPENING FAIL\n", 2 + x);
+			return 1;
+		}
+		CBReleaseObject(blockObj);
+		CBReleaseObject(blocks[x]);
+	}
+	// Pruning a block keeps the header and removes the block file once it has no blocks.
+	CBBlockChainStorageSaveUndo(&validator, 2, NULL, 0);
+	if (NOT CBBlockChainStorageCommitData(storage)
+		|| NOT CBBlockChainStorageUndoExists(&validator, 2)) {
+		printf("SAVE UNDO TO PRUNE FAIL\n");
+		return 1;
+	}
+	if (NOT CBBlockChainStoragePruneBlock(&validator, 2)
+		|| NOT CBBlockChainStorageCommitData(storage)) {
+		printf("PRUNE BLOCK FAIL\n");
+		return 1;
+	}
+	uint8_t header[80];
+	if (CBBlockChainStorageBlockSize(&validator, 2)
+		|| NOT CBBlockChainStorageBlockExists(&validator, 2)
+		|| CBBlockChainStorageUndoExists(&validator, 2)
+		|| CBBlockChainStorageLoadBlock(&validator, 2)
+		|| NOT CBBlockChainStorageLoadBlockHeader(&validator, 2, header)
+		|| memcmp(header, blockData[0], 80)) {
+		printf("PRUNED BLOCK FAIL\n");
+		return 1;
+	}
+	if (NOT access("./blk00001.dat", F_OK)
+		|| access("./blk00002.dat", F_OK)) {
+		printf("PRUNED BLOCK FILE FAIL\n");
+		return 1;
+	}
+	// Apply the changes of a block where each transaction spends a migrated output and the second output of the previous transaction, first one change at a time and then batched.
+	CBUnspentOutputChange * changes = malloc(sizeof(*changes) * NUM_OUTPUTS * 2);
+	CBTransactionOutput * newOutputs[NUM_OUTPUTS];
+	uint32_t numChanges = 0, numTxs = NUM_OUTPUTS / 2;
+	for (uint32_t x = 0; x < numTxs; x++) {
+		memcpy(changes[numChanges].key, txHash, 32);
+		CBInt32ToArray(changes[numChanges].key, 32, x);
+		changes[numChanges].output = NULL;
+		changes[numChanges++].cancelled = false;
+		if (x) {
+			memcpy(changes[numChanges].key, changes[numChanges - 2].key, 32);
+			CBInt32ToArray(changes[numChanges].key, 32, 1);
+			changes[numChanges].output = NULL;
+			changes[numChanges++].cancelled = false;
+		}
+		for (uint32_t y = 0; y < 2; y++) {
+			memset(changes[numChanges].key, 0, 32);
+			CBInt32ToArray(changes[numChanges].key, 0, x + 1);
+			CBInt32ToArray(changes[numChanges].key, 32, y);
+			newOutputs[x*2 + y] = CBNewTransactionOutput(makeValue(x*2 + y), scripts[x*2 + y]);
+			changes[numChanges].output = newOutputs[x*2 + y];
+			changes[numChanges].coinbase = false;
+			changes[numChanges++].cancelled = false;
+		}
+	}
+	uint8_t * undo = NULL;
+	uint32_t undoLength = 0, undoAllocSize = 0;
+	start = seconds();
+	for (uint32_t x = 0; x < numChanges; x++) {
+		bool ok = changes[x].output
+			? CBBlockChainStorageSaveUnspentOutput(&validator, changes[x].key, CBArrayToInt32(changes[x].key, 32), changes[x].output, 7, false)
+			: CBBlockChainStorageSpendUnspentOutput(&validator, changes[x].key, CBArrayToInt32(changes[x].key, 32), &undo, &undoLength, &undoAllocSize);
+		if (NOT ok) {
+			printf("UNSPENT OUTPUT CHANGE %u FAIL\n", x);
+			return 1;
+		}
+	}
+	double individual = seconds() - start;
+	uint32_t individualUndoLength = undoLength, individualUndoNum = CBArrayToInt32(undo, 0);
+	CBBlockChainStorageReset(storage);
+	start = seconds();
+	qsort(changes, numChanges, sizeof(*changes), changeCompare);
+	uint32_t cancelled = 0;
+	for (uint32_t x = 1; x < numChanges; x++)
+		if (NOT changes[x].output && changes[x - 1].output
+			&& NOT memcmp(changes[x].key, changes[x - 1].key, 36)) {
+			changes[x].cancelled = changes[x - 1].cancelled = true;
+			cancelled++;
+		}
+	undoLength = 0;
+	if (NOT CBBlockChainStorageApplyUnspentOutputChanges(&validator, changes, numChanges, 7, &undo, &undoLength, &undoAllocSize)) {
+		printf("APPLY UNSPENT OUTPUT CHANGES FAIL\n");
+		return 1;
+	}
+	printf("%u unspent output changes for a block took %.0fus one at a time, %.0fus sorted with %u outputs cancelled\n", numChanges, individual * 1000000, (seconds() - start) * 1000000, cancelled);
+	// The undo data has the same outputs, though in a different order.
+	if (cancelled != numTxs - 1
+		|| undoLength != individualUndoLength
+		|| CBArrayToInt32(undo, 0) != individualUndoNum
+		|| individualUndoNum != numTxs * 2 - 1) {
+		printf("APPLY UNSPENT OUTPUT CHANGES UNDO FAIL\n");
+		return 1;
+	}
+	if (NOT CBBlockChainStorageCommitData(storage)) {
+		printf("COMMIT UNSPENT OUTPUT CHANGES FAIL\n");
+		return 1;
+	}
+	for (uint32_t x = 0; x < numTxs; x++) {
+		uint8_t newHash[32] = {0};
+		CBInt32ToArray(newHash, 0, x + 1);
+		if (CBBlockChainStorageUnspentOutputExists(&validator, txHash, x)
+			|| NOT CBBlockChainStorageUnspentOutputExists(&validator, newHash, 0)
+			|| CBBlockChainStorageUnspentOutputExists(&validator, newHash, 1) != (x == numTxs - 1)) {
+			printf("APPLIED UNSPENT OUTPUT CHANGES %u FAIL\n", x);
+			return 1;
+		}
+	}
+	// Read the remaining migrated outputs and some spent outputs in a random order, with and without prefetching them.
+	uint8_t outpoints[NUM_OUTPUTS][36];
+	for (uint32_t x = 0; x < NUM_OUTPUTS; x++) {
+		memcpy(outpoints[x], txHash, 32);
+		CBInt32ToArray(outpoints[x], 32, x);
+	}
+	for (uint32_t x = NUM_OUTPUTS; --x;) {
+		uint8_t swap[36];
+		uint32_t y = rand() % (x + 1);
+		memcpy(swap, outpoints[x], 36);
+		memcpy(outpoints[x], outpoints[y], 36);
+		memcpy(outpoints[y], swap, 36);
+	}
+	double lookups[2], prefetching = 0;
+	for (uint8_t x = 0; x < 2; x++) {
+		start = seconds();
+		if (x && NOT CBBlockChainStoragePrefetchUnspentOutputs(&validator, outpoints[0], NUM_OUTPUTS)) {
+			printf("PREFETCH UNSPENT OUTPUTS FAIL\n");
+			return 1;
+		}
+		if (x)
+			prefetching = seconds() - start;
+		for (uint32_t y = 0; y < NUM_OUTPUTS; y++) {
+			uint32_t outputIndex = CBArrayToInt32(outpoints[y], 32);
+			bool exists = CBBlockChainStorageUnspentOutputExists(&validator, txHash, outputIndex);
+			if (exists != (outputIndex >= numTxs)) {
+				printf("%sPREFETCHED UNSPENT OUTPUT EXISTS FAIL\n", x ? "" : "NOT ");
+				return 1;
+			}
+			if (NOT exists)
+				continue;
+			bool coinbase;
+			uint32_t height;
+			CBTransactionOutput * output = CBBlockChainStorageLoadUnspentOutput(&validator, txHash, outputIndex, &coinbase, &height);
+			if (NOT output || NOT outputMatches(output, makeValue(outputIndex), scripts[outputIndex]) || coinbase || height != 5) {
+				printf("%sPREFETCHED UNSPENT OUTPUT LOAD FAIL\n", x ? "" : "NOT ");
+				return 1;
+			}
+			CBReleaseObject(output);
+		}
+		lookups[x] = seconds() - start - prefetching;
+	}
+	printf("Reading %u unspent outputs during validation took %.0fus, %.0fus after prefetching in %.0fus\n", NUM_OUTPUTS, lookups[0] * 1000000, lookups[1] * 1000000, prefetching * 1000000);
+	// Prefetched outputs are dropped when the unspent outputs change.
+	uint8_t newHash[32] = {0xEE, 0xEE, 0xEE};
+	memcpy(outpoints[0], newHash, 32);
+	CBInt32ToArray(outpoints[0], 32, 0);
+	if (NOT CBBlockChainStoragePrefetchUnspentOutputs(&validator, outpoints[0], 1)
+		|| CBBlockChainStorageUnspentOutputExists(&validator, newHash, 0)
+		|| NOT CBBlockChainStorageSaveUnspentOutput(&validator, newHash, 0, newOutputs[0], 7, false)
+		|| NOT CBBlockChainStorageUnspentOutputExists(&validator, newHash, 0)) {
+		printf("PREFETCHED UNSPENT OUTPUT CHANGED FAIL\n");
+		return 1;
+	}
+	CBBlockChainStorageReset(storage);
+	free(undo);
+	free(changes);
+	for (uint32_t x = 0; x < numTxs * 2; x++)
+		CBReleaseObject(newOutputs[x]);
+	for (uint32_t x = 0; x < NUM_OUTPUTS; x++)
+		CBReleaseObject(scripts[x]);
+	CBFreeBlockChainStorage(storage);
+	return 0;
+}
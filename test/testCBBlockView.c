@@ -0,0 +1,248 @@
+//
+//  testCBBlockView.c
+//  cbitcoin
+//
+//  Copyright (c) 2012 Matthew Mitchell
+//
+//  This file is part of cbitcoin.
+//
+//  cbitcoin is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  cbitcoin is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with cbitcoin.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <time.h>
+#include "CBBlock.h"
+#include "CBBlockView.h"
+
+void CBLogError(char * format, ...);
+void CBLogError(char * format, ...){
+	va_list argptr;
+	va_start(argptr, format);
+	vfprintf(stderr, format, argptr);
+	va_end(argptr);
+	printf("\n");
+}
+
+#ifdef __GLIBC__
+// Count heap allocations to compare parsing with deserialisation.
+void * __libc_malloc(size_t size);
+void * __libc_realloc(void * ptr, size_t size);
+void * __libc_calloc(size_t num, size_t size);
+uint32_t allocations = 0;
+void * malloc(size_t size){
+	allocations++;
+	return __libc_malloc(size);
+}
+void * realloc(void * ptr, size_t size){
+	allocations++;
+	return __libc_realloc(ptr, size);
+}
+void * calloc(size_t num, size_t size){
+	allocations++;
+	return __libc_calloc(num, size);
+}
+#else
+uint32_t allocations = 0; // Not counted
+#endif
+
+#define TX_NUM 2000
+#define ROUNDS 20
+
+static double seconds(void){
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+static uint32_t putInt32(uint8_t * data, uint32_t cursor, uint32_t val){
+	for (uint8_t x = 0; x < 4; x++)
+		data[cursor + x] = val >> (x*8);
+	return cursor + 4;
+}
+// Makes a block with a coinbase and then transactions with two inputs and two outputs, of the size of typical pay to public key hash transactions.
+static uint32_t makeBlock(uint8_t * data){
+	uint32_t cursor = putInt32(data, 0, 2);
+	for (uint8_t x = 0; x < 64; x++)
+		data[cursor++] = x;
+	cursor = putInt32(data, cursor, 1234567890);
+	cursor = putInt32(data, cursor, 0x1d00ffff);
+	cursor = putInt32(data, cursor, 42);
+	data[cursor++] = 0xFD;
+	data[cursor++] = TX_NUM & 0xFF;
+	data[cursor++] = TX_NUM >> 8;
+	for (uint32_t x = 0; x < TX_NUM; x++) {
+		cursor = putInt32(data, cursor, 1);
+		uint8_t inputNum = x ? 2 : 1;
+		data[cursor++] = inputNum;
+		for (uint8_t y = 0; y < inputNum; y++) {
+			memset(data + cursor, 0, 32);
+			if (x) {
+				putInt32(data, cursor, x);
+				data[cursor + 4] = y;
+				cursor += 32;
+				cursor = putInt32(data, cursor, y);
+			}else{
+				cursor += 32;
+				cursor = putInt32(data, cursor, 0xFFFFFFFF);
+			}
+			uint8_t scriptLen = x ? 107 : 8;
+			data[cursor++] = scriptLen;
+			for (uint8_t z = 0; z < scriptLen; z++)
+				data[cursor++] = 1 + (x + z) % 75; // Push operations.
+			cursor = putInt32(data, cursor, 0xFFFFFFFF);
+		}
+		data[cursor++] = 2;
+		for (uint8_t y = 0; y < 2; y++) {
+			cursor = putInt32(data, cursor, 5000 + x);
+			cursor = putInt32(data, cursor, y);
+			data[cursor++] = 25;
+			data[cursor++] = CB_SCRIPT_OP_DUP;
+			data[cursor++] = CB_SCRIPT_OP_HASH160;
+			data[cursor++] = 20;
+			for (uint8_t z = 0; z < 20; z++)
+				data[cursor++] = x + y + z;
+			data[cursor++] = CB_SCRIPT_OP_EQUALVERIFY;
+			data[cursor++] = CB_SCRIPT_OP_CHECKSIG;
+		}
+		cursor = putInt32(data, cursor, x);
+	}
+	return cursor;
+}
+
+int main(){
+	uint8_t * data = malloc(TX_NUM * 400 + 100);
+	uint32_t length = makeBlock(data);
+	CBBlockView view;
+	CBInitBlockView(&view);
+	if (CBBlockViewParse(&view, data, length) != length) {
+		printf("PARSE LENGTH FAIL\n");
+		return 1;
+	}
+	CBByteArray * bytes = CBNewByteArrayWithDataCopy(data, length);
+	CBBlock * block = CBNewBlockFromData(bytes);
+	if (CBBlockDeserialise(block, true) != length) {
+		printf("DESERIALISE LENGTH FAIL\n");
+		return 1;
+	}
+	// Compare the view with the objects.
+	if (view.version != block->version || view.time != block->time || view.target != block->target || view.nonce != block->nonce || view.transactionNum != block->transactionNum) {
+		printf("HEADER FAIL\n");
+		return 1;
+	}
+	if (memcmp(CBBlockViewGetPrevBlockHash(&view), CBByteArrayGetData(block->prevBlockHash), 32)
+		|| memcmp(CBBlockViewGetMerkleRoot(&view), CBByteArrayGetData(block->merkleRoot), 32)) {
+		printf("HEADER HASHES FAIL\n");
+		return 1;
+	}
+	for (uint32_t x = 0; x < view.transactionNum; x++) {
+		CBBlockViewTransaction * vtx = view.transactions + x;
+		CBTransaction * tx = block->transactions[x];
+		if (vtx->version != tx->version || vtx->lockTime != tx->lockTime || vtx->inputNum != tx->inputNum || vtx->outputNum != tx->outputNum) {
+			printf("TRANSACTION %u FAIL\n", x);
+			return 1;
+		}
+		uint8_t hash[32];
+		CBBlockViewCalculateTransactionHash(&view, x, hash);
+		if (memcmp(hash, CBTransactionGetHash(tx), 32)) {
+			printf("TRANSACTION %u HASH FAIL\n", x);
+			return 1;
+		}
+		if (CBBlockViewTransactionIsCoinBase(&view, x) != CBTransactionIsCoinBase(tx)) {
+			printf("TRANSACTION %u COINBASE FAIL\n", x);
+			return 1;
+		}
+		for (uint32_t y = 0; y < vtx->inputNum; y++) {
+			CBBlockViewInput * vin = view.inputs + vtx->firstInput + y;
+			CBTransactionInput * in = tx->inputs[y];
+			CBScript script;
+			CBSharedData shared;
+			CBBlockViewGetInputScript(&view, vtx->firstInput + y, &script, &shared);
+			if (vin->prevOutIndex != in->prevOut.index || vin->sequence != in->sequence
+				|| memcmp(CBBlockViewGetPrevOutHash(&view, vtx->firstInput + y), CBByteArrayGetData(in->prevOut.hash), 32)
+				|| CBByteArrayCompare(&script, in->scriptObject) != CB_COMPARE_EQUAL) {
+				printf("TRANSACTION %u INPUT %u FAIL\n", x, y);
+				return 1;
+			}
+		}
+		for (uint32_t y = 0; y < vtx->outputNum; y++) {
+			CBBlockViewOutput * vout = view.outputs + vtx->firstOutput + y;
+			CBTransactionOutput * out = tx->outputs[y];
+			CBScript script;
+			CBSharedData shared;
+			CBBlockViewGetOutputScript(&view, vtx->firstOutput + y, &script, &shared);
+			if (vout->value != out->value || CBByteArrayCompare(&script, out->scriptObject) != CB_COMPARE_EQUAL) {
+				printf("TRANSACTION %u OUTPUT %u FAIL\n", x, y);
+				return 1;
+			}
+		}
+	}
+	uint8_t root[32];
+	CBBlockViewCalculateMerkleRoot(&view, root);
+	uint8_t * objRoot = CBBlockCalculateMerkleRoot(block);
+	if (memcmp(root, objRoot, 32)) {
+		printf("MERKLE ROOT FAIL\n");
+		return 1;
+	}
+	free(objRoot);
+	CBReleaseObject(block);
+	// Truncated data must fail without reading past the end.
+	for (uint32_t x = 0; x < 5000; x += 7)
+		if (CBBlockViewParse(&view, data, length - 1 - x)) {
+			printf("TRUNCATED %u FAIL\n", x);
+			return 1;
+		}
+	// A transaction count which overflows when multiplied by the minimum transaction size must fail.
+	uint8_t * crafted = malloc(length);
+	memcpy(crafted, data, 80);
+	memset(crafted + 80, 0, length - 80);
+	crafted[80] = 255;
+	for (uint8_t x = 0; x < 8; x++)
+		crafted[81 + x] = (uint8_t)(0x0444444444444445ULL >> (8*x));
+	if (CBBlockViewParse(&view, crafted, length)) {
+		printf("OVERFLOWING TRANSACTION NUMBER FAIL\n");
+		return 1;
+	}
+	free(crafted);
+	// Benchmark against object deserialisation, counting allocations.
+	uint32_t start = allocations;
+	double time = seconds();
+	for (uint8_t x = 0; x < ROUNDS; x++) {
+		block = CBNewBlockFromData(bytes);
+		CBBlockDeserialise(block, true);
+		CBReleaseObject(block);
+	}
+	double objTime = seconds() - time;
+	uint32_t objAllocs = allocations - start;
+	start = allocations;
+	time = seconds();
+	for (uint8_t x = 0; x < ROUNDS; x++)
+		CBBlockViewParse(&view, data, length);
+	double viewTime = seconds() - time;
+	uint32_t viewAllocs = allocations - start;
+	printf("%u byte block with %u transactions, %u inputs and %u outputs\n", length, view.transactionNum, view.inputNum, view.outputNum);
+	printf("CBBlockDeserialise: %.3f ms, %u allocations per block\n", objTime * 1000 / ROUNDS, objAllocs / ROUNDS);
+	printf("CBBlockViewParse: %.3f ms, %u allocations per block\n", viewTime * 1000 / ROUNDS, viewAllocs / ROUNDS);
+#ifdef __GLIBC__
+	if (viewAllocs) {
+		printf("VIEW ALLOCATIONS FAIL\n");
+		return 1;
+	}
+#endif
+	CBReleaseObject(bytes);
+	CBFreeBlockView(&view);
+	free(data);
+	return 0;
+}
@@ -0,0 +1,239 @@
+//
+//  testCBCryptoBackends.c
+//  cbitcoin
+//
+//  Copyright (c) 2012 Matthew Mitchell
+//
+//  This file is part of cbitcoin.
+//
+//  cbitcoin is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  cbitcoin is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with cbitcoin.  If not, see <http://www.gnu.org/licenses/>.
+
+// Cross-checks the crypto dependency libraries against each other and benchmarks them. The libraries are loaded with dlopen so that both can be used in one process.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <dlfcn.h>
+#include <sys/time.h>
+#include <openssl/ssl.h>
+#include "CBDependencies.h"
+
+#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
+
+#ifdef __APPLE__
+#define LIBRARY_EXTENSION ".2.0.dylib"
+#else
+#define LIBRARY_EXTENSION ".2.0.so"
+#endif
+#define BACKENDS 2
+#define KEYS 32
+#define BENCHMARK_VERIFICATIONS 1000
+#define BENCHMARK_ROUNDS 3
+
+typedef struct{
+	char * name;
+	void (*sha256)(uint8_t *, uint16_t, uint8_t *);
+	void (*sha160)(uint8_t *, uint16_t, uint8_t *);
+	void (*ripemd160)(uint8_t *, uint16_t, uint8_t *);
+	bool (*verify)(uint8_t *, uint8_t, uint8_t *, const uint8_t *, uint8_t);
+	bool (*verifyBatch)(CBEcdsaVerifyInput *, uint32_t, bool *);
+	bool (*sign)(uint8_t *, uint8_t *, unsigned int *, uint8_t **);
+} Backend;
+
+void CBLogError(char * b, ...);
+void CBLogError(char * b, ...){
+	printf("%s\n", b);
+}
+bool loadBackend(Backend * backend, char * name, char * path);
+bool loadBackend(Backend * backend, char * name, char * path){
+	void * lib = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+	if (NOT lib) {
+		printf("LOAD %s FAIL: %s\n", path, dlerror());
+		return false;
+	}
+	backend->name = name;
+	*(void **)&backend->sha256 = dlsym(lib, "CBSha256");
+	*(void **)&backend->sha160 = dlsym(lib, "CBSha160");
+	*(void **)&backend->ripemd160 = dlsym(lib, "CBRipemd160");
+	*(void **)&backend->verify = dlsym(lib, "CBEcdsaVerify");
+	*(void **)&backend->verifyBatch = dlsym(lib, "CBEcdsaVerifyBatch");
+	*(void **)&backend->sign = dlsym(lib, "CBEcdsaSign");
+	return backend->sha256 && backend->sha160 && backend->ripemd160 && backend->verify && backend->verifyBatch && backend->sign;
+}
+double getMilliseconds(void);
+double getMilliseconds(void){
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec * 1000.0 + tv.tv_usec / 1000.0;
+}
+
+int main(){
+	unsigned int s = (unsigned int)time(NULL);
+	printf("Session = %ui\n", s);
+	srand(s);
+	Backend backends[BACKENDS];
+	if (NOT loadBackend(&backends[0], "OPENSSL", "bin/libcbitcoin-crypto" LIBRARY_EXTENSION)
+		|| NOT loadBackend(&backends[1], "SECP256K1", "bin/libcbitcoin-crypto-secp256k1" LIBRARY_EXTENSION)) {
+		printf("LOAD BACKENDS FAIL\n");
+		return 1;
+	}
+	// Test hash vectors
+	uint8_t hash[32];
+	for (uint8_t b = 0; b < BACKENDS; b++) {
+		backends[b].sha256((uint8_t *)"abc", 3, hash);
+		if (memcmp(hash, (uint8_t []){0xBA, 0x78, 0x16, 0xBF, 0x8F, 0x01, 0xCF, 0xEA, 0x41, 0x41, 0x40, 0xDE, 0x5D, 0xAE, 0x22, 0x23, 0xB0, 0x03, 0x61, 0xA3, 0x96, 0x17, 0x7A, 0x9C, 0xB4, 0x10, 0xFF, 0x61, 0xF2, 0x00, 0x15, 0xAD}, 32)) {
+			printf("%s SHA256 VECTOR FAIL\n", backends[b].name);
+			return 1;
+		}
+		backends[b].ripemd160((uint8_t *)"abc", 3, hash);
+		if (memcmp(hash, (uint8_t []){0x8E, 0xB2, 0x08, 0xF7, 0xE0, 0x5D, 0x98, 0x7A, 0x9B, 0x04, 0x4A, 0x8E, 0x98, 0xC6, 0xB0, 0x87, 0xF1, 0x5A, 0x0B, 0xFC}, 20)) {
+			printf("%s RIPEMD160 VECTOR FAIL\n", backends[b].name);
+			return 1;
+		}
+		backends[b].sha160((uint8_t *)"abc", 3, hash);
+		if (memcmp(hash, (uint8_t []){0xA9, 0x99, 0x3E, 0x36, 0x47, 0x06, 0x81, 0x6A, 0xBA, 0x3E, 0x25, 0x71, 0x78, 0x50, 0xC2, 0x6C, 0x9C, 0xD0, 0xD8, 0x9D}, 20)) {
+			printf("%s SHA1 VECTOR FAIL\n", backends[b].name);
+			return 1;
+		}
+	}
+	// Cross-check hashes of random data of all lengths around the block boundaries
+	uint8_t data[300];
+	for (uint16_t len = 0; len < 300; len++) {
+		for (uint16_t x = 0; x < len; x++)
+			data[x] = rand();
+		uint8_t hashes[BACKENDS][3][32];
+		for (uint8_t b = 0; b < BACKENDS; b++) {
+			backends[b].sha256(data, len, hashes[b][0]);
+			backends[b].sha160(data, len, hashes[b][1]);
+			backends[b].ripemd160(data, len, hashes[b][2]);
+		}
+		if (memcmp(hashes[0][0], hashes[1][0], 32) || memcmp(hashes[0][1], hashes[1][1], 20) || memcmp(hashes[0][2], hashes[1][2], 20)) {
+			printf("HASH CROSS CHECK FAIL %u\n", len);
+			return 1;
+		}
+	}
+	// Test vector signature from the alert key
+	uint8_t alertPubKey[65] = {0x04, 0xFC, 0x97, 0x02, 0x84, 0x78, 0x40, 0xAA, 0xF1, 0x95, 0xDE, 0x84, 0x42, 0xEB, 0xEC, 0xED, 0xF5, 0xB0, 0x95, 0xCD, 0xBB, 0x9B, 0xC7, 0x16, 0xBD, 0xA9, 0x11, 0x09, 0x71, 0xB2, 0x8A, 0x49, 0xE0, 0xEA, 0xD8, 0x56, 0x4F, 0xF0, 0xDB, 0x22, 0x20, 0x9E, 0x03, 0x74, 0x78, 0x2C, 0x09, 0x3B, 0xB8, 0x99, 0x69, 0x2D, 0x52, 0x4E, 0x9D, 0x6A, 0x69, 0x56, 0xE7, 0xC5, 0xEC, 0xBC, 0xD6, 0x82, 0x84};
+	// Keys and signatures from each backend. The public keys are made with OpenSSL directly.
+	uint8_t privKeys[KEYS][32];
+	uint8_t pubKeys[KEYS][65];
+	uint8_t keyLens[KEYS];
+	uint8_t hashes[KEYS][32];
+	uint8_t * sigs[BACKENDS][KEYS];
+	unsigned int sigLens[BACKENDS][KEYS];
+	EC_GROUP * group = EC_GROUP_new_by_curve_name(NID_secp256k1);
+	for (uint8_t x = 0; x < KEYS; x++) {
+		for (uint8_t y = 0; y < 32; y++) {
+			privKeys[x][y] = rand();
+			hashes[x][y] = rand();
+		}
+		if (x == 0)
+			memset(privKeys[x], 0, 31); // Small key
+		privKeys[x][0] &= 0x7F;
+		BIGNUM * bn = BN_bin2bn(privKeys[x], 32, NULL);
+		EC_POINT * point = EC_POINT_new(group);
+		EC_POINT_mul(group, point, bn, NULL, NULL, NULL);
+		keyLens[x] = EC_POINT_point2oct(group, point, x % 2 ? POINT_CONVERSION_UNCOMPRESSED : POINT_CONVERSION_COMPRESSED, pubKeys[x], 65, NULL);
+		EC_POINT_free(point);
+		BN_free(bn);
+		for (uint8_t b = 0; b < BACKENDS; b++)
+			if (NOT backends[b].sign(hashes[x], privKeys[x], &sigLens[b][x], &sigs[b][x])) {
+				printf("%s SIGN FAIL\n", backends[b].name);
+				return 1;
+			}
+	}
+	EC_GROUP_free(group);
+	for (uint8_t b = 0; b < BACKENDS; b++) {
+		// The alert signature is over the double SHA-256 of the alert payload in testCBAlert.c, so check an invalid use of the key rejects in both.
+		if (backends[b].verify(sigs[0][0], sigLens[0][0], hashes[0], alertPubKey, 65)) {
+			printf("%s ALERT KEY WRONG SIG FAIL\n", backends[b].name);
+			return 1;
+		}
+		// Verify the signatures from every backend
+		for (uint8_t c = 0; c < BACKENDS; c++)
+			for (uint8_t x = 0; x < KEYS; x++) {
+				if (NOT backends[b].verify(sigs[c][x], sigLens[c][x], hashes[x], pubKeys[x], keyLens[x])) {
+					printf("%s VERIFY %s SIG FAIL %u\n", backends[b].name, backends[c].name, x);
+					return 1;
+				}
+				if (backends[b].verify(sigs[c][x], sigLens[c][x], hashes[(x + 1) % KEYS], pubKeys[x], keyLens[x])) {
+					printf("%s VERIFY %s WRONG HASH FAIL %u\n", backends[b].name, backends[c].name, x);
+					return 1;
+				}
+				if (backends[b].verify(sigs[c][x], sigLens[c][x], hashes[x], pubKeys[(x + 2) % KEYS], keyLens[(x + 2) % KEYS])) {
+					printf("%s VERIFY %s WRONG KEY FAIL %u\n", backends[b].name, backends[c].name, x);
+					return 1;
+				}
+			}
+	}
+	// Both must agree on random corruptions of signatures and keys.
+	for (uint16_t x = 0; x < 2000; x++) {
+		uint8_t k = rand() % KEYS;
+		uint8_t sig[80], key[65];
+		uint8_t sigLen = sigLens[0][k];
+		memcpy(sig, sigs[0][k], sigLen);
+		memcpy(key, pubKeys[k], keyLens[k]);
+		switch (rand() % 4) {
+			case 0: sig[rand() % sigLen] ^= 1 << (rand() % 8); break;
+			case 1: key[rand() % keyLens[k]] ^= 1 << (rand() % 8); break;
+			case 2: sigLen -= 1 + rand() % 3; break;
+			case 3: break;
+		}
+		bool res0 = backends[0].verify(sig, sigLen, hashes[k], key, keyLens[k]);
+		bool res1 = backends[1].verify(sig, sigLen, hashes[k], key, keyLens[k]);
+		if (res0 != res1) {
+			printf("CORRUPTION CROSS CHECK FAIL %u %u\n", res0, res1);
+			return 1;
+		}
+	}
+	// Test batch verification and benchmark
+	CBEcdsaVerifyInput inputs[KEYS];
+	for (uint8_t x = 0; x < KEYS; x++)
+		inputs[x] = (CBEcdsaVerifyInput){sigs[0][x], sigLens[0][x], hashes[x], pubKeys[x], keyLens[x]};
+	for (uint8_t b = 0; b < BACKENDS; b++) {
+		bool results[KEYS];
+		if (NOT backends[b].verifyBatch(inputs, KEYS, results)) {
+			printf("%s BATCH FAIL\n", backends[b].name);
+			return 1;
+		}
+	}
+	// The backends take turns and the best round of each is kept, so that changes in the load of the machine affect both alike. Only builds with optimisation, as made by make and make test, should be compared, as OpenSSL is optimised however this tree is built.
+	double verifyTimes[BACKENDS], signTimes[BACKENDS];
+	for (uint8_t round = 0; round < BENCHMARK_ROUNDS; round++)
+		for (uint8_t b = 0; b < BACKENDS; b++) {
+			double start = getMilliseconds();
+			for (uint32_t x = 0; x < BENCHMARK_VERIFICATIONS; x++)
+				backends[b].verify(sigs[0][x % KEYS], sigLens[0][x % KEYS], hashes[x % KEYS], pubKeys[x % KEYS], keyLens[x % KEYS]);
+			double time = getMilliseconds() - start;
+			if (NOT round || time < verifyTimes[b])
+				verifyTimes[b] = time;
+			start = getMilliseconds();
+			for (uint32_t x = 0; x < BENCHMARK_VERIFICATIONS / 10; x++) {
+				uint8_t * sig;
+				unsigned int sigLen;
+				backends[b].sign(hashes[x % KEYS], privKeys[x % KEYS], &sigLen, &sig);
+				free(sig);
+			}
+			time = getMilliseconds() - start;
+			if (NOT round || time < signTimes[b])
+				signTimes[b] = time;
+		}
+	for (uint8_t b = 0; b < BACKENDS; b++)
+		printf("%s VERIFICATIONS/SEC = %.0f (%.2fx OPENSSL) SIGNATURES/SEC = %.0f (%.2fx OPENSSL)\n", backends[b].name, BENCHMARK_VERIFICATIONS / verifyTimes[b] * 1000, verifyTimes[0] / verifyTimes[b], BENCHMARK_VERIFICATIONS / 10 / signTimes[b] * 1000, signTimes[0] / signTimes[b]);
+	for (uint8_t b = 0; b < BACKENDS; b++)
+		for (uint8_t x = 0; x < KEYS; x++)
+			free(sigs[b][x]);
+	return 0;
+}
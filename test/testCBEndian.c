@@ -0,0 +1,177 @@
+//
+//  testCBEndian.c
+//  cbitcoin
+//
+//  Copyright (c) 2012 Matthew Mitchell
+//
+//  This file is part of cbitcoin.
+//
+//  cbitcoin is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  cbitcoin is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with cbitcoin.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "CBByteArray.h"
+
+void CBLogError(char * b, ...);
+void CBLogError(char * b, ...){
+	printf("%s\n", b);
+}
+
+#define BENCH_ROUNDS 20000000
+
+// The byte at a time implementations which the helpers replace.
+static uint32_t oldArrayToInt32(uint8_t * arr, uint32_t offset){
+	return arr[offset] | (uint16_t)arr[offset + 1] << 8 | (uint32_t)arr[offset + 2] << 16 | (uint32_t)arr[offset + 3] << 24;
+}
+static uint64_t oldArrayToInt64(uint8_t * arr, uint32_t offset){
+	return oldArrayToInt32(arr, offset) | (uint64_t)oldArrayToInt32(arr, offset + 4) << 32;
+}
+static bool oldIsNull(uint8_t * data, uint32_t length){
+	for (uint32_t x = 0; x < length; x++)
+		if (data[x])
+			return false;
+	return true;
+}
+static void oldReverse(uint8_t * data, uint32_t length){
+	for (uint32_t x = 0; x < length / 2; x++) {
+		uint8_t temp = data[x];
+		data[x] = data[length - x - 1];
+		data[length - x - 1] = temp;
+	}
+}
+static int sign(int i){
+	return (i > 0) - (i < 0);
+}
+static double seconds(void){
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+int main(){
+	srand(1234);
+	uint8_t data[64];
+	for (uint32_t round = 0; round < 10000; round++) {
+		for (uint8_t x = 0; x < 64; x++)
+			data[x] = rand();
+		// Loads and stores at every alignment.
+		for (uint8_t off = 0; off < 16; off++) {
+			if (CBArrayToInt16(data, off) != (data[off] | data[off + 1] << 8)
+				|| CBArrayToInt32(data, off) != oldArrayToInt32(data, off)
+				|| CBArrayToInt48(data, off) != (oldArrayToInt64(data, off) & 0xFFFFFFFFFFFFULL)
+				|| CBArrayToInt64(data, off) != oldArrayToInt64(data, off)
+				|| CBArrayToInt32BigEndian(data, off) != ((uint32_t)data[off] << 24 | data[off + 1] << 16 | data[off + 2] << 8 | data[off + 3])) {
+				printf("LOAD FAIL\n");
+				return 1;
+			}
+			uint8_t store[32] = {0}, expected[32] = {0};
+			uint64_t i = oldArrayToInt64(data, 32 + off);
+			CBInt64ToArray(store, off, i)
+			for (uint8_t x = 0; x < 8; x++)
+				expected[off + x] = i >> (x*8);
+			CBInt32ToArray(store, off + 8, i)
+			for (uint8_t x = 0; x < 4; x++)
+				expected[off + 8 + x] = i >> (x*8);
+			CBInt16ToArray(store, off + 12, i);
+			expected[off + 12] = i;
+			expected[off + 13] = i >> 8;
+			if (memcmp(store, expected, 32)) {
+				printf("STORE FAIL\n");
+				return 1;
+			}
+			CBInt32ToArrayBigEndian(store, off, i);
+			if (CBArrayToInt32BigEndian(store, off) != (uint32_t)i || store[off] != (uint8_t)(i >> 24)) {
+				printf("BIG ENDIAN STORE FAIL\n");
+				return 1;
+			}
+		}
+		// Hash functions against the byte at a time versions, including equal and null hashes and differences at each position.
+		uint8_t hash1[33], hash2[33];
+		memcpy(hash1 + 1, data, 32); // Unaligned
+		memcpy(hash2 + 1, data, 32);
+		uint8_t pos = round % 33;
+		if (pos < 32)
+			hash2[1 + pos] = rand();
+		if (sign(CBHashCompare(hash1 + 1, hash2 + 1)) != sign(memcmp(hash1 + 1, hash2 + 1, 32))) {
+			printf("HASH COMPARE FAIL\n");
+			return 1;
+		}
+		if (round % 3 == 0)
+			memset(hash1 + 1, 0, 32);
+		if (round % 6 == 0 && pos < 32)
+			hash1[1 + pos] = 1;
+		if (CBHashIsNull(hash1 + 1) != oldIsNull(hash1 + 1, 32)) {
+			printf("HASH NULL FAIL\n");
+			return 1;
+		}
+		memcpy(hash1 + 1, data, 32);
+		memcpy(hash2 + 1, data, 32);
+		CBHashReverse(hash1 + 1);
+		oldReverse(hash2 + 1, 32);
+		if (memcmp(hash1 + 1, hash2 + 1, 32)) {
+			printf("HASH REVERSE FAIL\n");
+			return 1;
+		}
+		// Byte arrays of other lengths.
+		CBByteArray * ba = CBNewByteArrayWithDataCopy(data, 1 + round % 63);
+		CBByteArray * ba2 = CBByteArrayCopy(ba);
+		CBByteArrayReverseBytes(ba);
+		oldReverse(CBByteArrayGetData(ba2), ba2->length);
+		if (CBByteArrayCompare(ba, ba2) != CB_COMPARE_EQUAL || CBByteArrayIsNull(ba) != oldIsNull(data, ba->length)) {
+			printf("BYTE ARRAY FAIL\n");
+			return 1;
+		}
+		memset(CBByteArrayGetData(ba), 0, ba->length);
+		if (NOT CBByteArrayIsNull(ba)) {
+			printf("BYTE ARRAY NULL FAIL\n");
+			return 1;
+		}
+		CBReleaseObject(ba);
+		CBReleaseObject(ba2);
+	}
+	// Benchmark against the byte at a time versions. The volatile sink stops the work being removed.
+	volatile uint64_t sink = 0;
+	uint8_t buf[4096];
+	for (uint32_t x = 0; x < 4096; x++)
+		buf[x] = rand();
+	double start = seconds();
+	for (uint32_t x = 0; x < BENCH_ROUNDS; x++)
+		sink += oldArrayToInt64(buf, x & 4087) + oldArrayToInt32(buf, (x * 7) & 4091);
+	double oldInt = seconds() - start;
+	start = seconds();
+	for (uint32_t x = 0; x < BENCH_ROUNDS; x++)
+		sink += CBArrayToInt64(buf, x & 4087) + CBArrayToInt32(buf, (x * 7) & 4091);
+	double newInt = seconds() - start;
+	memset(buf, 0, 64);
+	start = seconds();
+	for (uint32_t x = 0; x < BENCH_ROUNDS; x++) {
+		sink += oldIsNull(buf + (x & 31), 32);
+		oldReverse(buf + (x & 15), 32);
+		sink += memcmp(buf + (x & 15), buf + 16 + (x & 15), 32) > 0;
+	}
+	double oldHash = seconds() - start;
+	start = seconds();
+	for (uint32_t x = 0; x < BENCH_ROUNDS; x++) {
+		sink += CBHashIsNull(buf + (x & 31));
+		CBHashReverse(buf + (x & 15));
+		sink += CBHashCompare(buf + (x & 15), buf + 16 + (x & 15)) == CB_COMPARE_MORE_THAN;
+	}
+	double newHash = seconds() - start;
+	printf("Integer loads: %.1f ns byte at a time, %.1f ns with helpers\n", oldInt * 1e9 / BENCH_ROUNDS, newInt * 1e9 / BENCH_ROUNDS);
+	printf("Hash null, reverse and compare: %.1f ns byte at a time, %.1f ns with helpers\n", oldHash * 1e9 / BENCH_ROUNDS, newHash * 1e9 / BENCH_ROUNDS);
+	return 0;
+}
@@ -24,6 +24,9 @@
 #include "CBBlockChainStorage.h"
 #include <stdarg.h>
 #include <stdio.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 static struct {
     uint8_t extranonce;
@@ -56,6 +59,36 @@ static struct {
     {2, 0x03e8779a}, {1, 0x98f34d8f}, {1, 0xc07b2b07}, {1, 0xdfe29668}, 
 };
 
+// Makes a copy of a block made from a template block with a single coinbase transaction, changing the previous block, the time and the coinbase output script.
+static CBBlock * CBCopyTestBlock(CBBlock * template, uint8_t * prevHash, uint32_t time, uint8_t id){
+	memcpy(CBByteArrayGetData(template->prevBlockHash), prevHash, 32);
+	template->time = time;
+	CBByteArraySetByte(template->transactions[0]->outputs[0]->scriptObject, 1, id);
+	CBTransactionSerialise(template->transactions[0], true);
+	memcpy(CBByteArrayGetData(template->merkleRoot), CBTransactionGetHash(template->transactions[0]), 32);
+	CBBlockSerialise(template, true, false);
+	CBByteArray * bytes = CBNewByteArrayWithDataCopy(CBByteArrayGetData(CBGetMessage(template)->bytes), CBGetMessage(template)->bytes->length);
+	CBBlock * block = CBNewBlockFromData(bytes);
+	CBReleaseObject(bytes);
+	CBBlockDeserialise(block, true);
+	return block;
+}
+
+// Removes the storage made from a snapshot.
+static void CBRemoveSnapshotStorage(void){
+	remove("./snapshot/blk_log.dat");
+	remove("./snapshot/blk_0.dat");
+	remove("./snapshot/blk_1.dat");
+	remove("./snapshot/blk_2.dat");
+	remove("./snapshot/blk00000.dat");
+}
+
+static double seconds(void){
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
 void CBLogError(char * format, ...){
 	va_list argptr;
     va_start(argptr, format);
@@ -91,40 +124,28 @@ int main(){
 		printf("ORPHAN NUM FAIL\n");
 		return 1;
 	}
-	if(validator->numBranches != 1){
-		printf("BRANCH NUM FAIL\n");
-		return 1;
-	}
-	if(validator->mainBranch){
-		printf("MAIN BRANCH FAIL\n");
-		return 1;
-	}
-	if(validator->branches[0].lastRetargetTime != 1231006505){
-		printf("LAST RETARGET FAIL\n");
+	if(validator->nextBlockID != 1){
+		printf("NEXT BLOCK ID FAIL\n");
 		return 1;
 	}
-	if(validator->branches[0].numBlocks != 1){
-		printf("NUM BLOCKS FAIL\n");
+	if(validator->mainTip->height || validator->mainTip->blockID){
+		printf("MAIN TIP FAIL\n");
 		return 1;
 	}
-	if(validator->branches[0].parentBranch){
-		printf("PARENT BRANCH FAIL\n");
+	if(validator->numSideHeaders){
+		printf("SIDE HEADERS FAIL\n");
 		return 1;
 	}
-	if(validator->branches[0].startHeight){
-		printf("START HEIGHT FAIL\n");
-		return 1;
-	}
-	if(validator->branches[0].work.length != 1){
+	if(validator->mainTip->work.length != 1){
 		printf("WORK LENGTH FAIL\n");
 		return 1;
 	}
-	if(validator->branches[0].work.data[0]){
+	if(validator->mainTip->work.data[0]){
 		printf("WORK VAL FAIL\n");
 		return 1;
 	}
 	// Try loading the genesis block
-	CBBlock * block = CBBlockChainStorageLoadBlock(validator, 0, 0);
+	CBBlock * block = CBBlockChainStorageLoadBlock(validator, 0);
 	if (NOT block) {
 		printf("GENESIS RETRIEVE FAIL\n");
 		return 1;
@@ -253,45 +274,35 @@ int main(){
 		printf("BLOCK ONE LOAD FROM FILE FAIL\n");
 		return 1;
 	}
-	if (validator->mainBranch) {
-		printf("BLOCK ONE MAIN BRANCH FAIL\n");
-		return 1;
-	}
-	if (validator->numBranches != 1) {
-		printf("BLOCK ONE MUM BRANCHES FAIL\n");
+	if (validator->nextBlockID != 2) {
+		printf("BLOCK ONE NEXT BLOCK ID FAIL\n");
 		return 1;
 	}
 	if (validator->numOrphans) {
 		printf("BLOCK ONE MUM ORPHANS FAIL\n");
 		return 1;
 	}
-	if (validator->branches[0].lastRetargetTime != 1231006505) {
-		printf("BLOCK ONE LAST RETARGET TIME FAIL\n");
-		return 1;
-	}
-	if (validator->branches[0].lastValidation != 1) {
-		printf("BLOCK ONE LAST VALIDATION FAIL\n");
+	if (NOT (validator->mainTip->flags & CB_HEADER_VALIDATED)) {
+		printf("BLOCK ONE VALIDATED FAIL\n");
 		return 1;
 	}
-	if (validator->branches[0].numBlocks != 2) {
-		printf("BLOCK ONE NUM REFS FAIL\n");
+	if (validator->mainTip->height != 1
+		|| validator->mainTip->blockID != 1
+		|| CBFullValidatorGetMainChainHeader(validator, 0) != validator->mainTip->prev) {
+		printf("BLOCK ONE MAIN TIP FAIL\n");
 		return 1;
 	}
 	CBReleaseObject(block1);
-	if (validator->branches[0].startHeight != 0) {
-		printf("BLOCK ONE START HEIGHT FAIL\n");
-		return 1;
-	}
-	if (validator->branches[0].work.length != 5) {
+	if (validator->mainTip->work.length != 5) {
 		printf("BLOCK ONE WORK LENGTH FAIL\n");
 		return 1;
 	}
-	if (memcmp(validator->branches[0].work.data, (uint8_t []){0x01, 0x00, 0x01, 0x00, 0x01}, 5)) {
+	if (memcmp(validator->mainTip->work.data, (uint8_t []){0x01, 0x00, 0x01, 0x00, 0x01}, 5)) {
 		printf("BLOCK ONE WORK FAIL\n");
 		return 1;
 	}
 	// Try to load block
-	block1 = CBBlockChainStorageLoadBlock(validator, 1, 0);
+	block1 = CBBlockChainStorageLoadBlock(validator, 1);
 	CBBlockDeserialise(block1, true);
 	if (NOT block1) {
 		printf("BLOCK ONE LOAD FAIL\n");
@@ -387,11 +398,11 @@ int main(){
 		return 1;
 	}
 	// Verify same data
-	if (memcmp(CBByteArrayGetData(CBGetMessage(output)->bytes), (uint8_t [76]){
-		0x00, 0xF2, 0x05, 0x2A, 0x01, 0x00, 0x00, 0x00, 
-		0x43, 
+	if (output->value != 50 * CB_ONE_BITCOIN
+		|| output->scriptObject->length != 67
+		|| memcmp(CBByteArrayGetData(output->scriptObject), (uint8_t [67]){
 		0x41, 0x04, 0x96, 0xb5, 0x38, 0xe8, 0x53, 0x51, 0x9c, 0x72, 0x6a, 0x2c, 0x91, 0xe6, 0x1e, 0xc1, 0x16, 0x00, 0xae, 0x13, 0x90, 0x81, 0x3a, 0x62, 0x7c, 0x66, 0xfb, 0x8b, 0xe7, 0x94, 0x7b, 0xe6, 0x3c, 0x52, 0xda, 0x75, 0x89, 0x37, 0x95, 0x15, 0xd4, 0xe0, 0xa6, 0x04, 0xf8, 0x14, 0x17, 0x81, 0xe6, 0x22, 0x94, 0x72, 0x11, 0x66, 0xbf, 0x62, 0x1e, 0x73, 0xa8, 0x2c, 0xbf, 0x23, 0x42, 0xc8, 0x58, 0xee, 0xAC
-	}, 76)) {
+	}, 67)) {
 		printf("BLOCK ONE UNSPENT OUTPUT DATA CONSISTENCY FAIL\n");
 		return 1;
 	}
@@ -481,6 +492,17 @@ int main(){
 				printf("SIDE FAIL AT %u\n", y);
 				return 1;
 			}
+		}else if (x == 24){
+			// Block 2 connects all of the orphans from 3 to 24.
+			if (res != CB_BLOCK_STATUS_MAIN || validator->numOrphans || validator->orphansConnected != 22) {
+				printf("ORPHAN CHAIN FAIL AT %u\n", y);
+				return 1;
+			}
+		}else if (x == 25 || x == 26){
+			if (res != CB_BLOCK_STATUS_DUPLICATE) {
+				printf("CONNECTED ORPHAN DUPLICATE FAIL AT %u\n", y);
+				return 1;
+			}
 		}else if (res != CB_BLOCK_STATUS_MAIN) {
 			// Reorg occurs at x == 1
 			printf("MAIN FAIL AT %u\n", y);
@@ -926,7 +948,7 @@ int main(){
 	CBReleaseObject(testBlock->transactions[1]);
 	testBlock->transactions[1] = CBNewTransaction(0, 1);
 	inScript = CBNewScriptWithDataCopy((uint8_t []){CB_SCRIPT_OP_TRUE}, 1);
-	CBTransactionTakeInput(testBlock->transactions[1], CBNewTransactionInput(inScript, CB_TRANSACTION_REF_BLOCK_INDEX, prevOutHash, 0));
+	CBTransactionTakeInput(testBlock->transactions[1], CBNewTransactionInput(inScript, 0, prevOutHash, 0));
 	CBReleaseObject(inScript);
 	CBTransactionTakeOutput(testBlock->transactions[1], CBNewTransactionOutput(CB_ONE_BITCOIN / 10, emptyScript));
 	CBGetMessage(testBlock->transactions[1])->bytes = CBNewByteArrayOfSize(CBTransactionCalculateLength(testBlock->transactions[1]));
@@ -1083,8 +1105,8 @@ int main(){
 		printf("NETWORK TIME BAD BLOCK TIME FAIL\n");
 		return 1;
 	}
-	// Test bad time against median time
-	testBlock->time -= 7;
+	// Test bad time against median time, which is the time of the sixth block back along this block's own chain
+	testBlock->time -= 8;
 	CBBlockSerialise(testBlock, true, false);
 	if (CBFullValidatorProcessBlock(validator, testBlock, 1349643202) != CB_BLOCK_STATUS_BAD) {
 		printf("MEDIAN TIME BAD BLOCK TIME FAIL\n");
@@ -1160,6 +1182,138 @@ int main(){
 		printf("ADD ORPHAN FAIL\n");
 		return 1;
 	}
+	if (validator->numOrphans != 1) {
+		printf("ORPHAN NUM FAIL\n");
+		return 1;
+	}
+	if (NOT CBAssociativeArrayFind(&validator->orphans, CBBlockGetHash(testBlock)).found) {
+		printf("ORPHAN DATA FAIL\n");
+		return 1;
+	}
+	if (CBFullValidatorProcessBlock(validator, testBlock, 1349643202) != CB_BLOCK_STATUS_DUPLICATE) {
+		printf("DUPLICATE ORPHAN FAIL\n");
+		return 1;
+	}
+	// Test a chain of orphans is connected once the first block arrives
+	CBByteArray * templateBytes = CBNewByteArrayWithDataCopy(CBByteArrayGetData(CBGetMessage(testBlock)->bytes), CBGetMessage(testBlock)->bytes->length);
+	CBBlock * template = CBNewBlockFromData(templateBytes);
+	CBReleaseObject(templateBytes);
+	CBBlockDeserialise(template, true);
+	uint32_t mainHeight = validator->mainTip->height;
+	uint64_t orphansConnected = validator->orphansConnected;
+	CBBlock * tip = CBBlockChainStorageLoadBlock(validator, validator->mainTip->blockID);
+	CBBlockDeserialise(tip, true);
+	uint32_t tipTime = validator->mainTip->time;
+	CBBlock * chain[3];
+	chain[0] = CBCopyTestBlock(template, CBBlockGetHash(tip), tipTime + 1, 200);
+	chain[1] = CBCopyTestBlock(template, CBBlockGetHash(chain[0]), tipTime + 2, 201);
+	chain[2] = CBCopyTestBlock(template, CBBlockGetHash(chain[1]), tipTime + 3, 202);
+	CBReleaseObject(tip);
+	if (CBFullValidatorProcessBlock(validator, chain[2], 1349643202) != CB_BLOCK_STATUS_ORPHAN
+		|| CBFullValidatorProcessBlock(validator, chain[1], 1349643202) != CB_BLOCK_STATUS_ORPHAN) {
+		printf("ADD ORPHAN CHAIN FAIL\n");
+		return 1;
+	}
+	if (validator->numOrphans != 3) {
+		printf("ORPHAN CHAIN NUM FAIL\n");
+		return 1;
+	}
+	if (CBFullValidatorProcessBlock(validator, chain[0], 1349643202) != CB_BLOCK_STATUS_MAIN) {
+		printf("CONNECT ORPHAN CHAIN FAIL\n");
+		return 1;
+	}
+	if (validator->numOrphans != 1 || validator->orphansConnected != orphansConnected + 2) {
+		printf("CONNECT ORPHAN CHAIN NUM FAIL\n");
+		return 1;
+	}
+	if (validator->mainTip->height != mainHeight + 3) {
+		printf("CONNECT ORPHAN CHAIN MAIN CHAIN FAIL\n");
+		return 1;
+	}
+	// Test the block tree has the connected blocks
+	CBHeaderEntry * entry = CBFullValidatorFindHeader(validator, CBBlockGetHash(chain[2]));
+	if (NOT entry
+		|| entry != validator->mainTip
+		|| NOT CBBlockChainStorageBlockExists(validator, entry->blockID)
+		|| entry->height != mainHeight + 3
+		|| entry->time != tipTime + 3
+		|| entry->target != chain[2]->target
+		|| NOT (entry->flags & CB_HEADER_VALIDATED)
+		|| memcmp(entry->prev->hash, CBBlockGetHash(chain[1]), 32)
+		|| CBBigIntCompareToBigInt(&entry->work, &entry->prev->work) != CB_COMPARE_MORE_THAN
+		|| CBFullValidatorGetMainChainHeader(validator, mainHeight + 1) != entry->prev->prev) {
+		printf("HEADER INDEX FAIL\n");
+		return 1;
+	}
+	uint8_t indexedHash[32];
+	memcpy(indexedHash, entry->hash, 32);
+	for (uint8_t y = 0; y < 3; y++)
+		CBReleaseObject(chain[y]);
+	// Test evicting orphans furthest from the tip
+	tipTime += 3;
+	uint8_t unknownHash[32];
+	memset(unknownHash, 2, 32);
+	CBBlock * near = CBCopyTestBlock(template, unknownHash, tipTime + 100, 203);
+	CBBlock * far = CBCopyTestBlock(template, unknownHash, tipTime + 1000, 204);
+	CBBlock * nearest = CBCopyTestBlock(template, unknownHash, tipTime + 10, 205);
+	CBBlock * furthest = CBCopyTestBlock(template, unknownHash, tipTime + 100000, 206);
+	validator->maxOrphanBytes = validator->orphanBytes + 2 * CBGetMessage(near)->bytes->length;
+	if (CBFullValidatorProcessBlock(validator, near, 1349643202) != CB_BLOCK_STATUS_ORPHAN
+		|| CBFullValidatorProcessBlock(validator, far, 1349643202) != CB_BLOCK_STATUS_ORPHAN
+		|| validator->numOrphans != 3
+		|| validator->orphansEvicted) {
+		printf("ADD ORPHANS WITHIN BUDGET FAIL\n");
+		return 1;
+	}
+	if (CBFullValidatorProcessBlock(validator, nearest, 1349643202) != CB_BLOCK_STATUS_ORPHAN
+		|| validator->numOrphans != 3
+		|| validator->orphansEvicted != 1
+		|| CBAssociativeArrayFind(&validator->orphans, CBBlockGetHash(far)).found
+		|| NOT CBAssociativeArrayFind(&validator->orphans, CBBlockGetHash(nearest)).found) {
+		printf("EVICT FURTHEST ORPHAN FAIL\n");
+		return 1;
+	}
+	if (CBFullValidatorProcessBlock(validator, furthest, 1349643202) != CB_BLOCK_STATUS_ORPHAN
+		|| validator->numOrphans != 3
+		|| validator->orphansEvicted != 2
+		|| CBAssociativeArrayFind(&validator->orphans, CBBlockGetHash(furthest)).found) {
+		printf("REFUSE FURTHEST ORPHAN FAIL\n");
+		return 1;
+	}
+	if (validator->orphanBytes > validator->maxOrphanBytes) {
+		printf("ORPHAN BUDGET FAIL\n");
+		return 1;
+	}
+	CBFullValidatorProcessBlock(validator, far, 1349643202);
+	if (validator->orphanRedownloads != 1) {
+		printf("ORPHAN REDOWNLOAD FAIL\n");
+		return 1;
+	}
+	// Test side chains are pruned once they fall behind the main chain tip
+	if (NOT validator->numSideHeaders) {
+		printf("SIDE CHAIN NUM FAIL\n");
+		return 1;
+	}
+	uint8_t staleHash[32];
+	memcpy(staleHash, validator->sideHeaders[0]->hash, 32);
+	uint32_t staleID = validator->sideHeaders[0]->blockID;
+	validator->staleForkDepth = 0;
+	CBBlock * next = CBCopyTestBlock(template, indexedHash, tipTime + 1, 207);
+	if (CBFullValidatorProcessBlock(validator, next, 1349643202) != CB_BLOCK_STATUS_MAIN
+		|| validator->numSideHeaders
+		|| CBFullValidatorFindHeader(validator, staleHash)
+		|| CBBlockChainStorageBlockExists(validator, staleID)) {
+		printf("PRUNE STALE SIDE CHAINS FAIL\n");
+		return 1;
+	}
+	validator->staleForkDepth = CB_STALE_FORK_DEPTH;
+	CBReleaseObject(next);
+	CBReleaseObject(near);
+	CBReleaseObject(far);
+	CBReleaseObject(nearest);
+	CBReleaseObject(furthest);
+	CBReleaseObject(template);
+	// Orphans are not stored
 	CBReleaseObject(validator);
 	CBFreeBlockChainStorage(storage);
 	storage = CBNewBlockChainStorage("./");
@@ -1168,13 +1322,372 @@ int main(){
 		printf("LOAD VALIDATOR WITH ORPHAN FAIL\n");
 		return 1;
 	}
-	if (validator->numOrphans != 1) {
-		printf("ORPHAN NUM FAIL\n");
+	if (validator->numOrphans) {
+		printf("ORPHAN NUM AFTER LOAD FAIL\n");
 		return 1;
 	}
-	if (memcmp(CBBlockGetHash(validator->orphans[0]), CBBlockGetHash(testBlock), 32)) {
-		printf("ORPHAN DATA FAIL\n");
+	// The block tree is loaded from storage
+	entry = CBFullValidatorFindHeader(validator, indexedHash);
+	if (NOT entry
+		|| entry != validator->mainTip->prev
+		|| entry != CBFullValidatorGetMainChainHeader(validator, mainHeight + 3)
+		|| entry->time != tipTime
+		|| CBBigIntCompareToBigInt(&entry->work, &validator->mainTip->work) != CB_COMPARE_LESS_THAN
+		|| validator->numSideHeaders
+		|| CBFullValidatorGetMainChainHeader(validator, 0)->prev
+		|| CBFullValidatorGetMainChainHeader(validator, 0)->height) {
+		printf("HEADER INDEX AFTER LOAD FAIL\n");
+		return 1;
+	}
+	// Test a reorganisation over 100 blocks, which restores the spent outputs from undo data.
+	validator->flags |= CB_FULL_VALIDATOR_DISABLE_POW_CHECK;
+	CBBlock * fork = CBBlockChainStorageLoadBlock(validator, validator->mainTip->blockID);
+	CBBlockDeserialise(fork, true);
+	uint8_t forkHash[32], branchHash[32];
+	memcpy(forkHash, CBBlockGetHash(fork), 32);
+	tipTime = validator->mainTip->time;
+	CBScript * coinbaseScript = fork->transactions[0]->inputs[0]->scriptObject;
+	// Mark the coinbase transactions of each branch so that they are not duplicates.
+	CBByteArraySetByte(coinbaseScript, coinbaseScript->length - 1, 0xA0);
+	memcpy(branchHash, forkHash, 32);
+	for (x = 0; x < 100; x++) {
+		CBBlock * block = CBCopyTestBlock(fork, branchHash, tipTime + 1 + x, x);
+		if (CBFullValidatorProcessBlock(validator, block, 1349643202) != CB_BLOCK_STATUS_MAIN) {
+			printf("REORG BENCHMARK MAIN BRANCH %u FAIL\n", x);
+			return 1;
+		}
+		memcpy(branchHash, CBBlockGetHash(block), 32);
+		CBReleaseObject(block);
+	}
+	uint32_t oldTipID = validator->mainTip->blockID;
+	if (NOT CBBlockChainStorageUndoExists(validator, oldTipID)) {
+		printf("UNDO DATA SAVED FAIL\n");
+		return 1;
+	}
+	CBByteArraySetByte(coinbaseScript, coinbaseScript->length - 1, 0xB0);
+	memcpy(branchHash, forkHash, 32);
+	for (x = 0; x < 101; x++) {
+		CBBlock * block = CBCopyTestBlock(fork, branchHash, tipTime + 1 + x, x);
+		double start = seconds();
+		CBBlockStatus status = CBFullValidatorProcessBlock(validator, block, 1349643202);
+		if (x == 100)
+			printf("Reorganisation over 100 blocks took %.1fms\n", (seconds() - start) * 1000);
+		if (status != ((x == 100) ? CB_BLOCK_STATUS_MAIN : CB_BLOCK_STATUS_SIDE)) {
+			printf("REORG BENCHMARK SIDE BRANCH %u FAIL\n", x);
+			return 1;
+		}
+		memcpy(branchHash, CBBlockGetHash(block), 32);
+		CBReleaseObject(block);
+	}
+	if (memcmp(validator->mainTip->hash, branchHash, 32)
+		|| CBBlockChainStorageUndoExists(validator, oldTipID)
+		|| NOT CBBlockChainStorageUndoExists(validator, validator->mainTip->blockID)) {
+		printf("REORG BENCHMARK UNDO FAIL\n");
 		return 1;
 	}
+	// Test pruning the main chain blocks more than pruneDepth below the tip
+	validator->pruneDepth = 10;
+	uint64_t blockBytes = validator->blockBytes;
+	CBByteArraySetByte(coinbaseScript, coinbaseScript->length - 1, 0xC0);
+	block = CBCopyTestBlock(fork, branchHash, tipTime + 102, 0);
+	if (CBFullValidatorProcessBlock(validator, block, 1349643202) != CB_BLOCK_STATUS_MAIN) {
+		printf("ADD BLOCK WHEN PRUNING FAIL\n");
+		return 1;
+	}
+	CBReleaseObject(block);
+	if (validator->pruneHeight != validator->mainTip->height - 10
+		|| validator->blockBytes >= blockBytes) {
+		printf("PRUNE HEIGHT FAIL\n");
+		return 1;
+	}
+	for (uint32_t y = 0; y <= validator->mainTip->height; y++) {
+		CBHeaderEntry * entry = validator->mainChain[y];
+		bool pruned = y < validator->pruneHeight;
+		if (pruned != (bool)(entry->flags & CB_HEADER_PRUNED)
+			|| pruned != NOT CBBlockChainStorageBlockSize(validator, entry->blockID)
+			|| NOT CBBlockChainStorageBlockExists(validator, entry->blockID)) {
+			printf("PRUNED BLOCK %u FAIL\n", y);
+			return 1;
+		}
+	}
+	// Test reorganising within the pruning depth
+	uint32_t forkHeight = validator->mainTip->height - 5;
+	memcpy(branchHash, validator->mainChain[forkHeight]->hash, 32);
+	uint32_t forkTime = validator->mainChain[forkHeight]->time;
+	CBByteArraySetByte(coinbaseScript, coinbaseScript->length - 1, 0xD0);
+	for (x = 0; x < 6; x++) {
+		block = CBCopyTestBlock(fork, branchHash, forkTime + 1 + x, x);
+		if (CBFullValidatorProcessBlock(validator, block, 1349643202) != ((x == 5) ? CB_BLOCK_STATUS_MAIN : CB_BLOCK_STATUS_SIDE)) {
+			printf("REORG WHEN PRUNING %u FAIL\n", x);
+			return 1;
+		}
+		memcpy(branchHash, CBBlockGetHash(block), 32);
+		CBReleaseObject(block);
+	}
+	if (memcmp(validator->mainTip->hash, branchHash, 32)
+		|| validator->pruneHeight != validator->mainTip->height - 10) {
+		printf("REORG WHEN PRUNING TIP FAIL\n");
+		return 1;
+	}
+	// Test the pruned blocks are found when loading
+	uint32_t pruneHeight = validator->pruneHeight;
+	blockBytes = validator->blockBytes;
+	CBReleaseObject(validator);
+	CBFreeBlockChainStorage(storage);
+	storage = CBNewBlockChainStorage("./");
+	validator = CBNewFullValidator(storage, &bad, CB_FULL_VALIDATOR_DISABLE_POW_CHECK | CB_FULL_VALIDATOR_TRANSACTION_INDEX);
+	if (NOT validator || bad
+		|| validator->pruneHeight != pruneHeight
+		|| validator->blockBytes != blockBytes
+		|| NOT (CBFullValidatorGetMainChainHeader(validator, pruneHeight - 1)->flags & CB_HEADER_PRUNED)
+		|| CBFullValidatorGetMainChainHeader(validator, pruneHeight)->flags & CB_HEADER_PRUNED) {
+		printf("LOAD PRUNED VALIDATOR FAIL\n");
+		return 1;
+	}
+	// Test pruning only beyond a budget
+	validator->pruneDepth = 2;
+	validator->pruneBudget = validator->blockBytes;
+	CBByteArraySetByte(coinbaseScript, coinbaseScript->length - 1, 0xE0);
+	block = CBCopyTestBlock(fork, branchHash, forkTime + 7, 0);
+	if (CBFullValidatorProcessBlock(validator, block, 1349643202) != CB_BLOCK_STATUS_MAIN
+		|| validator->pruneHeight != pruneHeight + 1
+		|| validator->blockBytes > validator->pruneBudget) {
+		printf("PRUNE WITH BUDGET FAIL\n");
+		return 1;
+	}
+	// The transaction index is only kept with CB_FULL_VALIDATOR_TRANSACTION_INDEX
+	uint8_t * outputs = NULL;
+	uint32_t outputsAllocSize = 0, outputsPos, outputsHeight;
+	bool outputsCoinbase;
+	if (NOT CBBlockChainStorageLoadOutputs(validator, CBTransactionGetHash(block->transactions[0]), &outputs, &outputsAllocSize, &outputsPos, &outputsHeight, &outputsCoinbase)
+		|| outputsHeight != validator->mainTip->height
+		|| NOT outputsCoinbase
+		|| CBArrayToInt64(outputs, 0) != block->transactions[0]->outputs[0]->value) {
+		printf("TRANSACTION INDEX FAIL\n");
+		return 1;
+	}
+	CBReleaseObject(block);
+	block = CBBlockChainStorageLoadBlock(validator, validator->mainTip->prev->blockID);
+	CBBlockDeserialise(block, true);
+	if (CBBlockChainStorageLoadOutputs(validator, CBTransactionGetHash(block->transactions[0]), &outputs, &outputsAllocSize, &outputsPos, &outputsHeight, &outputsCoinbase)) {
+		printf("NO TRANSACTION INDEX FAIL\n");
+		return 1;
+	}
+	free(outputs);
+	CBReleaseObject(block);
+	// Test assuming the scripts up to a block are valid, with a block spending a pay-to-pubkey output with a bad signature.
+	CBByteArraySetByte(coinbaseScript, coinbaseScript->length - 1, 0xB0);
+	block = CBCopyTestBlock(fork, branchHash, 0, 4);
+	CBByteArray * spentHash = CBNewByteArrayWithDataCopy(CBTransactionGetHash(block->transactions[0]), 32);
+	CBReleaseObject(block);
+	CBByteArraySetByte(coinbaseScript, coinbaseScript->length - 1, 0xF0);
+	block = CBCopyTestBlock(fork, validator->mainTip->hash, validator->mainTip->time + 1, 0);
+	uint8_t signature[72] = {71, 0x30, 0x44, 0x02, 0x20};
+	memset(signature + 5, 0x11, 32);
+	signature[37] = 0x02;
+	signature[38] = 0x20;
+	memset(signature + 39, 0x22, 32);
+	signature[71] = CB_SIGHASH_ALL;
+	CBScript * signatureScript = CBNewScriptWithDataCopy(signature, 72);
+	CBScript * outputScript = CBNewScriptOfSize(0);
+	CBTransaction * spend = CBNewTransaction(0, 1);
+	CBTransactionTakeInput(spend, CBNewTransactionInput(signatureScript, CB_TRANSACTION_INPUT_FINAL, spentHash, 0));
+	CBTransactionTakeOutput(spend, CBNewTransactionOutput(20 * CB_ONE_BITCOIN, outputScript));
+	CBReleaseObject(signatureScript);
+	CBReleaseObject(outputScript);
+	CBReleaseObject(spentHash);
+	CBGetMessage(spend)->bytes = CBNewByteArrayOfSize(CBTransactionCalculateLength(spend));
+	CBTransactionSerialise(spend, true);
+	block->transactionNum = 2;
+	block->transactions = realloc(block->transactions, sizeof(*block->transactions) * 2);
+	block->transactions[1] = spend;
+	CBBlockCalculateAndSetMerkleRoot(block);
+	CBReleaseObject(CBGetMessage(block)->bytes);
+	CBGetMessage(block)->bytes = CBNewByteArrayOfSize(CBBlockCalculateLength(block, true));
+	CBBlockSerialise(block, true, false);
+	uint32_t assumeValidHeight = validator->mainTip->height + 1;
+	double start = seconds();
+	if (CBFullValidatorCompleteBlockValidation(validator, block, assumeValidHeight) != CB_BLOCK_VALIDATION_BAD) {
+		printf("BAD SIGNATURE FAIL\n");
+		return 1;
+	}
+	double verified = seconds() - start;
+	CBFullValidatorSetAssumeValid(validator, CBBlockGetHash(block), assumeValidHeight);
+	start = seconds();
+	if (CBFullValidatorCompleteBlockValidation(validator, block, assumeValidHeight) != CB_BLOCK_VALIDATION_OK) {
+		printf("ASSUME VALID SIGNATURE FAIL\n");
+		return 1;
+	}
+	printf("Validating a pay-to-pubkey spend took %.0fus, %.0fus when assumed valid\n", verified * 1000000, (seconds() - start) * 1000000);
+	// A different block at the same height is not an ancestor of the assumed valid block, so its scripts are verified.
+	block->nonce++;
+	CBBlockSerialise(block, true, false);
+	if (CBFullValidatorCompleteBlockValidation(validator, block, assumeValidHeight) != CB_BLOCK_VALIDATION_BAD) {
+		printf("ASSUME VALID FORK SIGNATURE FAIL\n");
+		return 1;
+	}
+	block->nonce--;
+	CBBlockSerialise(block, true, false);
+	// With a later block assumed valid, the block is only assumed valid once the headers show that it leads to it.
+	uint8_t assumeValidChain[64];
+	memcpy(assumeValidChain, CBBlockGetHash(block), 32);
+	memset(assumeValidChain + 32, 0xAB, 32);
+	CBFullValidatorSetAssumeValid(validator, assumeValidChain + 32, assumeValidHeight + 1);
+	if (CBFullValidatorCompleteBlockValidation(validator, block, assumeValidHeight) != CB_BLOCK_VALIDATION_BAD) {
+		printf("ASSUME VALID UNKNOWN ANCESTOR FAIL\n");
+		return 1;
+	}
+	if (NOT CBFullValidatorSetAssumeValidChain(validator, assumeValidChain, assumeValidHeight)
+		|| CBFullValidatorCompleteBlockValidation(validator, block, assumeValidHeight) != CB_BLOCK_VALIDATION_OK) {
+		printf("ASSUME VALID ANCESTOR FAIL\n");
+		return 1;
+	}
+	CBFullValidatorSetAssumeValid(validator, CBBlockGetHash(block), assumeValidHeight);
+	// The unspent outputs are still checked
+	spend->inputs[0]->prevOut.index = 5;
+	CBTransactionSerialise(spend, true);
+	if (CBFullValidatorCompleteBlockValidation(validator, block, assumeValidHeight) != CB_BLOCK_VALIDATION_BAD) {
+		printf("ASSUME VALID MISSING OUTPUT FAIL\n");
+		return 1;
+	}
+	spend->inputs[0]->prevOut.index = 0;
+	CBTransactionSerialise(spend, true);
+	// Another block cannot take the place of the assumed valid block
+	CBBlock * other = CBCopyTestBlock(fork, validator->mainTip->hash, validator->mainTip->time + 1, 1);
+	if (CBFullValidatorProcessBlock(validator, other, 1349643202) != CB_BLOCK_STATUS_BAD
+		|| CBFullValidatorProcessBlock(validator, block, 1349643202) != CB_BLOCK_STATUS_MAIN) {
+		printf("ASSUME VALID BLOCK FAIL\n");
+		return 1;
+	}
+	CBReleaseObject(other);
+	// Validate a block of 4000 transactions, each spending the previous one.
+	CBBlock * chained = CBCopyTestBlock(fork, validator->mainTip->hash, validator->mainTip->time + 1, 2);
+	chained->transactionNum = 4000;
+	chained->transactions = realloc(chained->transactions, sizeof(*chained->transactions) * 4000);
+	CBScript * trueScript = CBNewScriptWithDataCopy((uint8_t []){CB_SCRIPT_OP_TRUE}, 1);
+	for (uint32_t x = 1; x < 4000; x++) {
+		CBByteArray * prevHash = CBNewByteArrayWithDataCopy(x == 1 ? CBTransactionGetHash(spend) : CBTransactionGetHash(chained->transactions[x - 1]), 32);
+		CBTransaction * tx = CBNewTransaction(0, 1);
+		CBTransactionTakeInput(tx, CBNewTransactionInput(trueScript, CB_TRANSACTION_INPUT_FINAL, prevHash, 0));
+		CBTransactionTakeOutput(tx, CBNewTransactionOutput(20 * CB_ONE_BITCOIN, trueScript));
+		CBReleaseObject(prevHash);
+		CBGetMessage(tx)->bytes = CBNewByteArrayOfSize(CBTransactionCalculateLength(tx));
+		CBTransactionSerialise(tx, true);
+		chained->transactions[x] = tx;
+	}
+	CBReleaseObject(trueScript);
+	start = seconds();
+	if (CBFullValidatorCompleteBlockValidation(validator, chained, assumeValidHeight) != CB_BLOCK_VALIDATION_OK) {
+		printf("CHAINED BLOCK FAIL\n");
+		return 1;
+	}
+	printf("Validating a block of 4000 chained transactions took %.1fms\n", (seconds() - start) * 1000);
+	// Spending an output twice or spending a later transaction fails
+	CBTransactionInput * input = chained->transactions[3999]->inputs[0];
+	CBByteArray * laterHash = input->prevOut.hash;
+	input->prevOut.hash = CBNewByteArrayWithDataCopy(CBTransactionGetHash(chained->transactions[1]), 32);
+	if (CBFullValidatorCompleteBlockValidation(validator, chained, assumeValidHeight) != CB_BLOCK_VALIDATION_BAD) {
+		printf("CHAINED BLOCK DOUBLE SPEND FAIL\n");
+		return 1;
+	}
+	CBReleaseObject(input->prevOut.hash);
+	input->prevOut.hash = laterHash;
+	input = chained->transactions[2]->inputs[0];
+	laterHash = input->prevOut.hash;
+	input->prevOut.hash = CBNewByteArrayWithDataCopy(CBTransactionGetHash(chained->transactions[3]), 32);
+	if (CBFullValidatorCompleteBlockValidation(validator, chained, assumeValidHeight) != CB_BLOCK_VALIDATION_BAD) {
+		printf("CHAINED BLOCK SPEND LATER TRANSACTION FAIL\n");
+		return 1;
+	}
+	CBReleaseObject(input->prevOut.hash);
+	input->prevOut.hash = laterHash;
+	CBReleaseObject(chained);
+	// Test exporting the unspent outputs to a snapshot and building new storage from it
+	uint8_t commitment[32], spendHash[32];
+	memcpy(spendHash, CBTransactionGetHash(spend), 32);
+	CBReleaseObject(block);
+	start = seconds();
+	if (NOT CBBlockChainStorageExportUnspentOutputs(validator, "./snapshot.dat", commitment)) {
+		printf("EXPORT SNAPSHOT FAIL\n");
+		return 1;
+	}
+	double exported = seconds() - start;
+	uint8_t tipHash[32];
+	memcpy(tipHash, validator->mainTip->hash, 32);
+	uint32_t tipHeight = validator->mainTip->height, snapshotTime = validator->mainTip->time;
+	CBReleaseObject(validator);
+	CBFreeBlockChainStorage(storage);
+	mkdir("./snapshot", 0777);
+	CBRemoveSnapshotStorage();
+	storage = CBNewBlockChainStorage("./snapshot/");
+	// The test blocks are not mined, so the proof of work of the headers only passes when the validator will not check it, and a commitment must be given
+	if (CBBlockChainStorageImportUnspentOutputs(storage, "./snapshot.dat", commitment, 0)
+		|| CBBlockChainStorageImportUnspentOutputs(storage, "./snapshot.dat", NULL, CB_FULL_VALIDATOR_DISABLE_POW_CHECK)
+		|| CBBlockChainStorageExists(storage)) {
+		printf("SNAPSHOT PROOF OF WORK FAIL\n");
+		return 1;
+	}
+	start = seconds();
+	if (NOT CBBlockChainStorageImportUnspentOutputs(storage, "./snapshot.dat", commitment, CB_FULL_VALIDATOR_DISABLE_POW_CHECK)) {
+		printf("IMPORT SNAPSHOT FAIL\n");
+		return 1;
+	}
+	printf("Exporting the unspent outputs took %.0fus and importing took %.0fus\n", exported * 1000000, (seconds() - start) * 1000000);
+	// Snapshots can only go into new storage
+	if (CBBlockChainStorageImportUnspentOutputs(storage, "./snapshot.dat", commitment, CB_FULL_VALIDATOR_DISABLE_POW_CHECK)) {
+		printf("IMPORT SNAPSHOT TWICE FAIL\n");
+		return 1;
+	}
+	validator = CBNewFullValidator(storage, &bad, CB_FULL_VALIDATOR_DISABLE_POW_CHECK);
+	if (NOT validator || bad
+		|| validator->mainTip->height != tipHeight
+		|| memcmp(validator->mainTip->hash, tipHash, 32)) {
+		printf("SNAPSHOT VALIDATOR FAIL\n");
+		return 1;
+	}
+	CBTransactionOutput * snapshotOutput = CBBlockChainStorageLoadUnspentOutput(validator, spendHash, 0, &outputsCoinbase, &outputsHeight);
+	if (NOT snapshotOutput
+		|| snapshotOutput->value != 20 * CB_ONE_BITCOIN
+		|| outputsHeight != tipHeight
+		|| outputsCoinbase) {
+		printf("SNAPSHOT UNSPENT OUTPUT FAIL\n");
+		return 1;
+	}
+	CBReleaseObject(snapshotOutput);
+	// Blocks can be added on top of the snapshot
+	block = CBCopyTestBlock(fork, tipHash, snapshotTime + 1, 2);
+	if (CBFullValidatorProcessBlock(validator, block, 1349643202) != CB_BLOCK_STATUS_MAIN) {
+		printf("SNAPSHOT ADD BLOCK FAIL\n");
+		return 1;
+	}
+	CBReleaseObject(block);
+	CBReleaseObject(validator);
+	CBFreeBlockChainStorage(storage);
+	// A snapshot with a different commitment or corrupted data is rejected
+	CBRemoveSnapshotStorage();
+	storage = CBNewBlockChainStorage("./snapshot/");
+	commitment[0]++;
+	if (CBBlockChainStorageImportUnspentOutputs(storage, "./snapshot.dat", commitment, CB_FULL_VALIDATOR_DISABLE_POW_CHECK)
+		|| CBBlockChainStorageExists(storage)) {
+		printf("SNAPSHOT WRONG COMMITMENT FAIL\n");
+		return 1;
+	}
+	commitment[0]--;
+	FILE * snapshot = fopen("./snapshot.dat", "rb+");
+	fseek(snapshot, -40, SEEK_END);
+	uint8_t byte = fgetc(snapshot) ^ 1;
+	fseek(snapshot, -40, SEEK_END);
+	fputc(byte, snapshot);
+	fclose(snapshot);
+	if (CBBlockChainStorageImportUnspentOutputs(storage, "./snapshot.dat", commitment, CB_FULL_VALIDATOR_DISABLE_POW_CHECK)
+		|| CBBlockChainStorageExists(storage)) {
+		printf("SNAPSHOT CORRUPT FAIL\n");
+		return 1;
+	}
+	remove("./snapshot.dat");
+	CBReleaseObject(fork);
+	CBFreeBlockChainStorage(storage);
+	CBRemoveSnapshotStorage();
+	rmdir("./snapshot");
 	return 0;
 }
@@ -0,0 +1,181 @@
+//
+//  testCBObjectAllocator.c
+//  cbitcoin
+//
+//  Copyright (c) 2012 Matthew Mitchell
+//
+//  This file is part of cbitcoin.
+//
+//  cbitcoin is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  cbitcoin is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with cbitcoin.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <time.h>
+#include "CBBlock.h"
+#include "CBPeer.h"
+
+void CBLogError(char * format, ...);
+void CBLogError(char * format, ...){
+	va_list argptr;
+	va_start(argptr, format);
+	vfprintf(stderr, format, argptr);
+	va_end(argptr);
+	printf("\n");
+}
+
+#define TX_NUM 2000
+#define ROUNDS 20
+
+static double seconds(void){
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+static uint32_t putInt32(uint8_t * data, uint32_t cursor, uint32_t val){
+	for (uint8_t x = 0; x < 4; x++)
+		data[cursor + x] = val >> (x*8);
+	return cursor + 4;
+}
+// Makes a block of transactions with two inputs and two outputs, of the size of typical pay to public key hash transactions.
+static uint32_t makeBlock(uint8_t * data){
+	memset(data, 0, 80);
+	uint32_t cursor = 80;
+	data[cursor++] = 0xFD;
+	data[cursor++] = TX_NUM & 0xFF;
+	data[cursor++] = TX_NUM >> 8;
+	for (uint32_t x = 0; x < TX_NUM; x++) {
+		cursor = putInt32(data, cursor, 1);
+		data[cursor++] = 2;
+		for (uint8_t y = 0; y < 2; y++) {
+			memset(data + cursor, 0, 32);
+			putInt32(data, cursor, x);
+			cursor = putInt32(data, cursor + 32, y);
+			data[cursor++] = 107;
+			memset(data + cursor, 1, 107);
+			cursor = putInt32(data, cursor + 107, 0xFFFFFFFF);
+		}
+		data[cursor++] = 2;
+		for (uint8_t y = 0; y < 2; y++) {
+			cursor = putInt32(data, cursor, 5000 + x);
+			cursor = putInt32(data, cursor, 0);
+			data[cursor++] = 25;
+			memset(data + cursor, CB_SCRIPT_OP_NOP, 25);
+			cursor += 25;
+		}
+		cursor = putInt32(data, cursor, 0);
+	}
+	return cursor;
+}
+// Deserialises and hashes the block as a stand in for validation.
+static bool processBlock(CBByteArray * bytes){
+	CBBlock * block = CBNewBlockFromData(bytes);
+	if (NOT block || NOT CBBlockDeserialise(block, true))
+		return false;
+	uint8_t * root = CBBlockCalculateMerkleRoot(block);
+	if (NOT root)
+		return false;
+	free(root);
+	CBReleaseObject(block);
+	return true;
+}
+
+int main(){
+	uint8_t * data = malloc(TX_NUM * 400 + 100);
+	uint32_t length = makeBlock(data);
+	CBByteArray * bytes = CBNewByteArrayWithDataCopy(data, length);
+	free(data);
+	CBObjectAllocationCounters counters, before;
+	// The allocators can be changed while objects exist.
+	CBObjectSetAllocator(CB_OBJECT_ALLOCATOR_SLAB);
+	CBByteArray * ip = CBNewByteArrayWithDataCopy((uint8_t []){0,0,0,0,0,0,0,0,0,0,0xFF,0xFF,127,0,0,1}, 16);
+	CBNetworkAddress * addr = CBNewNetworkAddress(1234, ip, 8333, CB_SERVICE_FULL_BLOCKS, false);
+	CBReleaseObject(ip);
+	// Peers are made by enlarging the address object.
+	CBPeer * peer = CBNewPeerByTakingNetworkAddress(addr);
+	if (NOT peer || CBGetNetworkAddress(peer)->lastSeen != 1234 || CBGetNetworkAddress(peer)->port != 8333) {
+		printf("REALLOC OBJECT FAIL\n");
+		return 1;
+	}
+	CBObjectSetAllocator(CB_OBJECT_ALLOCATOR_HEAP);
+	CBReleaseObject(peer);
+	// Slabs reuse freed objects, so processing a block again does not allocate chunks.
+	CBObjectSetAllocator(CB_OBJECT_ALLOCATOR_SLAB);
+	processBlock(bytes);
+	CBObjectGetAllocationCounters(&before);
+	processBlock(bytes);
+	CBObjectGetAllocationCounters(&counters);
+	if (counters.chunkAllocations != before.chunkAllocations || counters.heapAllocations != before.heapAllocations) {
+		printf("SLAB REUSE FAIL\n");
+		return 1;
+	}
+	// Block arenas remain while any of their objects are retained.
+	CBObjectSetAllocator(CB_OBJECT_ALLOCATOR_BLOCK_ARENA);
+	CBBlock * block = CBNewBlockFromData(bytes);
+	CBObjectGetAllocationCounters(&before);
+	CBBlockDeserialise(block, true);
+	CBObjectGetAllocationCounters(&counters);
+	if (counters.arenaAllocations - before.arenaAllocations < TX_NUM * 9) {
+		printf("ARENA ALLOCATIONS FAIL\n");
+		return 1;
+	}
+	if (CBObjectGetCurrentArena()) {
+		printf("ARENA ENDED FAIL\n");
+		return 1;
+	}
+	CBTransaction * tx = block->transactions[10];
+	CBRetainObject(tx);
+	CBReleaseObject(block);
+	CBObjectGetAllocationCounters(&counters);
+	if (counters.chunkFrees != before.chunkFrees) {
+		printf("ARENA FREED EARLY FAIL\n");
+		return 1;
+	}
+	if (tx->inputs[1]->prevOut.index != 1 || tx->outputs[1]->value != 5010) {
+		printf("ARENA OBJECT FAIL\n");
+		return 1;
+	}
+	CBReleaseObject(tx);
+	CBObjectGetAllocationCounters(&counters);
+	if (counters.chunkFrees == before.chunkFrees || counters.chunkFrees - before.chunkFrees != counters.chunkAllocations - before.chunkAllocations) {
+		printf("ARENA FREE FAIL\n");
+		return 1;
+	}
+	// Benchmark deserialising and hashing a block with each allocator.
+	char * names[3] = {"malloc", "slab", "block arena"};
+	for (uint8_t x = 0; x < 3; x++) {
+		CBObjectSetAllocator(x);
+		processBlock(bytes); // Warm up
+		CBObjectResetAllocationCounters();
+		double start = seconds();
+		for (uint8_t y = 0; y < ROUNDS; y++)
+			if (NOT processBlock(bytes)) {
+				printf("PROCESS BLOCK FAIL\n");
+				return 1;
+			}
+		double time = seconds() - start;
+		CBObjectGetAllocationCounters(&counters);
+		printf("%s: %.3f ms per block, %llu objects, %llu object mallocs per block\n", names[x], time * 1000 / ROUNDS,
+			   (unsigned long long)(counters.heapAllocations + counters.slabAllocations + counters.arenaAllocations) / ROUNDS,
+			   (unsigned long long)(counters.heapAllocations + counters.chunkAllocations) / ROUNDS);
+		if (x && counters.heapAllocations) {
+			printf("%s HEAP ALLOCATIONS FAIL\n", names[x]);
+			return 1;
+		}
+	}
+	CBReleaseObject(bytes);
+	return 0;
+}
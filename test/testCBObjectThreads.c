@@ -0,0 +1,165 @@
+//
+//  testCBObjectThreads.c
+//  cbitcoin
+//
+//  Copyright (c) 2012 Matthew Mitchell
+//
+//  This file is part of cbitcoin.
+//
+//  cbitcoin is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  cbitcoin is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with cbitcoin.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <pthread.h>
+#include "CBBlock.h"
+
+void CBLogError(char * format, ...);
+void CBLogError(char * format, ...){
+	va_list argptr;
+	va_start(argptr, format);
+	vfprintf(stderr, format, argptr);
+	va_end(argptr);
+	printf("\n");
+}
+
+#define THREADS 4
+#define ROUNDS 200000
+#define BLOCKS 2000
+
+CBBlock * sharedBlock;
+CBByteArray * sharedBytes;
+
+// Retains and releases the shared block, its transactions and sub-references of the shared bytes.
+void * retainRelease(void * arg);
+void * retainRelease(void * arg){
+	// Contend on the same counts without allocating in between.
+	for (uint32_t x = 0; x < ROUNDS * 10; x++) {
+		CBRetainObject(sharedBlock);
+		CBReleaseObject(sharedBlock);
+	}
+	for (uint32_t x = 0; x < ROUNDS; x++) {
+		CBTransaction * tx = sharedBlock->transactions[x % sharedBlock->transactionNum];
+		CBRetainObject(sharedBlock);
+		CBRetainObject(tx);
+		CBByteArray * sub = CBByteArraySubReference(sharedBytes, x % 64, 16);
+		if (NOT sub)
+			return arg;
+		CBReleaseObject(tx);
+		CBReleaseObject(sharedBlock);
+		CBReleaseObject(sub);
+	}
+	return NULL;
+}
+
+// A simple queue for handing blocks from a producer to consumers.
+CBBlock * queue[BLOCKS + 1];
+uint32_t queueHead = 0;
+uint32_t queueTail = 0;
+pthread_mutex_t queueLock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t queueCond = PTHREAD_COND_INITIALIZER;
+
+// Takes blocks from the queue and releases them after reading the transactions.
+void * consume(void * arg);
+void * consume(void * arg){
+	for (;;) {
+		pthread_mutex_lock(&queueLock);
+		while (queueHead == queueTail)
+			pthread_cond_wait(&queueCond, &queueLock);
+		CBBlock * block = queue[queueHead];
+		if (block)
+			queueHead++;
+		pthread_mutex_unlock(&queueLock);
+		if (NOT block)
+			return NULL; // The end of the queue is left for the other consumers.
+		for (uint32_t x = 0; x < block->transactionNum; x++)
+			if (NOT block->transactions[x]->inputNum)
+				return arg;
+		CBReleaseObject(block);
+	}
+}
+
+int main(){
+	if (NOT CBObjectHasAtomicReferences()) {
+		printf("Not built with CB_ATOMIC_REFERENCES. Skipping.\n");
+		return 0;
+	}
+	CBObjectResetAllocationCounters();
+	CBBlock * genesis = CBNewBlockGenesis();
+	sharedBytes = CBGetMessage(genesis)->bytes;
+	sharedBlock = CBNewBlockFromData(sharedBytes);
+	if (NOT CBBlockDeserialise(sharedBlock, true)) {
+		printf("DESERIALISE FAIL\n");
+		return 1;
+	}
+	pthread_t threads[THREADS];
+	for (uint8_t x = 0; x < THREADS; x++)
+		pthread_create(&threads[x], NULL, retainRelease, NULL);
+	for (uint8_t x = 0; x < THREADS; x++) {
+		void * res;
+		pthread_join(threads[x], &res);
+		if (res) {
+			printf("RETAIN RELEASE THREAD FAIL\n");
+			return 1;
+		}
+	}
+	if (CBGetObject(sharedBlock)->references != 1 || CBGetObject(sharedBlock->transactions[0])->references != 1) {
+		printf("OBJECT REFERENCES FAIL\n");
+		return 1;
+	}
+	// The genesis block, the block and its transaction, inputs, outputs, scripts and hashes share the genesis data.
+	uint32_t references = sharedBytes->sharedData->references;
+	CBReleaseObject(sharedBlock);
+	if (sharedBytes->sharedData->references >= references) {
+		printf("SHARED DATA REFERENCES FAIL\n");
+		return 1;
+	}
+	// Hand blocks made in this thread to consumers which release them, with deserialised data shared between the blocks.
+	for (uint8_t x = 0; x < THREADS; x++)
+		pthread_create(&threads[x], NULL, consume, NULL);
+	for (uint32_t x = 0; x < BLOCKS; x++) {
+		CBBlock * block = CBNewBlockFromData(sharedBytes);
+		if (NOT block || NOT CBBlockDeserialise(block, true)) {
+			printf("BLOCK %u FAIL\n", x);
+			return 1;
+		}
+		pthread_mutex_lock(&queueLock);
+		queue[queueTail++] = block;
+		pthread_cond_broadcast(&queueCond);
+		pthread_mutex_unlock(&queueLock);
+	}
+	pthread_mutex_lock(&queueLock);
+	queue[queueTail++] = NULL;
+	pthread_cond_broadcast(&queueCond);
+	pthread_mutex_unlock(&queueLock);
+	for (uint8_t x = 0; x < THREADS; x++) {
+		void * res;
+		pthread_join(threads[x], &res);
+		if (res) {
+			printf("CONSUMER THREAD FAIL\n");
+			return 1;
+		}
+	}
+	CBReleaseObject(genesis);
+	// Every object should have been freed exactly once.
+	CBObjectAllocationCounters counters;
+	CBObjectGetAllocationCounters(&counters);
+	if (counters.frees != counters.heapAllocations + counters.slabAllocations + counters.arenaAllocations) {
+		printf("FREES FAIL %llu != %llu\n", (unsigned long long)counters.frees, (unsigned long long)(counters.heapAllocations + counters.slabAllocations + counters.arenaAllocations));
+		return 1;
+	}
+	return 0;
+}
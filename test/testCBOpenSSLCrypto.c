@@ -0,0 +1,158 @@
+//
+//  testCBOpenSSLCrypto.c
+//  cbitcoin
+//
+//  Copyright (c) 2012 Matthew Mitchell
+//
+//  This file is part of cbitcoin.
+//
+//  cbitcoin is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  cbitcoin is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with cbitcoin.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <sys/time.h>
+#include <openssl/ssl.h>
+#include "CBDependencies.h"
+
+#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
+
+#define KEYS 10
+#define BENCHMARK_VERIFICATIONS 1000
+#define BENCHMARK_ROUNDS 5
+
+void CBLogError(char * b, ...);
+void CBLogError(char * b, ...){
+	printf("%s\n", b);
+}
+
+// The verification before keeping context between calls, for the benchmark.
+bool uncachedEcdsaVerify(uint8_t * signature, uint8_t sigLen, uint8_t * hash, const uint8_t * pubKey, uint8_t keyLen);
+bool uncachedEcdsaVerify(uint8_t * signature, uint8_t sigLen, uint8_t * hash, const uint8_t * pubKey, uint8_t keyLen){
+	EC_KEY * key = EC_KEY_new_by_curve_name(NID_secp256k1);
+	o2i_ECPublicKey(&key, &pubKey, keyLen);
+	int res = ECDSA_verify(0, hash, 32, signature, sigLen, key);
+	EC_KEY_free(key);
+	return res == 1;
+}
+double getMilliseconds(void);
+double getMilliseconds(void){
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec * 1000.0 + tv.tv_usec / 1000.0;
+}
+
+int main(){
+	unsigned int s = (unsigned int)time(NULL);
+	printf("Session = %ui\n", s);
+	srand(s);
+	uint8_t privKeys[KEYS][32];
+	uint8_t pubKeys[KEYS][65];
+	uint8_t hashes[KEYS][32];
+	uint8_t * sigs[KEYS];
+	unsigned int sigLens[KEYS];
+	EC_GROUP * group = EC_GROUP_new_by_curve_name(NID_secp256k1);
+	for (uint8_t x = 0; x < KEYS; x++) {
+		for (uint8_t y = 0; y < 32; y++) {
+			privKeys[x][y] = rand();
+			hashes[x][y] = rand();
+		}
+		privKeys[x][0] = 0x7F; // Keep the key below the curve order.
+		// Get the public key, compressed for even keys.
+		BIGNUM * bn = BN_bin2bn(privKeys[x], 32, NULL);
+		EC_POINT * point = EC_POINT_new(group);
+		EC_POINT_mul(group, point, bn, NULL, NULL, NULL);
+		EC_POINT_point2oct(group, point, x % 2 ? POINT_CONVERSION_UNCOMPRESSED : POINT_CONVERSION_COMPRESSED, pubKeys[x], 65, NULL);
+		EC_POINT_free(point);
+		BN_free(bn);
+		if (NOT CBEcdsaSign(hashes[x], privKeys[x], &sigLens[x], &sigs[x])) {
+			printf("SIGN FAIL\n");
+			return 1;
+		}
+	}
+	EC_GROUP_free(group);
+	// Test verification, twice so that the second time uses cached keys.
+	for (uint8_t y = 0; y < 2; y++)
+		for (uint8_t x = 0; x < KEYS; x++) {
+			uint8_t keyLen = x % 2 ? 65 : 33;
+			if (NOT CBEcdsaVerify(sigs[x], sigLens[x], hashes[x], pubKeys[x], keyLen)) {
+				printf("VERIFY FAIL %u\n", x);
+				return 1;
+			}
+			if (CBEcdsaVerify(sigs[x], sigLens[x], hashes[(x + 1) % KEYS], pubKeys[x], keyLen)) {
+				printf("VERIFY WRONG HASH FAIL %u\n", x);
+				return 1;
+			}
+			if (CBEcdsaVerify(sigs[x], sigLens[x], hashes[x], pubKeys[(x + 2) % KEYS], keyLen)) {
+				printf("VERIFY WRONG KEY FAIL %u\n", x);
+				return 1;
+			}
+		}
+	// Test invalid public keys
+	uint8_t badKey[33] = {0x05};
+	if (CBEcdsaVerify(sigs[0], sigLens[0], hashes[0], badKey, 33)
+		|| CBEcdsaVerify(sigs[0], sigLens[0], hashes[0], pubKeys[0], 1)
+		|| CBEcdsaVerify(sigs[0], sigLens[0], hashes[0], pubKeys[0], 32)) {
+		printf("BAD KEY FAIL\n");
+		return 1;
+	}
+	// Test batch verification
+	CBEcdsaVerifyInput inputs[KEYS];
+	bool results[KEYS];
+	for (uint8_t x = 0; x < KEYS; x++)
+		inputs[x] = (CBEcdsaVerifyInput){sigs[x], sigLens[x], hashes[x], pubKeys[x], x % 2 ? 65 : 33};
+	if (NOT CBEcdsaVerifyBatch(inputs, KEYS, results)) {
+		printf("BATCH FAIL\n");
+		return 1;
+	}
+	inputs[3].hash = hashes[4];
+	if (CBEcdsaVerifyBatch(inputs, KEYS, results)) {
+		printf("BATCH INVALID FAIL\n");
+		return 1;
+	}
+	for (uint8_t x = 0; x < KEYS; x++)
+		if (results[x] != (x != 3)) {
+			printf("BATCH RESULTS FAIL %u\n", x);
+			return 1;
+		}
+	inputs[3].hash = hashes[3];
+	// Benchmark against the verification without kept context. The methods take turns and the best round of each is kept, so that changes in the load of the machine affect both alike.
+	double uncached = 0, cached = 0, batch = 0;
+	for (uint8_t round = 0; round < BENCHMARK_ROUNDS; round++) {
+		double start = getMilliseconds();
+		for (uint32_t x = 0; x < BENCHMARK_VERIFICATIONS; x++)
+			uncachedEcdsaVerify(sigs[x % KEYS], sigLens[x % KEYS], hashes[x % KEYS], pubKeys[x % KEYS], x % 2 ? 65 : 33);
+		double time = getMilliseconds() - start;
+		if (NOT round || time < uncached)
+			uncached = time;
+		start = getMilliseconds();
+		for (uint32_t x = 0; x < BENCHMARK_VERIFICATIONS; x++)
+			CBEcdsaVerify(sigs[x % KEYS], sigLens[x % KEYS], hashes[x % KEYS], pubKeys[x % KEYS], x % 2 ? 65 : 33);
+		time = getMilliseconds() - start;
+		if (NOT round || time < cached)
+			cached = time;
+		start = getMilliseconds();
+		for (uint32_t x = 0; x < BENCHMARK_VERIFICATIONS / KEYS; x++)
+			CBEcdsaVerifyBatch(inputs, KEYS, NULL);
+		time = getMilliseconds() - start;
+		if (NOT round || time < batch)
+			batch = time;
+	}
+	printf("UNCACHED VERIFICATIONS/SEC = %.0f\n", BENCHMARK_VERIFICATIONS / uncached * 1000);
+	printf("CACHED VERIFICATIONS/SEC = %.0f (%+.1f%%)\n", BENCHMARK_VERIFICATIONS / cached * 1000, (uncached / cached - 1) * 100);
+	printf("BATCH VERIFICATIONS/SEC = %.0f (%+.1f%%)\n", BENCHMARK_VERIFICATIONS / batch * 1000, (uncached / batch - 1) * 100);
+	for (uint8_t x = 0; x < KEYS; x++)
+		free(sigs[x]);
+	return 0;
+}
@@ -0,0 +1,173 @@
+//
+//  testCBRand.c
+//  cbitcoin
+//
+//  Copyright (c) 2012 Matthew Mitchell
+//
+//  This file is part of cbitcoin.
+//
+//  cbitcoin is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  cbitcoin is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with cbitcoin.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/wait.h>
+#include "CBDependencies.h"
+
+void CBLogError(char * b, ...);
+void CBLogError(char * b, ...){
+	printf("%s\n", b);
+}
+
+#define BENCH_BYTES (32 * 1024 * 1024)
+
+void * threadBytes(void * arg);
+void * threadBytes(void * arg){
+	if (NOT CBSecureRandomBytes(arg, 32))
+		return arg;
+	return NULL;
+}
+
+static double seconds(void){
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+int main(){
+	uint64_t gen;
+	if (NOT CBNewSecureRandomGenerator(&gen)) {
+		printf("NEW GENERATOR FAIL\n");
+		return 1;
+	}
+	// Known answer: the zero key gives the ChaCha20 keystream for the zero key, after the 32 bytes used to change the key.
+	CBRandomSeed(gen, 0);
+	uint64_t expected[3] = {0x8d4857517c5941daULL, 0x374ad8b83fe02477ULL, 0x1ca11815f4b8436aULL};
+	for (uint8_t x = 0; x < 3; x++) {
+		uint64_t i = CBSecureRandomInteger(gen);
+		if (i != expected[x]) {
+			printf("KNOWN ANSWER %u FAIL %llx != %llx\n", x, (unsigned long long)i, (unsigned long long)expected[x]);
+			return 1;
+		}
+	}
+	// The 61st integer comes from the second refill, with the new key.
+	for (uint8_t x = 3; x < 60; x++)
+		CBSecureRandomInteger(gen);
+	if (CBSecureRandomInteger(gen) != 0xfe243c69f0d4a704ULL) {
+		printf("REKEY KNOWN ANSWER FAIL\n");
+		return 1;
+	}
+	// Seeding is deterministic, including for bulk fills.
+	uint8_t a[1000], b[1000];
+	CBRandomSeed(gen, 12345);
+	CBSecureRandomFill(gen, a, 1000);
+	CBRandomSeed(gen, 12345);
+	CBSecureRandomFill(gen, b, 1000);
+	if (memcmp(a, b, 1000)) {
+		printf("SEED REPEAT FAIL\n");
+		return 1;
+	}
+	CBRandomSeed(gen, 12346);
+	CBSecureRandomFill(gen, b, 1000);
+	if (NOT memcmp(a, b, 1000)) {
+		printf("DIFFERENT SEED FAIL\n");
+		return 1;
+	}
+	// Secure seeding should not leak file descriptors.
+	int fdBefore = open("/dev/null", O_RDONLY);
+	close(fdBefore);
+	for (uint16_t x = 0; x < 1000; x++)
+		if (NOT CBSecureRandomSeed(gen)) {
+			printf("SECURE SEED FAIL\n");
+			return 1;
+		}
+	int fdAfter = open("/dev/null", O_RDONLY);
+	close(fdAfter);
+	if (fdBefore != fdAfter) {
+		printf("SECURE SEED FD LEAK FAIL\n");
+		return 1;
+	}
+	uint64_t gen2;
+	CBNewSecureRandomGenerator(&gen2);
+	CBSecureRandomSeed(gen2);
+	if (CBSecureRandomInteger(gen) == CBSecureRandomInteger(gen2)) {
+		printf("SECURE SEED SAME FAIL\n");
+		return 1;
+	}
+	CBFreeSecureRandomGenerator(gen2);
+	// Per-thread generators give different output.
+	uint8_t mine[32], other[2][32];
+	if (NOT CBSecureRandomBytes(mine, 32)) {
+		printf("THREAD BYTES FAIL\n");
+		return 1;
+	}
+	pthread_t threads[2];
+	for (uint8_t x = 0; x < 2; x++)
+		pthread_create(&threads[x], NULL, threadBytes, other[x]);
+	for (uint8_t x = 0; x < 2; x++) {
+		void * res;
+		pthread_join(threads[x], &res);
+		if (res || NOT memcmp(mine, other[x], 32)) {
+			printf("THREAD %u FAIL\n", x);
+			return 1;
+		}
+	}
+	if (NOT memcmp(other[0], other[1], 32)) {
+		printf("THREADS SAME FAIL\n");
+		return 1;
+	}
+	// A fork child must not repeat the parent's output.
+	int fds[2];
+	if (pipe(fds)) {
+		printf("PIPE FAIL\n");
+		return 1;
+	}
+	pid_t pid = fork();
+	if (pid == 0) {
+		CBSecureRandomBytes(mine, 32);
+		_exit(write(fds[1], mine, 32) != 32);
+	}
+	CBSecureRandomBytes(mine, 32);
+	if (read(fds[0], other[0], 32) != 32 || NOT memcmp(mine, other[0], 32)) {
+		printf("FORK FAIL\n");
+		return 1;
+	}
+	waitpid(pid, NULL, 0);
+	close(fds[0]);
+	close(fds[1]);
+	// Benchmark against hashing the state with SHA-256 for each integer, as the generator did before.
+	uint8_t * bench = malloc(BENCH_BYTES);
+	double start = seconds();
+	CBSecureRandomBytes(bench, BENCH_BYTES);
+	double bulk = seconds() - start;
+	start = seconds();
+	for (uint32_t x = 0; x < BENCH_BYTES; x += 8)
+		CBSecureRandomBytes(bench + x, 8);
+	double small = seconds() - start;
+	uint8_t state[32] = {0};
+	start = seconds();
+	for (uint32_t x = 0; x < BENCH_BYTES; x += 8) {
+		CBSha256(state, 32, state);
+		memcpy(bench + x, state, 8);
+	}
+	double sha = seconds() - start;
+	printf("ChaCha20 bulk: %.1f MB/s\nChaCha20 8 byte requests: %.1f MB/s\nSHA-256 per integer: %.1f MB/s\n", BENCH_BYTES / bulk / 1e6, BENCH_BYTES / small / 1e6, BENCH_BYTES / sha / 1e6);
+	free(bench);
+	CBFreeSecureRandomGenerator(gen);
+	return 0;
+}
@@ -35,6 +35,33 @@ void CBLogError(char * format, ...){
 	printf("\n");
 }
 
+#ifdef __GLIBC__
+// Count heap allocations to check that script execution does not use the heap.
+void * __libc_malloc(size_t size);
+void * __libc_realloc(void * ptr, size_t size);
+void * __libc_calloc(size_t num, size_t size);
+uint32_t allocations = 0;
+void * malloc(size_t size){
+	allocations++;
+	return __libc_malloc(size);
+}
+void * realloc(void * ptr, size_t size){
+	allocations++;
+	return __libc_realloc(ptr, size);
+}
+void * calloc(size_t num, size_t size){
+	allocations++;
+	return __libc_calloc(num, size);
+}
+#else
+uint32_t allocations = 0; // Not counted
+#endif
+
+CBGetHashReturn getHashForSigFail(void * tx, CBByteArray * prevOutSubScript, uint32_t input, CBSignType signType, uint8_t * hash);
+CBGetHashReturn getHashForSigFail(void * tx, CBByteArray * prevOutSubScript, uint32_t input, CBSignType signType, uint8_t * hash){
+	return CB_TX_HASH_BAD;
+}
+
 int main(){
 	unsigned int s = (unsigned int)time(NULL);
 	s = 1337544566;
@@ -67,9 +94,10 @@ int main(){
 				printf("%i: {%s} INVALID\n", x, line);
 				return 1;
 			}else{
-				CBScriptStack stack = CBNewEmptyScriptStack();
+				CBScriptStack stack;
+				CBInitScriptStack(&stack);
 				bool res = CBScriptExecute(script, &stack, NULL, NULL, 0, true);
-				CBFreeScriptStack(stack);
+				CBFreeScriptStack(&stack);
 				char c = fgetc(f);
 				if ((c == '1' && res != CB_SCRIPT_TRUE)
 					|| (c == '0' && (res != CB_SCRIPT_INVALID && res != CB_SCRIPT_FALSE))) {
@@ -87,14 +115,15 @@ int main(){
 	fclose(f);
 	// Test PUSHDATA
 	CBScript * script = CBNewScriptWithDataCopy((uint8_t []){CB_SCRIPT_OP_PUSHDATA1, 0x01, 0x47, CB_SCRIPT_OP_DUP, CB_SCRIPT_OP_PUSHDATA2, 0x01, 0x00, 0x47, CB_SCRIPT_OP_EQUALVERIFY, CB_SCRIPT_OP_PUSHDATA4, 0x01, 0x00, 0x00, 0x00, 0x47, CB_SCRIPT_OP_EQUAL}, 16);
-	CBScriptStack stack = CBNewEmptyScriptStack();
+	CBScriptStack stack;
+	CBInitScriptStack(&stack);
 	if(CBScriptExecute(script, &stack, NULL, NULL, 0, true) != CB_SCRIPT_TRUE){
 		printf("PUSHDATA TEST 1 FAIL\n");
 		return 1;
 	}
 	CBReleaseObject(script);
 	script = CBNewScriptWithDataCopy((uint8_t []){CB_SCRIPT_OP_PUSHDATA1, 0x01, 0x00, CB_SCRIPT_OP_DUP, CB_SCRIPT_OP_PUSHDATA2, 0x01, 0x00, 0x00, CB_SCRIPT_OP_EQUALVERIFY, CB_SCRIPT_OP_PUSHDATA4, 0x01, 0x00, 0x00, 0x00, 0x00, CB_SCRIPT_OP_EQUAL}, 16);
-	stack = CBNewEmptyScriptStack();
+	CBInitScriptStack(&stack);
 	if(CBScriptExecute(script, &stack, NULL, NULL, 0, true) != CB_SCRIPT_TRUE){
 		printf("PUSHDATA TEST 2 FAIL\n");
 		return 1;
@@ -102,7 +131,7 @@ int main(){
 	CBReleaseObject(script);
 	// Test stack length limit
 	script = CBNewScriptWithDataCopy((uint8_t []){CB_SCRIPT_OP_TRUE}, 1);
-	stack = CBNewEmptyScriptStack();
+	CBInitScriptStack(&stack);
 	for (int x = 0; x < 1001; x++)
 		CBScriptStackPushItem(&stack, (CBScriptStackItem){NULL, 0});
 	if(CBScriptExecute(script, &stack, NULL, NULL, 0, true) != CB_SCRIPT_INVALID){
@@ -113,34 +142,101 @@ int main(){
 	// Test P2SH
 	CBScript * inputScript = CBNewScriptWithDataCopy((uint8_t []){CB_SCRIPT_OP_14, 0x04, CB_SCRIPT_OP_5, CB_SCRIPT_OP_9, CB_SCRIPT_OP_ADD, CB_SCRIPT_OP_EQUAL}, 6);
 	CBScript * outputScript = CBNewScriptWithDataCopy((uint8_t []){CB_SCRIPT_OP_HASH160, 0x14, 0x87, 0xF3, 0xB6, 0x21, 0xF1, 0x8C, 0x50, 0x06, 0x8B, 0x7D, 0xAB, 0xA1, 0x60, 0xBB, 0x2C, 0x51, 0xFD, 0xD6, 0xA5, 0xE2, CB_SCRIPT_OP_EQUAL}, 23);
-	stack = CBNewEmptyScriptStack();
+	CBInitScriptStack(&stack);
 	CBScriptExecute(inputScript, &stack, NULL, NULL, 0, false);
 	if (CBScriptExecute(outputScript, &stack, NULL, NULL, 0, false) != CB_SCRIPT_TRUE) {
 		printf("OK NO PS2H FAIL\n");
 		return 1;
 	}
-	stack = CBNewEmptyScriptStack();
+	CBInitScriptStack(&stack);
 	CBScriptExecute(inputScript, &stack, NULL, NULL, 0, false);
 	if (CBScriptExecute(outputScript, &stack, NULL, NULL, 0, true) != CB_SCRIPT_TRUE) {
 		printf("OK YES PS2H FAIL\n");
 		return 1;
 	}
 	CBByteArraySetByte(inputScript, 0, CB_SCRIPT_OP_13);
-	stack = CBNewEmptyScriptStack();
+	CBInitScriptStack(&stack);
 	CBScriptExecute(inputScript, &stack, NULL, NULL, 0, false);
 	if (CBScriptExecute(outputScript, &stack, NULL, NULL, 0, false) != CB_SCRIPT_TRUE) {
 		printf("BAD NO PS2H FAIL\n");
 		return 1;
 	}
-	stack = CBNewEmptyScriptStack();
+	CBInitScriptStack(&stack);
 	CBScriptExecute(inputScript, &stack, NULL, NULL, 0, false);
-	CBReleaseObject(inputScript);
 	if (CBScriptExecute(outputScript, &stack, NULL, NULL, 0, true) != CB_SCRIPT_FALSE) {
 		printf("BAD YES PS2H FAIL\n");
 		return 1;
 	}
-	CBFreeScriptStack(stack);
+	CBFreeScriptStack(&stack);
+	CBReleaseObject(inputScript); // Released after execution as the stack references the input script.
 	CBReleaseObject(outputScript);
+	// Test that standard scripts execute without heap allocations in the interpreter. P2PKH and P2SH. The hashing dependency may allocate itself so count the allocations of one HASH160 and discount them.
+	uint8_t pubKeyHash[20];
+	uint8_t pubKey[33] = {0x02};
+	uint8_t dataTemp[32];
+	allocations = 0;
+	CBSha256(pubKey, 33, dataTemp);
+	CBRipemd160(dataTemp, 32, pubKeyHash);
+	uint32_t hashAllocations = allocations;
+	inputScript = CBNewScriptOfSize(2 + 72 + 33);
+	CBByteArraySetByte(inputScript, 0, 72);
+	memset(CBByteArrayGetData(inputScript) + 1, 0x30, 72);
+	CBByteArraySetByte(inputScript, 73, 33);
+	CBByteArraySetBytes(inputScript, 74, pubKey, 33);
+	outputScript = CBNewScriptOfSize(25);
+	CBByteArraySetByte(outputScript, 0, CB_SCRIPT_OP_DUP);
+	CBByteArraySetByte(outputScript, 1, CB_SCRIPT_OP_HASH160);
+	CBByteArraySetByte(outputScript, 2, 20);
+	CBByteArraySetBytes(outputScript, 3, pubKeyHash, 20);
+	CBByteArraySetByte(outputScript, 23, CB_SCRIPT_OP_EQUALVERIFY);
+	CBByteArraySetByte(outputScript, 24, CB_SCRIPT_OP_CHECKSIG);
+	allocations = 0;
+	CBInitScriptStack(&stack);
+	CBScriptExecute(inputScript, &stack, NULL, NULL, 0, false);
+	// The signature is not checked, as the hash for the signature fails.
+	if (CBScriptExecute(outputScript, &stack, getHashForSigFail, NULL, 0, true) != CB_SCRIPT_FALSE) {
+		printf("P2PKH NO ALLOCATIONS EXECUTION FAIL\n");
+		return 1;
+	}
+	CBFreeScriptStack(&stack);
+	allocations -= hashAllocations;
+	printf("P2PKH EXECUTION HEAP ALLOCATIONS = %u\n", allocations);
+	if (allocations) {
+		printf("P2PKH NO ALLOCATIONS FAIL\n");
+		return 1;
+	}
+	CBReleaseObject(inputScript);
+	CBReleaseObject(outputScript);
+	inputScript = CBNewScriptWithDataCopy((uint8_t []){CB_SCRIPT_OP_14, 0x04, CB_SCRIPT_OP_5, CB_SCRIPT_OP_9, CB_SCRIPT_OP_ADD, CB_SCRIPT_OP_EQUAL}, 6);
+	outputScript = CBNewScriptWithDataCopy((uint8_t []){CB_SCRIPT_OP_HASH160, 0x14, 0x87, 0xF3, 0xB6, 0x21, 0xF1, 0x8C, 0x50, 0x06, 0x8B, 0x7D, 0xAB, 0xA1, 0x60, 0xBB, 0x2C, 0x51, 0xFD, 0xD6, 0xA5, 0xE2, CB_SCRIPT_OP_EQUAL}, 23);
+	allocations = 0;
+	CBInitScriptStack(&stack);
+	CBScriptExecute(inputScript, &stack, NULL, NULL, 0, false);
+	if (CBScriptExecute(outputScript, &stack, NULL, NULL, 0, true) != CB_SCRIPT_TRUE) {
+		printf("P2SH NO ALLOCATIONS EXECUTION FAIL\n");
+		return 1;
+	}
+	CBFreeScriptStack(&stack);
+	allocations -= hashAllocations;
+	printf("P2SH EXECUTION HEAP ALLOCATIONS = %u\n", allocations);
+	if (allocations) {
+		printf("P2SH NO ALLOCATIONS FAIL\n");
+		return 1;
+	}
+	CBReleaseObject(inputScript);
+	CBReleaseObject(outputScript);
+	// Test the arena falls back to the heap when exhausted.
+	CBInitScriptStack(&stack);
+	for (int x = 0; x < CB_SCRIPT_STACK_ARENA_SIZE / 32 + 1; x++)
+		if (NOT CBScriptStackAllocate(&stack, 32)) {
+			printf("ARENA OVERFLOW ALLOCATE FAIL\n");
+			return 1;
+		}
+	if (NOT stack.overflow) {
+		printf("ARENA OVERFLOW FAIL\n");
+		return 1;
+	}
+	CBFreeScriptStack(&stack);
 	// Test CBScriptIsPushOnly
 	script = CBNewScriptWithDataCopy((uint8_t [20]){0x02, 0x04, 0x73, CB_SCRIPT_OP_PUSHDATA1, 0x03, 0xA2, 0x70, 0x73, CB_SCRIPT_OP_PUSHDATA2, 0x01, 0x00, 0x5A, CB_SCRIPT_OP_PUSHDATA4, 0x03, 0x0, 0x0, 0x0, 0x5F, 0x70, 0x74}, 20);
 	if (NOT CBScriptIsPushOnly(script)) {
@@ -0,0 +1,142 @@
+//
+//  testCBSignatureCache.c
+//  cbitcoin
+//
+//  Copyright (c) 2012 Matthew Mitchell
+//
+//  This file is part of cbitcoin.
+//
+//  cbitcoin is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  cbitcoin is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with cbitcoin.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include "CBSignatureCache.h"
+
+void CBLogError(char * b, ...);
+void CBLogError(char * b, ...){
+	printf("%s\n", b);
+}
+
+// Replace the ECDSA verification so that the test can count verifications. Signatures are valid when the first byte is 0x30.
+uint32_t verifications = 0;
+bool CBEcdsaVerify(uint8_t * signature, uint8_t sigLen, uint8_t * hash, const uint8_t * pubKey, uint8_t keyLen){
+	__sync_fetch_and_add(&verifications, 1);
+	return signature[0] == 0x30;
+}
+
+#define THREADS 4
+#define THREAD_SIGS 20000
+
+void * verifyThread(void * arg);
+void * verifyThread(void * arg){
+	uint8_t hash[32] = {0};
+	uint8_t pubKey[33] = {0x02};
+	uint8_t sig[72] = {0x30};
+	for (uint32_t x = 0; x < THREAD_SIGS; x++) {
+		// Half of the signatures are shared between threads.
+		uint32_t n = x % 2 ? x : x + *(uint32_t *)arg * THREAD_SIGS;
+		memcpy(hash, &n, 4);
+		if (NOT CBSignatureCacheVerify(sig, 72, hash, pubKey, 33))
+			return arg;
+	}
+	return NULL;
+}
+
+int main(){
+	uint8_t hash[32] = {0};
+	uint8_t pubKey[33] = {0x02};
+	uint8_t sig[72] = {0x30};
+	// Test a valid signature is verified once and then found in the cache
+	if (NOT CBSignatureCacheVerify(sig, 72, hash, pubKey, 33)) {
+		printf("VALID SIG FAIL\n");
+		return 1;
+	}
+	if (NOT CBSignatureCacheVerify(sig, 72, hash, pubKey, 33)) {
+		printf("VALID SIG CACHED FAIL\n");
+		return 1;
+	}
+	if (verifications != 1 || CBSignatureCacheGetHits() != 1 || CBSignatureCacheGetMisses() != 1) {
+		printf("VALID SIG COUNT FAIL\n");
+		return 1;
+	}
+	// Test a different hash, public key or signature is not found.
+	hash[31] = 1;
+	CBSignatureCacheVerify(sig, 72, hash, pubKey, 33);
+	pubKey[32] = 1;
+	CBSignatureCacheVerify(sig, 72, hash, pubKey, 33);
+	sig[71] = 1;
+	CBSignatureCacheVerify(sig, 72, hash, pubKey, 33);
+	CBSignatureCacheVerify(sig, 71, hash, pubKey, 33);
+	if (verifications != 5 || CBSignatureCacheGetHits() != 1 || CBSignatureCacheGetMisses() != 5) {
+		printf("DIFFERENT SIG FAIL\n");
+		return 1;
+	}
+	// Test an invalid signature is not cached
+	sig[0] = 0;
+	if (CBSignatureCacheVerify(sig, 72, hash, pubKey, 33) || CBSignatureCacheVerify(sig, 72, hash, pubKey, 33)) {
+		printf("INVALID SIG FAIL\n");
+		return 1;
+	}
+	if (verifications != 7 || CBSignatureCacheGetHits() != 1) {
+		printf("INVALID SIG CACHED FAIL\n");
+		return 1;
+	}
+	// Test clearing the cache
+	CBSignatureCacheClear();
+	sig[0] = 0x30;
+	CBSignatureCacheVerify(sig, 72, hash, pubKey, 33);
+	if (verifications != 8 || CBSignatureCacheGetHits() != 0 || CBSignatureCacheGetMisses() != 1) {
+		printf("CLEAR FAIL\n");
+		return 1;
+	}
+	// Test the cache stays bounded by filling it beyond its capacity. The most recent entry must remain.
+	uint32_t capacity = CB_SIGNATURE_CACHE_BUCKETS * CB_SIGNATURE_CACHE_WAYS;
+	CBSignatureCacheClear();
+	verifications = 0;
+	for (uint32_t x = 0; x < capacity * 2; x++) {
+		memcpy(hash, &x, 4);
+		CBSignatureCacheVerify(sig, 72, hash, pubKey, 33);
+	}
+	CBSignatureCacheVerify(sig, 72, hash, pubKey, 33);
+	if (verifications != capacity * 2 || CBSignatureCacheGetHits() != 1) {
+		printf("FULL CACHE FAIL\n");
+		return 1;
+	}
+	// Test with many threads
+	CBSignatureCacheClear();
+	verifications = 0;
+	pthread_t threads[THREADS];
+	uint32_t ids[THREADS];
+	for (uint32_t x = 0; x < THREADS; x++) {
+		ids[x] = x;
+		pthread_create(&threads[x], NULL, verifyThread, &ids[x]);
+	}
+	for (uint32_t x = 0; x < THREADS; x++) {
+		void * res;
+		pthread_join(threads[x], &res);
+		if (res) {
+			printf("THREAD VERIFY FAIL\n");
+			return 1;
+		}
+	}
+	printf("THREADS HITS = %llu MISSES = %llu VERIFICATIONS = %u\n", (unsigned long long)CBSignatureCacheGetHits(), (unsigned long long)CBSignatureCacheGetMisses(), verifications);
+	if (CBSignatureCacheGetHits() + CBSignatureCacheGetMisses() != THREADS * THREAD_SIGS
+		|| CBSignatureCacheGetMisses() != verifications
+		|| CBSignatureCacheGetHits() == 0) {
+		printf("THREAD COUNT FAIL\n");
+		return 1;
+	}
+	return 0;
+}
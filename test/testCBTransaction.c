@@ -72,7 +72,8 @@ int main(){
 		printf("CBTransactionInput DESERIALISED outPointerIndex INCORRECT: %i != 0x514BFA05\n", input->prevOut.index);
 		return 1;
 	}
-	CBScriptStack stack = CBNewEmptyScriptStack();
+	CBScriptStack stack;
+	CBInitScriptStack(&stack);
 	if(CBScriptExecute(input->scriptObject, &stack, NULL, NULL, 0, false) != CB_SCRIPT_TRUE){
 		printf("CBTransactionInput DESERIALISED SCRIPT FAILURE\n");
 		return 1;
@@ -116,7 +117,7 @@ int main(){
 		printf("CBTransactionOutput DESERIALISED value INCORRECT: %" PRIu64 " != %" PRIu64 "\n", output->value, value);
 		return 1;
 	}
-	stack = CBNewEmptyScriptStack();
+	CBInitScriptStack(&stack);
 	if(CBScriptExecute(output->scriptObject, &stack, NULL, NULL, 0, false) != CB_SCRIPT_TRUE){
 		printf("CBTransactionOutput DESERIALISED SCRIPT FAILURE\n");
 		return 1;
@@ -225,7 +226,8 @@ int main(){
 			printf("TRANSACTION CBTransactionInput %i DESERIALISED outPointerIndex INCORRECT: %u != %u\n", x, tx->inputs[x]->prevOut.index, randInt);
 			return 1;
 		}
-		CBScriptStack stack = CBNewEmptyScriptStack();
+		CBScriptStack stack;
+		CBInitScriptStack(&stack);
 		if(CBScriptExecute(tx->inputs[x]->scriptObject, &stack, NULL, NULL, 0, false) != CB_SCRIPT_TRUE){
 			printf("TRANSACTION CBTransactionInput %i DESERIALISED SCRIPT FAILURE\n", x);
 			return 1;
@@ -240,7 +242,7 @@ int main(){
 			printf("TRANSACTION CBTransactionOutput %i DESERIALISED value INCORRECT: %" PRIu64 " != %" PRIu64 "\n", x, tx->outputs[x]->value, randInt64);
 			return 1;
 		}
-		stack = CBNewEmptyScriptStack();
+		CBInitScriptStack(&stack);
 		if(CBScriptExecute(tx->outputs[x]->scriptObject, &stack, NULL, NULL, 0, false) != CB_SCRIPT_TRUE){
 			printf("TRANSACTION CBTransactionOutput %i DESERIALISED SCRIPT FAILURE\n", x);
 			return 1;
@@ -359,7 +361,7 @@ int main(){
 	}
 	// Test SIGHASH_ALL
 	// Execute the transaction scripts to verify correctness.
-	stack = CBNewEmptyScriptStack();
+	CBInitScriptStack(&stack);
 	CBScriptExecute(tx->inputs[0]->scriptObject, &stack, NULL, NULL, 0, false);
 	if (CBScriptExecute(outputScripts[0], &stack, CBTransactionGetInputHashForSignature, tx, 0, false) != CB_SCRIPT_TRUE) {
 		printf("SIGHASH_ALL FAIL\n");
@@ -367,7 +369,7 @@ int main(){
 	}
 	// Test modified first output value
 	tx->outputs[0]->value++;
-	stack = CBNewEmptyScriptStack();
+	CBInitScriptStack(&stack);
 	CBScriptExecute(tx->inputs[0]->scriptObject, &stack, NULL, NULL, 0, false);
 	if (CBScriptExecute(outputScripts[0], &stack, CBTransactionGetInputHashForSignature, tx, 0, false) != CB_SCRIPT_FALSE) {
 		printf("SIGHASH_ALL AND MODIFIED FIRST OUTPUT VALUE FAIL\n");
@@ -376,7 +378,7 @@ int main(){
 	tx->outputs[0]->value--;
 	// Test modified first output script
 	CBByteArraySetByte(CBGetByteArray(tx->outputs[0]->scriptObject), 0, CBByteArrayGetByte(CBGetByteArray(tx->outputs[0]->scriptObject), 0) + 1);
-	stack = CBNewEmptyScriptStack();
+	CBInitScriptStack(&stack);
 	CBScriptExecute(tx->inputs[0]->scriptObject, &stack, NULL, NULL, 0, false);
 	if (CBScriptExecute(outputScripts[0], &stack, CBTransactionGetInputHashForSignature, tx, 0, false) != CB_SCRIPT_FALSE) {
 		printf("SIGHASH_ALL AND MODIFIED FIRST OUTPUT SCRIPT FAIL\n");
@@ -385,7 +387,7 @@ int main(){
 	CBByteArraySetByte(CBGetByteArray(tx->outputs[0]->scriptObject), 0, CBByteArrayGetByte(CBGetByteArray(tx->outputs[0]->scriptObject), 0) - 1);
 	// Test modified second output value
 	tx->outputs[1]->value++;
-	stack = CBNewEmptyScriptStack();
+	CBInitScriptStack(&stack);
 	CBScriptExecute(tx->inputs[0]->scriptObject, &stack, NULL, NULL, 0, false);
 	if (CBScriptExecute(outputScripts[0], &stack, CBTransactionGetInputHashForSignature, tx, 0, false) != CB_SCRIPT_FALSE) {
 		printf("SIGHASH_ALL AND MODIFIED FIRST OUTPUT VALUE FAIL\n");
@@ -394,7 +396,7 @@ int main(){
 	tx->outputs[1]->value--;
 	// Test modified second output script
 	CBByteArraySetByte(CBGetByteArray(tx->outputs[1]->scriptObject), 0, CBByteArrayGetByte(CBGetByteArray(tx->outputs[1]->scriptObject), 0) + 1);
-	stack = CBNewEmptyScriptStack();
+	CBInitScriptStack(&stack);
 	CBScriptExecute(tx->inputs[0]->scriptObject, &stack, NULL, NULL, 0, false);
 	if (CBScriptExecute(outputScripts[0], &stack, CBTransactionGetInputHashForSignature, tx, 0, false) != CB_SCRIPT_FALSE) {
 		printf("SIGHASH_ALL AND MODIFIED SECOND OUTPUT SCRIPT FAIL\n");
@@ -403,7 +405,7 @@ int main(){
 	CBByteArraySetByte(CBGetByteArray(tx->outputs[1]->scriptObject), 0, CBByteArrayGetByte(CBGetByteArray(tx->outputs[1]->scriptObject), 0) - 1);
 	// Test modified lock time
 	tx->lockTime++;
-	stack = CBNewEmptyScriptStack();
+	CBInitScriptStack(&stack);
 	CBScriptExecute(tx->inputs[0]->scriptObject, &stack, NULL, NULL, 0, false);
 	if (CBScriptExecute(outputScripts[0], &stack, CBTransactionGetInputHashForSignature, tx, 0, false) != CB_SCRIPT_FALSE) {
 		printf("SIGHASH_ALL AND MODIFIED LOCK TIME FAIL\n");
@@ -412,7 +414,7 @@ int main(){
 	tx->lockTime--;
 	// Test modified input outPointerHash
 	CBByteArraySetByte(tx->inputs[0]->prevOut.hash, 0, CBByteArrayGetByte(tx->inputs[0]->prevOut.hash, 0) + 1);
-	stack = CBNewEmptyScriptStack();
+	CBInitScriptStack(&stack);
 	CBScriptExecute(tx->inputs[0]->scriptObject, &stack, NULL, NULL, 0, false);
 	if (CBScriptExecute(outputScripts[0], &stack, CBTransactionGetInputHashForSignature, tx, 0, false) != CB_SCRIPT_FALSE) {
 		printf("SIGHASH_ALL AND MODIFIED INPUT OUT POINTER HASH FAIL\n");
@@ -421,7 +423,7 @@ int main(){
 	CBByteArraySetByte(tx->inputs[0]->prevOut.hash, 0, CBByteArrayGetByte(tx->inputs[0]->prevOut.hash, 0) - 1);
 	// Test modified input outPointerIndex
 	tx->inputs[0]->prevOut.index++;
-	stack = CBNewEmptyScriptStack();
+	CBInitScriptStack(&stack);
 	CBScriptExecute(tx->inputs[0]->scriptObject, &stack, NULL, NULL, 0, false);
 	if (CBScriptExecute(outputScripts[0], &stack, CBTransactionGetInputHashForSignature, tx, 0, false) != CB_SCRIPT_FALSE) {
 		printf("SIGHASH_ALL AND MODIFIED INPUT OUT POINTER INDEX FAIL\n");
@@ -430,7 +432,7 @@ int main(){
 	tx->inputs[0]->prevOut.index--;
 	// Test modified input sequence
 	tx->inputs[0]->sequence++;
-	stack = CBNewEmptyScriptStack();
+	CBInitScriptStack(&stack);
 	CBScriptExecute(tx->inputs[0]->scriptObject, &stack, NULL, NULL, 0, false);
 	if (CBScriptExecute(outputScripts[0], &stack, CBTransactionGetInputHashForSignature, tx, 0, false) != CB_SCRIPT_FALSE) {
 		printf("SIGHASH_ALL AND MODIFIED INPUT SEQUENCE FAIL\n");
@@ -440,7 +442,7 @@ int main(){
 	// Test false signature
 	CBByteArray * tempBytes = CBNewByteArraySubReference(CBGetByteArray(tx->inputs[0]->scriptObject), 1, sigSizes[0]);
 	CBByteArrayReverseBytes(tempBytes);
-	stack = CBNewEmptyScriptStack();
+	CBInitScriptStack(&stack);
 	CBScriptExecute(tx->inputs[0]->scriptObject, &stack, NULL, NULL, 0, false);
 	if (CBScriptExecute(outputScripts[0], &stack, CBTransactionGetInputHashForSignature, tx, 0, false) != CB_SCRIPT_FALSE) {
 		printf("SIGHASH_ALL AND FALSE SIGNATURE FAIL\n");
@@ -451,7 +453,7 @@ int main(){
 	// Test false public key
 	tempBytes = CBNewByteArraySubReference(CBGetByteArray(tx->inputs[0]->scriptObject), 2 + sigSizes[0], pubSizes[0]);
 	CBByteArrayReverseBytes(tempBytes);
-	stack = CBNewEmptyScriptStack();
+	CBInitScriptStack(&stack);
 	CBScriptExecute(tx->inputs[0]->scriptObject, &stack, NULL, NULL, 0, false);
 	if (CBScriptExecute(outputScripts[0], &stack, CBTransactionGetInputHashForSignature, tx, 0, false) != CB_SCRIPT_INVALID) {
 		printf("SIGHASH_ALL AND FALSE PUBLIC KEY FAIL\n");
@@ -461,7 +463,7 @@ int main(){
 	CBReleaseObject(tempBytes);
 	// Test too few items on stack
 	CBGetByteArray(tx->inputs[0]->scriptObject)->length = sigSizes[0] + 1;
-	stack = CBNewEmptyScriptStack();
+	CBInitScriptStack(&stack);
 	CBScriptExecute(tx->inputs[0]->scriptObject, &stack, NULL, NULL, 0, false);
 	if (CBScriptExecute(outputScripts[0], &stack, CBTransactionGetInputHashForSignature, tx, 0, false) != CB_SCRIPT_INVALID) {
 		printf("OP_CHECKSIG AND TOO FEW ITEMS FAIL\n");
@@ -469,7 +471,7 @@ int main(){
 	}
 	// Test SIGHASH_SINGLE
 	// Execute the transaction scripts to verify correctness.
-	stack = CBNewEmptyScriptStack();
+	CBInitScriptStack(&stack);
 	CBScriptExecute(tx->inputs[1]->scriptObject, &stack, NULL, NULL, 0, false);
 	if (CBScriptExecute(outputScripts[1], &stack, CBTransactionGetInputHashForSignature, tx, 1, false) != CB_SCRIPT_TRUE) {
 		printf("SIGHASH_SINGLE FAIL\n");
@@ -477,7 +479,7 @@ int main(){
 	}
 	// Test modified first output value
 	tx->outputs[0]->value++;
-	stack = CBNewEmptyScriptStack();
+	CBInitScriptStack(&stack);
 	CBScriptExecute(tx->inputs[1]->scriptObject, &stack, NULL, NULL, 0, false);
 	if (CBScriptExecute(outputScripts[1], &stack, CBTransactionGetInputHashForSignature, tx, 1, false) != CB_SCRIPT_TRUE) {
 		printf("SIGHASH_SINGLE AND MODIFIED FIRST OUTPUT VALUE FAIL\n");
@@ -486,7 +488,7 @@ int main(){
 	tx->outputs[0]->value--;
 	// Test modified first output script
 	CBByteArraySetByte(CBGetByteArray(tx->outputs[0]->scriptObject), 0, CBByteArrayGetByte(CBGetByteArray(tx->outputs[0]->scriptObject), 0) + 1);
-	stack = CBNewEmptyScriptStack();
+	CBInitScriptStack(&stack);
 	CBScriptExecute(tx->inputs[1]->scriptObject, &stack, NULL, NULL, 0, false);
 	if (CBScriptExecute(outputScripts[1], &stack, CBTransactionGetInputHashForSignature, tx, 1, false) != CB_SCRIPT_TRUE) {
 		printf("SIGHASH_SINGLE AND MODIFIED FIRST OUTPUT SCRIPT FAIL\n");
@@ -495,7 +497,7 @@ int main(){
 	CBByteArraySetByte(CBGetByteArray(tx->outputs[0]->scriptObject), 0, CBByteArrayGetByte(CBGetByteArray(tx->outputs[0]->scriptObject), 0) - 1);
 	// Test modified second output value
 	tx->outputs[1]->value++;
-	stack = CBNewEmptyScriptStack();
+	CBInitScriptStack(&stack);
 	CBScriptExecute(tx->inputs[1]->scriptObject, &stack, NULL, NULL, 0, false);
 	if (CBScriptExecute(outputScripts[1], &stack, CBTransactionGetInputHashForSignature, tx, 1, false) != CB_SCRIPT_FALSE) {
 		printf("SIGHASH_SINGLE AND MODIFIED FIRST OUTPUT VALUE FAIL\n");
@@ -504,7 +506,7 @@ int main(){
 	tx->outputs[1]->value--;
 	// Test modified second output script
 	CBByteArraySetByte(CBGetByteArray(tx->outputs[1]->scriptObject), 0, CBByteArrayGetByte(CBGetByteArray(tx->outputs[1]->scriptObject), 0) + 1);
-	stack = CBNewEmptyScriptStack();
+	CBInitScriptStack(&stack);
 	CBScriptExecute(tx->inputs[1]->scriptObject, &stack, NULL, NULL, 0, false);
 	if (CBScriptExecute(outputScripts[1], &stack, CBTransactionGetInputHashForSignature, tx, 1, false) != CB_SCRIPT_FALSE) {
 		printf("SIGHASH_SINGLE AND MODIFIED SECOND OUTPUT SCRIPT FAIL\n");
@@ -513,7 +515,7 @@ int main(){
 	CBByteArraySetByte(CBGetByteArray(tx->outputs[1]->scriptObject), 0, CBByteArrayGetByte(CBGetByteArray(tx->outputs[1]->scriptObject), 0) - 1);
 	// Test modified third output value. Should be ignored
 	tx->outputs[2]->value++;
-	stack = CBNewEmptyScriptStack();
+	CBInitScriptStack(&stack);
 	CBScriptExecute(tx->inputs[1]->scriptObject, &stack, NULL, NULL, 0, false);
 	if (CBScriptExecute(outputScripts[1], &stack, CBTransactionGetInputHashForSignature, tx, 1, false) != CB_SCRIPT_TRUE) {
 		printf("SIGHASH_SINGLE AND MODIFIED FIRST OUTPUT VALUE FAIL\n");
@@ -522,7 +524,7 @@ int main(){
 	tx->outputs[2]->value--;
 	// Test modified third output script
 	CBByteArraySetByte(CBGetByteArray(tx->outputs[2]->scriptObject), 0, CBByteArrayGetByte(CBGetByteArray(tx->outputs[2]->scriptObject), 0) + 1);
-	stack = CBNewEmptyScriptStack();
+	CBInitScriptStack(&stack);
 	CBScriptExecute(tx->inputs[1]->scriptObject, &stack, NULL, NULL, 0, false);
 	if (CBScriptExecute(outputScripts[1], &stack, CBTransactionGetInputHashForSignature, tx, 1, false) != CB_SCRIPT_TRUE) {
 		printf("SIGHASH_SINGLE AND MODIFIED SECOND OUTPUT SCRIPT FAIL\n");
@@ -531,7 +533,7 @@ int main(){
 	CBByteArraySetByte(CBGetByteArray(tx->outputs[2]->scriptObject), 0, CBByteArrayGetByte(CBGetByteArray(tx->outputs[2]->scriptObject), 0) - 1);
 	// Test modified lock time
 	tx->lockTime++;
-	stack = CBNewEmptyScriptStack();
+	CBInitScriptStack(&stack);
 	CBScriptExecute(tx->inputs[1]->scriptObject, &stack, NULL, NULL, 0, false);
 	if (CBScriptExecute(outputScripts[1], &stack, CBTransactionGetInputHashForSignature, tx, 1, false) != CB_SCRIPT_FALSE) {
 		printf("SIGHASH_SINGLE AND MODIFIED LOCK TIME FAIL\n");
@@ -540,7 +542,7 @@ int main(){
 	tx->lockTime--;
 	// Test modified first input outPointerHash
 	CBByteArraySetByte(tx->inputs[0]->prevOut.hash, 0, CBByteArrayGetByte(tx->inputs[0]->prevOut.hash, 0) + 1);
-	stack = CBNewEmptyScriptStack();
+	CBInitScriptStack(&stack);
 	CBScriptExecute(tx->inputs[1]->scriptObject, &stack, NULL, NULL, 0, false);
 	if (CBScriptExecute(outputScripts[1], &stack, CBTransactionGetInputHashForSignature, tx, 1, false) != CB_SCRIPT_FALSE) {
 		printf("SIGHASH_SINGLE AND MODIFIED FIRST INPUT OUT POINTER HASH FAIL\n");
@@ -549,7 +551,7 @@ int main(){
 	CBByteArraySetByte(tx->inputs[0]->prevOut.hash, 0, CBByteArrayGetByte(tx->inputs[0]->prevOut.hash, 0) - 1);
 	// Test modified first input outPointerIndex
 	tx->inputs[0]->prevOut.index++;
-	stack = CBNewEmptyScriptStack();
+	CBInitScriptStack(&stack);
 	CBScriptExecute(tx->inputs[1]->scriptObject, &stack, NULL, NULL, 0, false);
 	if (CBScriptExecute(outputScripts[1], &stack, CBTransactionGetInputHashForSignature, tx, 1, false) != CB_SCRIPT_FALSE) {
 		printf("SIGHASH_SINGLE AND MODIFIED FIRST INPUT OUT POINTER INDEX FAIL\n");
@@ -558,7 +560,7 @@ int main(){
 	tx->inputs[0]->prevOut.index--;
 	// Test modified first input sequence
 	tx->inputs[0]->sequence++;
-	stack = CBNewEmptyScriptStack();
+	CBInitScriptStack(&stack);
 	CBScriptExecute(tx->inputs[1]->scriptObject, &stack, NULL, NULL, 0, false);
 	if (CBScriptExecute(outputScripts[1], &stack, CBTransactionGetInputHashForSignature, tx, 1, false) != CB_SCRIPT_TRUE) {
 		printf("SIGHASH_SINGLE AND MODIFIED FIRST INPUT SEQUENCE FAIL\n");
@@ -567,7 +569,7 @@ int main(){
 	tx->inputs[0]->sequence--;
 	// Test modified second input outPointerHash
 	CBByteArraySetByte(tx->inputs[1]->prevOut.hash, 0, CBByteArrayGetByte(tx->inputs[1]->prevOut.hash, 0) + 1);
-	stack = CBNewEmptyScriptStack();
+	CBInitScriptStack(&stack);
 	CBScriptExecute(tx->inputs[1]->scriptObject, &stack, NULL, NULL, 0, false);
 	if (CBScriptExecute(outputScripts[1], &stack, CBTransactionGetInputHashForSignature, tx, 1, false) != CB_SCRIPT_FALSE) {
 		printf("SIGHASH_SINGLE AND MODIFIED SECOND INPUT OUT POINTER HASH FAIL\n");
@@ -576,7 +578,7 @@ int main(){
 	CBByteArraySetByte(tx->inputs[1]->prevOut.hash, 0, CBByteArrayGetByte(tx->inputs[1]->prevOut.hash, 0) - 1);
 	// Test modified second input outPointerIndex
 	tx->inputs[1]->prevOut.index++;
-	stack = CBNewEmptyScriptStack();
+	CBInitScriptStack(&stack);
 	CBScriptExecute(tx->inputs[1]->scriptObject, &stack, NULL, NULL, 0, false);
 	if (CBScriptExecute(outputScripts[1], &stack, CBTransactionGetInputHashForSignature, tx, 1, false) != CB_SCRIPT_FALSE) {
 		printf("SIGHASH_SINGLE AND MODIFIED SECOND INPUT OUT POINTER INDEX FAIL\n");
@@ -585,7 +587,7 @@ int main(){
 	tx->inputs[1]->prevOut.index--;
 	// Test modified second input sequence
 	tx->inputs[1]->sequence++;
-	stack = CBNewEmptyScriptStack();
+	CBInitScriptStack(&stack);
 	CBScriptExecute(tx->inputs[1]->scriptObject, &stack, NULL, NULL, 0, false);
 	if (CBScriptExecute(outputScripts[1], &stack, CBTransactionGetInputHashForSignature, tx, 1, false) != CB_SCRIPT_FALSE) {
 		printf("SIGHASH_SINGLE AND MODIFIED SECOND INPUT SEQUENCE FAIL\n");
@@ -594,7 +596,7 @@ int main(){
 	tx->inputs[1]->sequence--;
 	// Test SIGHASH_NONE
 	// Execute the transaction scripts to verify correctness.
-	stack = CBNewEmptyScriptStack();
+	CBInitScriptStack(&stack);
 	CBScriptExecute(tx->inputs[2]->scriptObject, &stack, NULL, NULL, 0, false);
 	if (CBScriptExecute(outputScripts[2], &stack, CBTransactionGetInputHashForSignature, tx, 2, false) != CB_SCRIPT_TRUE) {
 		printf("SIGHASH_NONE FAIL\n");
@@ -602,7 +604,7 @@ int main(){
 	}
 	// Test modified first output value
 	tx->outputs[0]->value++;
-	stack = CBNewEmptyScriptStack();
+	CBInitScriptStack(&stack);
 	CBScriptExecute(tx->inputs[2]->scriptObject, &stack, NULL, NULL, 0, false);
 	if (CBScriptExecute(outputScripts[2], &stack, CBTransactionGetInputHashForSignature, tx, 2, false) != CB_SCRIPT_TRUE) {
 		printf("SIGHASH_NONE AND MODIFIED FIRST OUTPUT VALUE FAIL\n");
@@ -611,7 +613,7 @@ int main(){
 	tx->outputs[0]->value--;
 	// Test modified first output script
 	CBByteArraySetByte(CBGetByteArray(tx->outputs[0]->scriptObject), 0, CBByteArrayGetByte(CBGetByteArray(tx->outputs[0]->scriptObject), 0) + 1);
-	stack = CBNewEmptyScriptStack();
+	CBInitScriptStack(&stack);
 	CBScriptExecute(tx->inputs[2]->scriptObject, &stack, NULL, NULL, 0, false);
 	if (CBScriptExecute(outputScripts[2], &stack, CBTransactionGetInputHashForSignature, tx, 2, false) != CB_SCRIPT_TRUE) {
 		printf("SIGHASH_NONE AND MODIFIED FIRST OUTPUT SCRIPT FAIL\n");
@@ -620,7 +622,7 @@ int main(){
 	CBByteArraySetByte(CBGetByteArray(tx->outputs[0]->scriptObject), 0, CBByteArrayGetByte(CBGetByteArray(tx->outputs[0]->scriptObject), 0) - 1);
 	// Test modified third output value. 
 	tx->outputs[2]->value++;
-	stack = CBNewEmptyScriptStack();
+	CBInitScriptStack(&stack);
 	CBScriptExecute(tx->inputs[2]->scriptObject, &stack, NULL, NULL, 0, false);
 	if (CBScriptExecute(outputScripts[2], &stack, CBTransactionGetInputHashForSignature, tx, 2, false) != CB_SCRIPT_TRUE) {
 		printf("SIGHASH_NONE AND MODIFIED THIRD OUTPUT VALUE FAIL\n");
@@ -629,7 +631,7 @@ int main(){
 	tx->outputs[2]->value--;
 	// Test modified third output script
 	CBByteArraySetByte(CBGetByteArray(tx->outputs[2]->scriptObject), 0, CBByteArrayGetByte(CBGetByteArray(tx->outputs[2]->scriptObject), 0) + 1);
-	stack = CBNewEmptyScriptStack();
+	CBInitScriptStack(&stack);
 	CBScriptExecute(tx->inputs[2]->scriptObject, &stack, NULL, NULL, 0, false);
 	if (CBScriptExecute(outputScripts[2], &stack, CBTransactionGetInputHashForSignature, tx, 2, false) != CB_SCRIPT_TRUE) {
 		printf("SIGHASH_NONE AND MODIFIED THIRD OUTPUT SCRIPT FAIL\n");
@@ -638,7 +640,7 @@ int main(){
 	CBByteArraySetByte(CBGetByteArray(tx->outputs[2]->scriptObject), 0, CBByteArrayGetByte(CBGetByteArray(tx->outputs[2]->scriptObject), 0) - 1);
 	// Test modified lock time
 	tx->lockTime++;
-	stack = CBNewEmptyScriptStack();
+	CBInitScriptStack(&stack);
 	CBScriptExecute(tx->inputs[2]->scriptObject, &stack, NULL, NULL, 0, false);
 	if (CBScriptExecute(outputScripts[2], &stack, CBTransactionGetInputHashForSignature, tx, 2, false) != CB_SCRIPT_FALSE) {
 		printf("SIGHASH_NONE AND MODIFIED LOCK TIME FAIL\n");
@@ -647,7 +649,7 @@ int main(){
 	tx->lockTime--;
 	// Test modified first input outPointerHash
 	CBByteArraySetByte(tx->inputs[0]->prevOut.hash, 0, CBByteArrayGetByte(tx->inputs[0]->prevOut.hash, 0) + 1);
-	stack = CBNewEmptyScriptStack();
+	CBInitScriptStack(&stack);
 	CBScriptExecute(tx->inputs[2]->scriptObject, &stack, NULL, NULL, 0, false);
 	if (CBScriptExecute(outputScripts[2], &stack, CBTransactionGetInputHashForSignature, tx, 2, false) != CB_SCRIPT_FALSE) {
 		printf("SIGHASH_NONE AND MODIFIED FIRST INPUT OUT POINTER HASH FAIL\n");
@@ -656,7 +658,7 @@ int main(){
 	CBByteArraySetByte(tx->inputs[0]->prevOut.hash, 0, CBByteArrayGetByte(tx->inputs[0]->prevOut.hash, 0) - 1);
 	// Test modified first input outPointerIndex
 	tx->inputs[0]->prevOut.index++;
-	stack = CBNewEmptyScriptStack();
+	CBInitScriptStack(&stack);
 	CBScriptExecute(tx->inputs[2]->scriptObject, &stack, NULL, NULL, 0, false);
 	if (CBScriptExecute(outputScripts[2], &stack, CBTransactionGetInputHashForSignature, tx, 2, false) != CB_SCRIPT_FALSE) {
 		printf("SIGHASH_NONE AND MODIFIED FIRST INPUT OUT POINTER INDEX FAIL\n");
@@ -665,7 +667,7 @@ int main(){
 	tx->inputs[0]->prevOut.index--;
 	// Test modified first input sequence
 	tx->inputs[0]->sequence++;
-	stack = CBNewEmptyScriptStack();
+	CBInitScriptStack(&stack);
 	CBScriptExecute(tx->inputs[2]->scriptObject, &stack, NULL, NULL, 0, false);
 	if (CBScriptExecute(outputScripts[2], &stack, CBTransactionGetInputHashForSignature, tx, 2, false) != CB_SCRIPT_TRUE) {
 		printf("SIGHASH_NONE AND MODIFIED FIRST INPUT SEQUENCE FAIL\n");
@@ -674,7 +676,7 @@ int main(){
 	tx->inputs[0]->sequence--;
 	// Test modified third input outPointerHash
 	CBByteArraySetByte(tx->inputs[2]->prevOut.hash, 0, CBByteArrayGetByte(tx->inputs[2]->prevOut.hash, 0) + 1);
-	stack = CBNewEmptyScriptStack();
+	CBInitScriptStack(&stack);
 	CBScriptExecute(tx->inputs[2]->scriptObject, &stack, NULL, NULL, 0, false);
 	if (CBScriptExecute(outputScripts[2], &stack, CBTransactionGetInputHashForSignature, tx, 2, false) != CB_SCRIPT_FALSE) {
 		printf("SIGHASH_NONE AND MODIFIED THIRD INPUT OUT POINTER HASH FAIL\n");
@@ -683,7 +685,7 @@ int main(){
 	CBByteArraySetByte(tx->inputs[2]->prevOut.hash, 0, CBByteArrayGetByte(tx->inputs[2]->prevOut.hash, 0) - 1);
 	// Test modified third input outPointerIndex
 	tx->inputs[2]->prevOut.index++;
-	stack = CBNewEmptyScriptStack();
+	CBInitScriptStack(&stack);
 	CBScriptExecute(tx->inputs[2]->scriptObject, &stack, NULL, NULL, 0, false);
 	if (CBScriptExecute(outputScripts[2], &stack, CBTransactionGetInputHashForSignature, tx, 2, false) != CB_SCRIPT_FALSE) {
 		printf("SIGHASH_NONE AND MODIFIED THIRD INPUT OUT POINTER INDEX FAIL\n");
@@ -692,7 +694,7 @@ int main(){
 	tx->inputs[2]->prevOut.index--;
 	// Test modified third input sequence
 	tx->inputs[2]->sequence++;
-	stack = CBNewEmptyScriptStack();
+	CBInitScriptStack(&stack);
 	CBScriptExecute(tx->inputs[2]->scriptObject, &stack, NULL, NULL, 0, false);
 	if (CBScriptExecute(outputScripts[2], &stack, CBTransactionGetInputHashForSignature, tx, 2, false) != CB_SCRIPT_FALSE) {
 		printf("SIGHASH_NONE AND MODIFIED THIRD INPUT SEQUENCE FAIL\n");
@@ -701,7 +703,7 @@ int main(){
 	tx->inputs[2]->sequence--;
 	// Test SIGHASH_ANYONECANPAY
 	// Execute the transaction scripts to verify correctness.
-	stack = CBNewEmptyScriptStack();
+	CBInitScriptStack(&stack);
 	CBScriptExecute(tx->inputs[3]->scriptObject, &stack, NULL, NULL, 0, false);
 	if (CBScriptExecute(outputScripts[3], &stack, CBTransactionGetInputHashForSignature, tx, 3, false) != CB_SCRIPT_TRUE) {
 		printf("SIGHASH_ANYONECANPAY FAIL\n");
@@ -709,7 +711,7 @@ int main(){
 	}
 	// Test modified first output value
 	tx->outputs[0]->value++;
-	stack = CBNewEmptyScriptStack();
+	CBInitScriptStack(&stack);
 	CBScriptExecute(tx->inputs[3]->scriptObject, &stack, NULL, NULL, 0, false);
 	if (CBScriptExecute(outputScripts[3], &stack, CBTransactionGetInputHashForSignature, tx, 3, false) != CB_SCRIPT_FALSE) {
 		printf("SIGHASH_ANYONECANPAY AND MODIFIED FIRST OUTPUT VALUE FAIL\n");
@@ -721,7 +723,7 @@ int main(){
 	tx->outputs[0]->value--;
 	// Test modified first output script
 	CBByteArraySetByte(CBGetByteArray(tx->outputs[0]->scriptObject), 0, CBByteArrayGetByte(CBGetByteArray(tx->outputs[0]->scriptObject), 0) + 1);
-	stack = CBNewEmptyScriptStack();
+	CBInitScriptStack(&stack);
 	CBScriptExecute(tx->inputs[3]->scriptObject, &stack, NULL, NULL, 0, false);
 	if (CBScriptExecute(outputScripts[3], &stack, CBTransactionGetInputHashForSignature, tx, 3, false) != CB_SCRIPT_FALSE) {
 		printf("SIGHASH_ANYONECANPAY AND MODIFIED FIRST OUTPUT SCRIPT FAIL\n");
@@ -730,7 +732,7 @@ int main(){
 	CBByteArraySetByte(CBGetByteArray(tx->outputs[0]->scriptObject), 0, CBByteArrayGetByte(CBGetByteArray(tx->outputs[0]->scriptObject), 0) - 1);
 	// Test modified lock time
 	tx->lockTime++;
-	stack = CBNewEmptyScriptStack();
+	CBInitScriptStack(&stack);
 	CBScriptExecute(tx->inputs[3]->scriptObject, &stack, NULL, NULL, 0, false);
 	if (CBScriptExecute(outputScripts[3], &stack, CBTransactionGetInputHashForSignature, tx, 3, false) != CB_SCRIPT_FALSE) {
 		printf("SIGHASH_ANYONECANPAY AND MODIFIED LOCK TIME FAIL\n");
@@ -739,7 +741,7 @@ int main(){
 	tx->lockTime--;
 	// Test modified first input outPointerHash
 	CBByteArraySetByte(tx->inputs[0]->prevOut.hash, 0, CBByteArrayGetByte(tx->inputs[0]->prevOut.hash, 0) + 1);
-	stack = CBNewEmptyScriptStack();
+	CBInitScriptStack(&stack);
 	CBScriptExecute(tx->inputs[3]->scriptObject, &stack, NULL, NULL, 0, false);
 	if (CBScriptExecute(outputScripts[3], &stack, CBTransactionGetInputHashForSignature, tx, 3, false) != CB_SCRIPT_TRUE) {
 		printf("SIGHASH_ANYONECANPAY AND MODIFIED FIRST INPUT OUT POINTER HASH FAIL\n");
@@ -748,7 +750,7 @@ int main(){
 	CBByteArraySetByte(tx->inputs[0]->prevOut.hash, 0, CBByteArrayGetByte(tx->inputs[0]->prevOut.hash, 0) - 1);
 	// Test modified first input outPointerIndex
 	tx->inputs[0]->prevOut.index++;
-	stack = CBNewEmptyScriptStack();
+	CBInitScriptStack(&stack);
 	CBScriptExecute(tx->inputs[3]->scriptObject, &stack, NULL, NULL, 0, false);
 	if (CBScriptExecute(outputScripts[3], &stack, CBTransactionGetInputHashForSignature, tx, 3, false) != CB_SCRIPT_TRUE) {
 		printf("SIGHASH_ANYONECANPAY AND MODIFIED FIRST INPUT OUT POINTER INDEX FAIL\n");
@@ -757,7 +759,7 @@ int main(){
 	tx->inputs[0]->prevOut.index--;
 	// Test modified first input sequence
 	tx->inputs[0]->sequence++;
-	stack = CBNewEmptyScriptStack();
+	CBInitScriptStack(&stack);
 	CBScriptExecute(tx->inputs[3]->scriptObject, &stack, NULL, NULL, 0, false);
 	if (CBScriptExecute(outputScripts[3], &stack, CBTransactionGetInputHashForSignature, tx, 3, false) != CB_SCRIPT_TRUE) {
 		printf("SIGHASH_ANYONECANPAY AND MODIFIED FIRST INPUT SEQUENCE FAIL\n");
@@ -766,7 +768,7 @@ int main(){
 	tx->inputs[0]->sequence--;
 	// Test modified forth input outPointerHash
 	CBByteArraySetByte(tx->inputs[3]->prevOut.hash, 0, CBByteArrayGetByte(tx->inputs[3]->prevOut.hash, 0) + 1);
-	stack = CBNewEmptyScriptStack();
+	CBInitScriptStack(&stack);
 	CBScriptExecute(tx->inputs[3]->scriptObject, &stack, NULL, NULL, 0, false);
 	if (CBScriptExecute(outputScripts[3], &stack, CBTransactionGetInputHashForSignature, tx, 3, false) != CB_SCRIPT_FALSE) {
 		printf("SIGHASH_ANYONECANPAY AND MODIFIED FORTH INPUT OUT POINTER HASH FAIL\n");
@@ -775,7 +777,7 @@ int main(){
 	CBByteArraySetByte(tx->inputs[3]->prevOut.hash, 0, CBByteArrayGetByte(tx->inputs[3]->prevOut.hash, 0) - 1);
 	// Test modified forth input outPointerIndex
 	tx->inputs[3]->prevOut.index++;
-	stack = CBNewEmptyScriptStack();
+	CBInitScriptStack(&stack);
 	CBScriptExecute(tx->inputs[3]->scriptObject, &stack, NULL, NULL, 0, false);
 	if (CBScriptExecute(outputScripts[3], &stack, CBTransactionGetInputHashForSignature, tx, 3, false) != CB_SCRIPT_FALSE) {
 		printf("SIGHASH_ANYONECANPAY AND MODIFIED FORTH INPUT OUT POINTER INDEX FAIL\n");
@@ -784,7 +786,7 @@ int main(){
 	tx->inputs[3]->prevOut.index--;
 	// Test modified forth input sequence
 	tx->inputs[3]->sequence++;
-	stack = CBNewEmptyScriptStack();
+	CBInitScriptStack(&stack);
 	CBScriptExecute(tx->inputs[3]->scriptObject, &stack, NULL, NULL, 0, false);
 	if (CBScriptExecute(outputScripts[3], &stack, CBTransactionGetInputHashForSignature, tx, 3, false) != CB_SCRIPT_FALSE) {
 		printf("SIGHASH_ANYONECANPAY AND MODIFIED FORTH INPUT SEQUENCE FAIL\n");
@@ -834,7 +836,7 @@ int main(){
 	CBByteArraySetBytes(CBGetByteArray(scriptObj), sigSizes[0] + 5, pubKeys[0], pubSizes[0]);
 	CBByteArraySetByte(CBGetByteArray(scriptObj), sigSizes[0] + pubSizes[0] + 5, CB_SCRIPT_OP_1);
 	tx->inputs[0]->scriptObject = scriptObj;
-	stack = CBNewEmptyScriptStack();
+	CBInitScriptStack(&stack);
 	CBScriptExecute(tx->inputs[0]->scriptObject, &stack, NULL, NULL, 0, false);
 	if (CBScriptExecute(outputScript, &stack, CBTransactionGetInputHashForSignature, tx, 0, false) != CB_SCRIPT_TRUE) {
 		printf("OP_CHECKMULTISIG - ONE SIG - ONE OK KEY - ZERO BAD KEYS FAIL\n");
@@ -861,7 +863,7 @@ int main(){
 	}
 	CBByteArraySetByte(CBGetByteArray(scriptObj), cursor, CB_SCRIPT_OP_2);
 	tx->inputs[0]->scriptObject = scriptObj;
-	stack = CBNewEmptyScriptStack();
+	CBInitScriptStack(&stack);
 	CBScriptExecute(tx->inputs[0]->scriptObject, &stack, NULL, NULL, 0, false);
 	if (CBScriptExecute(outputScript, &stack, CBTransactionGetInputHashForSignature, tx, 0, false) != CB_SCRIPT_TRUE) {
 		printf("OP_CHECKMULTISIG - TWO SIGS - TWO OK KEYS - ZERO BAD KEYS FAIL\n");
@@ -893,7 +895,7 @@ int main(){
 	}
 	CBByteArraySetByte(CBGetByteArray(scriptObj), cursor, CB_SCRIPT_OP_4);
 	tx->inputs[0]->scriptObject = scriptObj;
-	stack = CBNewEmptyScriptStack();
+	CBInitScriptStack(&stack);
 	CBScriptExecute(tx->inputs[0]->scriptObject, &stack, NULL, NULL, 0, false);
 	if (CBScriptExecute(outputScript, &stack, CBTransactionGetInputHashForSignature, tx, 0, false) != CB_SCRIPT_TRUE) {
 		printf("OP_CHECKMULTISIG - THREE SIGS - THREE OK KEYS - ONE BAD KEY FAIL\n");
@@ -946,7 +948,7 @@ int main(){
 	}
 	CBByteArraySetByte(CBGetByteArray(scriptObj), cursor, CB_SCRIPT_OP_6);
 	tx->inputs[0]->scriptObject = scriptObj;
-	stack = CBNewEmptyScriptStack();
+	CBInitScriptStack(&stack);
 	CBScriptExecute(tx->inputs[0]->scriptObject, &stack, NULL, NULL, 0, false);
 	if (CBScriptExecute(outputScript, &stack, CBTransactionGetInputHashForSignature, tx, 0, false) != CB_SCRIPT_TRUE) {
 		printf("OP_CHECKMULTISIG - FOUR SIGS - FOUR OK KEYS - TWO BAD KEYS FAIL\n");
@@ -978,7 +980,7 @@ int main(){
 	}
 	CBByteArraySetByte(CBGetByteArray(scriptObj), cursor, CB_SCRIPT_OP_10);
 	tx->inputs[0]->scriptObject = scriptObj;
-	stack = CBNewEmptyScriptStack();
+	CBInitScriptStack(&stack);
 	CBScriptExecute(tx->inputs[0]->scriptObject, &stack, NULL, NULL, 0, false);
 	if (CBScriptExecute(outputScript, &stack, CBTransactionGetInputHashForSignature, tx, 0, false) != CB_SCRIPT_TRUE) {
 		printf("OP_CHECKMULTISIG - FIVE SIGS - FIVE OK KEYS - FIVE BAD KEYS FAIL\n");
@@ -1010,7 +1012,7 @@ int main(){
 	}
 	CBByteArraySetByte(CBGetByteArray(scriptObj), cursor, CB_SCRIPT_OP_10);
 	tx->inputs[0]->scriptObject = scriptObj;
-	stack = CBNewEmptyScriptStack();
+	CBInitScriptStack(&stack);
 	CBScriptExecute(tx->inputs[0]->scriptObject, &stack, NULL, NULL, 0, false);
 	if (CBScriptExecute(outputScript, &stack, CBTransactionGetInputHashForSignature, tx, 0, false) != CB_SCRIPT_TRUE) {
 		printf("OP_CHECKMULTISIG - FIVE SIGS - FIVE OK KEYS ODDS - FIVE BAD KEYS EVENS FAIL\n");
@@ -1046,7 +1048,7 @@ int main(){
 	cursor++;
 	CBByteArraySetByte(CBGetByteArray(scriptObj), cursor, 0x14);
 	tx->inputs[0]->scriptObject = scriptObj;
-	stack = CBNewEmptyScriptStack();
+	CBInitScriptStack(&stack);
 	CBScriptExecute(tx->inputs[0]->scriptObject, &stack, NULL, NULL, 0, false);
 	if (CBScriptExecute(outputScript, &stack, CBTransactionGetInputHashForSignature, tx, 0, false) != CB_SCRIPT_TRUE) {
 		printf("OP_CHECKMULTISIG - TWENTY SIGS - TWENTY OK KEYS - ZERO BAD KEYS FAIL\n");
@@ -1082,7 +1084,7 @@ int main(){
 	cursor++;
 	CBByteArraySetByte(CBGetByteArray(scriptObj), cursor, 0x15);
 	tx->inputs[0]->scriptObject = scriptObj;
-	stack = CBNewEmptyScriptStack();
+	CBInitScriptStack(&stack);
 	CBScriptExecute(tx->inputs[0]->scriptObject, &stack, NULL, NULL, 0, false);
 	if (CBScriptExecute(outputScript, &stack, CBTransactionGetInputHashForSignature, tx, 0, false) != CB_SCRIPT_INVALID) {
 		printf("OP_CHECKMULTISIG - TWENTY ONE SIGS - TWENTY ONE OK KEYS - ZERO BAD KEYS FAIL\n");
@@ -1099,7 +1101,7 @@ int main(){
 	CBByteArraySetBytes(CBGetByteArray(scriptObj), sigSizes[0] + 5, pubKeys[1], pubSizes[1]);
 	CBByteArraySetByte(CBGetByteArray(scriptObj), sigSizes[0] + pubSizes[1] + 5, CB_SCRIPT_OP_1);
 	tx->inputs[0]->scriptObject = scriptObj;
-	stack = CBNewEmptyScriptStack();
+	CBInitScriptStack(&stack);
 	CBScriptExecute(tx->inputs[0]->scriptObject, &stack, NULL, NULL, 0, false);
 	if (CBScriptExecute(outputScript, &stack, CBTransactionGetInputHashForSignature, tx, 0, false) != CB_SCRIPT_FALSE) {
 		printf("OP_CHECKMULTISIG - ONE SIG - ZERO OK KEYS - ONE BAD KEY FAIL\n");
@@ -1131,7 +1133,7 @@ int main(){
 	}
 	CBByteArraySetByte(CBGetByteArray(scriptObj), cursor, CB_SCRIPT_OP_8);
 	tx->inputs[0]->scriptObject = scriptObj;
-	stack = CBNewEmptyScriptStack();
+	CBInitScriptStack(&stack);
 	CBScriptExecute(tx->inputs[0]->scriptObject, &stack, NULL, NULL, 0, false);
 	if (CBScriptExecute(outputScript, &stack, CBTransactionGetInputHashForSignature, tx, 0, false) != CB_SCRIPT_FALSE) {
 		printf("OP_CHECKMULTISIG - FIVE SIGS - FOUR OK KEYS - FOUR BAD KEYS FAIL\n");
@@ -1161,7 +1163,7 @@ int main(){
 	}
 	CBByteArraySetByte(CBGetByteArray(scriptObj), cursor, CB_SCRIPT_OP_1);
 	tx->inputs[0]->scriptObject = scriptObj;
-	stack = CBNewEmptyScriptStack();
+	CBInitScriptStack(&stack);
 	CBScriptExecute(tx->inputs[0]->scriptObject, &stack, NULL, NULL, 0, false);
 	if (CBScriptExecute(outputScript, &stack, CBTransactionGetInputHashForSignature, tx, 0, false) != CB_SCRIPT_INVALID) {
 		printf("OP_CHECKMULTISIG - LOW KEY NUMBER FAIL\n");
@@ -1188,7 +1190,7 @@ int main(){
 	}
 	CBByteArraySetByte(CBGetByteArray(scriptObj), cursor, CB_SCRIPT_OP_2);
 	tx->inputs[0]->scriptObject = scriptObj;
-	stack = CBNewEmptyScriptStack();
+	CBInitScriptStack(&stack);
 	CBScriptExecute(tx->inputs[0]->scriptObject, &stack, NULL, NULL, 0, false);
 	if (CBScriptExecute(outputScript, &stack, CBTransactionGetInputHashForSignature, tx, 0, false) != CB_SCRIPT_TRUE) {
 		printf("OP_CHECKMULTISIG - LOW SIG NUMBER FAIL\n");
@@ -1215,7 +1217,7 @@ int main(){
 	}
 	CBByteArraySetByte(CBGetByteArray(scriptObj), cursor, CB_SCRIPT_OP_3);
 	tx->inputs[0]->scriptObject = scriptObj;
-	stack = CBNewEmptyScriptStack();
+	CBInitScriptStack(&stack);
 	CBScriptExecute(tx->inputs[0]->scriptObject, &stack, NULL, NULL, 0, false);
 	if (CBScriptExecute(outputScript, &stack, CBTransactionGetInputHashForSignature, tx, 0, false) != CB_SCRIPT_INVALID) {
 		printf("OP_CHECKMULTISIG - HIGH KEY NUMBER FAIL\n");
@@ -1242,7 +1244,7 @@ int main(){
 	}
 	CBByteArraySetByte(CBGetByteArray(scriptObj), cursor, CB_SCRIPT_OP_2);
 	tx->inputs[0]->scriptObject = scriptObj;
-	stack = CBNewEmptyScriptStack();
+	CBInitScriptStack(&stack);
 	CBScriptExecute(tx->inputs[0]->scriptObject, &stack, NULL, NULL, 0, false);
 	if (CBScriptExecute(outputScript, &stack, CBTransactionGetInputHashForSignature, tx, 0, false) != CB_SCRIPT_INVALID) {
 		printf("OP_CHECKMULTISIG - HIGH SIG NUMBER FAIL\n");